@@ -0,0 +1,958 @@
+// Synthetic music files for benchmarking. Each one is a tiny program or command
+// stream written directly, so nothing needs to be shipped or downloaded.
+
+#include "Synth_Files.h"
+
+#include <math.h>
+#include <string.h>
+
+// Appends bytes to file being built
+class Writer {
+public:
+	Writer( synth_data_t& out ) : out( out ) { }
+
+	long pos() const                { return (long) out.size(); }
+	void byte( int n )              { out.push_back( (unsigned char) n ); }
+	void le16( unsigned n )         { byte( n ); byte( n >> 8 ); }
+	void be16( unsigned n )         { byte( n >> 8 ); byte( n ); }
+	void le32( unsigned long n )    { le16( n & 0xFFFF ); le16( n >> 16 ); }
+	void str( const char* s )       { while ( *s ) byte( *s++ ); }
+	void fill( int n, long count )  { while ( count-- > 0 ) byte( n ); }
+	void pad( long size )           { fill( 0, size - pos() ); }
+	void bytes( unsigned char const* p, long n ) { out.insert( out.end(), p, p + n ); }
+
+	// Fixed-size text field, zero-padded
+	void field( const char* s, int size )
+	{
+		int len = (int) strlen( s );
+		if ( len > size )
+			len = size;
+		bytes( (unsigned char const*) s, len );
+		fill( 0, size - len );
+	}
+
+	void set_le16( long at, unsigned n )        { out [at] = n; out [at + 1] = n >> 8; }
+	void set_be16( long at, unsigned n )        { out [at] = n >> 8; out [at + 1] = n; }
+	void set_le32( long at, unsigned long n )   { set_le16( at, n & 0xFFFF ); set_le16( at + 2, n >> 16 ); }
+
+private:
+	synth_data_t& out;
+};
+
+#define CODE( w, ... ) do {\
+	static unsigned char const code_ [] = { __VA_ARGS__ };\
+	(w).bytes( code_, sizeof code_ );\
+} while ( 0 )
+
+// NSF/NSFE (6502, NES APU)
+
+// Init at beginning, play at +$40. Pulse, triangle and noise, with pitches
+// changed every frame.
+static void nes_code( Writer& w )
+{
+	long begin = w.pos();
+	CODE( w,
+		0xA9,0x0F, 0x8D,0x15,0x40,  // LDA #$0F  STA $4015
+		0xA9,0xBF, 0x8D,0x00,0x40,  // LDA #$BF  STA $4000
+		0xA9,0x08, 0x8D,0x01,0x40,  // LDA #$08  STA $4001
+		0xA9,0xFE, 0x8D,0x02,0x40,  // LDA #$FE  STA $4002
+		0xA9,0x01, 0x8D,0x03,0x40,  // LDA #$01  STA $4003
+		0xA9,0xFF, 0x8D,0x08,0x40,  // LDA #$FF  STA $4008
+		0xA9,0x80, 0x8D,0x0A,0x40,  // LDA #$80  STA $400A
+		0xA9,0x00, 0x8D,0x0B,0x40,  // LDA #$00  STA $400B
+		0xA9,0x3F, 0x8D,0x0C,0x40,  // LDA #$3F  STA $400C
+		0xA9,0x05, 0x8D,0x0E,0x40,  // LDA #$05  STA $400E
+		0xA9,0x00, 0x8D,0x0F,0x40,  // LDA #$00  STA $400F
+		0x85,0x00,                  // STA $00
+		0x60                        // RTS
+	);
+	w.pad( begin + 0x40 );
+	CODE( w,
+		0xE6,0x00,                  // INC $00
+		0xA5,0x00,                  // LDA $00
+		0x8D,0x02,0x40,             // STA $4002
+		0x29,0x1F,                  // AND #$1F
+		0x8D,0x0A,0x40,             // STA $400A
+		0xA5,0x00,                  // LDA $00
+		0x4A,0x4A,0x4A,0x4A,        // LSR  LSR  LSR  LSR
+		0x8D,0x0E,0x40,             // STA $400E
+		0x60                        // RTS
+	);
+}
+
+static void make_nsf( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "NESM\x1A" );
+	w.byte( 1 );        // version
+	w.byte( 1 );        // track count
+	w.byte( 1 );        // first track
+	w.le16( 0x8000 );   // load
+	w.le16( 0x8000 );   // init
+	w.le16( 0x8040 );   // play
+	w.field( "Synthetic", 32 );
+	w.field( "gme_bench", 32 );
+	w.field( "", 32 );
+	w.le16( 0x411A );   // NTSC rate
+	w.fill( 0, 8 );     // no bank switching
+	w.le16( 0x4E20 );   // PAL rate
+	w.byte( 0 );        // NTSC
+	w.byte( 0 );        // no expansion sound
+	w.fill( 0, 4 );
+	nes_code( w );
+}
+
+static void make_nsfe( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "NSFE" );
+
+	w.le32( 16 );
+	w.str( "INFO" );
+	w.le16( 0x8000 );   // load
+	w.le16( 0x8000 );   // init
+	w.le16( 0x8040 );   // play
+	w.byte( 0 );        // NTSC
+	w.byte( 0 );        // no expansion sound
+	w.byte( 1 );        // track count
+	w.byte( 0 );        // first track
+	w.fill( 0, 6 );
+
+	long size_pos = w.pos();
+	w.le32( 0 );
+	w.str( "DATA" );
+	long data = w.pos();
+	nes_code( w );
+	w.set_le32( size_pos, w.pos() - data );
+
+	w.le32( 0 );
+	w.str( "NEND" );
+}
+
+// GBS (Game Boy CPU and APU)
+
+static void make_gbs( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "GBS" );
+	w.byte( 1 );        // version
+	w.byte( 1 );        // track count
+	w.byte( 1 );        // first track
+	w.le16( 0x0400 );   // load
+	w.le16( 0x0400 );   // init
+	w.le16( 0x0480 );   // play
+	w.le16( 0xFFFE );   // stack
+	w.byte( 0 );        // timer modulo
+	w.byte( 0 );        // play on vertical blank
+	w.field( "Synthetic", 32 );
+	w.field( "gme_bench", 32 );
+	w.field( "", 32 );
+
+	// init: square 1, wave and noise
+	long begin = w.pos();
+	CODE( w,
+		0x3E,0x80, 0xE0,0x26,       // LD A,$80  LDH ($26),A
+		0x3E,0x77, 0xE0,0x24,       // LD A,$77  LDH ($24),A
+		0x3E,0xFF, 0xE0,0x25,       // LD A,$FF  LDH ($25),A
+		0x3E,0x80, 0xE0,0x11,       // LD A,$80  LDH ($11),A
+		0x3E,0xF0, 0xE0,0x12,       // LD A,$F0  LDH ($12),A
+		0x3E,0x00, 0xE0,0x13,       // LD A,$00  LDH ($13),A
+		0x3E,0x87, 0xE0,0x14,       // LD A,$87  LDH ($14),A
+		0x3E,0x00, 0xE0,0x1A        // LD A,$00  LDH ($1A),A
+	);
+	for ( int i = 0; i < 16; i++ )
+	{
+		// sawtooth into wave RAM
+		w.byte( 0x3E ); w.byte( (i * 2) << 4 | (i * 2 + 1) );
+		w.byte( 0xE0 ); w.byte( 0x30 + i );
+	}
+	CODE( w,
+		0x3E,0x80, 0xE0,0x1A,       // LD A,$80  LDH ($1A),A
+		0x3E,0x20, 0xE0,0x1C,       // LD A,$20  LDH ($1C),A
+		0x3E,0x00, 0xE0,0x1D,       // LD A,$00  LDH ($1D),A
+		0x3E,0x86, 0xE0,0x1E,       // LD A,$86  LDH ($1E),A
+		0x3E,0xF0, 0xE0,0x21,       // LD A,$F0  LDH ($21),A
+		0x3E,0x35, 0xE0,0x22,       // LD A,$35  LDH ($22),A
+		0x3E,0x80, 0xE0,0x23,       // LD A,$80  LDH ($23),A
+		0xC9                        // RET
+	);
+
+	// play
+	w.pad( begin + 0x80 );
+	CODE( w,
+		0xFA,0x00,0xC0,             // LD A,($C000)
+		0x3C,                       // INC A
+		0xEA,0x00,0xC0,             // LD ($C000),A
+		0xE0,0x13,                  // LDH ($13),A
+		0xE0,0x1D,                  // LDH ($1D),A
+		0xC9                        // RET
+	);
+}
+
+// AY (ZX Spectrum Z80 and AY-3-8910)
+
+// Writes n to AY register r through Spectrum ports
+#define AY_WRITE( r, n ) \
+	0x01,0xFD,0xFF,             /* LD BC,$FFFD */\
+	0x3E,r, 0xED,0x79,          /* LD A,r  OUT (C),A */\
+	0x06,0xBF,                  /* LD B,$BF */\
+	0x3E,n, 0xED,0x79           /* LD A,n  OUT (C),A */
+
+static void make_ay( synth_data_t& out )
+{
+	Writer w( out );
+
+	// Offsets in AY files are signed and relative to where they're stored
+	w.str( "ZXAYEMUL" );
+	w.byte( 0 );        // version
+	w.byte( 0 );        // player
+	w.fill( 0, 2 );
+	long author = w.pos();  w.be16( 0 );
+	long comment = w.pos(); w.be16( 0 );
+	w.byte( 0 );        // last track
+	w.byte( 0 );        // first track
+	long tracks = w.pos();  w.be16( 0 );
+
+	w.set_be16( tracks, w.pos() - tracks );
+	long name = w.pos();    w.be16( 0 );
+	long track = w.pos();   w.be16( 0 );
+
+	w.set_be16( track, w.pos() - track );
+	w.byte( 0 ); w.byte( 1 ); w.byte( 2 ); w.byte( 3 ); // channel mapping
+	w.be16( 0 );        // length
+	w.be16( 0 );        // fade
+	w.byte( 0 );        // initial register values
+	w.byte( 0 );
+	long points = w.pos();  w.be16( 0 );
+	long blocks = w.pos();  w.be16( 0 );
+
+	w.set_be16( points, w.pos() - points );
+	w.be16( 0x0000 );   // stack
+	w.be16( 0x8000 );   // init
+	w.be16( 0x8080 );   // play
+
+	w.set_be16( blocks, w.pos() - blocks );
+	w.be16( 0x8000 );
+	long block_size = w.pos(); w.be16( 0 );
+	long block_data = w.pos(); w.be16( 0 );
+	w.fill( 0, 8 );     // end of blocks
+
+	w.set_be16( author, w.pos() - author );
+	w.str( "gme_bench" ); w.byte( 0 );
+	w.set_be16( comment, w.pos() - comment );
+	w.byte( 0 );
+	w.set_be16( name, w.pos() - name );
+	w.str( "Synthetic" ); w.byte( 0 );
+
+	w.set_be16( block_data, w.pos() - block_data );
+	long begin = w.pos();
+	CODE( w,
+		AY_WRITE( 7, 0x38 ),
+		AY_WRITE( 8, 15 ),
+		AY_WRITE( 9, 12 ),
+		AY_WRITE( 10, 10 ),
+		AY_WRITE( 0, 0x80 ),
+		AY_WRITE( 2, 0x40 ),
+		AY_WRITE( 3, 0x01 ),
+		AY_WRITE( 4, 0xC0 ),
+		0xC9                        // RET
+	);
+	w.pad( begin + 0x80 );
+	CODE( w,
+		0x3A,0x00,0x90,             // LD A,($9000)
+		0x3C,                       // INC A
+		0x32,0x00,0x90,             // LD ($9000),A
+		0x5F,                       // LD E,A
+		0x01,0xFD,0xFF,             // LD BC,$FFFD
+		0x3E,0x00, 0xED,0x79,       // LD A,0  OUT (C),A
+		0x06,0xBF,                  // LD B,$BF
+		0x7B, 0xED,0x79,            // LD A,E  OUT (C),A
+		0xC9                        // RET
+	);
+	w.set_be16( block_size, w.pos() - begin );
+}
+
+// KSS (MSX Z80, AY and SCC)
+
+static void make_kss( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "KSCC" );
+	w.le16( 0x4000 );   // load
+	long size = w.pos(); w.le16( 0 );
+	w.le16( 0x4000 );   // init
+	w.le16( 0x4080 );   // play
+	w.byte( 0 );        // first bank
+	w.byte( 0 );        // no banks
+	w.byte( 0 );        // no extra header
+	w.byte( 0 );        // AY and SCC
+
+	long begin = w.pos();
+	CODE( w,
+		0x3E,0x07, 0xD3,0xA0, 0x3E,0x38, 0xD3,0xA1, // AY: tones on
+		0x3E,0x08, 0xD3,0xA0, 0x3E,0x0A, 0xD3,0xA1, // volumes
+		0x3E,0x09, 0xD3,0xA0, 0x3E,0x08, 0xD3,0xA1,
+		0x3E,0x01, 0xD3,0xA0, 0x3E,0x01, 0xD3,0xA1, // periods
+		0x3E,0x02, 0xD3,0xA0, 0x3E,0xC0, 0xD3,0xA1,
+		0x21,0x00,0x98,             // LD HL,$9800  (SCC square wave)
+		0x06,0x10, 0x3E,0x60,       // LD B,16  LD A,$60
+		0x77, 0x23, 0x10,0xFC,      // LD (HL),A  INC HL  DJNZ -4
+		0x06,0x10, 0x3E,0xA0,       // LD B,16  LD A,$A0
+		0x77, 0x23, 0x10,0xFC,      // LD (HL),A  INC HL  DJNZ -4
+		0x3E,0x00, 0x32,0x80,0x98,  // SCC period
+		0x3E,0x01, 0x32,0x81,0x98,
+		0x3E,0x0A, 0x32,0x8A,0x98,  // SCC volume
+		0x3E,0x01, 0x32,0x8F,0x98,  // SCC enable
+		0xC9                        // RET
+	);
+	w.pad( begin + 0x80 );
+	CODE( w,
+		0x3A,0x00,0xC0,             // LD A,($C000)
+		0x3C,                       // INC A
+		0x32,0x00,0xC0,             // LD ($C000),A
+		0x5F,                       // LD E,A
+		0x3E,0x00, 0xD3,0xA0,       // LD A,0  OUT ($A0),A
+		0x7B, 0xD3,0xA1,            // LD A,E  OUT ($A1),A
+		0x32,0x80,0x98,             // LD ($9880),A
+		0xC9                        // RET
+	);
+	w.set_le16( size, w.pos() - begin );
+}
+
+// HES (HuC6280 with PSG, driven by vertical blank interrupt)
+
+static void make_hes( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "HESM" );
+	w.byte( 0 );        // version
+	w.byte( 0 );        // first track
+	w.le16( 0xE000 );   // init
+	w.byte( 0xFF );     // I/O at $0000
+	w.byte( 0xF8 );     // RAM at $2000
+	w.fill( 0, 6 );     // ROM page 0 everywhere else
+	w.str( "DATA" );
+	w.le32( 0x2000 );
+	w.le32( 0 );
+	w.fill( 0, 4 );
+
+	long begin = w.pos();
+	CODE( w,
+		0x78,                       // SEI
+		0xA9,0x00, 0x8D,0x00,0x08,  // select channel 0
+		0xA9,0xFF, 0x8D,0x01,0x08,  // main volume
+		0xA9,0x00, 0x8D,0x04,0x08,  // reset wave position
+		0xA2,0x00,                  // LDX #0
+		0x8A,                       // TXA         (sawtooth)
+		0x8D,0x06,0x08,             // STA $0806
+		0xE8,                       // INX
+		0xE0,0x20,                  // CPX #32
+		0xD0,0xF7,                  // BNE -9
+		0xA9,0xFF, 0x8D,0x05,0x08,  // balance
+		0xA9,0x00, 0x8D,0x02,0x08,  // period
+		0xA9,0x02, 0x8D,0x03,0x08,
+		0xA9,0x9F, 0x8D,0x04,0x08,  // enable
+		0xA9,0x05, 0x8D,0x00,0x08,  // select channel 5
+		0xA9,0xFF, 0x8D,0x05,0x08,  // balance
+		0xA9,0x8C, 0x8D,0x04,0x08,  // enable
+		0xA9,0x85, 0x8D,0x07,0x08,  // noise
+		0xA9,0x00, 0x8D,0x00,0x08,  // select channel 0
+		0xA9,0x05, 0x8D,0x00,0x00,  // VDP register 5
+		0xA9,0x08, 0x8D,0x02,0x00,  // vertical blank interrupt
+		0xA9,0x05, 0x8D,0x02,0x14,  // enable only VDP interrupt
+		0x58,                       // CLI
+		0x60                        // RTS
+	);
+
+	// interrupt handler
+	w.pad( begin + 0x100 );
+	CODE( w,
+		0x48,                       // PHA
+		0xAD,0x00,0x00,             // LDA $0000   (acknowledge)
+		0xEE,0x00,0x20,             // INC $2000
+		0xAD,0x00,0x20,             // LDA $2000
+		0x8D,0x02,0x08,             // STA $0802
+		0x68,                       // PLA
+		0x40                        // RTI
+	);
+
+	// vectors
+	w.pad( begin + 0x1FF6 );
+	w.le16( 0xE100 );
+	w.le16( 0xE100 );
+	w.le16( 0xE100 );
+	w.le16( 0xE100 );
+	w.le16( 0xE000 );
+}
+
+// SAP (Atari 6502 and two POKEYs)
+
+static void make_sap( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "SAP\r\n"
+			"AUTHOR \"gme_bench\"\r\n"
+			"NAME \"Synthetic\"\r\n"
+			"TYPE B\r\n"
+			"INIT 2000\r\n"
+			"PLAYER 2080\r\n"
+			"STEREO\r\n" );
+	w.byte( 0xFF );
+	w.byte( 0xFF );
+	w.le16( 0x2000 );
+	long end = w.pos(); w.le16( 0 );
+
+	long begin = w.pos();
+	CODE( w,
+		0xA9,0x00, 0x8D,0x08,0xD2,  // AUDCTL
+		0xA9,0x03, 0x8D,0x0F,0xD2,  // SKCTL
+		0xA9,0xAA, 0x8D,0x01,0xD2,  // pure tone
+		0xA9,0x40, 0x8D,0x00,0xD2,
+		0xA9,0x86, 0x8D,0x03,0xD2,  // noise
+		0xA9,0x20, 0x8D,0x02,0xD2,
+		0xA9,0x00, 0x8D,0x18,0xD2,  // second POKEY
+		0xA9,0x03, 0x8D,0x1F,0xD2,
+		0xA9,0xAA, 0x8D,0x11,0xD2,
+		0xA9,0x60, 0x8D,0x10,0xD2,
+		0xA9,0x00, 0x85,0x80,       // LDA #0  STA $80
+		0x60                        // RTS
+	);
+	w.pad( begin + 0x80 );
+	CODE( w,
+		0xE6,0x80,                  // INC $80
+		0xA5,0x80,                  // LDA $80
+		0x8D,0x00,0xD2,             // STA $D200
+		0x49,0xFF,                  // EOR #$FF
+		0x8D,0x10,0xD2,             // STA $D210
+		0x60                        // RTS
+	);
+	w.set_le16( end, 0x2000 + w.pos() - begin - 1 );
+}
+
+// SPC (SPC-700 and DSP)
+
+static void make_spc( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "SNES-SPC700 Sound File Data v0.30" );
+	w.byte( 0x1A );
+	w.byte( 0x1A );
+	w.byte( 26 );       // has ID666 tag
+	w.byte( 30 );
+	w.le16( 0x0400 );   // PC
+	w.byte( 0 );        // A
+	w.byte( 0 );        // X
+	w.byte( 0 );        // Y
+	w.byte( 0 );        // PSW
+	w.byte( 0xEF );     // SP
+	w.pad( 0x100 );
+
+	long const ram = w.pos();
+	w.pad( ram + 0x10000 + 0x100 );
+	unsigned char* mem = &out [ram];
+
+	// Changes pitch on every timer tick and keys on both voices every 32
+	static unsigned char const code [] = {
+		0x8F,0x20,0xFA,             // MOV $FA,#$20     (timer 0 period)
+		0x8F,0x01,0xF1,             // MOV $F1,#$01     (enable timer 0)
+		0xE4,0xFD,                  // MOV A,$FD
+		0xF0,0xFC,                  // BEQ -4
+		0xAB,0x10,                  // INC $10
+		0xE4,0x10,                  // MOV A,$10
+		0x8F,0x02,0xF2,             // MOV $F2,#$02     (voice 0 pitch)
+		0xC4,0xF3,                  // MOV $F3,A
+		0x28,0x1F,                  // AND A,#$1F
+		0xD0,0xEF,                  // BNE -17
+		0x8F,0x4C,0xF2,             // MOV $F2,#$4C     (key on)
+		0x8F,0x03,0xF3,             // MOV $F3,#$03
+		0x2F,0xE7                   // BRA -25
+	};
+	memcpy( mem + 0x400, code, sizeof code );
+
+	// Sample directory at $200 with one looped sine sample at $300
+	mem [0x200] = 0x00; mem [0x201] = 0x03;
+	mem [0x202] = 0x00; mem [0x203] = 0x03;
+	double const pi = 3.14159265358979323846;
+	for ( int block = 0; block < 4; block++ )
+	{
+		unsigned char* p = mem + 0x300 + block * 9;
+		p [0] = 0xB0 | (block == 3 ? 3 : 0); // end and loop on last block
+		for ( int i = 0; i < 16; i++ )
+		{
+			int s = (int) (7 * sin( (block * 16 + i) * 2 * pi / 64 )) & 15;
+			p [1 + i / 2] |= (i & 1) ? s : s << 4;
+		}
+	}
+
+	// DSP registers
+	unsigned char* dsp = mem + 0x10000;
+	for ( int v = 0; v < 2; v++ )
+	{
+		unsigned char* r = dsp + v * 0x10;
+		r [0] = 0x60;               // volume
+		r [1] = v ? 0x20 : 0x60;
+		r [2] = 0x00;               // pitch
+		r [3] = 0x08 + v * 4;
+		r [4] = 0;                  // sample
+		r [5] = 0x8F;               // ADSR
+		r [6] = 0xE0 | (v * 5);
+	}
+	dsp [0x0C] = 0x7F;              // main volume
+	dsp [0x1C] = 0x7F;
+	dsp [0x2C] = 0x40;              // echo volume
+	dsp [0x3C] = 0x40;
+	dsp [0x4C] = 0x03;              // key on
+	dsp [0x0D] = 0x40;              // echo feedback
+	dsp [0x3D] = 0x02;              // noise on voice 1
+	dsp [0x4D] = 0x03;              // echo on
+	dsp [0x5D] = 0x02;              // sample directory
+	dsp [0x6D] = 0x80;              // echo buffer
+	dsp [0x7D] = 0x02;              // echo delay
+	dsp [0x0F] = 0x7F;              // echo FIR
+
+	w.pad( 0x10200 );
+}
+
+// Eight voices covering every envelope mode, pitch modulation, noise and echo
+static void make_spc_dense( synth_data_t& out )
+{
+	Writer w( out );
+	w.str( "SNES-SPC700 Sound File Data v0.30" );
+	w.byte( 0x1A );
+	w.byte( 0x1A );
+	w.byte( 26 );       // has ID666 tag
+	w.byte( 30 );
+	w.le16( 0x0400 );   // PC
+	w.byte( 0 );        // A
+	w.byte( 0 );        // X
+	w.byte( 0 );        // Y
+	w.byte( 0 );        // PSW
+	w.byte( 0xEF );     // SP
+	w.pad( 0x100 );
+
+	long const ram = w.pos();
+	w.pad( ram + 0x10000 + 0x100 );
+	unsigned char* mem = &out [ram];
+
+	// Changes pitch of voices 0 and 3 on every timer tick, keys off half the
+	// voices every 32 ticks and keys all on again 16 ticks later
+	static unsigned char const code [] = {
+		0x8F,0x20,0xFA,             // MOV $FA,#$20     (timer 0 period)
+		0x8F,0x01,0xF1,             // MOV $F1,#$01     (enable timer 0)
+		0xE4,0xFD,                  // MOV A,$FD
+		0xF0,0xFC,                  // BEQ -4
+		0xAB,0x10,                  // INC $10
+		0xE4,0x10,                  // MOV A,$10
+		0x8F,0x02,0xF2,             // MOV $F2,#$02     (voice 0 pitch)
+		0xC4,0xF3,                  // MOV $F3,A
+		0x8F,0x32,0xF2,             // MOV $F2,#$32     (voice 3 pitch)
+		0xC4,0xF3,                  // MOV $F3,A
+		0x28,0x1F,                  // AND A,#$1F
+		0x68,0x10,                  // CMP A,#$10
+		0xD0,0x06,                  // BNE +6
+		0x8F,0x5C,0xF2,             // MOV $F2,#$5C     (key off)
+		0x8F,0xAA,0xF3,             // MOV $F3,#$AA
+		0x68,0x00,                  // CMP A,#$00
+		0xD0,0xDE,                  // BNE -34
+		0x8F,0x5C,0xF2,             // MOV $F2,#$5C     (key off)
+		0x8F,0x00,0xF3,             // MOV $F3,#$00
+		0x8F,0x4C,0xF2,             // MOV $F2,#$4C     (key on)
+		0x8F,0xFF,0xF3,             // MOV $F3,#$FF
+		0x2F,0xD0                   // BRA -48
+	};
+	memcpy( mem + 0x400, code, sizeof code );
+
+	// Sample directory at $200: looped sine at $300, and a one-shot sine at
+	// $340 that ends after four blocks. Blocks use all four BRR filters.
+	mem [0x200] = 0x00; mem [0x201] = 0x03;
+	mem [0x202] = 0x00; mem [0x203] = 0x03;
+	mem [0x204] = 0x40; mem [0x205] = 0x03;
+	mem [0x206] = 0x40; mem [0x207] = 0x03;
+	double const pi = 3.14159265358979323846;
+	for ( int n = 0; n < 2; n++ )
+	{
+		for ( int block = 0; block < 4; block++ )
+		{
+			unsigned char* p = mem + 0x300 + n * 0x40 + block * 9;
+			p [0] = 0x90 | block << 2;
+			if ( block == 3 )
+				p [0] |= n ? 1 : 3; // end, and loop for first sample
+			for ( int i = 0; i < 16; i++ )
+			{
+				int s = (int) (7 * sin( (block * 16 + i) * 2 * pi / (n ? 16 : 64) )) & 15;
+				p [1 + i / 2] |= (i & 1) ? s : s << 4;
+			}
+		}
+	}
+
+	// DSP registers: volume, pitch, sample, ADSR and GAIN of each voice
+	static unsigned char const voices [8] [8] = {
+		{ 0x60, 0x60, 0x00, 0x08, 0, 0x8F, 0xE0, 0x00 }, // ADSR
+		{ 0x50, 0xB0, 0x00, 0x06, 1, 0xFA, 0x4A, 0x00 }, // ADSR, surround
+		{ 0x40, 0x30, 0x00, 0x10, 0, 0x00, 0x00, 0x7F }, // direct GAIN, pitch modulated
+		{ 0x30, 0x50, 0x80, 0x0C, 1, 0x00, 0x00, 0x9C }, // linear decrease
+		{ 0x58, 0x28, 0x00, 0x04, 0, 0x00, 0x00, 0xBA }, // exponential decrease
+		{ 0x20, 0x60, 0x40, 0x09, 1, 0x00, 0x00, 0xDC }, // linear increase, pitch modulated
+		{ 0x48, 0x48, 0x00, 0x05, 0, 0x00, 0x00, 0xFC }, // bent line increase
+		{ 0x18, 0x18, 0x00, 0x02, 0, 0x8A, 0x2C, 0x00 }  // ADSR, noise
+	};
+	unsigned char* dsp = mem + 0x10000;
+	for ( int v = 0; v < 8; v++ )
+		memcpy( dsp + v * 0x10, voices [v], sizeof voices [v] );
+	dsp [0x0C] = 0x7F;              // main volume
+	dsp [0x1C] = 0x7F;
+	dsp [0x2C] = 0x30;              // echo volume
+	dsp [0x3C] = 0xD0;
+	dsp [0x4C] = 0xFF;              // key on
+	dsp [0x6C] = 0x1C;              // noise rate
+	dsp [0x0D] = 0x50;              // echo feedback
+	dsp [0x2D] = 0x25;              // pitch modulation on voices 2 and 5 (voice 0 ignores it)
+	dsp [0x3D] = 0x80;              // noise on voice 7
+	dsp [0x4D] = 0xEF;              // echo on all but voice 4
+	dsp [0x5D] = 0x02;              // sample directory
+	dsp [0x6D] = 0x80;              // echo buffer
+	dsp [0x7D] = 0x03;              // echo delay
+	static unsigned char const fir [8] = { 0x40, 0x20, 0x10, 0x08, 0xF8, 0x04, 0x00, 0x10 };
+	for ( int i = 0; i < 8; i++ )
+		dsp [i * 0x10 + 0x0F] = fir [i];
+
+	w.pad( 0x10200 );
+}
+
+// VGM/GYM (YM2612, SN76489 and DAC)
+
+// Emits a command stream for either format
+class Fm_Stream {
+public:
+	Fm_Stream( Writer& w, bool vgm ) : w( w ), vgm( vgm ) { }
+
+	void fm( int port, int addr, int data )
+	{
+		w.byte( vgm ? 0x52 + port : 1 + port );
+		w.byte( addr );
+		w.byte( data );
+	}
+
+	void psg( int data )
+	{
+		w.byte( vgm ? 0x50 : 3 );
+		w.byte( data );
+	}
+
+	// Waits for 1/60 second
+	void frame()
+	{
+		if ( vgm )
+			w.byte( 0x62 );
+		else
+			w.byte( 0 );
+	}
+
+	void setup();
+	void note( int n, bool fm_on );
+
+private:
+	Writer& w;
+	bool vgm;
+};
+
+void Fm_Stream::setup()
+{
+	// Channel 1 on port 0, channel 4 on port 1
+	fm( 0, 0x22, 0x08 );
+	fm( 0, 0xB0, 0x32 );
+	fm( 0, 0xB4, 0xC0 );
+	for ( int op = 0; op < 4; op++ )
+	{
+		int const base = op * 4;
+		fm( 0, 0x30 + base, 0x71 );
+		fm( 0, 0x40 + base, op == 3 ? 0x20 : 0x30 );
+		fm( 0, 0x50 + base, 0x1F );
+		fm( 0, 0x60 + base, 0x05 );
+		fm( 0, 0x70 + base, 0x02 );
+		fm( 0, 0x80 + base, 0x11 );
+	}
+	fm( 1, 0xB0, 0x04 );
+	fm( 1, 0xB4, 0xC0 );
+	for ( int op = 0; op < 4; op++ )
+	{
+		int const base = op * 4;
+		fm( 1, 0x30 + base, 0x01 );
+		fm( 1, 0x40 + base, 0x18 );
+		fm( 1, 0x50 + base, 0x1F );
+		fm( 1, 0x80 + base, 0x0F );
+	}
+}
+
+void Fm_Stream::note( int n, bool fm_on )
+{
+	int period = 200 + n * 7;
+	psg( 0x80 | (period & 15) );
+	psg( (period >> 4) & 63 );
+	psg( 0x90 | (n % 8) );
+	psg( 0xE0 | (n & 7) );
+	psg( 0xF0 | (n % 12) );
+	if ( fm_on )
+	{
+		fm( 0, 0xA4, 0x22 + (n & 3) );
+		fm( 0, 0xA0, (n * 37) & 0xFF );
+		fm( 0, 0x28, 0x00 );
+		fm( 0, 0x28, 0xF0 );
+		fm( 1, 0xA4, 0x1A );
+		fm( 1, 0xA0, (n * 53) & 0xFF );
+		fm( 0, 0x28, (n & 1) ? 0x05 : 0xF5 );
+	}
+}
+
+int const vgm_notes = 40;
+int const note_frames = 12;
+int const pcm_size = 4000;
+
+static int pcm_sample( int i )
+{
+	return (int) (128 + 100 * sin( i / 5.0 )) & 0xFF;
+}
+
+// Writes header and returns position of loop offset
+static long write_vgm_header( Writer& w, long ym2413_clock, long ym2612_clock )
+{
+	w.str( "Vgm " );
+	w.le32( 0 );                    // EOF offset
+	w.le32( 0x150 );                // version
+	w.le32( 3579545 );              // PSG clock
+	w.le32( ym2413_clock );
+	w.le32( 0 );                    // GD3 offset
+	w.le32( 2L * vgm_notes * note_frames * 735 ); // total samples
+	long loop = w.pos(); w.le32( 0 );
+	w.le32( 1L * vgm_notes * note_frames * 735 ); // loop samples
+	w.le32( 0 );                    // rate
+	w.le16( 0x0009 );               // noise feedback
+	w.byte( 16 );                   // noise width
+	w.byte( 0 );
+	w.le32( ym2612_clock );
+	w.le32( 0 );                    // YM2151 clock
+	w.le32( 0x0C );                 // data offset
+	w.pad( 0x40 );
+	return loop;
+}
+
+static void make_vgm_( synth_data_t& out, bool fm_on )
+{
+	Writer w( out );
+	long loop = write_vgm_header( w, 0, fm_on ? 7670453 : 0 );
+
+	Fm_Stream s( w, true );
+	if ( fm_on )
+	{
+		// PCM data block
+		w.byte( 0x67 );
+		w.byte( 0x66 );
+		w.byte( 0x00 );
+		w.le32( pcm_size );
+		for ( int i = 0; i < pcm_size; i++ )
+			w.byte( pcm_sample( i ) );
+		s.setup();
+	}
+
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		if ( pass == 1 )
+			w.set_le32( loop, w.pos() - loop );
+
+		for ( int n = 0; n < vgm_notes; n++ )
+		{
+			s.note( n, fm_on );
+			if ( fm_on && n % 4 == 0 )
+			{
+				// burst of DAC writes from data block
+				s.fm( 0, 0x2B, 0x80 );
+				w.byte( 0xE0 );
+				w.le32( n * 100 % 3000 );
+				for ( int i = 0; i < 300; i++ )
+					w.byte( 0x80 | 3 );
+				s.fm( 0, 0x2B, 0x00 );
+			}
+			for ( int i = note_frames; i--; )
+				s.frame();
+		}
+	}
+	w.byte( 0x66 );
+	w.set_le32( 4, w.pos() - 4 );
+}
+
+// All six FM channels, each with a different algorithm, feedback and LFO
+// sensitivity, so every channel is active at once
+static void make_vgm_fm( synth_data_t& out )
+{
+	Writer w( out );
+	long loop = write_vgm_header( w, 0, 7670453 );
+
+	Fm_Stream s( w, true );
+	s.fm( 0, 0x22, 0x0B );          // LFO on
+	for ( int c = 0; c < 6; c++ )
+	{
+		int const port = c / 3;
+		int const ch = c % 3;
+		for ( int op = 0; op < 4; op++ )
+		{
+			int const base = op * 4 + ch;
+			s.fm( port, 0x30 + base, (op + c) % 8 << 4 | (op * 3 + c) % 16 );
+			s.fm( port, 0x40 + base, op == 3 ? 0x10 : 0x20 + c * 2 );
+			s.fm( port, 0x50 + base, 0x1C - op * 2 );
+			s.fm( port, 0x60 + base, (op == 1 ? 0x80 : 0) | (4 + c) );
+			s.fm( port, 0x70 + base, 0x03 );
+			s.fm( port, 0x80 + base, 0x24 + op );
+		}
+		s.fm( port, 0xB0 + ch, (c + 1) % 8 << 3 | c );
+		s.fm( port, 0xB4 + ch, (c % 3 + 1) << 6 | (c % 4) << 4 | (c + 2) % 8 );
+	}
+
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		if ( pass == 1 )
+			w.set_le32( loop, w.pos() - loop );
+
+		for ( int n = 0; n < vgm_notes; n++ )
+		{
+			// algorithms 6 and 7 take turns on last channel
+			s.fm( 1, 0xB2, 5 << 3 | (6 + (n & 1)) );
+			for ( int c = 0; c < 6; c++ )
+			{
+				int const port = c / 3;
+				int const ch = c % 3;
+				int const key = (c < 3 ? c : c + 1);
+				if ( (n + c) % 3 == 0 )
+				{
+					s.fm( port, 0xA4 + ch, 0x18 + ((n + c) & 7) );
+					s.fm( port, 0xA0 + ch, (n * 29 + c * 71) & 0xFF );
+					s.fm( 0, 0x28, key );
+					s.fm( 0, 0x28, 0xF0 | key );
+				}
+			}
+			for ( int i = note_frames; i--; )
+				s.frame();
+		}
+	}
+	w.byte( 0x66 );
+	w.set_le32( 4, w.pos() - 4 );
+}
+
+static void write_opll( Writer& w, int addr, int data )
+{
+	w.byte( 0x51 );
+	w.byte( addr );
+	w.byte( data );
+}
+
+// YM2413 with user instrument, six melodic channels and rhythm, then all
+// nine channels melodic
+static void make_vgm_opll( synth_data_t& out )
+{
+	Writer w( out );
+	long loop = write_vgm_header( w, 3579545, 0 );
+
+	static unsigned char const user_inst [8] = {
+		0x61, 0x21, 0x15, 0x1C, 0xF3, 0xA4, 0x26, 0x35
+	};
+	for ( int i = 0; i < 8; i++ )
+		write_opll( w, i, user_inst [i] );
+
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		if ( pass == 1 )
+			w.set_le32( loop, w.pos() - loop );
+
+		// rhythm channel frequencies and volumes
+		write_opll( w, 0x0E, 0x20 );
+		write_opll( w, 0x16, 0x20 );
+		write_opll( w, 0x26, 0x05 );
+		write_opll( w, 0x17, 0x50 );
+		write_opll( w, 0x27, 0x05 );
+		write_opll( w, 0x18, 0xC0 );
+		write_opll( w, 0x28, 0x01 );
+		write_opll( w, 0x36, 0x02 );
+		write_opll( w, 0x37, 0x31 );
+		write_opll( w, 0x38, 0x22 );
+
+		for ( int n = 0; n < vgm_notes; n++ )
+		{
+			bool const rhythm = n < vgm_notes / 2;
+			if ( n == vgm_notes / 2 )
+				write_opll( w, 0x0E, 0x00 );
+
+			int const chans = rhythm ? 6 : 9;
+			for ( int c = 0; c < chans; c++ )
+			{
+				if ( (n + c) % 2 )
+					continue;
+				int const fnum = 0x120 + ((n * 37 + c * 53) & 0xFF);
+				write_opll( w, 0x30 + c, ((n + c * 3) % 16) << 4 | (c % 4) * 2 );
+				write_opll( w, 0x20 + c, 0x00 );
+				write_opll( w, 0x10 + c, fnum & 0xFF );
+				write_opll( w, 0x20 + c, (n % 3 == 0 ? 0x20 : 0) | 0x10 | (2 + c % 4) << 1 | fnum >> 8 );
+			}
+
+			if ( rhythm )
+			{
+				write_opll( w, 0x0E, 0x20 );
+				write_opll( w, 0x0E, 0x20 | (0x11 << (n & 1)) | (n % 3 ? 0x04 : 0x0A) );
+			}
+
+			for ( int i = note_frames; i--; )
+				w.byte( 0x62 );
+		}
+	}
+	w.byte( 0x66 );
+	w.set_le32( 4, w.pos() - 4 );
+}
+
+static void make_vgm( synth_data_t& out )
+{
+	make_vgm_( out, true );
+}
+
+static void make_vgm_psg( synth_data_t& out )
+{
+	make_vgm_( out, false );
+}
+
+static void make_gym( synth_data_t& out )
+{
+	Writer w( out );
+	Fm_Stream s( w, false );
+	s.setup();
+	for ( int n = 0; n < vgm_notes; n++ )
+	{
+		s.note( n, true );
+		if ( n % 4 == 0 )
+		{
+			// DAC writes within one frame
+			s.fm( 0, 0x2B, 0x80 );
+			for ( int i = 0; i < 300; i++ )
+				s.fm( 0, 0x2A, pcm_sample( n * 100 + i ) );
+			s.frame();
+			s.fm( 0, 0x2B, 0x00 );
+		}
+		for ( int i = note_frames; i--; )
+			s.frame();
+	}
+}
+
+synth_file_t const synth_files [] = {
+	{ "ay",      "AY",   "Z80 and AY-3-8910",                    make_ay },
+	{ "gbs",     "GBS",  "Game Boy CPU, square, wave and noise", make_gbs },
+	{ "gym",     "GYM",  "YM2612 with DAC, SN76489",             make_gym },
+	{ "hes",     "HES",  "HuC6280 with interrupts, wave and noise", make_hes },
+	{ "kss",     "KSS",  "Z80, AY-3-8910 and SCC",               make_kss },
+	{ "nsf",     "NSF",  "6502, pulse, triangle and noise",      make_nsf },
+	{ "nsfe",    "NSFE", "NSF data in NSFE chunks",              make_nsfe },
+	{ "sap",     "SAP",  "6502 and two POKEYs",                  make_sap },
+	{ "spc",     "SPC",  "SPC-700, BRR, noise and echo",         make_spc },
+	{ "spc_dense","SPC", "Eight SPC voices, all envelope modes", make_spc_dense },
+	{ "vgm",     "VGM",  "YM2612 with DAC, SN76489",             make_vgm },
+	{ "vgm_psg", "VGM",  "SN76489 only",                         make_vgm_psg },
+	{ "vgm_fm",  "VGM",  "Six YM2612 channels, all algorithms and LFO", make_vgm_fm },
+	{ "vgm_opll","VGM",  "YM2413 melody and rhythm",            make_vgm_opll },
+	{ "vgz",     "VGZ",  "Uncompressed VGM data as VGZ type",    make_vgm },
+	{ NULL, NULL, NULL, NULL }
+};
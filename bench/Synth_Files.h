@@ -0,0 +1,22 @@
+// Small synthetic music files for each supported format, generated in memory
+
+#ifndef SYNTH_FILES_H
+#define SYNTH_FILES_H
+
+#include <vector>
+
+typedef std::vector<unsigned char> synth_data_t;
+
+struct synth_file_t
+{
+	const char* name;       // short name, also used for results and file names
+	const char* extension;  // used with gme_identify_extension()
+	const char* desc;
+	void (*make)( synth_data_t& out );
+};
+
+// Files, terminated by entry with NULL name. Each plays one track that keeps
+// the sound chips busy and loops or runs indefinitely.
+extern synth_file_t const synth_files [];
+
+#endif
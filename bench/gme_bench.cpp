@@ -0,0 +1,549 @@
+// Measures emulator performance on synthetic files for every supported music
+// type and writes results as JSON. Optionally compares with earlier results and
+// fails if steady-state play got slower than a threshold.
+
+// Usage: gme_bench [options] [name ...]
+//  -r rate     sample rate (default 44100)
+//  -s seconds  seconds of sound to play for each file (default 60)
+//  -n count    number of times to load and start each file (default 20)
+//  -o path     write JSON results to file (default gme_bench.json; - for stdout)
+//  -c path     compare play speed with results from earlier run
+//  -t percent  slowdown allowed by -c before failing (default 10)
+//  -d depth    stereo depth to play with (default 0)
+//  -w dir      also write synthetic files into directory
+//  name        only run these files (see Synth_Files.cpp)
+
+// If library was built with GME_STATS, results also include time spent in each
+// emulation stage and counters from gme_stats().
+
+// Peak memory use is reported once for the whole run, since the process's peak
+// only grows and can't be told apart for each file.
+
+#include "gme/gme.h"
+#include "Synth_Files.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined (__unix__) || defined (__APPLE__)
+	#include <sys/resource.h>
+	#define HAVE_GETRUSAGE 1
+#endif
+
+// Allocation counting
+
+static unsigned long alloc_count;
+
+#if defined (__GLIBC__)
+	// Catches library's malloc()/realloc() as well as operator new
+	extern "C" {
+		void* __libc_malloc( size_t );
+		void* __libc_calloc( size_t, size_t );
+		void* __libc_realloc( void*, size_t );
+
+		void* malloc( size_t size )
+		{
+			alloc_count++;
+			return __libc_malloc( size );
+		}
+
+		void* calloc( size_t count, size_t size )
+		{
+			alloc_count++;
+			return __libc_calloc( count, size );
+		}
+
+		void* realloc( void* p, size_t size )
+		{
+			alloc_count++;
+			return __libc_realloc( p, size );
+		}
+	}
+#else
+	// Only operator new can be replaced portably
+	#include <new>
+
+	void* operator new ( size_t size )
+	{
+		alloc_count++;
+		void* p = malloc( size ? size : 1 );
+		if ( !p )
+			throw std::bad_alloc();
+		return p;
+	}
+
+	void* operator new [] ( size_t size )   { return operator new ( size ); }
+	void operator delete ( void* p ) throw()    { free( p ); }
+	void operator delete [] ( void* p ) throw() { free( p ); }
+#endif
+
+// Peak resident memory of process so far, or -1 if unknown
+static long peak_rss_kb()
+{
+	#if HAVE_GETRUSAGE
+		struct rusage usage;
+		if ( getrusage( RUSAGE_SELF, &usage ) )
+			return -1;
+		#ifdef __APPLE__
+			return usage.ru_maxrss / 1024; // bytes on OS X
+		#else
+			return usage.ru_maxrss;
+		#endif
+	#else
+		return -1;
+	#endif
+}
+
+// Timing
+
+struct phase_t
+{
+	double seconds;
+	unsigned long allocs;
+
+	clock_t start_time;
+	unsigned long start_allocs;
+
+	void clear()    { seconds = 0; allocs = 0; }
+	void begin()    { start_allocs = alloc_count; start_time = clock(); }
+	void end()
+	{
+		seconds += (double) (clock() - start_time) / CLOCKS_PER_SEC;
+		allocs  += alloc_count - start_allocs;
+	}
+};
+
+struct options_t
+{
+	int sample_rate;
+	int play_seconds;
+	int iterations;
+	double stereo_depth;
+	const char* out_path;
+	const char* baseline_path;
+	double threshold;
+	const char* write_dir;
+};
+
+struct result_t
+{
+	synth_file_t const* file;
+	gme_type_t type;
+	long size;
+	phase_t load;
+	phase_t start;
+	phase_t play;
+	long play_samples;
+	char warning [256];
+	const char* error;
+	bool have_stats; // library was built with GME_STATS
+	gme_stats_t stats;
+};
+
+static void write_file( options_t const& opt, synth_file_t const& f, synth_data_t const& data )
+{
+	char path [512];
+	char ext [8];
+	int i = 0;
+	for ( ; f.extension [i] && i < (int) sizeof ext - 1; i++ )
+		ext [i] = f.extension [i] | 0x20;
+	ext [i] = 0;
+	sprintf( path, "%.400s/%s.%s", opt.write_dir, f.name, ext );
+
+	FILE* out = fopen( path, "wb" );
+	if ( !out || fwrite( &data [0], data.size(), 1, out ) != 1 )
+		fprintf( stderr, "Couldn't write %s\n", path );
+	if ( out )
+		fclose( out );
+}
+
+static const char* bench_file( options_t const& opt, result_t& r )
+{
+	synth_data_t data;
+	r.file->make( data );
+	r.size = (long) data.size();
+	if ( opt.write_dir )
+		write_file( opt, *r.file, data );
+
+	// Load and start are fast, so do them several times and report average
+	Music_Emu* emu = NULL;
+	for ( int n = opt.iterations; n--; )
+	{
+		gme_delete( emu );
+
+		r.load.begin();
+		emu = gme_new_emu( r.type, opt.sample_rate );
+		gme_err_t err = "Out of memory";
+		if ( emu )
+			err = gme_load_data( emu, &data [0], r.size );
+		r.load.end();
+		if ( err )
+		{
+			gme_delete( emu );
+			return err;
+		}
+
+		r.start.begin();
+		err = gme_start_track( emu, 0 );
+		r.start.end();
+		if ( err )
+		{
+			gme_delete( emu );
+			return err;
+		}
+	}
+
+	// Keep playing even if synthetic file goes quiet
+	gme_ignore_silence( emu, 1 );
+	gme_set_stereo_depth( emu, opt.stereo_depth );
+	gme_clear_stats( emu );
+
+	enum { buf_size = 4096 };
+	static short buf [buf_size];
+	long remain = (long) opt.sample_rate * 2 * opt.play_seconds;
+	r.play.begin();
+	while ( remain > 0 )
+	{
+		int n = (remain < buf_size ? (int) remain : (int) buf_size);
+		gme_err_t err = gme_play( emu, n, buf );
+		if ( err )
+		{
+			r.play.end();
+			gme_delete( emu );
+			return err;
+		}
+		remain -= n;
+		r.play_samples += n;
+	}
+	r.play.end();
+	r.have_stats = !gme_stats( emu, &r.stats );
+
+	const char* w = gme_warning( emu );
+	if ( w )
+	{
+		strncpy( r.warning, w, sizeof r.warning - 1 );
+		r.warning [sizeof r.warning - 1] = 0;
+	}
+
+	gme_delete( emu );
+	return 0;
+}
+
+// JSON output
+
+static void write_string( FILE* out, const char* s )
+{
+	fputc( '"', out );
+	for ( ; *s; s++ )
+	{
+		if ( *s == '"' || *s == '\\' )
+			fprintf( out, "\\%c", *s );
+		else if ( (unsigned char) *s < 0x20 )
+			fprintf( out, "\\u%04x", (unsigned char) *s );
+		else
+			fputc( *s, out );
+	}
+	fputc( '"', out );
+}
+
+static double per_sec( double count, double seconds )
+{
+	return seconds > 0 ? count / seconds : 0;
+}
+
+static void write_phase( FILE* out, const char* name, phase_t const& p, int iterations )
+{
+	double seconds = p.seconds / iterations;
+	double allocs  = (double) p.allocs / iterations;
+	fprintf( out, "\t\t\t\"%s\": { \"seconds\": %.9f, \"allocs\": %.1f, \"allocs_per_sec\": %.1f },\n",
+			name, seconds, allocs, per_sec( allocs, seconds ) );
+}
+
+static void write_stats( FILE* out, gme_stats_t const& s )
+{
+	static const char* const stages [gme_stage_count] = {
+		"cpu", "apu", "mix", "resample", "filter", "silence", "fade", "other", "loudness"
+	};
+	static const char* const chips [gme_chip_count] = {
+		"nes_apu", "vrc6", "fme7", "namco", "ay", "scc", "sms_psg", "ym2612", "ym2413",
+		"gb_apu", "hes_apu", "sap_apu", "spc_dsp"
+	};
+	fprintf( out, "\t\t\t\"stage_seconds\": {" );
+	for ( int i = 0; i < gme_stage_count; i++ )
+		fprintf( out, "%s \"%s\": %.6f", i ? "," : "", stages [i],
+				per_sec( (double) s.ticks [i], s.ticks_per_sec ) );
+	fprintf( out, " },\n" );
+	fprintf( out, "\t\t\t\"writes\": {" );
+	const char* sep = "";
+	for ( int i = 0; i < gme_chip_count; i++ )
+	{
+		if ( s.writes [i] )
+		{
+			fprintf( out, "%s \"%s\": %llu", sep, chips [i], s.writes [i] );
+			sep = ",";
+		}
+	}
+	fprintf( out, " },\n" );
+	fprintf( out, "\t\t\t\"idle_clocks\": {" );
+	sep = "";
+	for ( int i = 0; i < gme_chip_count; i++ )
+	{
+		if ( s.idle_clocks [i] )
+		{
+			fprintf( out, "%s \"%s\": %llu", sep, chips [i], s.idle_clocks [i] );
+			sep = ",";
+		}
+	}
+	fprintf( out, " },\n" );
+	fprintf( out, "\t\t\t\"counters\": { \"clocks\": %llu, \"impulses\": %llu, "
+			"\"resampler_in\": %llu, \"resampler_out\": %llu, \"lookahead\": %llu, "
+			"\"lookahead_silent\": %llu, \"brr_cache_hits\": %llu, "
+			"\"brr_cache_misses\": %llu },\n",
+			s.clocks, s.impulses, s.resampler_in, s.resampler_out, s.lookahead,
+			s.lookahead_silent, s.brr_cache_hits, s.brr_cache_misses );
+}
+
+static void write_results( FILE* out, options_t const& opt, result_t const* results, int count )
+{
+	fprintf( out, "{\n" );
+	fprintf( out, "\t\"gme_bench\": 1,\n" );
+	fprintf( out, "\t\"sample_rate\": %d,\n", opt.sample_rate );
+	fprintf( out, "\t\"play_seconds\": %d,\n", opt.play_seconds );
+	fprintf( out, "\t\"iterations\": %d,\n", opt.iterations );
+	fprintf( out, "\t\"stereo_depth\": %g,\n", opt.stereo_depth );
+	fprintf( out, "\t\"peak_rss_kb\": %ld,\n", peak_rss_kb() );
+	fprintf( out, "\t\"results\": [\n" );
+	for ( int i = 0; i < count; i++ )
+	{
+		result_t const& r = results [i];
+		fprintf( out, "\t\t{\n" );
+		fprintf( out, "\t\t\t\"name\": " );
+		write_string( out, r.file ? r.file->name : gme_type_system( r.type ) );
+		fprintf( out, ",\n\t\t\t\"system\": " );
+		write_string( out, gme_type_system( r.type ) );
+		fprintf( out, ",\n" );
+		if ( !r.file || r.error )
+		{
+			fprintf( out, "\t\t\t\"error\": " );
+			write_string( out, r.error ? r.error : "No synthetic file for type" );
+			fprintf( out, "\n" );
+		}
+		else
+		{
+			fprintf( out, "\t\t\t\"input_bytes\": %ld,\n", r.size );
+			write_phase( out, "load", r.load, opt.iterations );
+			write_phase( out, "start_track", r.start, opt.iterations );
+			double rate = per_sec( (double) r.play_samples, r.play.seconds );
+			fprintf( out, "\t\t\t\"play\": { \"seconds\": %.6f, \"samples\": %ld, "
+					"\"samples_per_sec\": %.0f, \"realtime_factor\": %.2f, "
+					"\"allocs\": %lu, \"allocs_per_sec\": %.1f },\n",
+					r.play.seconds, r.play_samples, rate, rate / (opt.sample_rate * 2.0),
+					r.play.allocs, per_sec( (double) r.play.allocs, r.play.seconds ) );
+			if ( r.have_stats )
+				write_stats( out, r.stats );
+			fprintf( out, "\t\t\t\"warning\": " );
+			if ( *r.warning )
+				write_string( out, r.warning );
+			else
+				fprintf( out, "null" );
+			fprintf( out, "\n" );
+		}
+		fprintf( out, "\t\t}%s\n", i + 1 < count ? "," : "" );
+	}
+	fprintf( out, "\t]\n}\n" );
+}
+
+// Comparison with earlier results
+
+static char* read_text( const char* path )
+{
+	FILE* in = fopen( path, "rb" );
+	if ( !in )
+		return NULL;
+
+	fseek( in, 0, SEEK_END );
+	long size = ftell( in );
+	fseek( in, 0, SEEK_SET );
+	char* text = (char*) malloc( size + 1 );
+	if ( text )
+	{
+		if ( size < 0 || fread( text, 1, size, in ) != (size_t) size )
+			size = 0;
+		text [size] = 0;
+	}
+	fclose( in );
+	return text;
+}
+
+// Play rate of named result in text written by write_results(), or 0 if missing
+static double find_play_rate( const char* text, const char* name )
+{
+	char key [64];
+	sprintf( key, "\"name\": \"%.40s\"", name );
+	const char* p = strstr( text, key );
+	if ( !p )
+		return 0;
+
+	const char* next = strstr( p + 1, "\"name\":" );
+	p = strstr( p, "\"samples_per_sec\":" );
+	if ( !p || (next && p > next) )
+		return 0;
+
+	return atof( p + strlen( "\"samples_per_sec\":" ) );
+}
+
+static int compare( options_t const& opt, result_t const* results, int count )
+{
+	char* text = read_text( opt.baseline_path );
+	if ( !text )
+	{
+		fprintf( stderr, "Couldn't read %s\n", opt.baseline_path );
+		return 1;
+	}
+
+	int failed = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		result_t const& r = results [i];
+		if ( !r.file || r.error )
+			continue;
+
+		double old_rate = find_play_rate( text, r.file->name );
+		if ( old_rate <= 0 )
+			continue;
+
+		double rate = per_sec( (double) r.play_samples, r.play.seconds );
+		double change = (rate - old_rate) * 100 / old_rate;
+		bool slow = (change < -opt.threshold);
+		fprintf( stderr, "%-8s %+6.1f%%%s\n", r.file->name, change, slow ? "  REGRESSION" : "" );
+		if ( slow )
+			failed = 1;
+	}
+
+	free( text );
+	return failed;
+}
+
+static bool selected( const char* name, int argc, char** argv )
+{
+	if ( !argc )
+		return true;
+	for ( int i = 0; i < argc; i++ )
+		if ( !strcmp( name, argv [i] ) )
+			return true;
+	return false;
+}
+
+int main( int argc, char** argv )
+{
+	options_t opt;
+	opt.sample_rate   = 44100;
+	opt.play_seconds  = 60;
+	opt.iterations    = 20;
+	opt.stereo_depth  = 0;
+	opt.out_path      = "gme_bench.json";
+	opt.baseline_path = NULL;
+	opt.threshold     = 10;
+	opt.write_dir     = NULL;
+
+	int i = 1;
+	for ( ; i < argc && argv [i] [0] == '-' && argv [i] [1]; i++ )
+	{
+		char const opt_char = argv [i] [1];
+		if ( i + 1 >= argc )
+		{
+			fprintf( stderr, "Missing value for -%c\n", opt_char );
+			return EXIT_FAILURE;
+		}
+		const char* value = argv [++i];
+		switch ( opt_char )
+		{
+			case 'r': opt.sample_rate   = atoi( value ); break;
+			case 's': opt.play_seconds  = atoi( value ); break;
+			case 'n': opt.iterations    = atoi( value ); break;
+			case 'o': opt.out_path      = value; break;
+			case 'c': opt.baseline_path = value; break;
+			case 't': opt.threshold     = atof( value ); break;
+			case 'w': opt.write_dir     = value; break;
+			case 'd': opt.stereo_depth  = atof( value ); break;
+			default:
+				fprintf( stderr, "Unknown option -%c\n", opt_char );
+				return EXIT_FAILURE;
+		}
+	}
+	if ( opt.sample_rate <= 0 || opt.play_seconds <= 0 || opt.iterations <= 0 ||
+			opt.stereo_depth < 0 )
+	{
+		fprintf( stderr, "Invalid option value\n" );
+		return EXIT_FAILURE;
+	}
+	int name_count = argc - i;
+	char** names = argv + i;
+
+	// Every file for every type, and an entry for types without one
+	enum { max_results = 64 };
+	static result_t results [max_results];
+	int count = 0;
+	for ( gme_type_t const* type = gme_type_list(); *type && count < max_results; type++ )
+	{
+		bool found = false;
+		for ( synth_file_t const* f = synth_files; f->name && count < max_results; f++ )
+		{
+			if ( gme_identify_extension( f->extension ) != *type )
+				continue;
+			found = true;
+			if ( selected( f->name, name_count, names ) )
+			{
+				results [count].file = f;
+				results [count++].type = *type;
+			}
+		}
+		if ( !found && !name_count )
+			results [count++].type = *type;
+	}
+
+	int errors = 0;
+	for ( int n = 0; n < count; n++ )
+	{
+		result_t& r = results [n];
+		if ( !r.file )
+			continue;
+
+		fprintf( stderr, "%-8s ", r.file->name );
+		fflush( stderr );
+		r.load.clear();
+		r.start.clear();
+		r.play.clear();
+		r.error = bench_file( opt, r );
+		if ( r.error )
+		{
+			errors++;
+			fprintf( stderr, "error: %s\n", r.error );
+		}
+		else
+		{
+			fprintf( stderr, "%6.1fx real time\n",
+					per_sec( (double) r.play_samples, r.play.seconds ) / (opt.sample_rate * 2.0) );
+		}
+	}
+
+	FILE* out = stdout;
+	if ( strcmp( opt.out_path, "-" ) )
+		out = fopen( opt.out_path, "w" );
+	if ( !out )
+	{
+		fprintf( stderr, "Couldn't write %s\n", opt.out_path );
+		return EXIT_FAILURE;
+	}
+	write_results( out, opt, results, count );
+	if ( out != stdout )
+		fclose( out );
+
+	int failed = errors;
+	if ( opt.baseline_path )
+		failed |= compare( opt, results, count );
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+// Renders every synthetic file and test.nsf under several settings and compares
+// hashes of the output with golden digests, so that optimizations can be
+// checked for unchanged output.
+
+// Usage: gme_golden [-u] [-g path] [-p dir] [name ...]
+//  -u          write new digests instead of checking
+//  -g path     digests file (default golden.txt in source directory)
+//  -p dir      directory for reference output (default build directory)
+//  name        only check these files (see Synth_Files.cpp)
+
+// Output is hashed in blocks, so the digests alone only tell which block first
+// differs. To find the exact sample, output that matches its digests is saved as
+// reference output, then compared with sample by sample after a mismatch. Without
+// reference output, only the block is reported.
+
+// Each voice is also rendered alone, so the voices involved can be reported.
+
+// Floating-point differences between platforms (filter setup, resampler
+// coefficients) can change output, so digests are only meaningful for the
+// platform they were made on.
+
+#include "gme/gme.h"
+#include "Synth_Files.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#ifndef GME_GOLDEN_PATH
+	#define GME_GOLDEN_PATH "golden.txt"
+#endif
+
+#ifndef GME_TEST_NSF_PATH
+	#define GME_TEST_NSF_PATH "test.nsf"
+#endif
+
+#ifndef GME_GOLDEN_REF_DIR
+	#define GME_GOLDEN_REF_DIR "."
+#endif
+
+int const render_msec = 2000;
+int const block_size  = 4096; // samples per hash
+
+struct config_t
+{
+	const char* name;
+	int sample_rate;
+	double tempo;
+	int mute_mask;
+	int accuracy;
+	int set_eq;
+	double treble;
+	double bass;
+	double stereo_depth;
+};
+
+static config_t const configs [] = {
+	//  name        rate  tempo  mute acc eq treble bass depth
+	{ "default",   44100, 1.0,   0x00, 0, 0,   0,    0, 0.0 },
+	{ "accurate",  48000, 1.0,   0x00, 1, 0,   0,    0, 0.0 },
+	{ "fast",      22050, 1.5,   0x00, 0, 0,   0,    0, 0.0 },
+	{ "slow",      96000, 0.75,  0x00, 0, 0,   0,    0, 0.0 },
+	{ "mute1",     44100, 1.0,   0x01, 0, 0,   0,    0, 0.0 },
+	{ "mute_odd",  32000, 1.0,   0xAA, 1, 0,   0,    0, 0.0 },
+	{ "eq",        44100, 1.0,   0x00, 0, 1, -14,   80, 0.0 },
+	{ "stereo",    44100, 1.0,   0x00, 0, 0,   0,    0, 0.8 },
+};
+int const config_count = sizeof configs / sizeof *configs;
+
+struct input_t
+{
+	const char* name;
+	synth_data_t data;
+	gme_type_t type;
+};
+
+// 32-bit FNV-1a over samples as little-endian bytes
+static unsigned long hash_samples( short const* in, int count, unsigned long h )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+		h = ((h ^ (in [i] & 0xFF)) * 16777619) & 0xFFFFFFFF;
+		h = ((h ^ (in [i] >> 8 & 0xFF)) * 16777619) & 0xFFFFFFFF;
+	}
+	return h;
+}
+
+unsigned long const hash_start = 2166136261UL;
+
+// Renders input under config with given muting mask. Appends hash of each block
+// to out, or one hash of everything if whole is true. Appends samples to pcm if
+// not NULL.
+static const char* render( input_t const& in, config_t const& c, int mute_mask,
+		bool whole, std::string& out, std::vector<short>* pcm = NULL )
+{
+	Music_Emu* emu = gme_new_emu( in.type, c.sample_rate );
+	if ( !emu )
+		return "Out of memory";
+
+	gme_err_t err = gme_load_data( emu, &in.data [0], (long) in.data.size() );
+	if ( !err )
+	{
+		gme_set_tempo( emu, c.tempo );
+		gme_enable_accuracy( emu, c.accuracy );
+		gme_set_stereo_depth( emu, c.stereo_depth );
+		gme_mute_voices( emu, mute_mask );
+		if ( c.set_eq )
+		{
+			gme_equalizer_t eq;
+			gme_equalizer( emu, &eq );
+			eq.treble = c.treble;
+			eq.bass   = c.bass;
+			gme_set_equalizer( emu, &eq );
+		}
+		err = gme_start_track( emu, 0 );
+	}
+
+	static short buf [block_size];
+	long remain = (long) c.sample_rate * 2 * render_msec / 1000;
+	unsigned long h = hash_start;
+	while ( !err && remain > 0 )
+	{
+		int n = (remain < block_size ? (int) remain : block_size);
+		err = gme_play( emu, n, buf );
+		remain -= n;
+		if ( pcm )
+			pcm->insert( pcm->end(), buf, buf + n );
+
+		if ( !whole )
+			h = hash_start;
+		h = hash_samples( buf, n, h );
+		if ( !whole || remain <= 0 )
+		{
+			char str [16];
+			sprintf( str, " %08lx", h );
+			out += str;
+		}
+	}
+
+	gme_delete( emu );
+	return err;
+}
+
+// Digests
+
+typedef std::map<std::string,std::string> digests_t;
+
+static bool read_digests( const char* path, digests_t& out )
+{
+	FILE* in = fopen( path, "r" );
+	if ( !in )
+		return false;
+
+	std::string line;
+	int c;
+	while ( (c = getc( in )) != EOF )
+	{
+		if ( c != '\n' )
+		{
+			if ( c != '\r' )
+				line += (char) c;
+			continue;
+		}
+
+		// "name config kind" followed by hashes
+		if ( !line.empty() && line [0] != '#' )
+		{
+			std::string::size_type end = line.find( ' ' );
+			if ( end != line.npos )
+				end = line.find( ' ', end + 1 );
+			if ( end != line.npos )
+				end = line.find( ' ', end + 1 );
+			if ( end != line.npos )
+				out [line.substr( 0, end )] = line.substr( end );
+		}
+		line.clear();
+	}
+	fclose( in );
+	return true;
+}
+
+// Index of first differing hash, or -1 if same
+static int first_difference( std::string const& a, std::string const& b )
+{
+	int const hash_len = 9; // " %08lx"
+	for ( int i = 0; ; i++ )
+	{
+		std::string::size_type pos = (std::string::size_type) i * hash_len;
+		if ( pos >= a.size() && pos >= b.size() )
+			return -1;
+		if ( a.compare( pos, hash_len, b, pos, hash_len ) )
+			return i;
+	}
+}
+
+// Reference output
+
+// Reference output file holds hash of the digests it matched, then samples as
+// little-endian 16-bit values
+static std::string ref_path( const char* dir, std::string const& key )
+{
+	std::string path = std::string( dir ) + "/golden-";
+	for ( std::string::size_type i = 0; i < key.size(); i++ )
+		path += (key [i] == ' ' ? '-' : key [i]);
+	return path + ".pcm";
+}
+
+static unsigned long hash_digests( std::string const& digests )
+{
+	unsigned long h = hash_start;
+	for ( std::string::size_type i = 0; i < digests.size(); i++ )
+		h = ((h ^ (unsigned char) digests [i]) * 16777619) & 0xFFFFFFFF;
+	return h;
+}
+
+// Opens reference output and returns true if it was saved for the given digests
+static bool open_ref( std::string const& path, unsigned long digests_hash, FILE** out )
+{
+	*out = fopen( path.c_str(), "rb" );
+	char header [10] = { 0 }; // "%08lx\n"
+	if ( *out && fread( header, 1, 9, *out ) == 9 && header [8] == '\n' &&
+			strtoul( header, NULL, 16 ) == digests_hash )
+		return true;
+	if ( *out )
+		fclose( *out );
+	*out = NULL;
+	return false;
+}
+
+// Saves output that matched digests, unless already saved
+static void save_ref( std::string const& path, std::string const& digests,
+		std::vector<short> const& pcm )
+{
+	unsigned long h = hash_digests( digests );
+	FILE* file;
+	if ( open_ref( path, h, &file ) )
+	{
+		fclose( file );
+		return;
+	}
+
+	file = fopen( path.c_str(), "wb" );
+	if ( !file )
+		return;
+	fprintf( file, "%08lx\n", h );
+	for ( size_t i = 0; i < pcm.size(); i++ )
+	{
+		putc( pcm [i] & 0xFF, file );
+		putc( pcm [i] >> 8 & 0xFF, file );
+	}
+	if ( fclose( file ) )
+		remove( path.c_str() );
+}
+
+// Index of first sample that differs from reference output saved for digests,
+// or -1 if there isn't any
+static long first_different_sample( std::string const& path, std::string const& digests,
+		std::vector<short> const& pcm )
+{
+	FILE* file;
+	if ( !open_ref( path, hash_digests( digests ), &file ) )
+		return -1;
+
+	long i = 0;
+	int lo;
+	while ( (size_t) i < pcm.size() && (lo = getc( file )) != EOF )
+	{
+		int hi = getc( file );
+		if ( hi == EOF || (short) (hi << 8 | lo) != pcm [i] )
+			break;
+		i++;
+	}
+	fclose( file );
+	return i;
+}
+
+static bool selected( const char* name, int argc, char** argv )
+{
+	if ( !argc )
+		return true;
+	for ( int i = 0; i < argc; i++ )
+		if ( !strcmp( name, argv [i] ) )
+			return true;
+	return false;
+}
+
+static bool load_file( const char* path, synth_data_t& out )
+{
+	FILE* in = fopen( path, "rb" );
+	if ( !in )
+		return false;
+	int c;
+	while ( (c = getc( in )) != EOF )
+		out.push_back( (unsigned char) c );
+	fclose( in );
+	return !out.empty();
+}
+
+int main( int argc, char** argv )
+{
+	bool update = false;
+	const char* golden_path = GME_GOLDEN_PATH;
+	const char* ref_dir = GME_GOLDEN_REF_DIR;
+
+	int i = 1;
+	for ( ; i < argc && argv [i] [0] == '-'; i++ )
+	{
+		if ( !strcmp( argv [i], "-u" ) )
+		{
+			update = true;
+		}
+		else if ( !strcmp( argv [i], "-g" ) && i + 1 < argc )
+		{
+			golden_path = argv [++i];
+		}
+		else if ( !strcmp( argv [i], "-p" ) && i + 1 < argc )
+		{
+			ref_dir = argv [++i];
+		}
+		else
+		{
+			fprintf( stderr, "Unknown option %s\n", argv [i] );
+			return EXIT_FAILURE;
+		}
+	}
+	int name_count = argc - i;
+	char** names = argv + i;
+
+	// Inputs
+	static input_t inputs [64];
+	int input_count = 0;
+	for ( synth_file_t const* f = synth_files; f->name && input_count < 63; f++ )
+	{
+		gme_type_t type = gme_identify_extension( f->extension );
+		if ( !type || !selected( f->name, name_count, names ) )
+			continue;
+		input_t& in = inputs [input_count++];
+		in.name = f->name;
+		in.type = type;
+		f->make( in.data );
+	}
+	if ( selected( "test_nsf", name_count, names ) )
+	{
+		input_t& in = inputs [input_count];
+		in.name = "test_nsf";
+		in.type = gme_identify_extension( "NSF" );
+		if ( in.type && load_file( GME_TEST_NSF_PATH, in.data ) )
+			input_count++;
+		else
+			fprintf( stderr, "Skipping %s\n", GME_TEST_NSF_PATH );
+	}
+
+	digests_t golden;
+	if ( !update && !read_digests( golden_path, golden ) )
+	{
+		fprintf( stderr, "Couldn't read %s\n", golden_path );
+		return EXIT_FAILURE;
+	}
+
+	FILE* out = NULL;
+	if ( update )
+	{
+		out = fopen( golden_path, "w" );
+		if ( !out )
+		{
+			fprintf( stderr, "Couldn't write %s\n", golden_path );
+			return EXIT_FAILURE;
+		}
+		fprintf( out, "# Digests for gme_golden. Regenerate with gme_golden -u only when\n"
+				"# output is meant to change.\n" );
+	}
+
+	int checked = 0;
+	int failed  = 0;
+	for ( int n = 0; n < input_count; n++ )
+	{
+		input_t const& in = inputs [n];
+		for ( int k = 0; k < config_count; k++ )
+		{
+			config_t const& c = configs [k];
+			std::string key = std::string( in.name ) + " " + c.name;
+			std::string blocks;
+			std::vector<short> pcm;
+			const char* err = render( in, c, c.mute_mask, false, blocks, &pcm );
+			if ( err )
+			{
+				fprintf( stderr, "%s: error: %s\n", key.c_str(), err );
+				failed++;
+				continue;
+			}
+
+			if ( update )
+			{
+				// voices are only rendered alone when writing digests or
+				// after a mismatch
+				std::string voices;
+				Music_Emu* emu = NULL;
+				gme_open_data( &in.data [0], (long) in.data.size(), &emu, c.sample_rate );
+				int voice_count = emu ? gme_voice_count( emu ) : 0;
+				gme_delete( emu );
+				for ( int v = 0; v < voice_count && !err; v++ )
+					err = render( in, c, ~(1 << v), true, voices );
+
+				fprintf( out, "%s blocks%s\n", key.c_str(), blocks.c_str() );
+				fprintf( out, "%s voices%s\n", key.c_str(), voices.c_str() );
+				save_ref( ref_path( ref_dir, key ), blocks, pcm );
+				checked++;
+				continue;
+			}
+
+			checked++;
+			digests_t::const_iterator expected = golden.find( key + " blocks" );
+			if ( expected == golden.end() )
+			{
+				fprintf( stderr, "%s: no digest\n", key.c_str() );
+				failed++;
+				continue;
+			}
+
+			int block = first_difference( blocks, expected->second );
+			if ( block < 0 )
+			{
+				save_ref( ref_path( ref_dir, key ), blocks, pcm );
+				continue;
+			}
+			failed++;
+
+			// samples are interleaved left and right
+			long offset = first_different_sample( ref_path( ref_dir, key ), expected->second, pcm );
+			if ( offset >= 0 )
+				fprintf( stderr, "%s: differs at sample %ld (%.3f sec) of %s channel",
+						key.c_str(), offset / 2, offset / 2.0 / c.sample_rate,
+						(offset & 1) ? "right" : "left" );
+			else
+				fprintf( stderr, "%s: differs in block starting at sample %ld (%.3f sec)",
+						key.c_str(), (long) block * block_size / 2,
+						(double) block * block_size / 2 / c.sample_rate );
+
+			// find voices that differ when played alone
+			std::string voices;
+			digests_t::const_iterator expected_voices = golden.find( key + " voices" );
+			Music_Emu* emu = NULL;
+			gme_open_data( &in.data [0], (long) in.data.size(), &emu, c.sample_rate );
+			int voice_count = emu ? gme_voice_count( emu ) : 0;
+			for ( int v = 0; v < voice_count; v++ )
+			{
+				voices.clear();
+				if ( render( in, c, ~(1 << v), true, voices ) )
+					continue;
+				int const hash_len = 9;
+				if ( expected_voices == golden.end() ||
+						expected_voices->second.compare( v * hash_len, hash_len, voices ) )
+					fprintf( stderr, ", voice %d (%s)", v, gme_voice_name( emu, v ) );
+			}
+			gme_delete( emu );
+			fprintf( stderr, "\n" );
+		}
+	}
+
+	if ( out )
+	{
+		fclose( out );
+		fprintf( stderr, "Wrote %d digests to %s\n", checked, golden_path );
+		return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	fprintf( stderr, "%d of %d renders differ\n", failed, checked );
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,6 +2,9 @@
 
 #include "Ay_Apu.h"
 
+#include "blargg_lfsr.h"
+#include "blargg_state.h"
+
 /* Copyright (C) 2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -16,7 +19,6 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 #include "blargg_source.h"
 
 // Emulation inaccuracies:
-// * Noise isn't run when not in use
 // * Changes to envelope and noise periods are delayed until next reload
 // * Super-sonic tone should attenuate output to about 60%, not 50%
 
@@ -117,6 +119,30 @@ void Ay_Apu::reset()
 	write_data_( 13, 0 );
 }
 
+void Ay_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		osc_t& osc = oscs [i];
+		copier( osc.period );
+		copier( osc.delay );
+		copier( osc.last_amp );
+		copier( osc.phase );
+	}
+	copier( regs );
+	
+	copier( noise.delay );
+	copier( noise.lfsr );
+	
+	int wave = env.wave - env.modes [0];
+	copier( wave );
+	env.wave = env.modes [0] + wave;
+	copier( env.delay );
+	copier( env.pos );
+	
+	copier( last_time );
+}
+
 void Ay_Apu::write_data_( int addr, int data )
 {
 	assert( (unsigned) addr < reg_count );
@@ -161,8 +187,21 @@ void Ay_Apu::write_data_( int addr, int data )
 int const noise_off = 0x08;
 int const tone_off  = 0x01;
 
+static blargg_ulong noise_step( blargg_ulong lfsr )
+{
+	return ((0 - (lfsr & 1)) & 0x12000) ^ (lfsr >> 1);
+}
+
+// Noise LFSR after count steps, without running them one at a time
+static blargg_ulong jump_noise( blargg_ulong lfsr, blargg_long count )
+{
+	static Blargg_Lfsr_Jump const noise_jump( noise_step, 17 ); // built on first use
+	return noise_jump.run( lfsr, count );
+}
+
 void Ay_Apu::run_until( blip_time_t final_end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	require( final_end_time >= last_time );
 	
 	// noise period and initial values
@@ -172,6 +211,7 @@ void Ay_Apu::run_until( blip_time_t final_end_time )
 		noise_period = noise_period_factor;
 	blip_time_t const old_noise_delay = noise.delay;
 	blargg_ulong const old_noise_lfsr = noise.lfsr;
+	int noise_used = false;
 	
 	// envelope period
 	blip_time_t const env_period_factor = period_factor * 2; // verified
@@ -190,7 +230,10 @@ void Ay_Apu::run_until( blip_time_t final_end_time )
 		// output
 		Blip_Buffer* const osc_output = osc->output;
 		if ( !osc_output )
+		{
+			GME_STATS_IDLE( ay, final_end_time - last_time );
 			continue;
+		}
 		osc_output->set_modified();
 		
 		// period
@@ -225,11 +268,13 @@ void Ay_Apu::run_until( blip_time_t final_end_time )
 			else if ( !volume )
 			{
 				osc_mode = noise_off | tone_off;
+				GME_STATS_IDLE( ay, final_end_time - start_time );
 			}
 		}
 		else if ( !volume )
 		{
 			osc_mode = noise_off | tone_off;
+			GME_STATS_IDLE( ay, final_end_time - start_time );
 		}
 		
 		// tone time
@@ -371,7 +416,22 @@ void Ay_Apu::run_until( blip_time_t final_end_time )
 		{
 			noise.delay = ntime - final_end_time;
 			noise.lfsr = noise_lfsr;
+			noise_used = true;
+		}
+	}
+	
+	// keep noise running while no channel uses it
+	if ( !noise_used )
+	{
+		blip_time_t ntime = last_time + old_noise_delay;
+		blip_time_t remain = final_end_time - ntime;
+		if ( remain >= 0 ) // advance *past* end time, as above
+		{
+			blargg_long count = remain / noise_period + 1;
+			noise.lfsr = jump_noise( old_noise_lfsr, count );
+			ntime += count * noise_period;
 		}
+		noise.delay = ntime - final_end_time;
 	}
 	
 	// TODO: optimized saw wave envelope?
@@ -7,6 +7,8 @@
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
 
+class Blargg_State_Copier;
+
 class Ay_Apu {
 public:
 	// Set buffer to generate all sound into, or disable sound if NULL
@@ -37,6 +39,9 @@ public:
 	// Set treble equalization (see documentation)
 	void treble_eq( blip_eq_t const& );
 	
+	// Copy exact emulation state to/from saved state (see blargg_state.h)
+	void copy_state( Blargg_State_Copier& );
+	
 public:
 	Ay_Apu();
 	typedef unsigned char byte;
@@ -78,6 +83,7 @@ inline void Ay_Apu::treble_eq( blip_eq_t const& eq ) { synth_.treble_eq( eq ); }
 
 inline void Ay_Apu::write( blip_time_t time, int addr, int data )
 {
+	GME_STATS_WRITE( ay );
 	run_until( time );
 	write_data_( addr, data );
 }
@@ -3,6 +3,7 @@
 #include "Ay_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
@@ -272,6 +273,36 @@ blargg_err_t Ay_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Ay_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	RETURN_ERR( copy_buffer_state( copier ) );
+	
+	if ( copier.loading() )
+		cpu::reset( mem.ram );
+	copier( r );
+	cpu_time_t time = this->time();
+	copier( time );
+	set_time( time );
+	copier( mem );
+	
+	copier( next_play );
+	copier( beeper_delta );
+	copier( last_beeper );
+	copier( apu_addr );
+	copier( cpc_latch );
+	copier( spectrum_mode );
+	copier( cpc_mode );
+	if ( copier.loading() )
+	{
+		change_clock_rate( cpc_mode ? cpc_clock : spectrum_clock );
+		set_tempo( tempo() );
+	}
+	
+	apu.copy_state( copier );
+	
+	return 0;
+}
+
 // Emulation
 
 void Ay_Emu::cpu_out_misc( cpu_time_t time, unsigned addr, int data )
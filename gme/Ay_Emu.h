@@ -43,6 +43,7 @@ protected:
 	void set_tempo_( double );
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
+	blargg_err_t copy_state_( Blargg_State_Copier& );
 private:
 	file_t file;
 	
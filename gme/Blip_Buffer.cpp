@@ -37,6 +37,7 @@ Blip_Buffer::Blip_Buffer()
 	clock_rate_   = 0;
 	bass_freq_    = 16;
 	length_       = 0;
+	fanout_       = 0;
 	
 	// assumptions code makes about implementation-defined features
 	#ifndef NDEBUG
@@ -86,6 +86,7 @@ public:
 	// not documented yet
 	void set_modified() { modified_ = 1; }
 	int clear_modified() { int b = modified_; modified_ = 0; return b; }
+	int modified() const { return modified_; }
 	typedef blip_ulong blip_resampled_time_t;
 	void remove_silence( long count );
 	blip_resampled_time_t resampled_duration( int t ) const     { return t * factor_; }
@@ -111,6 +112,11 @@ public:
 	blip_long buffer_size_;
 	blip_long reader_accum_;
 	int bass_shift_;
+	
+	// Next of a chain of buffers with the same clock rate but different sample
+	// rates, which also receive everything Blip_Synth adds to this one, or NULL.
+	// See Multi_Rate_Buffer.
+	Blip_Buffer* fanout_;
 private:
 	long sample_rate_;
 	long clock_rate_;
@@ -124,6 +130,8 @@ private:
 	#include "config.h"
 #endif
 
+#include "Gme_Stats.h"
+
 // Number of bits in resample ratio fraction. Higher values give a more accurate ratio
 // but reduce maximum buffer size.
 #ifndef BLIP_BUFFER_ACCURACY
@@ -222,6 +230,8 @@ public:
 	}
 	
 private:
+	void add_resampled( blip_resampled_time_t, int delta, Blip_Buffer* ) const;
+	void fan_out( blip_resampled_time_t, int delta, Blip_Buffer const* ) const;
 #if BLIP_BUFFER_FAST
 	Blip_Synth_Fast_ impl;
 #else
@@ -334,12 +344,13 @@ private:
 #include <assert.h>
 
 template<int quality,int range>
-inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t time,
+inline void Blip_Synth<quality,range>::add_resampled( blip_resampled_time_t time,
 		int delta, Blip_Buffer* blip_buf ) const
 {
 	// Fails if time is beyond end of Blip_Buffer, due to a bug in caller code or the
 	// need for a longer buffer as set by set_sample_rate().
 	assert( (blip_long) (time >> BLIP_BUFFER_ACCURACY) < blip_buf->buffer_size_ );
+	GME_STATS_ADD( impulses, 1 );
 	delta *= impl.delta_factor;
 	blip_long* BLIP_RESTRICT buf = blip_buf->buffer_ + (time >> BLIP_BUFFER_ACCURACY);
 	int phase = (int) (time >> (BLIP_BUFFER_ACCURACY - BLIP_PHASE_BITS) & (blip_res - 1));
@@ -443,6 +454,27 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 #undef BLIP_FWD
 #undef BLIP_REV
 
+template<int quality,int range>
+inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t time,
+		int delta, Blip_Buffer* blip_buf ) const
+{
+	add_resampled( time, delta, blip_buf );
+	if ( blip_buf->fanout_ )
+		fan_out( time, delta, blip_buf );
+}
+
+// Converts time from the start of first buffer's frame to each of the others' rates
+// directly, so that rounding doesn't accumulate along the chain
+template<int quality,int range>
+void Blip_Synth<quality,range>::fan_out( blip_resampled_time_t time, int delta,
+		Blip_Buffer const* first ) const
+{
+	unsigned long long elapsed = time - first->offset_;
+	for ( Blip_Buffer* b = first->fanout_; b; b = b->fanout_ )
+		add_resampled( (blip_resampled_time_t) (elapsed * b->factor_ / first->factor_) +
+				b->offset_, delta, b );
+}
+
 template<int quality,int range>
 #if BLIP_BUFFER_FAST
 	inline
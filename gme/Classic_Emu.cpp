@@ -22,17 +22,28 @@ Classic_Emu::Classic_Emu()
 {
 	buf           = 0;
 	stereo_buffer = 0;
+	rates_buffer  = 0;
+	single_buf    = 0;
 	voice_types   = 0;
 	
 	// avoid inconsistency in our duplicated constants
 	assert( (int) wave_type  == (int) Multi_Buffer::wave_type );
 	assert( (int) noise_type == (int) Multi_Buffer::noise_type );
 	assert( (int) mixed_type == (int) Multi_Buffer::mixed_type );
+	assert( (int) max_extra_rates == (int) Multi_Rate_Buffer::max_extra_rates );
 }
 
 Classic_Emu::~Classic_Emu()
 {
 	delete stereo_buffer;
+	delete rates_buffer;
+}
+
+void Classic_Emu::unload()
+{
+	if ( rates_buffer && buf == rates_buffer )
+		buf = single_buf; // extra rates are removed by loading
+	Music_Emu::unload();
 }
 
 void Classic_Emu::set_equalizer_( equalizer_t const& eq )
@@ -88,6 +99,44 @@ blargg_err_t Classic_Emu::setup_buffer( long rate )
 	return 0;
 }
 
+void Classic_Emu::clear_buffer() { buf->clear(); }
+
+blargg_err_t Classic_Emu::copy_buffer_state( Blargg_State_Copier& copier ) { return buf->copy_state( copier ); }
+
+blargg_err_t Classic_Emu::set_extra_rates_( long const* rates, int count )
+{
+	if ( rates_buffer && buf == rates_buffer )
+		buf = single_buf;
+	if ( count )
+	{
+		// replaces custom buffer too, since it can't fan out
+		if ( !rates_buffer )
+		{
+			CHECK_ALLOC( rates_buffer = BLARGG_NEW Multi_Rate_Buffer );
+			RETURN_ERR( rates_buffer->set_sample_rate( buf->sample_rate(), buf->length() ) );
+		}
+		RETURN_ERR( rates_buffer->set_extra_rates( rates, count ) );
+		single_buf = buf;
+		buf = rates_buffer;
+	}
+	
+	// voices must be given new buffer's channels
+	RETURN_ERR( setup_buffer( clock_rate_ ) );
+	remute_voices();
+	buf->clear();
+	return 0;
+}
+
+long Classic_Emu::extra_avail_( int index, long pending ) const
+{
+	return (buf == rates_buffer ? rates_buffer->extra_avail( index, pending ) : 0);
+}
+
+long Classic_Emu::read_extra_( int index, long count, sample_t* out )
+{
+	return (buf == rates_buffer ? rates_buffer->read_extra( index, out, count ) : 0);
+}
+
 blargg_err_t Classic_Emu::start_track_( int track )
 {
 	RETURN_ERR( Music_Emu::start_track_( track ) );
@@ -100,7 +149,10 @@ blargg_err_t Classic_Emu::play_( long count, sample_t* out )
 	long remain = count;
 	while ( remain )
 	{
-		remain -= buf->read_samples( &out [count - remain], remain );
+		{
+			GME_STATS_STAGE( gme_stage_mix );
+			remain -= buf->read_samples( &out [count - remain], remain );
+		}
 		if ( remain )
 		{
 			if ( buf_changed_count != buf->channels_changed_count() )
@@ -110,8 +162,13 @@ blargg_err_t Classic_Emu::play_( long count, sample_t* out )
 			}
 			int msec = buf->length();
 			blip_time_t clocks_emulated = (blargg_long) msec * clock_rate_ / 1000;
-			RETURN_ERR( run_clocks( clocks_emulated, msec ) );
+			{
+				GME_STATS_STAGE( gme_stage_cpu );
+				RETURN_ERR( run_clocks( clocks_emulated, msec ) );
+			}
 			assert( clocks_emulated );
+			GME_STATS_ADD( clocks, clocks_emulated );
+			GME_STATS_STAGE( gme_stage_mix );
 			buf->end_frame( clocks_emulated );
 		}
 	}
@@ -120,16 +177,53 @@ blargg_err_t Classic_Emu::play_( long count, sample_t* out )
 
 // Rom_Data
 
+Rom_Data_::Rom_Data_()
+{
+	shared = 0;
+	clear_();
+}
+
+Rom_Data_::~Rom_Data_()
+{
+	if ( shared )
+		shared->release();
+}
+
+void Rom_Data_::clear_()
+{
+	if ( shared )
+		shared->release();
+	shared     = 0;
+	image      = rom.begin();
+	image_size = 0;
+	file_size_ = 0;
+	size_      = 0;
+}
+
 blargg_err_t Rom_Data_::load_rom_data_( Data_Reader& in,
-		int header_size, void* header_out, int fill, long pad_size )
+		int header_size, void* header_out, int fill, long pad_size, Shared_Rom* src )
 {
 	long file_offset = pad_size - header_size;
 	
+	clear_();
 	rom_addr = 0;
 	mask     = 0;
-	size_    = 0;
-	rom.clear();
 	
+	if ( src )
+	{
+		check( in.remain() == src->size() );
+		file_size_ = src->size();
+		if ( file_size_ <= header_size )
+			return gme_wrong_file_type;
+		RETURN_ERR( src->padded_image( header_size, fill, pad_size, &shared ) );
+		memcpy( header_out, src->data(), header_size );
+		file_size_ -= header_size;
+		image      = shared->data();
+		image_size = shared->size();
+		return 0;
+	}
+	
+	// resize() reuses any allocation left over from the previous file
 	file_size_ = in.remain();
 	if ( file_size_ <= header_size ) // <= because there must be data after header
 		return gme_wrong_file_type;
@@ -139,6 +233,7 @@ blargg_err_t Rom_Data_::load_rom_data_( Data_Reader& in,
 	if ( err )
 	{
 		rom.clear();
+		clear_();
 		return err;
 	}
 	
@@ -148,6 +243,9 @@ blargg_err_t Rom_Data_::load_rom_data_( Data_Reader& in,
 	memset( rom.begin()         , fill, pad_size );
 	memset( rom.end() - pad_size, fill, pad_size );
 	
+	image      = rom.begin();
+	image_size = rom.size();
+	
 	return 0;
 }
 
@@ -172,7 +270,16 @@ void Rom_Data_::set_addr_( long addr, int unit )
 	if ( addr < 0 )
 		addr = 0;
 	size_ = rounded;
-	if ( rom.resize( rounded - rom_addr + pad_extra ) ) { } // OK if shrink fails
+	
+	// shrink to end of last page; a shared image is left as is
+	long new_size = rounded - rom_addr + pad_extra;
+	if ( new_size < image_size )
+		image_size = new_size;
+	if ( !shared )
+	{
+		if ( rom.resize( image_size ) ) { } // OK if shrink fails
+		image = rom.begin();
+	}
 
 	if ( 0 )
 	{
@@ -7,6 +7,8 @@
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
 #include "Music_Emu.h"
+#include "Shared_Rom.h"
+class Multi_Rate_Buffer;
 
 class Classic_Emu : public Music_Emu {
 public:
@@ -20,6 +22,8 @@ protected:
 	blargg_err_t setup_buffer( long clock_rate );
 	long clock_rate() const { return clock_rate_; }
 	void change_clock_rate( long ); // experimental
+	void clear_buffer(); // discard buffered samples, i.e. when restoring saved state
+	blargg_err_t copy_buffer_state( Blargg_State_Copier& ); // buffered samples, for copy_state_()
 	
 	// Overridable
 	virtual void set_voice( int index, Blip_Buffer* center,
@@ -32,9 +36,15 @@ protected:
 	void mute_voices_( int );
 	void set_equalizer_( equalizer_t const& );
 	blargg_err_t play_( long, sample_t* );
+	blargg_err_t set_extra_rates_( long const*, int );
+	long extra_avail_( int, long ) const;
+	long read_extra_( int, long, sample_t* );
+	void unload();
 private:
 	Multi_Buffer* buf;
 	Multi_Buffer* stereo_buffer; // NULL if using custom buffer
+	Multi_Rate_Buffer* rates_buffer; // replaces buf while extra rates are used
+	Multi_Buffer* single_buf;        // buf replaced by rates_buffer
 	long clock_rate_;
 	unsigned buf_changed_count;
 	int const* voice_types;
@@ -49,21 +59,29 @@ inline void Classic_Emu::set_buffer( Multi_Buffer* new_buf )
 // ROM data handler, used by several Classic_Emu derivitives. Loads file data
 // with padding on both sides, allowing direct use in bank mapping. The main purpose
 // is to allow all file data to be loaded with only one read() call (for efficiency).
+// When loading from a Shared_Rom, uses a padded image shared with other emulators
+// instead of making a copy.
 
 class Rom_Data_ {
 public:
 	typedef unsigned char byte;
 protected:
 	enum { pad_extra = 8 };
-	blargg_vector<byte> rom;
+	blargg_vector<byte> rom; // private image; allocation is kept for reuse
+	Shared_Rom* shared;      // shared image used instead of rom, or NULL
+	byte const* image;       // rom.begin() or shared image
+	long image_size;
 	long file_size_;
 	blargg_long rom_addr;
 	blargg_long mask;
 	blargg_long size_; // TODO: eliminate
 	
+	Rom_Data_();
+	~Rom_Data_();
 	blargg_err_t load_rom_data_( Data_Reader& in, int header_size, void* header_out,
-			int fill, long pad_size );
+			int fill, long pad_size, Shared_Rom* );
 	void set_addr_( long addr, int unit );
+	void clear_();
 };
 
 template<int unit>
@@ -71,29 +89,32 @@ class Rom_Data : public Rom_Data_ {
 	enum { pad_size = unit + pad_extra };
 public:
 	// Load file data, using already-loaded header 'h' if not NULL. Copy header
-	// from loaded file data into *out and fill unmapped bytes with 'fill'.
-	blargg_err_t load( Data_Reader& in, int header_size, void* header_out, int fill )
+	// from loaded file data into *out and fill unmapped bytes with 'fill'. If
+	// 'src' isn't NULL, 'in' must be reading its data, and the padded image
+	// is shared with other emulators loading it.
+	blargg_err_t load( Data_Reader& in, int header_size, void* header_out, int fill,
+			Shared_Rom* src = 0 )
 	{
-		return load_rom_data_( in, header_size, header_out, fill, pad_size );
+		return load_rom_data_( in, header_size, header_out, fill, pad_size, src );
 	}
 	
 	// Size of file data read in (excluding header)
 	long file_size() const { return file_size_; }
 	
 	// Pointer to beginning of file data
-	byte* begin() const { return rom.begin() + pad_size; }
+	byte const* begin() const { return image + pad_size; }
 	
 	// Set address that file data should start at
 	void set_addr( long addr ) { set_addr_( addr, unit ); }
 	
-	// Free data
-	void clear() { rom.clear(); }
+	// Forget data. Allocation is kept so that the next load() can reuse it.
+	void clear() { clear_(); }
 	
 	// Size of data + start addr, rounded to a multiple of unit
 	long size() const { return size_; }
 	
 	// Pointer to unmapped page filled with same value
-	byte* unmapped() { return rom.begin(); }
+	byte const* unmapped() const { return image; }
 	
 	// Mask address to nearest power of two greater than size()
 	blargg_long mask_addr( blargg_long addr ) const
@@ -105,12 +126,12 @@ public:
 	}
 	
 	// Pointer to page starting at addr. Returns unmapped() if outside data.
-	byte* at_addr( blargg_long addr )
+	byte const* at_addr( blargg_long addr ) const
 	{
 		blargg_ulong offset = mask_addr( addr ) - rom_addr;
-		if ( offset > blargg_ulong (rom.size() - pad_size) )
+		if ( offset > blargg_ulong (image_size - pad_size) )
 			offset = 0; // unmapped
-		return &rom [offset];
+		return image + offset;
 	}
 };
 
@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if BLARGG_X86_SIMD
+	#include <emmintrin.h>
+#endif
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -55,15 +59,25 @@ void Dual_Resampler::play_frame_( Blip_Buffer& blip_buf, dsample_t* out )
 	blip_time_t blip_time = blip_buf.count_clocks( pair_count );
 	int sample_count = oversamples_per_frame - resampler.written();
 	
-	int new_count = play_frame( blip_time, sample_count, resampler.buffer() );
+	int new_count;
+	{
+		GME_STATS_STAGE( gme_stage_cpu );
+		new_count = play_frame( blip_time, sample_count, resampler.buffer() );
+	}
 	assert( new_count < resampler_size );
+	GME_STATS_ADD( clocks, blip_time );
 	
+	GME_STATS_STAGE( gme_stage_mix );
 	blip_buf.end_frame( blip_time );
 	assert( blip_buf.samples_avail() == pair_count );
 	
 	resampler.write( new_count );
 	
-	long count = resampler.read( sample_buf.begin(), sample_buf_size );
+	long count;
+	{
+		GME_STATS_STAGE( gme_stage_resample );
+		count = resampler.read( sample_buf.begin(), sample_buf_size );
+	}
 	assert( count == (long) sample_buf_size );
 	
 	mix_samples( blip_buf, out );
@@ -102,29 +116,87 @@ void Dual_Resampler::dual_play( long count, dsample_t* out, Blip_Buffer& blip_bu
 	}
 }
 
-void Dual_Resampler::mix_samples( Blip_Buffer& blip_buf, dsample_t* out )
+// Mixes count pairs from in with mono samples s
+static void mix_pairs( Dual_Resampler::dsample_t* out, Dual_Resampler::dsample_t const* in,
+		int const* s, int count )
 {
-	Blip_Reader sn;
-	int bass = sn.begin( blip_buf );
-	const dsample_t* in = sample_buf.begin();
-	
-	for ( int n = sample_buf_size >> 1; n--; )
+	for ( int n = 0; n < count; n++ )
 	{
-		int s = sn.read();
-		blargg_long l = (blargg_long) in [0] * 2 + s;
+		blargg_long l = (blargg_long) in [0] * 2 + s [n];
 		if ( (BOOST::int16_t) l != l )
 			l = 0x7FFF - (l >> 24);
 		
-		sn.next( bass );
-		blargg_long r = (blargg_long) in [1] * 2 + s;
+		blargg_long r = (blargg_long) in [1] * 2 + s [n];
 		if ( (BOOST::int16_t) r != r )
 			r = 0x7FFF - (r >> 24);
 		
 		in += 2;
-		out [0] = l;
-		out [1] = r;
+		out [0] = (Dual_Resampler::dsample_t) l;
+		out [1] = (Dual_Resampler::dsample_t) r;
 		out += 2;
 	}
+}
+
+#if BLARGG_X86_SIMD
+
+// Same as mix_pairs(), four pairs at a time. Blip_Reader samples are within
+// 17 bits, so sums never reach the 24 bits where the clamp above would differ
+// from saturation.
+BLARGG_TARGET( "sse2" )
+static void mix_pairs_sse2( Dual_Resampler::dsample_t* out, Dual_Resampler::dsample_t const* in,
+		int const* s, int count )
+{
+	int n = 0;
+	for ( ; n + 4 <= count; n += 4 )
+	{
+		__m128i pairs = _mm_loadu_si128( (__m128i const*) (in + n * 2) );
+		__m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( pairs, pairs ), 16 );
+		__m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( pairs, pairs ), 16 );
+		__m128i mono = _mm_loadu_si128( (__m128i const*) (s + n) );
+		lo = _mm_add_epi32( _mm_add_epi32( lo, lo ), _mm_unpacklo_epi32( mono, mono ) );
+		hi = _mm_add_epi32( _mm_add_epi32( hi, hi ), _mm_unpackhi_epi32( mono, mono ) );
+		_mm_storeu_si128( (__m128i*) (out + n * 2), _mm_packs_epi32( lo, hi ) );
+	}
+	mix_pairs( out + n * 2, in + n * 2, s + n, count - n );
+}
+
+#endif
+
+void Dual_Resampler::mix_samples( Blip_Buffer& blip_buf, dsample_t* out )
+{
+	Blip_Reader sn;
+	int bass = sn.begin( blip_buf );
+	const dsample_t* in = sample_buf.begin();
+	
+	#if BLARGG_X86_SIMD
+		bool const sse2 = blargg_cpu_has( blargg_cpu_sse2 );
+	#endif
+	
+	// Blip_Reader has to be read one sample at a time, so read a block of
+	// samples first, then mix them in
+	int const block_size = 256;
+	for ( int remain = sample_buf_size >> 1; remain; )
+	{
+		int count = (remain < block_size ? remain : block_size);
+		remain -= count;
+		
+		int s [block_size];
+		for ( int n = 0; n < count; n++ )
+		{
+			s [n] = sn.read();
+			sn.next( bass );
+		}
+		
+		#if BLARGG_X86_SIMD
+			if ( sse2 )
+				mix_pairs_sse2( out, in, s, count );
+			else
+		#endif
+				mix_pairs( out, in, s, count );
+		
+		in += count * 2;
+		out += count * 2;
+	}
 	
 	sn.end( blip_buf );
 }
@@ -2,7 +2,9 @@
 
 #include "Effects_Buffer.h"
 
+#include "blargg_state.h"
 #include <string.h>
+#include <math.h>
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -121,6 +123,28 @@ void Effects_Buffer::clear()
 		bufs [i].clear();
 }
 
+blargg_err_t Effects_Buffer::copy_state( Blargg_State_Copier& copier )
+{
+	if ( copier.loading() )
+		clear();
+	
+	copier( stereo_remain );
+	copier( effect_remain );
+	copier( effects_enabled );
+	copier( reverb_pos );
+	copier( echo_pos );
+	for ( int i = 0; i < buf_count; i++ )
+		copy_blip_state( bufs [i], copier );
+	
+	// echo and reverb are only non-zero if effects were used since clear()
+	if ( effects_enabled && echo_buf.size() )
+	{
+		copier.copy( &echo_buf [0], echo_size * sizeof echo_buf [0] );
+		copier.copy( &reverb_buf [0], reverb_size * sizeof reverb_buf [0] );
+	}
+	return 0;
+}
+
 inline int pin_range( int n, int max, int min = 0 )
 {
 	if ( n < min )
@@ -385,73 +409,226 @@ void Effects_Buffer::mix_stereo( blip_sample_t* out_, blargg_long count )
 	BLIP_READER_END( c, bufs [0] );
 }
 
-void Effects_Buffer::mix_mono_enhanced( blip_sample_t* out_, blargg_long count )
+// Echo and reverb are run over blocks of samples, each split where a ring
+// position wraps around, so that every inner loop works on contiguous memory.
+
+// Largest block whose reverb and echo taps are all older than the samples the
+// block itself writes
+int Effects_Buffer::effects_block() const
 {
-	blip_sample_t* BLIP_RESTRICT out = out_;
-	int const bass = BLIP_READER_BASS( bufs [2] );
-	BLIP_READER_BEGIN( center, bufs [2] );
-	BLIP_READER_BEGIN( sq1, bufs [0] );
-	BLIP_READER_BEGIN( sq2, bufs [1] );
+	int n = max_block;
+	int reverb_l = (reverb_size - chans.reverb_delay_l) >> 1;
+	int reverb_r = (reverb_size + 1 - chans.reverb_delay_r) >> 1;
+	int echo_l = echo_size - chans.echo_delay_l;
+	int echo_r = echo_size - chans.echo_delay_r;
+	if ( n > reverb_l ) n = reverb_l;
+	if ( n > reverb_r ) n = reverb_r;
+	if ( n > echo_l   ) n = echo_l;
+	if ( n > echo_r   ) n = echo_r;
+	return n;
+}
+
+// Number of samples before ring position pos reaches end, stepping by step
+static inline int until_wrap( int pos, int size, int step )
+{
+	return (size - pos + step - 1) / step;
+}
+
+BLARGG_VECTORIZE
+static int max_abs( int const* in, int count )
+{
+	int largest = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		int n = in [i];
+		if ( n < 0 )
+			n = -n;
+		if ( largest < n )
+			largest = n;
+	}
+	return largest;
+}
+
+// Levels for multiplies in reverb and echo loops, as type T
+template<class T>
+struct effect_levels_t {
+	T pan_1_l, pan_1_r, pan_2_l, pan_2_r;
+	T reverb;
+	T echo;
+};
+
+// Taps and out don't wrap during loop, and can be at the same position as out
+// when delay is the whole ring, so they aren't restricted
+template<class T>
+BLARGG_VECTORIZE
+static void run_reverb( int count, int const* BLIP_RESTRICT s1, int const* BLIP_RESTRICT s2,
+		int* BLIP_RESTRICT l, int* BLIP_RESTRICT r, blip_sample_t const* in_l,
+		blip_sample_t const* in_r, blip_sample_t* out, effect_levels_t<T> const& v )
+{
+	T const pan_1_l = v.pan_1_l;
+	T const pan_1_r = v.pan_1_r;
+	T const pan_2_l = v.pan_2_l;
+	T const pan_2_r = v.pan_2_r;
+	T const reverb_level = v.reverb;
+	for ( int i = 0; i < count; i++ )
+	{
+		int new_reverb_l = FMUL( s1 [i], pan_1_l ) + FMUL( s2 [i], pan_2_l ) +
+				l [i] + in_l [i * 2];
+		int new_reverb_r = FMUL( s1 [i], pan_1_r ) + FMUL( s2 [i], pan_2_r ) +
+				r [i] + in_r [i * 2];
+		out [i * 2    ] = (blip_sample_t) FMUL( new_reverb_l, reverb_level );
+		out [i * 2 + 1] = (blip_sample_t) FMUL( new_reverb_r, reverb_level );
+		l [i] = new_reverb_l;
+		r [i] = new_reverb_r;
+	}
+}
+
+template<class T>
+BLARGG_VECTORIZE
+static void run_echo( int count, int const* BLIP_RESTRICT c, int* BLIP_RESTRICT l,
+		int* BLIP_RESTRICT r, blip_sample_t const* in_l, blip_sample_t const* in_r,
+		blip_sample_t* out, effect_levels_t<T> const& v )
+{
+	T const echo_level = v.echo;
+	for ( int i = 0; i < count; i++ )
+	{
+		l [i] += c [i] + FMUL( echo_level, in_l [i] );
+		r [i] += c [i] + FMUL( echo_level, in_r [i] );
+		out [i] = (blip_sample_t) c [i];
+	}
+}
+
+template<class T>
+inline void Effects_Buffer::run_effects( int count, int const* sq1, int const* sq2,
+		int* left, int* right, int const* center )
+{
+	effect_levels_t<T> v;
+	v.pan_1_l = (T) chans.pan_1_levels [0];
+	v.pan_1_r = (T) chans.pan_1_levels [1];
+	v.pan_2_l = (T) chans.pan_2_levels [0];
+	v.pan_2_r = (T) chans.pan_2_levels [1];
+	v.reverb  = (T) chans.reverb_level;
+	v.echo    = (T) chans.echo_level;
 	
 	blip_sample_t* const reverb_buf = this->reverb_buf.begin();
+	int reverb_pos = this->reverb_pos;
+	for ( int i = 0; i < count; )
+	{
+		int pos_l = (reverb_pos + chans.reverb_delay_l) & reverb_mask;
+		int pos_r = (reverb_pos + chans.reverb_delay_r) & reverb_mask;
+		int n = count - i;
+		n = min( n, until_wrap( reverb_pos, reverb_size, 2 ) );
+		n = min( n, until_wrap( pos_l, reverb_size, 2 ) );
+		n = min( n, until_wrap( pos_r, reverb_size, 2 ) );
+		run_reverb( n, sq1 + i, sq2 + i, left + i, right + i, &reverb_buf [pos_l],
+				&reverb_buf [pos_r], &reverb_buf [reverb_pos], v );
+		reverb_pos = (reverb_pos + n * 2) & reverb_mask;
+		i += n;
+	}
+	this->reverb_pos = reverb_pos;
+	
 	blip_sample_t* const echo_buf = this->echo_buf.begin();
 	int echo_pos = this->echo_pos;
-	int reverb_pos = this->reverb_pos;
+	for ( int i = 0; i < count; )
+	{
+		int pos_l = (echo_pos + chans.echo_delay_l) & echo_mask;
+		int pos_r = (echo_pos + chans.echo_delay_r) & echo_mask;
+		int n = count - i;
+		n = min( n, until_wrap( echo_pos, echo_size, 1 ) );
+		n = min( n, until_wrap( pos_l, echo_size, 1 ) );
+		n = min( n, until_wrap( pos_r, echo_size, 1 ) );
+		run_echo( n, center + i, left + i, right + i, &echo_buf [pos_l],
+				&echo_buf [pos_r], &echo_buf [echo_pos], v );
+		echo_pos = (echo_pos + n) & echo_mask;
+		i += n;
+	}
+	this->echo_pos = echo_pos;
+}
+
+void Effects_Buffer::mix_effects( int count, int const* sq1, int const* sq2,
+		int* left, int* right, int const* center )
+{
+	// Multiplies vectorize much better in int than in fixed_t, and give the
+	// same result unless samples are far past clipping, so check the block
+	double const int_max = 2147483647.0;
+	double pan = 0;
+	for ( int i = 0; i < 2; i++ )
+	{
+		pan = max( pan, fabs( (double) chans.pan_1_levels [i] ) );
+		pan = max( pan, fabs( (double) chans.pan_2_levels [i] ) );
+	}
+	double sq = max( max_abs( sq1, count ), max_abs( sq2, count ) ) * pan;
+	double reverb = 2 * (sq / 0x8000 + 1) + 0x8000 +
+			max( max_abs( left, count ), max_abs( right, count ) );
+	double echo = fabs( (double) chans.echo_level ) * 0x8000;
+	if ( sq <= int_max && reverb * fabs( (double) chans.reverb_level ) <= int_max &&
+			echo <= int_max &&
+			reverb + max_abs( center, count ) + echo / 0x8000 + 1 <= int_max )
+		run_effects<int>( count, sq1, sq2, left, right, center );
+	else
+		run_effects<fixed_t>( count, sq1, sq2, left, right, center );
+}
+
+// Clamps and interleaves count samples from left and right
+BLARGG_VECTORIZE
+static void write_stereo( blip_sample_t* BLIP_RESTRICT out, int const* left,
+		int const* right, int count )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+		int l = left [i];
+		int r = right [i];
+		if ( (BOOST::int16_t) l != l )
+			l = 0x7FFF - (l >> 24);
+		if ( (BOOST::int16_t) r != r )
+			r = 0x7FFF - (r >> 24);
+		out [i * 2    ] = (blip_sample_t) l;
+		out [i * 2 + 1] = (blip_sample_t) r;
+	}
+}
+
+void Effects_Buffer::mix_mono_enhanced( blip_sample_t* out, blargg_long count )
+{
+	int const bass = BLIP_READER_BASS( bufs [2] );
+	BLIP_READER_BEGIN( center, bufs [2] );
+	BLIP_READER_BEGIN( sq1, bufs [0] );
+	BLIP_READER_BEGIN( sq2, bufs [1] );
 	
-	while ( count-- )
+	int const block = effects_block();
+	while ( count )
 	{
-		int sum1_s = BLIP_READER_READ( sq1 );
-		int sum2_s = BLIP_READER_READ( sq2 );
-		
-		BLIP_READER_NEXT( sq1, bass );
-		BLIP_READER_NEXT( sq2, bass );
-		
-		int new_reverb_l = FMUL( sum1_s, chans.pan_1_levels [0] ) +
-				FMUL( sum2_s, chans.pan_2_levels [0] ) +
-				reverb_buf [(reverb_pos + chans.reverb_delay_l) & reverb_mask];
-		
-		int new_reverb_r = FMUL( sum1_s, chans.pan_1_levels [1] ) +
-				FMUL( sum2_s, chans.pan_2_levels [1] ) +
-				reverb_buf [(reverb_pos + chans.reverb_delay_r) & reverb_mask];
-		
-		fixed_t reverb_level = chans.reverb_level;
-		reverb_buf [reverb_pos] = (blip_sample_t) FMUL( new_reverb_l, reverb_level );
-		reverb_buf [reverb_pos + 1] = (blip_sample_t) FMUL( new_reverb_r, reverb_level );
-		reverb_pos = (reverb_pos + 2) & reverb_mask;
-		
-		int sum3_s = BLIP_READER_READ( center );
-		BLIP_READER_NEXT( center, bass );
-		
-		int left = new_reverb_l + sum3_s + FMUL( chans.echo_level,
-				echo_buf [(echo_pos + chans.echo_delay_l) & echo_mask] );
-		int right = new_reverb_r + sum3_s + FMUL( chans.echo_level,
-				echo_buf [(echo_pos + chans.echo_delay_r) & echo_mask] );
-		
-		echo_buf [echo_pos] = sum3_s;
-		echo_pos = (echo_pos + 1) & echo_mask;
-		
-		if ( (BOOST::int16_t) left != left )
-			left = 0x7FFF - (left >> 24);
-		
-		out [0] = left;
-		out [1] = right;
-		
-		out += 2;
+		int n = (count < block ? (int) count : block);
+		count -= n;
+		
+		int s1 [max_block];
+		int s2 [max_block];
+		int c  [max_block];
+		int l  [max_block];
+		int r  [max_block];
+		for ( int i = 0; i < n; i++ )
+		{
+			s1 [i] = BLIP_READER_READ( sq1 );
+			s2 [i] = BLIP_READER_READ( sq2 );
+			c  [i] = BLIP_READER_READ( center );
+			BLIP_READER_NEXT( sq1, bass );
+			BLIP_READER_NEXT( sq2, bass );
+			BLIP_READER_NEXT( center, bass );
+			l [i] = 0;
+			r [i] = 0;
+		}
 		
-		if ( (BOOST::int16_t) right != right )
-			out [-1] = 0x7FFF - (right >> 24);
+		mix_effects( n, s1, s2, l, r, c );
+		write_stereo( out, l, r, n );
+		out += n * 2;
 	}
-	this->reverb_pos = reverb_pos;
-	this->echo_pos = echo_pos;
 	
 	BLIP_READER_END( sq1, bufs [0] );
 	BLIP_READER_END( sq2, bufs [1] );
 	BLIP_READER_END( center, bufs [2] );
 }
 
-void Effects_Buffer::mix_enhanced( blip_sample_t* out_, blargg_long count )
+void Effects_Buffer::mix_enhanced( blip_sample_t* out, blargg_long count )
 {
-	blip_sample_t* BLIP_RESTRICT out = out_;
 	int const bass = BLIP_READER_BASS( bufs [2] );
 	BLIP_READER_BEGIN( center, bufs [2] );
 	BLIP_READER_BEGIN( l1, bufs [3] );
@@ -461,62 +638,46 @@ void Effects_Buffer::mix_enhanced( blip_sample_t* out_, blargg_long count )
 	BLIP_READER_BEGIN( sq1, bufs [0] );
 	BLIP_READER_BEGIN( sq2, bufs [1] );
 	
-	blip_sample_t* const reverb_buf = this->reverb_buf.begin();
-	blip_sample_t* const echo_buf = this->echo_buf.begin();
-	int echo_pos = this->echo_pos;
-	int reverb_pos = this->reverb_pos;
-	
-	while ( count-- )
+	int const block = effects_block();
+	while ( count )
 	{
-		int sum1_s = BLIP_READER_READ( sq1 );
-		int sum2_s = BLIP_READER_READ( sq2 );
-		
-		BLIP_READER_NEXT( sq1, bass );
-		BLIP_READER_NEXT( sq2, bass );
-		
-		int new_reverb_l = FMUL( sum1_s, chans.pan_1_levels [0] ) +
-				FMUL( sum2_s, chans.pan_2_levels [0] ) + BLIP_READER_READ( l1 ) +
-				reverb_buf [(reverb_pos + chans.reverb_delay_l) & reverb_mask];
-		
-		int new_reverb_r = FMUL( sum1_s, chans.pan_1_levels [1] ) +
-				FMUL( sum2_s, chans.pan_2_levels [1] ) + BLIP_READER_READ( r1 ) +
-				reverb_buf [(reverb_pos + chans.reverb_delay_r) & reverb_mask];
-		
-		BLIP_READER_NEXT( l1, bass );
-		BLIP_READER_NEXT( r1, bass );
-		
-		fixed_t reverb_level = chans.reverb_level;
-		reverb_buf [reverb_pos] = (blip_sample_t) FMUL( new_reverb_l, reverb_level );
-		reverb_buf [reverb_pos + 1] = (blip_sample_t) FMUL( new_reverb_r, reverb_level );
-		reverb_pos = (reverb_pos + 2) & reverb_mask;
-		
-		int sum3_s = BLIP_READER_READ( center );
-		BLIP_READER_NEXT( center, bass );
-		
-		int left = new_reverb_l + sum3_s + BLIP_READER_READ( l2 ) + FMUL( chans.echo_level,
-				echo_buf [(echo_pos + chans.echo_delay_l) & echo_mask] );
-		int right = new_reverb_r + sum3_s + BLIP_READER_READ( r2 ) + FMUL( chans.echo_level,
-				echo_buf [(echo_pos + chans.echo_delay_r) & echo_mask] );
-		
-		BLIP_READER_NEXT( l2, bass );
-		BLIP_READER_NEXT( r2, bass );
-		
-		echo_buf [echo_pos] = sum3_s;
-		echo_pos = (echo_pos + 1) & echo_mask;
-		
-		if ( (BOOST::int16_t) left != left )
-			left = 0x7FFF - (left >> 24);
-		
-		out [0] = left;
-		out [1] = right;
-		
-		out += 2;
+		int n = (count < block ? (int) count : block);
+		count -= n;
+		
+		int s1 [max_block];
+		int s2 [max_block];
+		int c  [max_block];
+		int l  [max_block];
+		int r  [max_block];
+		int dry_l [max_block];
+		int dry_r [max_block];
+		for ( int i = 0; i < n; i++ )
+		{
+			s1 [i] = BLIP_READER_READ( sq1 );
+			s2 [i] = BLIP_READER_READ( sq2 );
+			c  [i] = BLIP_READER_READ( center );
+			l  [i] = BLIP_READER_READ( l1 );
+			r  [i] = BLIP_READER_READ( r1 );
+			dry_l [i] = BLIP_READER_READ( l2 );
+			dry_r [i] = BLIP_READER_READ( r2 );
+			BLIP_READER_NEXT( sq1, bass );
+			BLIP_READER_NEXT( sq2, bass );
+			BLIP_READER_NEXT( center, bass );
+			BLIP_READER_NEXT( l1, bass );
+			BLIP_READER_NEXT( r1, bass );
+			BLIP_READER_NEXT( l2, bass );
+			BLIP_READER_NEXT( r2, bass );
+		}
 		
-		if ( (BOOST::int16_t) right != right )
-			out [-1] = 0x7FFF - (right >> 24);
+		mix_effects( n, s1, s2, l, r, c );
+		for ( int i = 0; i < n; i++ )
+		{
+			l [i] += dry_l [i];
+			r [i] += dry_r [i];
+		}
+		write_stereo( out, l, r, n );
+		out += n * 2;
 	}
-	this->reverb_pos = reverb_pos;
-	this->echo_pos = echo_pos;
 	
 	BLIP_READER_END( l1, bufs [3] );
 	BLIP_READER_END( r1, bufs [4] );
@@ -526,4 +687,3 @@ void Effects_Buffer::mix_enhanced( blip_sample_t* out_, blargg_long count )
 	BLIP_READER_END( sq2, bufs [1] );
 	BLIP_READER_END( center, bufs [2] );
 }
-
@@ -48,6 +48,7 @@ public:
 	void end_frame( blip_time_t );
 	long read_samples( blip_sample_t*, long );
 	long samples_avail() const;
+	blargg_err_t copy_state( Blargg_State_Copier& );
 private:
 	typedef long fixed_t;
 	
@@ -81,6 +82,14 @@ private:
 	void mix_stereo( blip_sample_t*, blargg_long );
 	void mix_enhanced( blip_sample_t*, blargg_long );
 	void mix_mono_enhanced( blip_sample_t*, blargg_long );
+	
+	enum { max_block = 256 };
+	int effects_block() const;
+	void mix_effects( int count, int const* sq1, int const* sq2,
+			int* left, int* right, int const* center );
+	template<class T>
+	void run_effects( int count, int const* sq1, int const* sq2,
+			int* left, int* right, int const* center );
 };
 
 #endif
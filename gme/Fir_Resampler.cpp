@@ -2,11 +2,16 @@
 
 #include "Fir_Resampler.h"
 
+#include "blargg_state.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
+#if BLARGG_X86_SIMD
+	#include <emmintrin.h>
+#endif
+
 /* Copyright (C) 2004-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -63,6 +68,12 @@ Fir_Resampler_::Fir_Resampler_( int width, sample_t* impulses_ ) :
 	skip_bits = 0;
 	step      = stereo;
 	ratio_    = 1.0;
+	
+	// read_sse2() handles four points at a time
+	sse2 = false;
+	#if BLARGG_X86_SIMD
+		sse2 = width % 4 == 0 && blargg_cpu_has( blargg_cpu_sse2 );
+	#endif
 }
 
 Fir_Resampler_::~Fir_Resampler_() { }
@@ -77,6 +88,16 @@ void Fir_Resampler_::clear()
 	}
 }
 
+void Fir_Resampler_::copy_state( Blargg_State_Copier& copier )
+{
+	int pos = write_pos - buf.begin();
+	copier( pos );
+	assert( (unsigned) pos <= buf.size() );
+	write_pos = &buf [pos];
+	copier( imp_phase );
+	copier.copy( buf.begin(), pos * sizeof buf [0] );
+}
+
 blargg_err_t Fir_Resampler_::buffer_size( int new_size )
 {
 	RETURN_ERR( buf.resize( new_size + write_offset ) );
@@ -197,3 +218,92 @@ int Fir_Resampler_::skip_input( long count )
 	
 	return count;
 }
+
+#if BLARGG_X86_SIMD
+
+// Same as Fir_Resampler::read(), but does four points at a time with SSE2.
+// Input pairs are rearranged from L0 R0 L1 R1 to L0 L1 R0 R1 so that pmaddwd
+// sums two points of one channel. Sums can wrap around the same way as in
+// read(), so output is identical.
+BLARGG_TARGET( "sse2" )
+int Fir_Resampler_::read_sse2( sample_t* out_begin, blargg_long count )
+{
+	sample_t* out = out_begin;
+	const sample_t* in = buf.begin();
+	sample_t* end_pos = write_pos;
+	blargg_ulong skip = skip_bits >> imp_phase;
+	int const width = width_;
+	sample_t const* imp = impulses + imp_phase * width;
+	int remain = res - imp_phase;
+	int const step = this->step;
+	
+	count >>= 1;
+	
+	if ( end_pos - in >= width * stereo )
+	{
+		end_pos -= width * stereo;
+		do
+		{
+			count--;
+			if ( count < 0 )
+				break;
+			
+			__m128i sum = _mm_setzero_si128();
+			const sample_t* i = in;
+			int n = width;
+			for ( ; n >= 8; n -= 8 )
+			{
+				__m128i pt = _mm_loadu_si128( (__m128i const*) imp );
+				__m128i in0 = _mm_loadu_si128( (__m128i const*) i );
+				__m128i in1 = _mm_loadu_si128( (__m128i const*) (i + 8) );
+				in0 = _mm_shufflehi_epi16( _mm_shufflelo_epi16( in0, 0xD8 ), 0xD8 );
+				in1 = _mm_shufflehi_epi16( _mm_shufflelo_epi16( in1, 0xD8 ), 0xD8 );
+				sum = _mm_add_epi32( sum, _mm_madd_epi16( in0, _mm_unpacklo_epi32( pt, pt ) ) );
+				sum = _mm_add_epi32( sum, _mm_madd_epi16( in1, _mm_unpackhi_epi32( pt, pt ) ) );
+				imp += 8;
+				i += 16;
+			}
+			if ( n )
+			{
+				__m128i pt = _mm_loadl_epi64( (__m128i const*) imp );
+				__m128i in0 = _mm_loadu_si128( (__m128i const*) i );
+				in0 = _mm_shufflehi_epi16( _mm_shufflelo_epi16( in0, 0xD8 ), 0xD8 );
+				sum = _mm_add_epi32( sum, _mm_madd_epi16( in0, _mm_unpacklo_epi32( pt, pt ) ) );
+				imp += 4;
+			}
+			
+			// L R L R -> L R
+			sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, 0x4E ) );
+			sum = _mm_srai_epi32( sum, 15 );
+			
+			remain--;
+			
+			in += (skip * stereo) & stereo;
+			skip >>= 1;
+			in += step;
+			
+			if ( !remain )
+			{
+				imp = impulses;
+				skip = skip_bits;
+				remain = res;
+			}
+			
+			out [0] = (sample_t) _mm_cvtsi128_si32( sum );
+			out [1] = (sample_t) _mm_cvtsi128_si32( _mm_srli_si128( sum, 4 ) );
+			out += 2;
+		}
+		while ( in <= end_pos );
+	}
+	
+	imp_phase = res - remain;
+	
+	GME_STATS_ADD( resampler_in, in - buf.begin() );
+	GME_STATS_ADD( resampler_out, out - out_begin );
+	
+	remove_input( in );
+	
+	return out - out_begin;
+}
+
+#endif
@@ -5,8 +5,12 @@
 #define FIR_RESAMPLER_H
 
 #include "blargg_common.h"
+#include "blargg_cpu.h"
+#include "Gme_Stats.h"
 #include <string.h>
 
+class Blargg_State_Copier;
+
 class Fir_Resampler_ {
 public:
 	
@@ -45,6 +49,10 @@ public:
 	// Skip 'count' input samples. Returns number of samples actually skipped.
 	int skip_input( long count );
 	
+	// Copy buffered input and phase to/from saved state (see blargg_state.h).
+	// Buffer size and ratio must be the same when loading.
+	void copy_state( Blargg_State_Copier& );
+	
 // Output
 	
 	// Number of extra input samples needed until 'count' output samples are available
@@ -69,9 +77,12 @@ protected:
 	int input_per_cycle;
 	double ratio_;
 	sample_t* impulses;
+	bool sse2;
 	
 	Fir_Resampler_( int width, sample_t* );
 	int avail_( blargg_long input_count ) const;
+	int read_sse2( sample_t*, blargg_long );
+	void remove_input( sample_t const* in );
 };
 
 // Width is number of points in FIR. Must be even and 4 or more. More points give
@@ -96,9 +107,22 @@ inline void Fir_Resampler_::write( long count )
 	assert( write_pos <= buf.end() );
 }
 
+// Removes input before in
+inline void Fir_Resampler_::remove_input( sample_t const* in )
+{
+	int left = write_pos - in;
+	write_pos = &buf [left];
+	memmove( buf.begin(), in, left * sizeof *in );
+}
+
 template<int width>
 int Fir_Resampler<width>::read( sample_t* out_begin, blargg_long count )
 {
+	#if BLARGG_X86_SIMD
+		if ( sse2 )
+			return read_sse2( out_begin, count );
+	#endif
+	
 	sample_t* out = out_begin;
 	const sample_t* in = buf.begin();
 	sample_t* end_pos = write_pos;
@@ -161,9 +185,10 @@ int Fir_Resampler<width>::read( sample_t* out_begin, blargg_long count )
 	
 	imp_phase = res - remain;
 	
-	int left = write_pos - in;
-	write_pos = &buf [left];
-	memmove( buf.begin(), in, left * sizeof *in );
+	GME_STATS_ADD( resampler_in, in - buf.begin() );
+	GME_STATS_ADD( resampler_out, out - out_begin );
+	
+	remove_input( in );
 	
 	return out - out_begin;
 }
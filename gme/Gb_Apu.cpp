@@ -2,6 +2,7 @@
 
 #include "Gb_Apu.h"
 
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
@@ -126,12 +127,56 @@ void Gb_Apu::reset()
 	memcpy( wave.wave, initial_wave, sizeof wave.wave );
 }
 
+static void copy_osc_state( Gb_Osc& osc, Blargg_State_Copier& copier )
+{
+	copier( osc.output_select );
+	osc.output = osc.outputs [osc.output_select];
+	copier( osc.delay );
+	copier( osc.last_amp );
+	copier( osc.volume );
+	copier( osc.length );
+	copier( osc.enabled );
+}
+
+static void copy_square_state( Gb_Square& osc, Blargg_State_Copier& copier )
+{
+	copy_osc_state( osc, copier );
+	copier( osc.env_delay );
+	copier( osc.sweep_delay );
+	copier( osc.sweep_freq );
+	copier( osc.phase );
+}
+
+void Gb_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	copier( regs );
+	if ( copier.loading() )
+		update_volume();
+	
+	copy_square_state( square1, copier );
+	copy_square_state( square2, copier );
+	
+	copy_osc_state( wave, copier );
+	copier( wave.wave_pos );
+	copier( wave.wave );
+	
+	copy_osc_state( noise, copier );
+	copier( noise.env_delay );
+	copier( noise.bits );
+	
+	copier( next_frame_time );
+	copier( last_time );
+	copier( frame_count );
+}
+
 void Gb_Apu::run_until( blip_time_t end_time )
 {
 	require( end_time >= last_time ); // end_time must not be before previous time
 	if ( end_time == last_time )
 		return;
 	
+	GME_STATS_STAGE( gme_stage_apu );
+	
 	while ( true )
 	{
 		blip_time_t time = next_frame_time;
@@ -149,6 +194,8 @@ void Gb_Apu::run_until( blip_time_t end_time )
 				if ( osc.enabled && osc.volume &&
 						(!(osc.regs [4] & osc.len_enabled_mask) || osc.length) )
 					playing = -1;
+				else
+					GME_STATS_IDLE( gb_apu, time - last_time );
 				switch ( i )
 				{
 				case 0: square1.run( last_time, time, playing ); break;
@@ -199,6 +246,7 @@ void Gb_Apu::end_frame( blip_time_t end_time )
 
 void Gb_Apu::write_register( blip_time_t time, unsigned addr, int data )
 {
+	GME_STATS_WRITE( gb_apu );
 	require( (unsigned) data < 0x100 );
 	
 	int reg = addr - start_addr;
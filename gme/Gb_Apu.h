@@ -6,6 +6,8 @@
 
 #include "Gb_Oscs.h"
 
+class Blargg_State_Copier;
+
 class Gb_Apu {
 public:
 	
@@ -50,6 +52,9 @@ public:
 	
 	void set_tempo( double );
 	
+	// Copy exact emulation state to/from saved state (see blargg_state.h)
+	void copy_state( Blargg_State_Copier& );
+	
 public:
 	Gb_Apu();
 private:
@@ -47,12 +47,12 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 	#define PAGE_OFFSET( addr ) ((addr) & (page_size - 1))
 #endif
 
-inline void Gb_Cpu::set_code_page( int i, uint8_t* p )
+inline void Gb_Cpu::set_code_page( int i, uint8_t const* p )
 {
 	state->code_map [i] = p - PAGE_OFFSET( i * (blargg_long) page_size );
 }
 
-void Gb_Cpu::reset( void* unmapped )
+void Gb_Cpu::reset( void const* unmapped )
 {
 	check( state == &state_ );
 	state = &state_;
@@ -60,7 +60,7 @@ void Gb_Cpu::reset( void* unmapped )
 	state_.remain = 0;
 	
 	for ( int i = 0; i < page_count + 1; i++ )
-		set_code_page( i, (uint8_t*) unmapped );
+		set_code_page( i, (uint8_t const*) unmapped );
 	
 	memset( &r, 0, sizeof r );
 	//interrupts_enabled = false;
@@ -68,7 +68,7 @@ void Gb_Cpu::reset( void* unmapped )
 	blargg_verify_byte_order();
 }
 
-void Gb_Cpu::map_code( gb_addr_t start, unsigned size, void* data )
+void Gb_Cpu::map_code( gb_addr_t start, unsigned size, void const* data )
 {
 	// address range must begin and end on page boundaries
 	require( start % page_size == 0 );
@@ -76,7 +76,7 @@ void Gb_Cpu::map_code( gb_addr_t start, unsigned size, void* data )
 	
 	unsigned first_page = start / page_size;
 	for ( unsigned i = size / page_size; i--; )
-		set_code_page( first_page + i, (uint8_t*) data + i * page_size );
+		set_code_page( first_page + i, (uint8_t const*) data + i * page_size );
 }
 
 #define READ( addr )            CPU_READ( this, (addr), s.remain )
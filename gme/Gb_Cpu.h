@@ -16,14 +16,14 @@ public:
 	typedef BOOST::uint8_t uint8_t;
 	
 	// Clear registers and map all pages to unmapped
-	void reset( void* unmapped = 0 );
+	void reset( void const* unmapped = 0 );
 	
 	// Map code memory (memory accessed via the program counter). Start and size
 	// must be multiple of page_size.
 	enum { page_size = 0x2000 };
-	void map_code( gb_addr_t start, unsigned size, void* code );
+	void map_code( gb_addr_t start, unsigned size, void const* code );
 	
-	uint8_t* get_code( gb_addr_t );
+	uint8_t const* get_code( gb_addr_t );
 	
 	// Push a byte on the stack
 	void push_byte( int );
@@ -72,16 +72,16 @@ private:
 	Gb_Cpu& operator = ( const Gb_Cpu& );
 	
 	struct state_t {
-		uint8_t* code_map [page_count + 1];
+		uint8_t const* code_map [page_count + 1];
 		blargg_long remain;
 	};
 	state_t* state; // points to state_ or a local copy within run()
 	state_t state_;
 	
-	void set_code_page( int, uint8_t* );
+	void set_code_page( int, uint8_t const* );
 };
 
-inline BOOST::uint8_t* Gb_Cpu::get_code( gb_addr_t addr )
+inline BOOST::uint8_t const* Gb_Cpu::get_code( gb_addr_t addr )
 {
 	return state->code_map [addr >> page_shift] + addr
 	#if !BLARGG_NONPORTABLE
@@ -4,6 +4,8 @@
 
 #include <string.h>
 
+#include "blargg_lfsr.h"
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -168,6 +170,28 @@ void Gb_Square::run( blip_time_t time, blip_time_t end_time, int playing )
 
 // Gb_Noise
 
+struct gb_noise_step_t
+{
+	int tap;
+	blargg_ulong operator () ( blargg_ulong n ) const
+	{
+		return (n << 1) | ((n >> tap ^ n >> (tap + 1)) & 1);
+	}
+};
+
+static gb_noise_step_t const long_noise_step  = { 13 };
+static gb_noise_step_t const short_noise_step = {  5 };
+
+// Noise bits after count steps, without running them one at a time
+static unsigned jump_noise( unsigned bits, int tap, blargg_long count )
+{
+	// 15-bit and 7-bit mode, built on first use
+	static Blargg_Lfsr_Jump const long_jump ( long_noise_step,  15 );
+	static Blargg_Lfsr_Jump const short_jump( short_noise_step, 15 );
+	Blargg_Lfsr_Jump const& jump = (tap == 13 ? long_jump : short_jump);
+	return (unsigned) jump.run( bits, count );
+}
+
 void Gb_Noise::run( blip_time_t time, blip_time_t end_time, int playing )
 {
 	int amp = volume & playing;
@@ -184,15 +208,30 @@ void Gb_Noise::run( blip_time_t time, blip_time_t end_time, int playing )
 		}
 	}
 	
+	static unsigned char const table [8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+	int period = table [regs [3] & 7] << (regs [3] >> 4);
+	
 	time += delay;
 	if ( !playing )
-		time = end_time;
+	{
+		if ( enabled && !volume && (!(regs [4] & len_enabled_mask) || length) )
+		{
+			// noise keeps running while enabled channel's volume is zero
+			if ( time < end_time )
+			{
+				blargg_long count = (end_time - time + period - 1) / period;
+				bits = jump_noise( bits, tap, count );
+				time += count * period;
+			}
+		}
+		else
+		{
+			time = end_time;
+		}
+	}
 	
 	if ( time < end_time )
 	{
-		static unsigned char const table [8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
-		int period = table [regs [3] & 7] << (regs [3] >> 4);
-		
 		// keep parallel resampled time to eliminate time conversion in the loop
 		Blip_Buffer* const output = this->output;
 		const blip_resampled_time_t resampled_period =
@@ -3,6 +3,7 @@
 #include "Gbs_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
@@ -35,6 +36,7 @@ Gbs_Emu::Gbs_Emu()
 	};
 	set_voice_types( types );
 	
+	bank = 0;
 	set_silence_lookahead( 6 );
 	set_max_initial_silence( 21 );
 	set_gain( 1.2 );
@@ -48,7 +50,7 @@ Gbs_Emu::~Gbs_Emu() { }
 void Gbs_Emu::unload()
 {
 	rom.clear();
-	Music_Emu::unload();
+	Classic_Emu::unload();
 }
 
 // Track info
@@ -107,7 +109,7 @@ gme_type_t const gme_gbs_type = &gme_gbs_type_;
 blargg_err_t Gbs_Emu::load_( Data_Reader& in )
 {
 	assert( offsetof (header_t,copyright [32]) == header_size );
-	RETURN_ERR( rom.load( in, header_size, &header_, 0 ) );
+	RETURN_ERR( rom.load( in, header_size, &header_, 0, shared_rom() ) );
 	
 	set_track_count( header_.track_count );
 	RETURN_ERR( check_gbs_header( &header_ ) );
@@ -155,9 +157,22 @@ void Gbs_Emu::set_bank( int n )
 		return;
 		//n = 1;
 	}
+	bank = n;
 	cpu::map_code( bank_size, bank_size, rom.at_addr( addr ) );
 }
 
+void Gbs_Emu::map_memory()
+{
+	unsigned load_addr = get_le16( header_.load_addr );
+	rom.set_addr( load_addr );
+	cpu::rst_base = load_addr;
+	
+	cpu::reset( rom.unmapped() );
+	
+	cpu::map_code( ram_addr, 0x10000 - ram_addr, ram );
+	cpu::map_code( 0, bank_size, rom.at_addr( 0 ) );
+}
+
 void Gbs_Emu::update_timer()
 {
 	if ( header_.timer_mode & 0x04 )
@@ -212,14 +227,7 @@ blargg_err_t Gbs_Emu::start_track_( int track )
 	for ( int i = 0; i < (int) sizeof sound_data; i++ )
 		apu.write_register( 0, i + apu.start_addr, sound_data [i] );
 	
-	unsigned load_addr = get_le16( header_.load_addr );
-	rom.set_addr( load_addr );
-	cpu::rst_base = load_addr;
-	
-	cpu::reset( rom.unmapped() );
-	
-	cpu::map_code( ram_addr, 0x10000 - ram_addr, ram );
-	cpu::map_code( 0, bank_size, rom.at_addr( 0 ) );
+	map_memory();
 	set_bank( rom.size() > bank_size );
 	
 	ram [hi_page + 6] = header_.timer_modulo;
@@ -236,6 +244,28 @@ blargg_err_t Gbs_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Gbs_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	RETURN_ERR( copy_buffer_state( copier ) );
+	
+	copier( bank );
+	if ( copier.loading() )
+	{
+		map_memory();
+		set_bank( bank );
+	}
+	copier( cpu::r );
+	copier( ram );
+	
+	copier( next_play );
+	if ( copier.loading() )
+		update_timer();
+	
+	apu.copy_state( copier );
+	
+	return 0;
+}
+
 blargg_err_t Gbs_Emu::run_clocks( blip_time_t& duration, int )
 {
 	cpu_time = 0;
@@ -57,11 +57,14 @@ protected:
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
 	void unload();
+	blargg_err_t copy_state_( Blargg_State_Copier& );
 private:
 	// rom
 	enum { bank_size = 0x4000 };
 	Rom_Data<bank_size> rom;
+	int bank; // currently mapped at bank_size
 	void set_bank( int );
+	void map_memory();
 	
 	// timer
 	blip_time_t cpu_time;
@@ -2,6 +2,7 @@
 
 #include "Gme_File.h"
 
+#include "Shared_Rom.h"
 #include "blargg_endian.h"
 #include <string.h>
 
@@ -23,6 +24,8 @@ const char* const gme_wrong_file_type = "Wrong file type for this emulator";
 void Gme_File::clear_playlist()
 {
 	playlist.clear();
+	shared_playlist = 0;
+	shared_entries.clear();
 	clear_playlist_();
 	track_count_ = raw_track_count_;
 }
@@ -32,7 +35,11 @@ void Gme_File::unload()
 	clear_playlist(); // *before* clearing track count
 	track_count_     = 0;
 	raw_track_count_ = 0;
-	file_data.clear();
+	// file_data is kept allocated for reuse by the next load_()
+	if ( shared_rom_ )
+		shared_rom_->release();
+	shared_rom_ = 0;
+	file_hash.clear();
 }
 
 Gme_File::Gme_File()
@@ -40,6 +47,8 @@ Gme_File::Gme_File()
 	type_         = 0;
 	user_data_    = 0;
 	user_cleanup_ = 0;
+	shared_rom_   = 0;
+	length_cache_ = 0;
 	unload(); // clears fields
 	blargg_verify_byte_order(); // used by most emulator types, so save them the trouble
 }
@@ -48,6 +57,8 @@ Gme_File::~Gme_File()
 {
 	if ( user_cleanup_ )
 		user_cleanup_( user_data_ );
+	if ( shared_rom_ )
+		shared_rom_->release();
 }
 
 blargg_err_t Gme_File::load_mem_( byte const* data, long size )
@@ -59,11 +70,56 @@ blargg_err_t Gme_File::load_mem_( byte const* data, long size )
 
 blargg_err_t Gme_File::load_( Data_Reader& in )
 {
+	if ( shared_rom_ )
+		return load_mem_( shared_rom_->data(), shared_rom_->size() );
+	
 	RETURN_ERR( file_data.resize( in.remain() ) );
 	RETURN_ERR( in.read( file_data.begin(), file_data.size() ) );
 	return load_mem_( file_data.begin(), file_data.size() );
 }
 
+// Hashes data as emulator reads it
+class Hash_Reader : public Data_Reader {
+public:
+	File_Hash hash;
+	
+	Hash_Reader( Data_Reader& r ) : in( r ) { }
+	
+	long read_avail( void* p, long n )
+	{
+		n = in.read_avail( p, n );
+		if ( n > 0 )
+			hash.add( p, n );
+		return n;
+	}
+	
+	blargg_err_t read( void* p, long n )
+	{
+		RETURN_ERR( in.read( p, n ) );
+		hash.add( p, n );
+		return 0;
+	}
+	
+	long remain() const { return in.remain(); }
+private:
+	Data_Reader& in;
+};
+
+blargg_err_t Gme_File::load_hashed( Data_Reader& in )
+{
+	Hash_Reader hashed( in );
+	RETURN_ERR( load_( hashed ) );
+	RETURN_ERR( hashed.skip( hashed.remain() ) ); // include anything emulator didn't read
+	file_hash = hashed.hash;
+	return 0;
+}
+
+bool Gme_File::same_file( Gme_File const& other ) const
+{
+	return file_hash.size() && file_hash.size() == other.file_hash.size() &&
+			file_hash.hash() == other.file_hash.hash();
+}
+
 // public load functions call this at beginning
 void Gme_File::pre_load() { unload(); }
 
@@ -87,13 +143,29 @@ blargg_err_t Gme_File::post_load( blargg_err_t err )
 blargg_err_t Gme_File::load_mem( void const* in, long size )
 {
 	pre_load();
-	return post_load( load_mem_( (byte const*) in, size ) );
+	blargg_err_t err = load_mem_( (byte const*) in, size );
+	if ( !err )
+		file_hash.add( in, size );
+	return post_load( err );
+}
+
+blargg_err_t Gme_File::load_shared( Shared_Rom* rom )
+{
+	require( rom );
+	pre_load();
+	rom->add_ref();
+	shared_rom_ = rom;
+	Mem_File_Reader in( rom->data(), rom->size() );
+	blargg_err_t err = load_( in );
+	if ( !err )
+		file_hash.add( rom->data(), rom->size() );
+	return post_load( err );
 }
 
 blargg_err_t Gme_File::load( Data_Reader& in )
 {
 	pre_load();
-	return post_load( load_( in ) );
+	return post_load( load_hashed( in ) );
 }
 
 blargg_err_t Gme_File::load_file( const char* path )
@@ -101,7 +173,7 @@ blargg_err_t Gme_File::load_file( const char* path )
 	pre_load();
 	GME_FILE_READER in;
 	RETURN_ERR( in.open( path ) );
-	return post_load( load_( in ) );
+	return post_load( load_hashed( in ) );
 }
 
 blargg_err_t Gme_File::load_remaining_( void const* h, long s, Data_Reader& in )
@@ -151,14 +223,24 @@ void Gme_File::copy_field_( char* out, const char* in )
 	copy_field_( out, in, max_field_ );
 }
 
+int Gme_File::playlist_size() const
+{
+	return shared_playlist ? (int) shared_entries.size() : playlist.size();
+}
+
+M3u_Playlist::entry_t const& Gme_File::playlist_entry( int i ) const
+{
+	return shared_playlist ? (*shared_playlist) [shared_entries [i]] : playlist [i];
+}
+
 blargg_err_t Gme_File::remap_track_( int* track_io ) const
 {
 	if ( (unsigned) *track_io >= (unsigned) track_count() )
 		return "Invalid track";
 	
-	if ( (unsigned) *track_io < (unsigned) playlist.size() )
+	if ( (unsigned) *track_io < (unsigned) playlist_size() )
 	{
-		M3u_Playlist::entry_t const& e = playlist [*track_io];
+		M3u_Playlist::entry_t const& e = playlist_entry( *track_io );
 		*track_io = 0;
 		if ( e.track >= 0 )
 		{
@@ -171,7 +253,7 @@ blargg_err_t Gme_File::remap_track_( int* track_io ) const
 	}
 	else
 	{
-		check( !playlist.size() );
+		check( !playlist_size() );
 	}
 	return 0;
 }
@@ -198,19 +280,44 @@ blargg_err_t Gme_File::track_info( track_info_t* out, int track ) const
 	RETURN_ERR( track_info_( out, remapped ) );
 	
 	// override with m3u info
-	if ( playlist.size() )
+	if ( playlist_size() )
 	{
-		M3u_Playlist::info_t const& i = playlist.info();
+		M3u_Playlist::info_t const& i = (shared_playlist ? *shared_playlist : playlist).info();
 		copy_field_( out->game  , i.title );
 		copy_field_( out->author, i.engineer );
 		copy_field_( out->author, i.composer );
 		copy_field_( out->dumper, i.ripping );
 		
-		M3u_Playlist::entry_t const& e = playlist [track];
+		M3u_Playlist::entry_t const& e = playlist_entry( track );
 		copy_field_( out->song, e.name );
 		if ( e.length >= 0 ) out->length       = e.length * 1000L;
 		if ( e.intro  >= 0 ) out->intro_length = e.intro  * 1000L;
 		if ( e.loop   >= 0 ) out->loop_length  = e.loop   * 1000L;
 	}
+	
+	// use length measured by earlier playback, up to silence at end if it was found
+	gme_track_length_t cached;
+	if ( out->length <= 0 && length_cache_ && file_hash.size() &&
+			length_cache_->find( file_hash.hash(), file_hash.size(), remapped, &cached ) )
+	{
+		out->length = (cached.silence_start >= 0 ? cached.silence_start : cached.length);
+		if ( out->intro_length < 0 ) out->intro_length = cached.intro_length;
+		if ( out->loop_length  < 0 ) out->loop_length  = cached.loop_length;
+	}
 	return 0;
 }
+
+// Track length cache
+
+bool Gme_File::cached_length( int track, gme_track_length_t* out ) const
+{
+	return length_cache_ && file_hash.size() && !remap_track_( &track ) &&
+			length_cache_->find( file_hash.hash(), file_hash.size(), track, out );
+}
+
+void Gme_File::cache_length_( int remapped, gme_track_length_t const& length )
+{
+	// cache only saves time later, so running out of memory isn't an error
+	if ( length_cache_ && file_hash.size() )
+		length_cache_->add( file_hash.hash(), file_hash.size(), remapped, length );
+}
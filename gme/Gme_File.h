@@ -8,6 +8,7 @@
 #include "blargg_common.h"
 #include "Data_Reader.h"
 #include "M3u_Playlist.h"
+#include "Track_Cache.h"
 
 // Error returned if file is wrong type
 //extern const char gme_wrong_file_type []; // declared in gme.h
@@ -62,10 +63,19 @@ public:
 	// must not free it until you're done with the file.
 	blargg_err_t load_mem( void const* data, long size );
 	
+	// Load from data shared with other emulators (see Shared_Rom.h). Keeps a
+	// reference to it until another file is loaded or this emulator is deleted.
+	blargg_err_t load_shared( Shared_Rom* );
+	
 	// Load an m3u playlist. Must be done after loading main music file.
 	blargg_err_t load_m3u( const char* path );
 	blargg_err_t load_m3u( Data_Reader& in );
 	
+	// Use entries for 'file' from a playlist shared with other emulators, without
+	// copying it. Must be done after loading main music file. Playlist must not be
+	// changed or deleted until clear_playlist() is called or another file is loaded.
+	blargg_err_t use_shared_m3u( M3u_Playlist const&, const char* file );
+	
 	// Clears any loaded m3u playlist and any internal playlist that the music
 	// format supports (NSFE for example).
 	void clear_playlist();
@@ -87,6 +97,18 @@ public:
 	// See gme.h for definition of struct track_info_t.
 	blargg_err_t track_info( track_info_t* out, int track ) const;
 	
+// Track length cache
+	
+	// Use cache of track lengths measured during playback, which can be shared with
+	// other emulators, or stop using one if NULL. Lengths of tracks in the cache are
+	// given by track_info() when the file doesn't have them. Music_Emu adds tracks to
+	// it as they end. Cache must not be deleted while in use.
+	void set_length_cache( Track_Cache* c ) { length_cache_ = c; }
+	Track_Cache* length_cache() const       { return length_cache_; }
+	
+	// Length of track in cache; returns false if it isn't there
+	bool cached_length( int track, gme_track_length_t* out ) const;
+	
 // User data/cleanup
 	
 	// Set/get pointer to data you want to associate with this emulator.
@@ -111,7 +133,10 @@ protected:
 	void set_track_count( int n )       { track_count_ = raw_track_count_ = n; }
 	void set_warning( const char* s )   { warning_ = s; }
 	void set_type( gme_type_t t )       { type_ = t; }
+	Shared_Rom* shared_rom() const      { return shared_rom_; } // data being loaded by load_shared(), or NULL
 	blargg_err_t load_remaining_( void const* header, long header_size, Data_Reader& remaining );
+	void cache_length_( int remapped, gme_track_length_t const& ); // add to length cache
+	bool same_file( Gme_File const& ) const; // true if both loaded same data, by size and hash
 	
 	// Overridable
 	virtual void unload();  // called before loading file and if loading fails
@@ -136,10 +161,18 @@ private:
 	void* user_data_;
 	gme_user_cleanup_t user_cleanup_;
 	M3u_Playlist playlist;
+	M3u_Playlist const* shared_playlist; // used instead of playlist if not NULL
+	blargg_vector<int> shared_entries;   // indices of entries for this file in shared_playlist
 	char playlist_warning [64];
 	blargg_vector<byte> file_data; // only if loaded into memory using default load
+	Shared_Rom* shared_rom_;       // used instead of file_data if not NULL
+	Track_Cache* length_cache_;
+	File_Hash file_hash;           // of data loaded; empty if none
 	
+	blargg_err_t load_hashed( Data_Reader& );
 	blargg_err_t load_m3u_( blargg_err_t );
+	int playlist_size() const;
+	M3u_Playlist::entry_t const& playlist_entry( int ) const;
 	blargg_err_t post_load( blargg_err_t err );
 public:
 	// track_info field copying
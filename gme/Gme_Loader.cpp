@@ -0,0 +1,500 @@
+// Game_Music_Emu 0.5.5. http://www.slack.net/~ant/
+
+#include "Music_Emu.h"
+
+#include "Shared_Rom.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if GME_DISABLE_THREADS
+	#include <time.h>
+#elif defined (_WIN32)
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <pthread.h>
+	#include <time.h>
+#endif
+
+/* Copyright (C) 2006 Shay Green. This module is free software; you
+can redistribute it and/or modify it under the terms of the GNU Lesser
+General Public License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version. This
+module is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+details. You should have received a copy of the GNU Lesser General Public
+License along with this module; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
+
+#include "blargg_source.h"
+
+// Minimal threads, mutex, and condition variables. Without threads, requests are
+// loaded as soon as they're queued.
+#if GME_DISABLE_THREADS
+	typedef int loader_mutex_t;
+	typedef int loader_cond_t;
+	inline void mutex_init( loader_mutex_t* ) { }
+	inline void mutex_destroy( loader_mutex_t* ) { }
+	inline void mutex_lock( loader_mutex_t* ) { }
+	inline void mutex_unlock( loader_mutex_t* ) { }
+	inline void cond_init( loader_cond_t* ) { }
+	inline void cond_destroy( loader_cond_t* ) { }
+	inline void cond_wait( loader_cond_t*, loader_mutex_t* ) { }
+	inline void cond_signal( loader_cond_t* ) { }
+	inline void cond_broadcast( loader_cond_t* ) { }
+#elif defined (_WIN32)
+	typedef HANDLE loader_thread_t;
+	typedef CRITICAL_SECTION loader_mutex_t;
+	typedef CONDITION_VARIABLE loader_cond_t;
+	#define LOADER_THREAD_FUNC( name, arg ) static unsigned __stdcall name( void* arg )
+	inline bool thread_start( loader_thread_t* t, unsigned (__stdcall* func)( void* ), void* arg )
+	{
+		*t = (HANDLE) _beginthreadex( 0, 0, func, arg, 0, 0 );
+		return *t != 0;
+	}
+	inline void thread_join( loader_thread_t t ) { WaitForSingleObject( t, INFINITE ); CloseHandle( t ); }
+	inline void mutex_init( loader_mutex_t* m ) { InitializeCriticalSection( m ); }
+	inline void mutex_destroy( loader_mutex_t* m ) { DeleteCriticalSection( m ); }
+	inline void mutex_lock( loader_mutex_t* m ) { EnterCriticalSection( m ); }
+	inline void mutex_unlock( loader_mutex_t* m ) { LeaveCriticalSection( m ); }
+	inline void cond_init( loader_cond_t* c ) { InitializeConditionVariable( c ); }
+	inline void cond_destroy( loader_cond_t* ) { }
+	inline void cond_wait( loader_cond_t* c, loader_mutex_t* m ) { SleepConditionVariableCS( c, m, INFINITE ); }
+	inline void cond_signal( loader_cond_t* c ) { WakeConditionVariable( c ); }
+	inline void cond_broadcast( loader_cond_t* c ) { WakeAllConditionVariable( c ); }
+#else
+	typedef pthread_t loader_thread_t;
+	typedef pthread_mutex_t loader_mutex_t;
+	typedef pthread_cond_t loader_cond_t;
+	#define LOADER_THREAD_FUNC( name, arg ) static void* name( void* arg )
+	inline bool thread_start( loader_thread_t* t, void* (*func)( void* ), void* arg )
+	{
+		return !pthread_create( t, 0, func, arg );
+	}
+	inline void thread_join( loader_thread_t t ) { pthread_join( t, 0 ); }
+	inline void mutex_init( loader_mutex_t* m ) { pthread_mutex_init( m, 0 ); }
+	inline void mutex_destroy( loader_mutex_t* m ) { pthread_mutex_destroy( m ); }
+	inline void mutex_lock( loader_mutex_t* m ) { pthread_mutex_lock( m ); }
+	inline void mutex_unlock( loader_mutex_t* m ) { pthread_mutex_unlock( m ); }
+	inline void cond_init( loader_cond_t* c ) { pthread_cond_init( c, 0 ); }
+	inline void cond_destroy( loader_cond_t* c ) { pthread_cond_destroy( c ); }
+	inline void cond_wait( loader_cond_t* c, loader_mutex_t* m ) { pthread_cond_wait( c, m ); }
+	inline void cond_signal( loader_cond_t* c ) { pthread_cond_signal( c ); }
+	inline void cond_broadcast( loader_cond_t* c ) { pthread_cond_broadcast( c ); }
+#endif
+
+typedef unsigned long long loader_time_t;
+
+// Current time in microseconds, from an arbitrary starting point
+static loader_time_t time_usec()
+{
+#if defined (_WIN32) && !GME_DISABLE_THREADS
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &count );
+	return (loader_time_t) ((double) count.QuadPart * 1e6 / (double) freq.QuadPart);
+#elif defined (CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (loader_time_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return (loader_time_t) ((double) clock() * 1e6 / CLOCKS_PER_SEC);
+#endif
+}
+
+// Load requests
+
+struct Load_Request
+{
+	Load_Request* next;
+	gme_loaded_t callback;
+	void* user_data;
+	int index;
+	int sample_rate;
+	bool record_start_states;
+	Music_Emu* emu;
+	gme_err_t error;
+	loader_time_t queued;
+	loader_time_t started;
+	loader_time_t read;
+	loader_time_t loaded;
+	char path [1]; // actual size allocated as needed
+};
+
+static Load_Request* new_request( const char* path, int rate, bool record,
+		gme_loaded_t callback, void* user_data, int index )
+{
+	size_t len = strlen( path );
+	Load_Request* r = (Load_Request*) malloc( offsetof (Load_Request,path) + len + 1 );
+	if ( r )
+	{
+		r->next        = 0;
+		r->callback    = callback;
+		r->user_data   = user_data;
+		r->index       = index;
+		r->sample_rate = rate;
+		r->record_start_states = record;
+		r->emu         = 0;
+		r->error       = 0;
+		r->queued      = 0;
+		memcpy( r->path, path, len + 1 );
+	}
+	return r;
+}
+
+static void delete_requests( Load_Request* r )
+{
+	while ( r )
+	{
+		Load_Request* next = r->next;
+		delete r->emu;
+		free( r );
+		r = next;
+	}
+}
+
+// Reads file, then creates emulator of type in file's header (or of type for
+// its extension, if header isn't recognized) and loads file into it, recording
+// its start states if requested
+static void load_request( Load_Request* r )
+{
+	r->started = time_usec();
+	
+	Shared_Rom* rom = 0;
+	{
+		GME_FILE_READER in;
+		r->error = in.open( r->path );
+		if ( !r->error )
+			r->error = Shared_Rom::load( in, &rom );
+	}
+	r->read = time_usec();
+	
+	if ( rom )
+	{
+		gme_type_t type = 0;
+		if ( rom->size() >= 4 )
+			type = gme_identify_extension( gme_identify_header( rom->data() ) );
+		if ( !type )
+			type = gme_identify_extension( r->path );
+		
+		if ( !type )
+		{
+			r->error = gme_wrong_file_type;
+		}
+		else
+		{
+			r->emu = gme_new_emu( type, r->sample_rate );
+			if ( !r->emu )
+			{
+				r->error = "Out of memory";
+			}
+			else
+			{
+				// emulator ends up holding the only reference to the file data
+				r->error = r->emu->load_shared( rom );
+				if ( r->error )
+				{
+					delete r->emu;
+					r->emu = 0;
+				}
+				else if ( r->record_start_states )
+				{
+					// types without start states just start tracks normally
+					r->emu->record_start_states();
+				}
+			}
+		}
+		rom->release();
+	}
+	
+	r->loaded = time_usec();
+}
+
+// Loader
+
+struct gme_loader_t
+{
+	loader_mutex_t mutex;
+	loader_cond_t work_ready;   // signaled when request is queued
+	loader_cond_t done_ready;   // signaled when request has been loaded
+	
+	Load_Request* queue;        // requests waiting for a thread
+	Load_Request* queue_tail;
+	Load_Request* done;         // loaded requests waiting for gme_loader_poll()
+	Load_Request* done_tail;
+	int active;                 // queued or being loaded
+	int done_count;
+	bool stopping;
+	bool record_start_states;   // only accessed by thread queueing requests
+	
+	gme_loader_stats_t stats;
+	
+#if !GME_DISABLE_THREADS
+	int thread_count;
+	blargg_vector<loader_thread_t> threads;
+#endif
+	
+	BLARGG_DISABLE_NOTHROW
+};
+
+static void add_latency( long* hist, loader_time_t begin, loader_time_t end )
+{
+	loader_time_t t = (end > begin ? end - begin : 0) >> 1;
+	int i = 0;
+	while ( t && i < gme_latency_buckets - 1 )
+	{
+		t >>= 1;
+		i++;
+	}
+	hist [i]++;
+}
+
+// Moves loaded request to done list. Loader must be locked.
+static void finish_request( gme_loader_t* gl, Load_Request* r )
+{
+	gme_loader_stats_t& s = gl->stats;
+	if ( r->error )
+		s.failed++;
+	else
+		s.loaded++;
+	add_latency( s.queued, r->queued,  r->started );
+	add_latency( s.read,   r->started, r->read    );
+	add_latency( s.parse,  r->read,    r->loaded  );
+	add_latency( s.total,  r->queued,  r->loaded  );
+	
+	r->next = 0;
+	if ( gl->done )
+		gl->done_tail->next = r;
+	else
+		gl->done = r;
+	gl->done_tail = r;
+	gl->done_count++;
+	gl->active--;
+	cond_signal( &gl->done_ready );
+}
+
+#if !GME_DISABLE_THREADS
+LOADER_THREAD_FUNC( loader_thread, arg )
+{
+	gme_loader_t* gl = (gme_loader_t*) arg;
+	mutex_lock( &gl->mutex );
+	while ( 1 )
+	{
+		while ( !gl->queue && !gl->stopping )
+			cond_wait( &gl->work_ready, &gl->mutex );
+		if ( gl->stopping )
+			break;
+		
+		Load_Request* r = gl->queue;
+		gl->queue = r->next;
+		mutex_unlock( &gl->mutex );
+		
+		load_request( r );
+		
+		mutex_lock( &gl->mutex );
+		finish_request( gl, r );
+	}
+	mutex_unlock( &gl->mutex );
+	return 0;
+}
+#endif
+
+BLARGG_EXPORT gme_loader_t* gme_loader_create( int thread_count )
+{
+	gme_loader_t* gl = BLARGG_NEW gme_loader_t;
+	if ( !gl )
+		return 0;
+	
+	mutex_init( &gl->mutex );
+	cond_init( &gl->work_ready );
+	cond_init( &gl->done_ready );
+	gl->queue      = 0;
+	gl->queue_tail = 0;
+	gl->done       = 0;
+	gl->done_tail  = 0;
+	gl->active     = 0;
+	gl->done_count = 0;
+	gl->stopping   = false;
+	gl->record_start_states = false;
+	memset( &gl->stats, 0, sizeof gl->stats );
+	
+#if !GME_DISABLE_THREADS
+	if ( thread_count < 1 )
+		thread_count = 1;
+	gl->thread_count = 0;
+	if ( !gl->threads.resize( thread_count ) )
+	{
+		// use as many threads as could be started
+		while ( gl->thread_count < thread_count &&
+				thread_start( &gl->threads [gl->thread_count], loader_thread, gl ) )
+			gl->thread_count++;
+	}
+	if ( !gl->thread_count )
+	{
+		gme_loader_delete( gl );
+		return 0;
+	}
+#else
+	(void) thread_count;
+#endif
+	
+	return gl;
+}
+
+BLARGG_EXPORT void gme_loader_delete( gme_loader_t* gl )
+{
+	if ( !gl )
+		return;
+	
+	mutex_lock( &gl->mutex );
+	gl->stopping = true;
+	delete_requests( gl->queue );
+	gl->queue = 0;
+	cond_broadcast( &gl->work_ready );
+	mutex_unlock( &gl->mutex );
+	
+#if !GME_DISABLE_THREADS
+	// threads finish requests they've started
+	while ( gl->thread_count )
+		thread_join( gl->threads [--gl->thread_count] );
+#endif
+	
+	delete_requests( gl->done );
+	cond_destroy( &gl->done_ready );
+	cond_destroy( &gl->work_ready );
+	mutex_destroy( &gl->mutex );
+	delete gl;
+}
+
+// Queues list of requests linked through next
+static void queue_requests( gme_loader_t* gl, Load_Request* first, Load_Request* last, int count )
+{
+	loader_time_t now = time_usec();
+	for ( Load_Request* r = first; r; r = r->next )
+		r->queued = now;
+	
+#if GME_DISABLE_THREADS
+	while ( first )
+	{
+		Load_Request* next = first->next;
+		load_request( first );
+		gl->active++;
+		finish_request( gl, first );
+		first = next;
+	}
+	(void) last;
+	(void) count;
+#else
+	mutex_lock( &gl->mutex );
+	if ( gl->queue )
+		gl->queue_tail->next = first;
+	else
+		gl->queue = first;
+	gl->queue_tail = last;
+	gl->active += count;
+	if ( count > 1 )
+		cond_broadcast( &gl->work_ready );
+	else
+		cond_signal( &gl->work_ready );
+	mutex_unlock( &gl->mutex );
+#endif
+}
+
+BLARGG_EXPORT void gme_loader_record_start_states( gme_loader_t* gl, int enabled )
+{
+	require( gl );
+	gl->record_start_states = (enabled != 0);
+}
+
+BLARGG_EXPORT gme_err_t gme_open_async( gme_loader_t* gl, const char* path, int rate,
+		gme_loaded_t callback, void* user_data )
+{
+	return gme_open_batch( gl, &path, 1, rate, callback, user_data );
+}
+
+BLARGG_EXPORT gme_err_t gme_open_batch( gme_loader_t* gl, const char* const* paths, int count,
+		int rate, gme_loaded_t callback, void* user_data )
+{
+	require( gl && (paths || !count) && callback );
+	
+	// allocate all first, so that either all or none are queued
+	Load_Request* first = 0;
+	Load_Request* last  = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		Load_Request* r = new_request( paths [i], rate, gl->record_start_states,
+				callback, user_data, i );
+		if ( !r )
+		{
+			delete_requests( first );
+			return "Out of memory";
+		}
+		if ( first )
+			last->next = r;
+		else
+			first = r;
+		last = r;
+	}
+	
+	if ( first )
+		queue_requests( gl, first, last, count );
+	
+	return 0;
+}
+
+BLARGG_EXPORT int gme_loader_poll( gme_loader_t* gl )
+{
+	require( gl );
+	
+	// take whole list, so callbacks can queue more requests
+	mutex_lock( &gl->mutex );
+	Load_Request* r = gl->done;
+	gl->done       = 0;
+	gl->done_tail  = 0;
+	gl->done_count = 0;
+	mutex_unlock( &gl->mutex );
+	
+	int count = 0;
+	while ( r )
+	{
+		Load_Request* next = r->next;
+		r->callback( r->user_data, r->index, r->emu, r->error );
+		free( r );
+		r = next;
+		count++;
+	}
+	return count;
+}
+
+BLARGG_EXPORT int gme_loader_wait( gme_loader_t* gl )
+{
+	require( gl );
+	
+	mutex_lock( &gl->mutex );
+	while ( !gl->done && gl->active )
+		cond_wait( &gl->done_ready, &gl->mutex );
+	mutex_unlock( &gl->mutex );
+	
+	return gme_loader_poll( gl );
+}
+
+BLARGG_EXPORT int gme_loader_pending( gme_loader_t* gl )
+{
+	require( gl );
+	
+	mutex_lock( &gl->mutex );
+	int count = gl->active + gl->done_count;
+	mutex_unlock( &gl->mutex );
+	return count;
+}
+
+BLARGG_EXPORT void gme_loader_stats( gme_loader_t* gl, gme_loader_stats_t* out )
+{
+	require( gl && out );
+	
+	mutex_lock( &gl->mutex );
+	*out = gl->stats;
+	mutex_unlock( &gl->mutex );
+}
@@ -0,0 +1,40 @@
+// Game_Music_Emu 0.5.5. http://www.slack.net/~ant/
+
+#include "Gme_Stats.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#ifdef GME_STATS
+
+#include <time.h>
+
+GME_STATS_THREAD Gme_Stats_Thread gme_stats_thread;
+
+double gme_stats_time_rate()
+{
+	static double rate;
+	if ( !rate )
+	{
+		// time stamp counter against clock() over about 1/20 second
+		clock_t start = clock();
+		clock_t begin;
+		while ( (begin = clock()) == start ) { }
+		gme_counter_t time_begin = GME_STATS_TIME();
+		clock_t end;
+		while ( (end = clock()) - begin < CLOCKS_PER_SEC / 20 ) { }
+		gme_counter_t time_end = GME_STATS_TIME();
+		rate = (double) (time_end - time_begin) * CLOCKS_PER_SEC / (end - begin);
+	}
+	return rate;
+}
+
+#endif
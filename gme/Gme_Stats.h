@@ -0,0 +1,110 @@
+// Optional counters and timers for profiling emulation (see gme_stats() in gme.h)
+
+// Game_Music_Emu 0.5.5
+#ifndef GME_STATS_H
+#define GME_STATS_H
+
+#include "blargg_config.h"
+
+// Everything here compiles to nothing unless GME_STATS is defined
+
+#ifdef GME_STATS
+
+#include "gme.h"
+
+#if defined (_MSC_VER) && (defined (_M_IX86) || defined (_M_X64))
+	#include <intrin.h>
+	#define GME_STATS_TIME() ((gme_counter_t) __rdtsc())
+#elif defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+	#include <x86intrin.h>
+	#define GME_STATS_TIME() ((gme_counter_t) __rdtsc())
+#else
+	#include <time.h>
+	#define GME_STATS_TIME() ((gme_counter_t) clock())
+#endif
+
+#if __cplusplus >= 201103L
+	#define GME_STATS_THREAD thread_local
+#elif defined (_MSC_VER)
+	#define GME_STATS_THREAD __declspec(thread)
+#else
+	#define GME_STATS_THREAD __thread
+#endif
+
+// Stats being collected by current thread
+struct Gme_Stats_Thread {
+	gme_stats_t* stats; // NULL if not inside Music_Emu
+	int stage;
+	gme_counter_t stage_start;
+};
+extern GME_STATS_THREAD Gme_Stats_Thread gme_stats_thread;
+
+// Approximate rate of GME_STATS_TIME(), measured on first call
+double gme_stats_time_rate();
+
+// Charges time so far to current stage, then switches to new stage. Returns previous stage.
+inline int gme_stats_enter( int stage )
+{
+	Gme_Stats_Thread& t = gme_stats_thread;
+	int prev = t.stage;
+	if ( t.stats )
+	{
+		gme_counter_t now = GME_STATS_TIME();
+		t.stats->ticks [prev] += now - t.stage_start;
+		t.stage_start = now;
+	}
+	t.stage = stage;
+	return prev;
+}
+
+// Charges time to stage while in scope
+class Gme_Stats_Stage {
+	int prev;
+public:
+	Gme_Stats_Stage( int stage )    { prev = gme_stats_enter( stage ); }
+	~Gme_Stats_Stage()              { gme_stats_enter( prev ); }
+};
+
+// Collects into stats while in scope. Can be nested.
+class Gme_Stats_Scope {
+	Gme_Stats_Thread saved;
+public:
+	Gme_Stats_Scope( gme_stats_t* stats )
+	{
+		gme_stats_enter( gme_stage_other );
+		saved = gme_stats_thread;
+		gme_stats_thread.stats       = stats;
+		gme_stats_thread.stage       = gme_stage_other;
+		gme_stats_thread.stage_start = GME_STATS_TIME();
+	}
+	~Gme_Stats_Scope()
+	{
+		gme_stats_enter( gme_stage_other );
+		gme_counter_t now = gme_stats_thread.stage_start;
+		gme_stats_thread = saved;
+		gme_stats_thread.stage_start = now;
+	}
+};
+
+#define GME_STATS_SCOPE( stats )    Gme_Stats_Scope gme_stats_scope_( stats )
+#define GME_STATS_STAGE( stage )    Gme_Stats_Stage gme_stats_stage_( stage )
+
+// Adds n to field of gme_stats_t
+#define GME_STATS_ADD( field, n ) \
+	do { if ( gme_stats_thread.stats ) gme_stats_thread.stats->field += (n); } while ( 0 )
+
+#else
+
+#define GME_STATS_SCOPE( stats )    ((void) 0)
+#define GME_STATS_STAGE( stage )    ((void) 0)
+#define GME_STATS_ADD( field, n )   ((void) 0)
+
+#endif
+
+// Counts register write to chip
+#define GME_STATS_WRITE( chip )     GME_STATS_ADD( writes [gme_chip_##chip], 1 )
+
+// Counts n oscillator clocks that chip skipped over without running
+#define GME_STATS_IDLE( chip, n )   GME_STATS_ADD( idle_clocks [gme_chip_##chip], n )
+
+#endif
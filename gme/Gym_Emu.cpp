@@ -362,7 +362,8 @@ void Gym_Emu::parse_frame()
 
 int Gym_Emu::play_frame( blip_time_t blip_time, int sample_count, sample_t* buf )
 {
-	if ( !track_ended() )
+	// track_ended() lags behind end of data due to silence lookahead
+	if ( pos < data_end )
 		parse_frame();
 	
 	apu.end_frame( blip_time );
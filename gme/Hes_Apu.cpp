@@ -4,6 +4,9 @@
 
 #include <string.h>
 
+#include "blargg_lfsr.h"
+#include "blargg_state.h"
+
 /* Copyright (C) 2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -53,6 +56,23 @@ void Hes_Apu::reset()
 	while ( osc != oscs );
 }
 
+void Hes_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Hes_Osc& osc = oscs [i];
+		copier.copy( &osc, offsetof (Hes_Osc,outputs) );
+		copier( osc.noise_lfsr );
+		copier( osc.control );
+	}
+	copier( latch );
+	copier( balance );
+	
+	if ( copier.loading() )
+		for ( int i = 0; i < osc_count; i++ )
+			balance_changed( oscs [i] );
+}
+
 void Hes_Apu::osc_output( int index, Blip_Buffer* center, Blip_Buffer* left, Blip_Buffer* right )
 {
 	require( (unsigned) index < osc_count );
@@ -69,6 +89,18 @@ void Hes_Apu::osc_output( int index, Blip_Buffer* center, Blip_Buffer* left, Bli
 	while ( osc != oscs );
 }
 
+static blargg_ulong noise_step( blargg_ulong lfsr )
+{
+	return (lfsr >> 1) ^ (0xE008 & (0 - (lfsr & 1)));
+}
+
+// Noise LFSR after count steps, without running them one at a time
+static unsigned jump_noise( unsigned lfsr, blargg_long count )
+{
+	static Blargg_Lfsr_Jump const noise_jump( noise_step, 16 ); // built on first use
+	return (unsigned) noise_jump.run( lfsr, count );
+}
+
 void Hes_Osc::run_until( synth_t& synth_, blip_time_t end_time )
 {
 	Blip_Buffer* const osc_outputs_0 = outputs [0]; // cache often-used values
@@ -126,6 +158,15 @@ void Hes_Osc::run_until( synth_t& synth_, blip_time_t end_time )
 					this->noise_lfsr = noise_lfsr;
 					assert( noise_lfsr );
 				}
+				else
+				{
+					// keep noise running while silent
+					GME_STATS_IDLE( hes_apu, end_time - time );
+					int const period = (32 - (noise & 0x1F)) * 64;
+					blargg_long count = (end_time - time + period - 1) / period;
+					noise_lfsr = jump_noise( noise_lfsr, count );
+					time += count * period;
+				}
 			}
 			else if ( !(control & 0x40) )
 			{
@@ -162,6 +203,7 @@ void Hes_Osc::run_until( synth_t& synth_, blip_time_t end_time )
 					}
 					
 					// maintain phase when silent
+					GME_STATS_IDLE( hes_apu, end_time - time );
 					blargg_long count = (end_time - time + period - 1) / period;
 					phase += count; // phase will be masked below
 					time += count * period;
@@ -178,6 +220,10 @@ void Hes_Osc::run_until( synth_t& synth_, blip_time_t end_time )
 		last_amp [0] = dac * volume_0;
 		last_amp [1] = dac * volume_1;
 	}
+	else
+	{
+		GME_STATS_IDLE( hes_apu, end_time - last_time );
+	}
 	last_time = end_time;
 }
 
@@ -229,6 +275,8 @@ void Hes_Apu::balance_changed( Hes_Osc& osc )
 
 void Hes_Apu::write_data( blip_time_t time, int addr, int data )
 {
+	GME_STATS_WRITE( hes_apu );
+	GME_STATS_STAGE( gme_stage_apu );
 	if ( addr == 0x800 )
 	{
 		latch = data & 7;
@@ -302,6 +350,7 @@ void Hes_Apu::write_data( blip_time_t time, int addr, int data )
 
 void Hes_Apu::end_frame( blip_time_t end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	Hes_Osc* osc = &oscs [osc_count];
 	do
 	{
@@ -7,6 +7,8 @@
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
 
+class Blargg_State_Copier;
+
 struct Hes_Osc
 {
 	unsigned char wave [32];
@@ -47,6 +49,8 @@ public:
 	
 	void end_frame( blip_time_t );
 	
+	void copy_state( Blargg_State_Copier& );
+	
 public:
 	Hes_Apu();
 private:
@@ -3,6 +3,7 @@
 #include "Hes_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
@@ -49,7 +50,7 @@ Hes_Emu::~Hes_Emu() { }
 void Hes_Emu::unload()
 {
 	rom.clear();
-	Music_Emu::unload();
+	Classic_Emu::unload();
 }
 
 // Track info
@@ -141,7 +142,7 @@ gme_type_t const gme_hes_type = &gme_hes_type_;
 blargg_err_t Hes_Emu::load_( Data_Reader& in )
 {
 	assert( offsetof (header_t,unused [4]) == header_size );
-	RETURN_ERR( rom.load( in, header_size, &header_, unmapped ) );
+	RETURN_ERR( rom.load( in, header_size, &header_, unmapped, shared_rom() ) );
 	
 	RETURN_ERR( check_hes_header( header_.tag ) );
 	
@@ -252,6 +253,43 @@ blargg_err_t Hes_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Hes_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	RETURN_ERR( copy_buffer_state( copier ) );
+	
+	copier( ram );
+	copier( sgx );
+	
+	if ( copier.loading() )
+		cpu::reset();
+	copier( r );
+	copier( mmr );
+	if ( copier.loading() )
+	{
+		for ( int i = 0; i <= page_count; i++ )
+			set_mmr( i, mmr [i] );
+	}
+	hes_time_t end      = end_time();
+	hes_time_t next_irq = irq_time();
+	hes_time_t time     = this->time();
+	copier( end );
+	copier( next_irq );
+	copier( time );
+	set_end_time( end );
+	set_irq_time( next_irq );
+	set_time( time );
+	
+	copier( timer );
+	copier( vdp );
+	copier( irq );
+	copier( last_frame_hook );
+	recalc_timer_load();
+	
+	apu.copy_state( copier );
+	
+	return 0;
+}
+
 // Hardware
 
 void Hes_Emu::cpu_write_vdp( int addr, int data )
@@ -3,6 +3,7 @@
 #include "Kss_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
@@ -110,7 +111,7 @@ gme_type_t const gme_kss_type = &gme_kss_type_;
 void Kss_Emu::update_gain()
 {
 	double g = gain() * 1.4;
-	if ( scc_accessed )
+	if ( scc_accessed && gain_updated )
 		g *= 1.5;
 	ay.volume( g );
 	scc.volume( g );
@@ -123,7 +124,7 @@ blargg_err_t Kss_Emu::load_( Data_Reader& in )
 	memset( &header_, 0, sizeof header_ );
 	assert( offsetof (header_t,device_flags) == header_size - 1 );
 	assert( offsetof (ext_header_t,msx_audio_vol) == ext_header_size - 1 );
-	RETURN_ERR( rom.load( in, header_size, STATIC_CAST(header_t*,&header_), 0 ) );
+	RETURN_ERR( rom.load( in, header_size, STATIC_CAST(header_t*,&header_), 0, shared_rom() ) );
 	
 	RETURN_ERR( check_kss_header( header_.tag ) );
 	
@@ -211,13 +212,40 @@ blargg_err_t Kss_Emu::start_track_( int track )
 	memcpy( ram + 0x93, vectors, sizeof vectors );
 	
 	// copy non-banked data into RAM
+	long load_size = map_memory();
+	memcpy( ram + get_le16( header_.load_addr ), rom.begin() + header_.extra_header, load_size );
+	
+	ram [idle_addr] = 0xFF;
+	banks [0] = -1;
+	banks [1] = -1;
+	
+	ay.reset();
+	scc.reset();
+	if ( sn )
+		sn->reset();
+	r.sp = 0xF380;
+	ram [--r.sp] = idle_addr >> 8;
+	ram [--r.sp] = idle_addr & 0xFF;
+	r.b.a = track;
+	r.pc = get_le16( header_.init_addr );
+	next_play = play_period;
+	scc_accessed = false;
+	gain_updated = false;
+	update_gain();
+	ay_latch = 0;
+	
+	return 0;
+}
+
+// Sets up banks and maps RAM everywhere. Returns size of non-banked data.
+long Kss_Emu::map_memory()
+{
 	unsigned load_addr = get_le16( header_.load_addr );
 	long orig_load_size = get_le16( header_.load_size );
 	long load_size = min( orig_load_size, rom.file_size() );
 	load_size = min( load_size, long (mem_size - load_addr) );
 	if ( load_size != orig_load_size )
 		set_warning( "Excessive data size" );
-	memcpy( ram + load_addr, rom.begin() + header_.extra_header, load_size );
 	
 	rom.set_addr( -load_size - header_.extra_header );
 	
@@ -234,26 +262,10 @@ blargg_err_t Kss_Emu::start_track_( int track )
 	//debug_printf( "bank_size : $%X\n", bank_size );
 	//debug_printf( "bank_count: %d (%d claimed)\n", bank_count, header_.bank_mode & 0x7F );
 	
-	ram [idle_addr] = 0xFF;
 	cpu::reset( unmapped_write, unmapped_read );
 	cpu::map_mem( 0, mem_size, ram, ram );
 	
-	ay.reset();
-	scc.reset();
-	if ( sn )
-		sn->reset();
-	r.sp = 0xF380;
-	ram [--r.sp] = idle_addr >> 8;
-	ram [--r.sp] = idle_addr & 0xFF;
-	r.b.a = track;
-	r.pc = get_le16( header_.init_addr );
-	next_play = play_period;
-	scc_accessed = false;
-	gain_updated = false;
-	update_gain();
-	ay_latch = 0;
-	
-	return 0;
+	return load_size;
 }
 
 void Kss_Emu::set_bank( int logical, int physical )
@@ -263,6 +275,7 @@ void Kss_Emu::set_bank( int logical, int physical )
 	unsigned addr = 0x8000;
 	if ( logical && bank_size == 8 * 1024 )
 		addr = 0xA000;
+	banks [addr == 0xA000] = physical;
 	
 	physical -= header_.first_bank;
 	if ( (unsigned) physical >= (unsigned) bank_count )
@@ -296,7 +309,8 @@ void Kss_Emu::cpu_write( unsigned addr, int data )
 	int scc_addr = (addr & 0xDFFF) ^ 0x9800;
 	if ( scc_addr < scc.reg_count )
 	{
-		scc_accessed = true;
+		if ( !gain_updated )
+			scc_accessed = true;
 		scc.write( time(), scc_addr, data );
 		return;
 	}
@@ -372,6 +386,47 @@ int kss_cpu_in( Kss_Cpu*, cpu_time_t, unsigned addr )
 	return 0;
 }
 
+blargg_err_t Kss_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	RETURN_ERR( copy_buffer_state( copier ) );
+	
+	copier( banks );
+	if ( copier.loading() )
+	{
+		map_memory();
+		set_bank( 0, banks [0] );
+		if ( bank_size() == 8 * 1024 )
+			set_bank( 1, banks [1] );
+	}
+	copier( r );
+	cpu_time_t time = this->time();
+	copier( time );
+	set_time( time );
+	copier( ram );
+	
+	copier( next_play );
+	copier( ay_latch );
+	copier( scc_accessed );
+	copier( gain_updated );
+	if ( copier.loading() )
+	{
+		// make same gain changes as starting track then playing, since synth
+		// rounding depends on previous volume
+		bool updated = gain_updated;
+		gain_updated = false;
+		update_gain();
+		gain_updated = updated;
+		update_gain();
+	}
+	
+	ay.copy_state( copier );
+	scc.copy_state( copier );
+	if ( sn )
+		sn->copy_state( copier );
+	
+	return 0;
+}
+
 // Emulation
 
 blargg_err_t Kss_Emu::run_clocks( blip_time_t& duration, int )
@@ -59,18 +59,21 @@ protected:
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
 	void unload();
+	blargg_err_t copy_state_( Blargg_State_Copier& );
 private:
 	Rom_Data<page_size> rom;
 	composite_header_t header_;
 	
-	bool scc_accessed;
-	bool gain_updated;
+	bool scc_accessed; // before first play call
+	bool gain_updated; // set by first play call
 	void update_gain();
 	
 	unsigned scc_enabled; // 0 or 0xC000
 	byte const* bank_data;
 	int bank_count;
+	int banks [2]; // last selected at $8000 and $A000, or -1 if RAM was never replaced
 	void set_bank( int logical, int physical );
+	long map_memory();
 	blargg_long bank_size() const { return (16 * 1024L) >> (header_.bank_mode >> 7 & 1); }
 	
 	blip_time_t play_period;
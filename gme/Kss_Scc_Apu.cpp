@@ -2,6 +2,8 @@
 
 #include "Kss_Scc_Apu.h"
 
+#include "blargg_state.h"
+
 /* Copyright (C) 2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -21,15 +23,32 @@ unsigned const inaudible_freq = 16384;
 
 int const wave_size = 0x20;
 
+void Scc_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		osc_t& osc = oscs [i];
+		copier( osc.delay );
+		copier( osc.phase );
+		copier( osc.last_amp );
+	}
+	copier( regs );
+	copier( last_time );
+}
+
 void Scc_Apu::run_until( blip_time_t end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	for ( int index = 0; index < osc_count; index++ )
 	{
 		osc_t& osc = oscs [index];
 		
 		Blip_Buffer* const output = osc.output;
 		if ( !output )
+		{
+			GME_STATS_IDLE( scc, end_time - last_time );
 			continue;
+		}
 		output->set_modified();
 		
 		blip_time_t period = (regs [0x80 + index * 2 + 1] & 0x0F) * 0x100 +
@@ -62,6 +81,7 @@ void Scc_Apu::run_until( blip_time_t end_time )
 			if ( !volume )
 			{
 				// maintain phase
+				GME_STATS_IDLE( scc, end_time - time );
 				blargg_long count = (end_time - time + period - 1) / period;
 				osc.phase = (osc.phase + count) & (wave_size - 1);
 				time += count * period;
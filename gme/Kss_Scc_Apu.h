@@ -8,6 +8,8 @@
 #include "Blip_Buffer.h"
 #include <string.h>
 
+class Blargg_State_Copier;
+
 class Scc_Apu {
 public:
 	// Set buffer to generate all sound into, or disable sound if NULL
@@ -38,6 +40,9 @@ public:
 	// Set treble equalization (see documentation)
 	void treble_eq( blip_eq_t const& );
 	
+	// Copy exact emulation state to/from saved state (see blargg_state.h)
+	void copy_state( Blargg_State_Copier& );
+	
 public:
 	Scc_Apu();
 private:
@@ -69,6 +74,7 @@ inline void Scc_Apu::osc_output( int index, Blip_Buffer* b )
 
 inline void Scc_Apu::write( blip_time_t time, int addr, int data )
 {
+	GME_STATS_WRITE( scc );
 	assert( (unsigned) addr < reg_count );
 	run_until( time );
 	regs [addr] = data;
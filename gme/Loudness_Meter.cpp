@@ -0,0 +1,445 @@
+// Game_Music_Emu 0.5.5. http://www.slack.net/~ant/
+
+#include "Loudness_Meter.h"
+
+#include <string.h>
+#include <math.h>
+
+#if BLARGG_X86_SIMD
+	#include <emmintrin.h>
+#endif
+
+/* Copyright (C) 2006 Shay Green. This module is free software; you
+can redistribute it and/or modify it under the terms of the GNU Lesser
+General Public License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version. This
+module is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+details. You should have received a copy of the GNU Lesser General Public
+License along with this module; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
+
+#include "blargg_source.h"
+
+#undef PI
+#define PI 3.1415926535897932384626433832795029
+
+int const stereo = 2;
+double const abs_gate = -70.0; // LUFS
+double const integrated_gate = 10.0; // LU below mean of blocks above abs_gate
+double const range_gate = 20.0;
+double const replay_gain_ref = -18.0; // LUFS, as used by ReplayGain 2.0
+
+static double loudness( double energy )
+{
+	return (energy > 0 ? -0.691 + 10 * log10( energy ) : -HUGE_VAL);
+}
+
+Loudness_Meter::Loudness_Meter()
+{
+	sse2 = false;
+	#if BLARGG_X86_SIMD
+		sse2 = blargg_cpu_has( blargg_cpu_sse2 );
+	#endif
+	
+	// Interpolates between samples at quarter-sample offsets, using Hann-windowed
+	// sinc. Phase 0 passes samples through unchanged.
+	for ( int p = 0; p < tp_phases; p++ )
+	{
+		double sum = 0;
+		double h [tp_taps];
+		for ( int j = 0; j < tp_taps; j++ )
+		{
+			double x = j - tp_taps / 2 + (double) p / tp_phases;
+			double sinc = (x == floor( x ) ? (x ? 0.0 : 1.0) : sin( PI * x ) / (PI * x));
+			h [j] = sinc * (0.5 + 0.5 * cos( PI * x / (tp_taps / 2) ));
+			sum += h [j];
+		}
+		for ( int j = 0; j < tp_taps; j++ )
+			tp_coefs [j] [p] = (float) (h [j] / sum);
+	}
+	
+	set_sample_rate( 44100 );
+}
+
+// K-weighting filters of ITU-R BS.1770, derived for any sample rate
+void Loudness_Meter::set_sample_rate( long rate )
+{
+	sample_rate = rate;
+	
+	// high shelf modelling head
+	{
+		double const f0 = 1681.974450955533;
+		double const gain = 3.999843853973347;
+		double const q = 0.7071752369554196;
+		double k = tan( PI * f0 / rate );
+		double vh = pow( 10.0, gain / 20 );
+		double vb = pow( vh, 0.4996667741545416 );
+		double a0 = 1 + k / q + k * k;
+		coefs [0] [0] = (vh + vb * k / q + k * k) / a0;
+		coefs [0] [1] = 2 * (k * k - vh) / a0;
+		coefs [0] [2] = (vh - vb * k / q + k * k) / a0;
+		coefs [0] [3] = 2 * (k * k - 1) / a0;
+		coefs [0] [4] = (1 - k / q + k * k) / a0;
+	}
+	
+	// RLB high-pass
+	{
+		double const f0 = 38.13547087602444;
+		double const q = 0.5003270373238773;
+		double k = tan( PI * f0 / rate );
+		double a0 = 1 + k / q + k * k;
+		coefs [1] [0] = 1;
+		coefs [1] [1] = -2;
+		coefs [1] [2] = 1;
+		coefs [1] [3] = 2 * (k * k - 1) / a0;
+		coefs [1] [4] = (1 - k / q + k * k) / a0;
+	}
+	
+	sub_block_size = (rate + 5) / 10;
+	clear();
+}
+
+void Loudness_Meter::clear()
+{
+	memset( state, 0, sizeof state );
+	memset( tp_hist, 0, sizeof tp_hist );
+	memset( energies, 0, sizeof energies );
+	memset( &momentary, 0, sizeof momentary );
+	memset( &short_term, 0, sizeof short_term );
+	sub_block_remain = sub_block_size;
+	sub_block_sum [0] = 0;
+	sub_block_sum [1] = 0;
+	sub_block_count = 0;
+	momentary_max   = 0;
+	short_term_max  = 0;
+	true_peak       = 0;
+	sample_peak     = 0;
+	clipped         = 0;
+	sample_count    = 0;
+}
+
+// Blocks
+
+void Loudness_Meter::add_block( hist_t& hist, double energy )
+{
+	double l = loudness( energy );
+	if ( l < abs_gate )
+		return;
+	
+	int i = (int) ((l - abs_gate) * 10);
+	if ( i >= hist_size )
+		i = hist_size - 1;
+	hist.count  [i]++;
+	hist.energy [i] += energy;
+}
+
+// Mean energy of blocks in histogram no more than 'gate' LU below the mean of those
+// above the absolute gate, and index of first bin included
+double Loudness_Meter::gated_mean( hist_t const& hist, double gate, int* first_bin )
+{
+	*first_bin = hist_size;
+	double sum = 0;
+	blargg_long count = 0;
+	for ( int i = 0; i < hist_size; i++ )
+	{
+		sum   += hist.energy [i];
+		count += hist.count  [i];
+	}
+	if ( !count )
+		return 0;
+	
+	int first = (int) ceil( (loudness( sum / count ) - gate - abs_gate) * 10 );
+	if ( first < 0 )
+		first = 0;
+	*first_bin = first;
+	
+	sum = 0;
+	count = 0;
+	for ( int i = first; i < hist_size; i++ )
+	{
+		sum   += hist.energy [i];
+		count += hist.count  [i];
+	}
+	return (count ? sum / count : 0);
+}
+
+void Loudness_Meter::end_sub_block()
+{
+	double e = (sub_block_sum [0] + sub_block_sum [1]) / sub_block_size;
+	sub_block_sum [0] = 0;
+	sub_block_sum [1] = 0;
+	sub_block_remain = sub_block_size;
+	
+	energies [sub_block_count % short_term_blocks] = e;
+	sub_block_count++;
+	
+	// 400 ms momentary blocks overlap by 75%, 3 second short-term blocks by 29/30
+	double sum = 0;
+	for ( int i = 0; i < short_term_blocks; i++ )
+	{
+		sum += energies [(sub_block_count - 1 - i + short_term_blocks) % short_term_blocks];
+		if ( i == momentary_blocks - 1 && sub_block_count >= momentary_blocks )
+		{
+			double m = sum / momentary_blocks;
+			if ( momentary_max < m )
+				momentary_max = m;
+			add_block( momentary, m );
+		}
+	}
+	if ( sub_block_count >= short_term_blocks )
+	{
+		double s = sum / short_term_blocks;
+		if ( short_term_max < s )
+			short_term_max = s;
+		add_block( short_term, s );
+	}
+}
+
+void Loudness_Meter::results( gme_loudness_t* out ) const
+{
+	int first;
+	out->integrated     = loudness( gated_mean( momentary, integrated_gate, &first ) );
+	out->momentary_max  = loudness( momentary_max );
+	out->short_term_max = loudness( short_term_max );
+	out->replay_gain    = (out->integrated > abs_gate ? replay_gain_ref - out->integrated : 0);
+	
+	// loudness range is from 10th to 95th percentile of gated short-term blocks
+	out->range = 0;
+	gated_mean( short_term, range_gate, &first );
+	blargg_long total = 0;
+	for ( int i = first; i < hist_size; i++ )
+		total += short_term.count [i];
+	if ( total )
+	{
+		blargg_long low_rank  = (blargg_long) (total * 0.10);
+		blargg_long high_rank = (blargg_long) (total * 0.95);
+		int low = -1;
+		int high = -1;
+		blargg_long n = 0;
+		for ( int i = first; i < hist_size && high < 0; i++ )
+		{
+			n += short_term.count [i];
+			if ( low < 0 && n > low_rank )
+				low = i;
+			if ( n > high_rank )
+				high = i;
+		}
+		if ( high < 0 )
+			high = hist_size - 1;
+		out->range = (high - low) * 0.1;
+	}
+	
+	out->sample_peak = sample_peak * (1.0 / 32768);
+	out->true_peak   = (true_peak > out->sample_peak ? true_peak : out->sample_peak);
+	out->clipped     = clipped;
+	out->samples     = sample_count;
+}
+
+// Filtering
+
+// Input samples are in tp_hist, after the previous block's last tp_taps - 1
+#define BLOCK_INPUT( ch ) (&tp_hist [ch] [tp_taps - 1])
+
+// Keeps filter state from decaying into denormals during silence, which would be slow
+static void flush_denormals( double* p, int count )
+{
+	for ( int i = 0; i < count; i++ )
+		if ( fabs( p [i] ) < 1e-30 )
+			p [i] = 0;
+}
+
+void Loudness_Meter::filter( long count )
+{
+	for ( int ch = 0; ch < stereo; ch++ )
+	{
+		float const* in = BLOCK_INPUT( ch );
+		double sum = sub_block_sum [ch];
+		double z [2] [2];
+		for ( int f = 0; f < 2; f++ )
+		{
+			z [f] [0] = state [f] [0] [ch];
+			z [f] [1] = state [f] [1] [ch];
+		}
+		
+		for ( long i = 0; i < count; i++ )
+		{
+			double x = in [i];
+			for ( int f = 0; f < 2; f++ )
+			{
+				double const* c = coefs [f];
+				double y = c [0] * x + z [f] [0];
+				z [f] [0] = c [1] * x - c [3] * y + z [f] [1];
+				z [f] [1] = c [2] * x - c [4] * y;
+				x = y;
+			}
+			sum += x * x;
+		}
+		
+		sub_block_sum [ch] = sum;
+		for ( int f = 0; f < 2; f++ )
+		{
+			state [f] [0] [ch] = z [f] [0];
+			state [f] [1] [ch] = z [f] [1];
+		}
+	}
+	flush_denormals( &state [0] [0] [0], sizeof state / sizeof state [0] [0] [0] );
+}
+
+void Loudness_Meter::find_true_peak( long count )
+{
+	float peak = true_peak;
+	for ( int ch = 0; ch < stereo; ch++ )
+	{
+		float const* in = BLOCK_INPUT( ch );
+		for ( long i = 0; i < count; i++ )
+		{
+			float acc [tp_phases] = { 0 };
+			for ( int j = 0; j < tp_taps; j++ )
+			{
+				float s = in [i - j];
+				for ( int p = 0; p < tp_phases; p++ )
+					acc [p] += tp_coefs [j] [p] * s;
+			}
+			for ( int p = 0; p < tp_phases; p++ )
+			{
+				float a = (float) fabs( acc [p] );
+				if ( peak < a )
+					peak = a;
+			}
+		}
+	}
+	true_peak = peak;
+}
+
+#if BLARGG_X86_SIMD
+
+// Same as filter(), with left and right channels in the two lanes. Operations are
+// done in the same order, so results are identical.
+BLARGG_TARGET( "sse2" )
+void Loudness_Meter::filter_sse2( long count )
+{
+	float const* left  = BLOCK_INPUT( 0 );
+	float const* right = BLOCK_INPUT( 1 );
+	__m128d sum = _mm_loadu_pd( sub_block_sum );
+	__m128d z [2] [2];
+	__m128d c [2] [5];
+	for ( int f = 0; f < 2; f++ )
+	{
+		z [f] [0] = _mm_loadu_pd( state [f] [0] );
+		z [f] [1] = _mm_loadu_pd( state [f] [1] );
+		for ( int n = 0; n < 5; n++ )
+			c [f] [n] = _mm_set1_pd( coefs [f] [n] );
+	}
+	
+	for ( long i = 0; i < count; i++ )
+	{
+		__m128d x = _mm_set_pd( right [i], left [i] );
+		for ( int f = 0; f < 2; f++ )
+		{
+			__m128d y = _mm_add_pd( _mm_mul_pd( c [f] [0], x ), z [f] [0] );
+			z [f] [0] = _mm_add_pd( _mm_sub_pd( _mm_mul_pd( c [f] [1], x ),
+					_mm_mul_pd( c [f] [3], y ) ), z [f] [1] );
+			z [f] [1] = _mm_sub_pd( _mm_mul_pd( c [f] [2], x ), _mm_mul_pd( c [f] [4], y ) );
+			x = y;
+		}
+		sum = _mm_add_pd( sum, _mm_mul_pd( x, x ) );
+	}
+	
+	_mm_storeu_pd( sub_block_sum, sum );
+	for ( int f = 0; f < 2; f++ )
+	{
+		_mm_storeu_pd( state [f] [0], z [f] [0] );
+		_mm_storeu_pd( state [f] [1], z [f] [1] );
+	}
+	flush_denormals( &state [0] [0] [0], sizeof state / sizeof state [0] [0] [0] );
+}
+
+// Same as find_true_peak(), with the four phases in the four lanes
+BLARGG_TARGET( "sse2" )
+void Loudness_Meter::find_true_peak_sse2( long count )
+{
+	__m128 const abs_mask = _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) );
+	__m128 c [tp_taps];
+	for ( int j = 0; j < tp_taps; j++ )
+		c [j] = _mm_loadu_ps( tp_coefs [j] );
+	
+	__m128 peak = _mm_set1_ps( true_peak );
+	for ( int ch = 0; ch < stereo; ch++ )
+	{
+		float const* in = BLOCK_INPUT( ch );
+		for ( long i = 0; i < count; i++ )
+		{
+			__m128 acc = _mm_setzero_ps();
+			for ( int j = 0; j < tp_taps; j++ )
+				acc = _mm_add_ps( acc, _mm_mul_ps( c [j], _mm_set1_ps( in [i - j] ) ) );
+			peak = _mm_max_ps( peak, _mm_and_ps( acc, abs_mask ) );
+		}
+	}
+	
+	peak = _mm_max_ps( peak, _mm_shuffle_ps( peak, peak, 0x4E ) );
+	peak = _mm_max_ps( peak, _mm_shuffle_ps( peak, peak, 0xB1 ) );
+	true_peak = _mm_cvtss_f32( peak );
+}
+
+#endif
+
+void Loudness_Meter::analyze( sample_t const* in, long count )
+{
+	require( count % stereo == 0 );
+	count /= stereo;
+	sample_count += count;
+	
+	while ( count )
+	{
+		long n = count;
+		if ( n > block_size )
+			n = block_size;
+		if ( n > sub_block_remain )
+			n = sub_block_remain;
+		
+		// convert to float, finding sample peak and clipping in the same pass
+		float* left  = BLOCK_INPUT( 0 );
+		float* right = BLOCK_INPUT( 1 );
+		int peak = sample_peak;
+		for ( long i = 0; i < n; i++ )
+		{
+			int l = in [0];
+			int r = in [1];
+			in += stereo;
+			left  [i] = l * (1.0f / 32768);
+			right [i] = r * (1.0f / 32768);
+			
+			// clamped samples end up at one of the two extremes
+			clipped += (l == 0x7FFF || l == -0x8000) + (r == 0x7FFF || r == -0x8000);
+			if ( l < 0 ) l = -l;
+			if ( r < 0 ) r = -r;
+			if ( peak < l ) peak = l;
+			if ( peak < r ) peak = r;
+		}
+		sample_peak = peak;
+		
+		#if BLARGG_X86_SIMD
+		if ( sse2 )
+		{
+			filter_sse2( n );
+			find_true_peak_sse2( n );
+		}
+		else
+		#endif
+		{
+			filter( n );
+			find_true_peak( n );
+		}
+		
+		// keep last inputs for interpolation filter
+		for ( int ch = 0; ch < stereo; ch++ )
+			memmove( tp_hist [ch], &tp_hist [ch] [n], (tp_taps - 1) * sizeof tp_hist [ch] [0] );
+		
+		count -= n;
+		sub_block_remain -= n;
+		if ( !sub_block_remain )
+			end_sub_block();
+	}
+}
@@ -0,0 +1,85 @@
+// Streaming EBU R128 loudness, true peak, and clipping measurement of stereo output
+
+// Game_Music_Emu 0.5.5
+#ifndef LOUDNESS_METER_H
+#define LOUDNESS_METER_H
+
+#include "blargg_common.h"
+#include "blargg_cpu.h"
+#include "gme.h"
+
+// Measures samples as they're played, keeping only filter state, the last three
+// seconds of block energies, and histograms of block loudness, so memory use doesn't
+// grow with length. Gated loudness and loudness range are accurate to 0.1 LU, the
+// histograms' resolution.
+class Loudness_Meter {
+public:
+	typedef short sample_t;
+	
+	// Set sample rate and clear
+	void set_sample_rate( long );
+	
+	// Clear measurements
+	void clear();
+	
+	// Measure count samples of interleaved stereo output
+	void analyze( sample_t const* in, long count );
+	
+	// Results so far
+	void results( gme_loudness_t* out ) const;
+	
+public:
+	Loudness_Meter();
+	BLARGG_DISABLE_NOTHROW
+private:
+	enum { tp_taps = 12 };      // true peak interpolation filter width
+	enum { tp_phases = 4 };     // oversampling
+	enum { block_size = 256 };  // samples pairs filtered at once
+	enum { short_term_blocks = 30 }; // 100 ms sub-blocks in 3 second window
+	enum { momentary_blocks = 4 };   // in 400 ms window
+	enum { hist_size = 750 };   // 0.1 LU bins from -70 to +5 LUFS
+	
+	struct hist_t {
+		blargg_long count [hist_size];
+		double energy [hist_size];
+	};
+	
+	// K-weighting, as two biquads applied to each channel
+	double coefs [2] [5];       // [filter] b0 b1 b2 a1 a2
+	double state [2] [2] [2];   // [filter] [z1, z2] [channel]
+	
+	// 100 ms sub-blocks
+	long sub_block_size;
+	long sub_block_remain;
+	double sub_block_sum [2];   // [channel]
+	double energies [short_term_blocks]; // most recent sub-block energies, circular
+	blargg_long sub_block_count;
+	
+	hist_t momentary;
+	hist_t short_term;
+	double momentary_max;
+	double short_term_max;
+	
+	// peaks
+	float tp_coefs [tp_taps] [tp_phases];
+	float tp_hist [2] [tp_taps - 1 + block_size]; // [channel] previous then current input
+	float true_peak;
+	int sample_peak;
+	blargg_long clipped;
+	blargg_long sample_count;
+	
+	long sample_rate;
+	bool sse2;
+	
+	void filter( long count );
+	void find_true_peak( long count );
+	#if BLARGG_X86_SIMD
+		void filter_sse2( long count );
+		void find_true_peak_sse2( long count );
+	#endif
+	void end_sub_block();
+	static void add_block( hist_t&, double energy );
+	static double gated_mean( hist_t const&, double gate, int* first_bin );
+};
+
+#endif
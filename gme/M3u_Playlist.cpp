@@ -3,6 +3,7 @@
 #include "M3u_Playlist.h"
 #include "Music_Emu.h"
 
+#include "blargg_endian.h"
 #include <string.h>
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
@@ -24,6 +25,9 @@ blargg_err_t Gme_File::load_m3u_( blargg_err_t err )
 {
 	require( raw_track_count_ ); // file must be loaded first
 	
+	shared_playlist = 0;
+	shared_entries.clear();
+	track_count_ = raw_track_count_;
 	if ( !err )
 	{
 		if ( playlist.size() )
@@ -52,6 +56,32 @@ blargg_err_t Gme_File::load_m3u( const char* path ) { return load_m3u_( playlist
 
 blargg_err_t Gme_File::load_m3u( Data_Reader& in )  { return load_m3u_( playlist.load( in ) ); }
 
+blargg_err_t Gme_File::use_shared_m3u( M3u_Playlist const& shared, const char* file )
+{
+	require( raw_track_count_ ); // file must be loaded first
+	
+	playlist.clear();
+	shared_playlist = 0;
+	shared_entries.clear();
+	track_count_ = raw_track_count_;
+	
+	const char* type = type_->extension_;
+	int count = 0;
+	for ( int i = shared.find( file, type ); i >= 0; i = shared.find( file, type, i ) )
+		count++;
+	if ( !count )
+		return "No entries for file in m3u playlist";
+	
+	RETURN_ERR( shared_entries.resize( count ) );
+	count = 0;
+	for ( int i = shared.find( file, type ); i >= 0; i = shared.find( file, type, i ) )
+		shared_entries [count++] = i;
+	
+	shared_playlist = &shared;
+	track_count_ = count;
+	return 0;
+}
+
 BLARGG_EXPORT gme_err_t gme_load_m3u( Music_Emu* me, const char* path ) { return me->load_m3u( path ); }
 
 BLARGG_EXPORT gme_err_t gme_load_m3u_data( Music_Emu* me, const void* data, long size )
@@ -60,6 +90,59 @@ BLARGG_EXPORT gme_err_t gme_load_m3u_data( Music_Emu* me, const void* data, long
 	return me->load_m3u( in );
 }
 
+struct gme_playlist_t
+{
+	M3u_Playlist m3u;
+	
+	BLARGG_DISABLE_NOTHROW
+};
+
+static gme_err_t new_playlist( gme_playlist_t** out )
+{
+	*out = BLARGG_NEW gme_playlist_t;
+	CHECK_ALLOC( *out );
+	return 0;
+}
+
+static gme_err_t finish_playlist( gme_err_t err, gme_playlist_t** out )
+{
+	if ( err )
+	{
+		delete *out;
+		*out = 0;
+	}
+	return err;
+}
+
+BLARGG_EXPORT gme_err_t gme_playlist_load( const char* path, gme_playlist_t** out )
+{
+	RETURN_ERR( new_playlist( out ) );
+	return finish_playlist( (*out)->m3u.load( path ), out );
+}
+
+BLARGG_EXPORT gme_err_t gme_playlist_load_data( void const* data, long size, gme_playlist_t** out )
+{
+	RETURN_ERR( new_playlist( out ) );
+	return finish_playlist( (*out)->m3u.load( data, size ), out );
+}
+
+BLARGG_EXPORT gme_err_t gme_playlist_load_index( void const* data, long size, gme_playlist_t** out )
+{
+	RETURN_ERR( new_playlist( out ) );
+	return finish_playlist( (*out)->m3u.load_index( data, size ), out );
+}
+
+BLARGG_EXPORT long gme_playlist_index_size( gme_playlist_t const* pl ) { return pl->m3u.index_size(); }
+
+BLARGG_EXPORT void gme_playlist_save_index( gme_playlist_t const* pl, void* out ) { pl->m3u.save_index( out ); }
+
+BLARGG_EXPORT gme_err_t gme_use_playlist( Music_Emu* me, gme_playlist_t const* pl, const char* file )
+{
+	return me->use_shared_m3u( pl->m3u, file );
+}
+
+BLARGG_EXPORT void gme_playlist_delete( gme_playlist_t* pl ) { delete pl; }
+
 
 
 static char* skip_white( char* in )
@@ -396,11 +479,10 @@ blargg_err_t M3u_Playlist::parse_()
 blargg_err_t M3u_Playlist::parse()
 {
 	blargg_err_t err = parse_();
+	if ( !err )
+		err = build_hash();
 	if ( err )
-	{
-		entries.clear();
-		data.clear();
-	}
+		clear();
 	return err;
 }
 
@@ -424,3 +506,185 @@ blargg_err_t M3u_Playlist::load( void const* in, long size )
 	memcpy( data.begin(), in, size );
 	return parse();
 }
+
+// Lookup by file
+
+static unsigned hash_file( const char* s )
+{
+	unsigned h = 2166136261u; // FNV-1a
+	while ( *s )
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return h;
+}
+
+blargg_err_t M3u_Playlist::build_hash()
+{
+	int count = size();
+	int bucket_count = 16;
+	while ( bucket_count < count )
+		bucket_count *= 2;
+	RETURN_ERR( hash_heads.resize( bucket_count ) );
+	RETURN_ERR( hash_next.resize( count ) );
+	for ( int i = 0; i < bucket_count; i++ )
+		hash_heads [i] = -1;
+	
+	// insert in reverse so that each chain is in playlist order
+	for ( int i = count; --i >= 0; )
+	{
+		int& head = hash_heads [hash_file( entries [i].file ) & (bucket_count - 1)];
+		hash_next [i] = head;
+		head = i;
+	}
+	return 0;
+}
+
+static bool same_type( const char* x, const char* y )
+{
+	while ( 1 )
+	{
+		int a = *x++;
+		int b = *y++;
+		if ( (unsigned) (a - 'a') < 26 ) a -= 'a' - 'A';
+		if ( (unsigned) (b - 'a') < 26 ) b -= 'a' - 'A';
+		if ( a != b )
+			return false;
+		if ( !a )
+			return true;
+	}
+}
+
+int M3u_Playlist::find( const char* file, const char* type, int after ) const
+{
+	if ( !hash_heads.size() )
+		return -1;
+	
+	// chains are in playlist order, so continue from 'after' if it's for the same file
+	int i;
+	if ( (unsigned) after < (unsigned) size() && !strcmp( entries [after].file, file ) )
+		i = hash_next [after];
+	else
+		i = hash_heads [hash_file( file ) & (hash_heads.size() - 1)];
+	for ( ; i >= 0; i = hash_next [i] )
+	{
+		entry_t const& e = entries [i];
+		if ( i > after && !strcmp( e.file, file ) && (!type || !*e.type || same_type( e.type, type )) )
+			break;
+	}
+	return i;
+}
+
+// Binary index
+
+// "M3UI", string data size, entry count, first error, five info strings, then
+// string data, then entries. All integers are 32-bit little-endian, and strings
+// are offsets into string data, or -1 for an empty string not in the data.
+int const index_header_size = 4 + 4 * 8;
+int const index_entry_size  = 4 * 10;
+
+long M3u_Playlist::string_offset( const char* s ) const
+{
+	if ( s >= data.begin() && s < data.end() )
+		return s - data.begin();
+	check( !*s ); // only empty strings are outside data
+	return -1;
+}
+
+const char* M3u_Playlist::offset_string( blargg_long n ) const
+{
+	if ( (blargg_ulong) n < data.size() )
+		return &data [n];
+	return "";
+}
+
+long M3u_Playlist::index_size() const
+{
+	return index_header_size + data.size() + size() * (long) index_entry_size;
+}
+
+void M3u_Playlist::save_index( void* out_ ) const
+{
+	byte* out = (byte*) out_;
+	memcpy( out, "M3UI", 4 );
+	set_le32( out +  4, data.size() );
+	set_le32( out +  8, size() );
+	set_le32( out + 12, first_error_ );
+	set_le32( out + 16, string_offset( info_.title ) );
+	set_le32( out + 20, string_offset( info_.composer ) );
+	set_le32( out + 24, string_offset( info_.engineer ) );
+	set_le32( out + 28, string_offset( info_.ripping ) );
+	set_le32( out + 32, string_offset( info_.tagging ) );
+	out += index_header_size;
+	
+	memcpy( out, data.begin(), data.size() );
+	out += data.size();
+	
+	for ( int i = 0; i < size(); i++, out += index_entry_size )
+	{
+		entry_t const& e = entries [i];
+		set_le32( out +  0, string_offset( e.file ) );
+		set_le32( out +  4, string_offset( e.type ) );
+		set_le32( out +  8, string_offset( e.name ) );
+		set_le32( out + 12, e.decimal_track );
+		set_le32( out + 16, e.track );
+		set_le32( out + 20, e.length );
+		set_le32( out + 24, e.intro );
+		set_le32( out + 28, e.loop );
+		set_le32( out + 32, e.fade );
+		set_le32( out + 36, e.repeat );
+	}
+}
+
+blargg_err_t M3u_Playlist::load_index( void const* in_, long size )
+{
+	clear();
+	byte const* in = (byte const*) in_;
+	if ( size < index_header_size || memcmp( in, "M3UI", 4 ) )
+		return "Not an m3u playlist index";
+	
+	blargg_ulong data_size = get_le32( in + 4 );
+	blargg_ulong count     = get_le32( in + 8 );
+	blargg_ulong remain    = size - index_header_size;
+	if ( data_size > remain || count > (remain - data_size) / index_entry_size ||
+			data_size + count * index_entry_size != remain )
+		return "Corrupt m3u playlist index";
+	
+	RETURN_ERR( data.resize( data_size ) );
+	memcpy( data.begin(), in + index_header_size, data_size );
+	if ( data_size )
+		data.end() [-1] = 0; // keep strings terminated even if index is corrupt
+	
+	blargg_err_t err = entries.resize( count );
+	if ( err )
+	{
+		clear();
+		return err;
+	}
+	
+	first_error_   = (int) get_le32( in + 12 );
+	info_.title    = offset_string( get_le32( in + 16 ) );
+	info_.composer = offset_string( get_le32( in + 20 ) );
+	info_.engineer = offset_string( get_le32( in + 24 ) );
+	info_.ripping  = offset_string( get_le32( in + 28 ) );
+	info_.tagging  = offset_string( get_le32( in + 32 ) );
+	
+	in += index_header_size + data_size;
+	for ( blargg_ulong i = 0; i < count; i++, in += index_entry_size )
+	{
+		entry_t& e = entries [i];
+		e.file          = offset_string( get_le32( in +  0 ) );
+		e.type          = offset_string( get_le32( in +  4 ) );
+		e.name          = offset_string( get_le32( in +  8 ) );
+		e.decimal_track = get_le32( in + 12 ) != 0;
+		e.track         = (BOOST::int32_t) get_le32( in + 16 );
+		e.length        = (BOOST::int32_t) get_le32( in + 20 );
+		e.intro         = (BOOST::int32_t) get_le32( in + 24 );
+		e.loop          = (BOOST::int32_t) get_le32( in + 28 );
+		e.fade          = (BOOST::int32_t) get_le32( in + 32 );
+		e.repeat        = (BOOST::int32_t) get_le32( in + 36 );
+	}
+	
+	err = build_hash();
+	if ( err )
+		clear();
+	return err;
+}
@@ -45,16 +45,37 @@ public:
 	entry_t const& operator [] ( int i ) const { return entries [i]; }
 	int size() const { return entries.size(); }
 	
+	// Index of first entry after 'after' for file, or -1 if there are no more. If
+	// type isn't NULL, skips entries with a different ::TYPE suffix (ignoring case).
+	// Uses a hash table, so it stays fast for playlists covering many files.
+	int find( const char* file, const char* type = NULL, int after = -1 ) const;
+	
 	void clear();
 	
+// Compact binary form of parsed playlist, which loads without any parsing
+
+	// Size of binary form
+	long index_size() const;
+	
+	// Write binary form to out, which must hold index_size() bytes
+	void save_index( void* out ) const;
+	
+	// Load binary form written by save_index()
+	blargg_err_t load_index( void const* data, long size );
+	
 private:
 	blargg_vector<entry_t> entries;
 	blargg_vector<char> data;
+	blargg_vector<int> hash_heads; // [hash of file] first entry, or -1
+	blargg_vector<int> hash_next;  // [entry] next entry with same hash, or -1
 	int first_error_;
 	info_t info_;
 	
 	blargg_err_t parse();
 	blargg_err_t parse_();
+	blargg_err_t build_hash();
+	long string_offset( const char* ) const;
+	const char* offset_string( blargg_long ) const;
 };
 
 inline void M3u_Playlist::clear()
@@ -62,6 +83,8 @@ inline void M3u_Playlist::clear()
 	first_error_ = 0;
 	entries.clear();
 	data.clear();
+	hash_heads.clear();
+	hash_next.clear();
 }
 
 #endif
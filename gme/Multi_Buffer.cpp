@@ -2,6 +2,9 @@
 
 #include "Multi_Buffer.h"
 
+#include "blargg_state.h"
+#include <string.h>
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -28,6 +31,31 @@ Multi_Buffer::Multi_Buffer( int spf ) : samples_per_frame_( spf )
 
 blargg_err_t Multi_Buffer::set_channel_count( int ) { return 0; }
 
+blargg_err_t Multi_Buffer::copy_state( Blargg_State_Copier& )
+{
+	return "Sound buffer doesn't support saving state";
+}
+
+// Only samples waiting to be read and the partially accumulated deltas following
+// them are non-zero, so that's all that needs copying
+void Multi_Buffer::copy_blip_state( Blip_Buffer& b, Blargg_State_Copier& copier )
+{
+	if ( copier.loading() )
+		b.clear();
+	
+	copier( b.offset_ );
+	copier( b.reader_accum_ );
+	
+	int modified = b.clear_modified();
+	copier( modified );
+	if ( modified )
+		b.set_modified();
+	
+	long count = b.samples_avail() + blip_buffer_extra_;
+	assert( count <= b.buffer_size_ + blip_buffer_extra_ );
+	copier.copy( b.buffer_, count * sizeof *b.buffer_ );
+}
+
 // Silent_Buffer
 
 Silent_Buffer::Silent_Buffer() : Multi_Buffer( 1 ) // 0 channels would probably confuse
@@ -49,6 +77,12 @@ Mono_Buffer::Mono_Buffer() : Multi_Buffer( 1 )
 
 Mono_Buffer::~Mono_Buffer() { }
 
+blargg_err_t Mono_Buffer::copy_state( Blargg_State_Copier& copier )
+{
+	copy_blip_state( buf, copier );
+	return 0;
+}
+
 blargg_err_t Mono_Buffer::set_sample_rate( long rate, int msec )
 {
 	RETURN_ERR( buf.set_sample_rate( rate, msec ) );
@@ -66,6 +100,15 @@ Stereo_Buffer::Stereo_Buffer() : Multi_Buffer( 2 )
 
 Stereo_Buffer::~Stereo_Buffer() { }
 
+blargg_err_t Stereo_Buffer::copy_state( Blargg_State_Copier& copier )
+{
+	copier( stereo_added );
+	copier( was_stereo );
+	for ( int i = 0; i < buf_count; i++ )
+		copy_blip_state( bufs [i], copier );
+	return 0;
+}
+
 blargg_err_t Stereo_Buffer::set_sample_rate( long rate, int msec )
 {
 	for ( int i = 0; i < buf_count; i++ )
@@ -230,3 +273,168 @@ void Stereo_Buffer::mix_mono( blip_sample_t* out_, blargg_long count )
 	
 	BLIP_READER_END( center, bufs [0] );
 }
+
+// Multi_Rate_Buffer
+
+Multi_Rate_Buffer::Multi_Rate_Buffer() : Multi_Buffer( 2 )
+{
+	extra_count_ = 0;
+	clock_rate_  = 0;
+	bass_freq_   = 16;
+	for ( int i = 0; i < max_extra_rates; i++ )
+	{
+		extras [i].begin = 0;
+		extras [i].end   = 0;
+	}
+}
+
+Multi_Rate_Buffer::~Multi_Rate_Buffer() { }
+
+// Make everything added to from's buffers also be added to the corresponding ones of to
+static void link_buffers( Stereo_Buffer& from, Stereo_Buffer* to )
+{
+	from.center()->fanout_ = (to ? to->center() : 0);
+	from.left  ()->fanout_ = (to ? to->left  () : 0);
+	from.right ()->fanout_ = (to ? to->right () : 0);
+}
+
+blargg_err_t Multi_Rate_Buffer::set_sample_rate( long rate, int msec )
+{
+	RETURN_ERR( main.set_sample_rate( rate, msec ) );
+	RETURN_ERR( Multi_Buffer::set_sample_rate( main.sample_rate(), main.length() ) );
+	for ( int i = 0; i < extra_count_; i++ )
+		RETURN_ERR( extras [i].buf.set_sample_rate( extras [i].buf.sample_rate(), length() ) );
+	clear();
+	return 0;
+}
+
+blargg_err_t Multi_Rate_Buffer::set_extra_rates( long const* rates, int count )
+{
+	require( sample_rate() ); // set_sample_rate() must be called first
+	require( (unsigned) count <= max_extra_rates );
+	
+	// unlink first, so that failure leaves just the main rate
+	extra_count_ = 0;
+	link_buffers( main, 0 );
+	
+	for ( int i = 0; i < count; i++ )
+	{
+		Stereo_Buffer& buf = extras [i].buf;
+		RETURN_ERR( buf.set_sample_rate( rates [i], length() ) );
+		if ( clock_rate_ )
+			buf.clock_rate( clock_rate_ );
+		buf.bass_freq( bass_freq_ );
+	}
+	
+	for ( int i = 0; i < count; i++ )
+		link_buffers( extras [i].buf, (i + 1 < count ? &extras [i + 1].buf : 0) );
+	if ( count )
+		link_buffers( main, &extras [0].buf );
+	extra_count_ = count;
+	update_ratios();
+	clear();
+	return 0;
+}
+
+// Ratio of resampling factors rather than of sample rates, since the factors are
+// rounded and fan-out scales time by them
+void Multi_Rate_Buffer::update_ratios()
+{
+	for ( int i = 0; i < extra_count_; i++ )
+		extras [i].ratio = (double) extras [i].buf.center()->factor_ / main.center()->factor_;
+}
+
+void Multi_Rate_Buffer::clock_rate( long rate )
+{
+	clock_rate_ = rate;
+	main.clock_rate( rate );
+	for ( int i = 0; i < extra_count_; i++ )
+		extras [i].buf.clock_rate( rate );
+	update_ratios();
+}
+
+void Multi_Rate_Buffer::bass_freq( int freq )
+{
+	bass_freq_ = freq;
+	main.bass_freq( freq );
+	for ( int i = 0; i < extra_count_; i++ )
+		extras [i].buf.bass_freq( freq );
+}
+
+void Multi_Rate_Buffer::clear()
+{
+	main.clear();
+	for ( int i = 0; i < extra_count_; i++ )
+	{
+		extras [i].buf.clear();
+		extras [i].begin = 0;
+		extras [i].end   = 0;
+	}
+}
+
+void Multi_Rate_Buffer::end_frame( blip_time_t time )
+{
+	for ( int i = 0; i < extra_count_; i++ )
+	{
+		// synthesis only marks main buffers as modified
+		extra_t& e = extras [i];
+		if ( main.center()->modified() ) e.buf.center()->set_modified();
+		if ( main.left  ()->modified() ) e.buf.left  ()->set_modified();
+		if ( main.right ()->modified() ) e.buf.right ()->set_modified();
+		e.buf.end_frame( time );
+		queue_samples( e );
+	}
+	main.end_frame( time );
+}
+
+void Multi_Rate_Buffer::queue_samples( extra_t& e )
+{
+	long count = e.buf.samples_avail();
+	if ( e.end + count > (long) e.queue.size() )
+	{
+		// move unread samples to beginning, then grow if still needed
+		if ( e.begin )
+		{
+			memmove( e.queue.begin(), e.queue.begin() + e.begin,
+					(e.end - e.begin) * sizeof *e.queue.begin() );
+			e.end -= e.begin;
+			e.begin = 0;
+		}
+		
+		long size = e.queue.size();
+		if ( e.end + count > size )
+		{
+			size = max( size * 2, e.end + count );
+			if ( e.queue.resize( size ) )
+			{
+				e.buf.clear(); // out of memory; lose samples rather than fail
+				return;
+			}
+		}
+	}
+	e.end += e.buf.read_samples( e.queue.begin() + e.end, count );
+}
+
+long Multi_Rate_Buffer::extra_avail( int index, long pending ) const
+{
+	require( (unsigned) index < (unsigned) extra_count_ );
+	extra_t const& e = extras [index];
+	
+	// keep samples for the same time as pending ones, rounded to whole sample pairs
+	pending += main.samples_avail();
+	long keep = (long) (pending / 2 * e.ratio) * 2;
+	long avail = e.end - e.begin - keep;
+	return (avail > 0 ? avail : 0);
+}
+
+long Multi_Rate_Buffer::read_extra( int index, blip_sample_t* out, long count )
+{
+	require( (unsigned) index < (unsigned) extra_count_ );
+	extra_t& e = extras [index];
+	if ( count > e.end - e.begin )
+		count = e.end - e.begin;
+	if ( out )
+		memcpy( out, e.queue.begin() + e.begin, count * sizeof *out );
+	e.begin += count;
+	return count;
+}
@@ -6,6 +6,7 @@
 
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
+class Blargg_State_Copier;
 
 // Interface to one or more Blip_Buffers mapped to one or more channels
 // consisting of left, center, and right buffers.
@@ -51,10 +52,15 @@ public:
 	virtual long read_samples( blip_sample_t*, long ) = 0;
 	virtual long samples_avail() const = 0;
 	
+	// Copy buffered samples to/from saved state (see blargg_state.h). Returns error
+	// if not supported by this buffer type.
+	virtual blargg_err_t copy_state( Blargg_State_Copier& );
+	
 public:
 	BLARGG_DISABLE_NOTHROW
 protected:
 	void channels_changed() { channels_changed_count_++; }
+	static void copy_blip_state( Blip_Buffer&, Blargg_State_Copier& );
 private:
 	// noncopyable
 	Multi_Buffer( const Multi_Buffer& );
@@ -85,6 +91,7 @@ public:
 	long read_samples( blip_sample_t* p, long s ) { return buf.read_samples( p, s ); }
 	channel_t channel( int, int ) { return chan; }
 	void end_frame( blip_time_t t ) { buf.end_frame( t ); }
+	blargg_err_t copy_state( Blargg_State_Copier& );
 };
 
 // Uses three buffers (one for center) and outputs stereo sample pairs.
@@ -108,6 +115,7 @@ public:
 	
 	long samples_avail() const { return bufs [0].samples_avail() * 2; }
 	long read_samples( blip_sample_t*, long );
+	blargg_err_t copy_state( Blargg_State_Copier& );
 	
 private:
 	enum { buf_count = 3 };
@@ -121,6 +129,60 @@ private:
 	void mix_mono( blip_sample_t*, blargg_long );
 };
 
+// Generates output at several sample rates from one synthesis. Channels are those
+// of a Stereo_Buffer at the main rate, whose Blip_Buffers fan out to Stereo_Buffers
+// at the extra rates (see Blip_Buffer::fanout_). Only works when all sound is added
+// using Blip_Synth. Extra rates' output is queued until read with read_extra().
+class Multi_Rate_Buffer : public Multi_Buffer {
+public:
+	enum { max_extra_rates = 4 };
+	
+	// Set extra sample rates, replacing any previous ones. Must be called after
+	// set_sample_rate(). Clears buffer.
+	blargg_err_t set_extra_rates( long const* rates, int count );
+	
+	// Number of extra rates
+	int extra_count() const { return extra_count_; }
+	
+	// Number of samples at extra rate 'index' ready to be read, leaving those which
+	// correspond to the 'pending' most recent samples read at main rate, plus any
+	// still waiting in this buffer
+	long extra_avail( int index, long pending = 0 ) const;
+	
+	// Read at most count samples at extra rate 'index' to out, or discard them if out
+	// is NULL. Returns number of samples read.
+	long read_extra( int index, blip_sample_t* out, long count );
+	
+public:
+	Multi_Rate_Buffer();
+	~Multi_Rate_Buffer();
+	blargg_err_t set_sample_rate( long, int msec = blip_default_length );
+	void clock_rate( long );
+	void bass_freq( int );
+	void clear();
+	channel_t channel( int i, int type ) { return main.channel( i, type ); }
+	void end_frame( blip_time_t );
+	long samples_avail() const { return main.samples_avail(); }
+	long read_samples( blip_sample_t* out, long count ) { return main.read_samples( out, count ); }
+	
+private:
+	struct extra_t {
+		Stereo_Buffer buf;
+		blargg_vector<blip_sample_t> queue;
+		long begin;
+		long end;
+		double ratio; // samples generated per main rate sample
+	};
+	Stereo_Buffer main;
+	extra_t extras [max_extra_rates];
+	int extra_count_;
+	long clock_rate_;
+	int bass_freq_;
+	
+	void queue_samples( extra_t& );
+	void update_ratios();
+};
+
 // Silent_Buffer generates no samples, useful where no sound is wanted
 class Silent_Buffer : public Multi_Buffer {
 	channel_t chan;
@@ -134,6 +196,7 @@ public:
 	void end_frame( blip_time_t ) { }
 	long samples_avail() const { return 0; }
 	long read_samples( blip_sample_t*, long ) { return 0; }
+	blargg_err_t copy_state( Blargg_State_Copier& ) { return 0; }
 };
 
 
@@ -3,9 +3,12 @@
 #include "Music_Emu.h"
 
 #include "Multi_Buffer.h"
+#include "Loudness_Meter.h"
+#include "blargg_state.h"
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <stdint.h>
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -46,13 +49,17 @@ void Music_Emu::clear_track_vars()
 void Music_Emu::unload()
 {
 	voice_count_ = 0;
+	extra_count_ = 0;
 	clear_track_vars();
+	clear_start_states();
 	Gme_File::unload();
 }
 
 Music_Emu::Music_Emu()
 {
 	effects_buffer = 0;
+	stereo_depth_  = 0;
+	loudness_meter = 0;
 	
 	sample_rate_ = 0;
 	mute_mask_   = 0;
@@ -72,9 +79,17 @@ Music_Emu::Music_Emu()
 	};
 	set_voice_names( names );
 	Music_Emu::unload(); // non-virtual
+	
+#ifdef GME_STATS
+	clear_stats();
+#endif
 }
 
-Music_Emu::~Music_Emu() { delete effects_buffer; }
+Music_Emu::~Music_Emu()
+{
+	delete effects_buffer;
+	delete loudness_meter;
+}
 
 blargg_err_t Music_Emu::set_sample_rate( long rate )
 {
@@ -131,13 +146,34 @@ void Music_Emu::post_load_()
 	remute_voices();
 }
 
+#ifdef GME_STATS
+void Music_Emu::clear_stats() { memset( &stats_, 0, sizeof stats_ ); }
+#endif
+
 blargg_err_t Music_Emu::start_track( int track )
 {
+	GME_STATS_SCOPE( &stats_ );
 	clear_track_vars();
+	if ( loudness_meter )
+		loudness_meter->clear();
 	
 	int remapped = track;
 	RETURN_ERR( remap_track_( &remapped ) );
 	current_track_ = track;
+	if ( start_state_usable( remapped ) )
+	{
+		Blargg_State_Copier in( Blargg_State_Copier::load, &start_states [start_offsets [remapped]] );
+		RETURN_ERR( copy_track_state( in ) );
+	}
+	else
+	{
+		RETURN_ERR( start_remapped_track( remapped ) );
+	}
+	return track_ended() ? warning() : 0;
+}
+
+blargg_err_t Music_Emu::start_remapped_track( int remapped )
+{
 	RETURN_ERR( start_track_( remapped ) );
 	
 	emu_track_ended_ = false;
@@ -157,8 +193,139 @@ blargg_err_t Music_Emu::start_track( int track )
 		out_time      = 0;
 		silence_time  = 0;
 		silence_count = 0;
+		drop_extras();
 	}
-	return track_ended() ? warning() : 0;
+	return 0;
+}
+
+// Start states
+
+blargg_err_t Music_Emu::copy_state_( Blargg_State_Copier& )
+{
+	return "Emulator doesn't support start states";
+}
+
+void Music_Emu::clear_start_states()
+{
+	start_states.clear();
+	start_offsets.clear();
+}
+
+bool Music_Emu::start_state_usable( int remapped ) const
+{
+	return (unsigned) remapped < start_offsets.size() && start_offsets [remapped] >= 0 &&
+			tempo_ == start_tempo && mute_mask_ == start_mute_mask &&
+			stereo_depth_ == start_stereo_depth && ignore_silence_ == start_ignore_silence &&
+			equalizer_.treble == start_eq.treble && equalizer_.bass == start_eq.bass;
+}
+
+blargg_err_t Music_Emu::copy_track_state( Blargg_State_Copier& copier )
+{
+	copier( out_time );
+	copier( emu_time );
+	copier( emu_track_ended_ );
+	bool ended = track_ended_;
+	copier( ended );
+	track_ended_ = ended;
+	copier( silence_time );
+	copier( silence_count );
+	copier( buf_remain );
+	copier.copy( buf.begin(), buf_size * sizeof *buf.begin() );
+	RETURN_ERR( copy_state_( copier ) );
+	
+	// last, since loading emulator state can set warning
+	const char* w = warning(); // also clears it
+	copier( w );
+	set_warning( w );
+	return 0;
+}
+
+blargg_err_t Music_Emu::record_start_states()
+{
+	GME_STATS_SCOPE( &stats_ );
+	clear_start_states();
+	
+	// find out whether state can be saved before spending time starting tracks
+	Blargg_State_Copier probe( Blargg_State_Copier::measure );
+	RETURN_ERR( copy_state_( probe ) );
+	
+	// states are indexed by remapped track, so playlist entries for the same track share one
+	int count = 0;
+	for ( int i = 0; i < track_count(); i++ )
+	{
+		int remapped = i;
+		RETURN_ERR( remap_track_( &remapped ) );
+		if ( count <= remapped )
+			count = remapped + 1;
+	}
+	RETURN_ERR( start_offsets.resize( count ) );
+	for ( int i = 0; i < count; i++ )
+		start_offsets [i] = -1;
+	
+	blargg_err_t err = 0;
+	for ( int i = 0; i < track_count(); i++ )
+	{
+		int remapped = i;
+		remap_track_( &remapped );
+		if ( start_offsets [remapped] >= 0 )
+			continue;
+		
+		clear_track_vars();
+		current_track_ = i;
+		err = start_remapped_track( remapped );
+		if ( err )
+			break;
+		
+		Blargg_State_Copier measure( Blargg_State_Copier::measure );
+		err = copy_track_state( measure );
+		if ( err )
+			break;
+		
+		long offset = start_states.size();
+		err = start_states.resize( offset + measure.size() );
+		if ( err )
+			break;
+		
+		Blargg_State_Copier out( Blargg_State_Copier::save, &start_states [offset] );
+		copy_track_state( out );
+		start_offsets [remapped] = offset;
+	}
+	
+	clear_track_vars();
+	if ( err )
+	{
+		clear_start_states();
+		return err;
+	}
+	
+	start_eq             = equalizer_;
+	start_tempo          = tempo_;
+	start_stereo_depth   = stereo_depth_;
+	start_mute_mask      = mute_mask_;
+	start_ignore_silence = ignore_silence_;
+	return 0;
+}
+
+blargg_err_t Music_Emu::take_start_states( Music_Emu& other )
+{
+	if ( other.type() != type() || other.sample_rate() != sample_rate() )
+		return "Start states are from different type of emulator";
+	if ( !same_file( other ) )
+		return "Start states are from different file";
+	
+	clear_start_states();
+	RETURN_ERR( start_states.resize( other.start_states.size() ) );
+	RETURN_ERR( start_offsets.resize( other.start_offsets.size() ) );
+	memcpy( start_states.begin(), other.start_states.begin(), start_states.size() );
+	memcpy( start_offsets.begin(), other.start_offsets.begin(),
+			start_offsets.size() * sizeof *start_offsets.begin() );
+	start_eq             = other.start_eq;
+	start_tempo          = other.start_tempo;
+	start_stereo_depth   = other.start_stereo_depth;
+	start_mute_mask      = other.start_mute_mask;
+	start_ignore_silence = other.start_ignore_silence;
+	other.clear_start_states();
+	return 0;
 }
 
 void Music_Emu::end_track_if_error( blargg_err_t err )
@@ -170,6 +337,25 @@ void Music_Emu::end_track_if_error( blargg_err_t err )
 	}
 }
 
+void Music_Emu::cache_length( blargg_long end_time )
+{
+	int remapped = current_track_;
+	track_info_t info;
+	if ( remap_track_( &remapped ) || Gme_File::track_info( &info, current_track_ ) )
+		return;
+	
+	// lengths are for tempo of 1.0
+	double const scale = tempo_ * 1000 / (stereo * sample_rate());
+	gme_track_length_t length;
+	length.length        = (int) (end_time * scale);
+	length.intro_length  = (int) info.intro_length;
+	length.loop_length   = (int) info.loop_length;
+	length.silence_start = -1;
+	if ( !ignore_silence_ )
+		length.silence_start = (int) (min( (blargg_long) silence_time, end_time ) * scale);
+	cache_length_( remapped, length );
+}
+
 // Tell/Seek
 
 blargg_long Music_Emu::msec_to_samples( blargg_long msec ) const
@@ -197,6 +383,7 @@ blargg_err_t Music_Emu::seek( long msec )
 blargg_err_t Music_Emu::skip( long count )
 {
 	require( current_track() >= 0 ); // start_track() must have been called already
+	GME_STATS_SCOPE( &stats_ );
 	out_time += count;
 	
 	// remove from silence and buf first
@@ -215,6 +402,7 @@ blargg_err_t Music_Emu::skip( long count )
 		emu_time += count;
 		end_track_if_error( skip_( count ) );
 	}
+	drop_extras();
 	
 	if ( !(silence_count | buf_remain) ) // caught up to emulator, so update track ended
 		track_ended_ |= emu_track_ended_;
@@ -235,6 +423,7 @@ blargg_err_t Music_Emu::skip_( long count )
 		{
 			RETURN_ERR( play_( buf_size, buf.begin() ) );
 			count -= buf_size;
+			drop_extras(); // keep them from piling up
 		}
 		
 		mute_voices( saved_mute );
@@ -247,10 +436,92 @@ blargg_err_t Music_Emu::skip_( long count )
 			n = count;
 		count -= n;
 		RETURN_ERR( play_( n, buf.begin() ) );
+		drop_extras();
 	}
 	return 0;
 }
 
+// Extra sample rates
+
+blargg_err_t Music_Emu::set_extra_rates_( long const*, int )
+{
+	return "Emulator doesn't support extra sample rates";
+}
+
+long Music_Emu::extra_avail_( int, long ) const     { return 0; }
+
+long Music_Emu::read_extra_( int, long, sample_t* ) { return 0; }
+
+blargg_err_t Music_Emu::set_extra_rates( long const* rates, int count )
+{
+	require( (unsigned) count <= max_extra_rates );
+	if ( !voice_count() )
+		return "Extra sample rates require a loaded file";
+	
+	clear_track_vars();
+	clear_start_states(); // recorded with different buffer
+	extra_count_ = 0;
+	RETURN_ERR( set_extra_rates_( rates, count ) );
+	for ( int i = 0; i < count; i++ )
+		extra_rates_ [i] = rates [i];
+	extra_count_ = count;
+	return 0;
+}
+
+// number of samples emulator has generated beyond out_time
+inline long Music_Emu::extra_pending() const
+{
+	return (emu_time > out_time ? emu_time - out_time : 0);
+}
+
+void Music_Emu::drop_extras()
+{
+	for ( int i = 0; i < extra_count_; i++ )
+		read_extra_( i, extra_avail_( i, extra_pending() ), 0 );
+}
+
+long Music_Emu::play_extra( int index, long count, sample_t* out )
+{
+	require( (unsigned) index < (unsigned) extra_count_ );
+	require( count % stereo == 0 );
+	GME_STATS_SCOPE( &stats_ );
+	
+	long avail = extra_avail_( index, extra_pending() );
+	long n = read_extra_( index, min( count, avail ), out );
+	if ( out_time > fade_start )
+	{
+		GME_STATS_STAGE( gme_stage_fade );
+		fade_extra( index, n, avail - n, out );
+	}
+	return n;
+}
+
+// Loudness measurement
+
+blargg_err_t Music_Emu::enable_loudness( bool enable )
+{
+	require( sample_rate() ); // sample rate must be set first
+	if ( !enable )
+	{
+		delete loudness_meter;
+		loudness_meter = 0;
+	}
+	else if ( !loudness_meter )
+	{
+		CHECK_ALLOC( loudness_meter = BLARGG_NEW Loudness_Meter );
+		loudness_meter->set_sample_rate( sample_rate() );
+	}
+	return 0;
+}
+
+blargg_err_t Music_Emu::loudness( gme_loudness_t* out ) const
+{
+	if ( !loudness_meter )
+		return "Loudness measurement not enabled";
+	loudness_meter->results( out );
+	return 0;
+}
+
 // Fading
 
 void Music_Emu::set_fade( long start_msec, long length_msec )
@@ -267,23 +538,68 @@ static int int_log( blargg_long x, int step, int unit )
 	return ((unit - fraction) + (fraction >> 1)) >> shift;
 }
 
-void Music_Emu::handle_fade( long out_count, sample_t* out )
+inline bool is_silent( int s )
+{
+	return (unsigned) (s + silence_threshold / 2) <= (unsigned) silence_threshold;
+}
+
+bool Music_Emu::handle_fade( long out_count, sample_t* out, long begin, long* silence )
 {
-	for ( int i = 0; i < out_count; i += fade_block_size )
+	bool ended = false;
+	long loud = begin; // last non-silent sample; begin counts as one, like count_silence()
+	for ( long i = 0; i < out_count; i += fade_block_size )
 	{
 		int const shift = 14;
 		int const unit = 1 << shift;
 		int gain = int_log( (out_time + i - fade_start) / fade_block_size,
 				fade_step, unit );
 		if ( gain < (unit >> fade_shift) )
-			track_ended_ = emu_track_ended_ = true;
+			ended = true;
 		
 		sample_t* io = &out [i];
-		for ( int count = min( fade_block_size, out_count - i ); count; --count )
+		int count = (int) min( (long) fade_block_size, out_count - i );
+		
+		// find last non-silent sample in block while it's in cache, before fading
+		// changes it; this normally stops at the first sample checked
+		if ( silence )
 		{
-			*io = sample_t ((*io * gain) >> shift);
-			++io;
+			int n = count;
+			int first = (int) max( begin + 1 - i, 0L );
+			while ( n > first && is_silent( io [n - 1] ) )
+				n--;
+			if ( n > first )
+				loud = i + n - 1;
 		}
+		
+		for ( int n = 0; n < count; n++ )
+			io [n] = sample_t ((io [n] * gain) >> shift);
+	}
+	
+	if ( silence )
+		*silence = out_count - loud;
+	return ended;
+}
+
+// Fades samples at extra rate, the last of which is 'after' samples before the time
+// corresponding to out_time. Gain is stepped per block, as handle_fade() does.
+void Music_Emu::fade_extra( int index, long count, long after, sample_t* out )
+{
+	double const scale = (double) sample_rate() / extra_rates_ [index];
+	blargg_long begin = out_time - (blargg_long) ((count + after) * scale);
+	for ( long i = 0; i < count; i += fade_block_size )
+	{
+		blargg_long time = begin + (blargg_long) (i * scale);
+		if ( time < fade_start )
+			continue;
+		
+		int const shift = 14;
+		int const unit = 1 << shift;
+		int gain = int_log( (time - fade_start) / fade_block_size, fade_step, unit );
+		
+		sample_t* io = &out [i];
+		int n = (int) min( (long) fade_block_size, count - i );
+		while ( n-- )
+			io [n] = sample_t ((io [n] * gain) >> shift);
 	}
 }
 
@@ -305,7 +621,7 @@ static long count_silence( Music_Emu::sample_t* begin, long size )
 	Music_Emu::sample_t first = *begin;
 	*begin = silence_threshold; // sentinel
 	Music_Emu::sample_t* p = begin + size;
-	while ( (unsigned) (*--p + silence_threshold / 2) <= (unsigned) silence_threshold ) { }
+	while ( is_silent( *--p ) ) { }
 	*begin = first;
 	return size - (p - begin);
 }
@@ -317,19 +633,27 @@ void Music_Emu::fill_buf()
 	if ( !emu_track_ended_ )
 	{
 		emu_play( buf_size, buf.begin() );
-		long silence = count_silence( buf.begin(), buf_size );
+		GME_STATS_ADD( lookahead, buf_size );
+		long silence;
+		{
+			GME_STATS_STAGE( gme_stage_silence );
+			silence = count_silence( buf.begin(), buf_size );
+		}
 		if ( silence < buf_size )
 		{
 			silence_time = emu_time - silence;
 			buf_remain   = buf_size;
 			return;
 		}
+		GME_STATS_ADD( lookahead_silent, buf_size );
 	}
 	silence_count += buf_size;
 }
 
 blargg_err_t Music_Emu::play( long out_count, sample_t* out )
 {
+	GME_STATS_SCOPE( &stats_ );
+	GME_STATS_ADD( samples, out_count );
 	if ( track_ended_ )
 	{
 		memset( out, 0, out_count * sizeof *out );
@@ -375,16 +699,28 @@ blargg_err_t Music_Emu::play( long out_count, sample_t* out )
 		}
 		
 		// generate remaining samples normally
+		bool const fading = out_time > fade_start;
+		bool fade_ended = false;
 		long remain = out_count - pos;
 		if ( remain )
 		{
 			emu_play( remain, out + pos );
 			track_ended_ |= emu_track_ended_;
 			
-			if ( !ignore_silence_ || out_time > fade_start )
+			if ( !ignore_silence_ || fading )
 			{
-				// check end for a new run of silence
-				long silence = count_silence( out + pos, remain );
+				// check end for a new run of silence, in same pass as fade if fading
+				long silence;
+				if ( fading )
+				{
+					GME_STATS_STAGE( gme_stage_fade );
+					fade_ended = handle_fade( out_count, out, pos, &silence );
+				}
+				else
+				{
+					GME_STATS_STAGE( gme_stage_silence );
+					silence = count_silence( out + pos, remain );
+				}
 				if ( silence < remain )
 					silence_time = emu_time - silence;
 				
@@ -392,9 +728,22 @@ blargg_err_t Music_Emu::play( long out_count, sample_t* out )
 					fill_buf(); // cause silence detection on next play()
 			}
 		}
+		else if ( fading )
+		{
+			GME_STATS_STAGE( gme_stage_fade );
+			fade_ended = handle_fade( out_count, out );
+		}
+		
+		if ( fade_ended )
+			track_ended_ = emu_track_ended_ = true;
+		else if ( track_ended_ && length_cache() )
+			cache_length( out_time + out_count ); // ended by itself
 		
-		if ( out_time > fade_start )
-			handle_fade( out_count, out );
+		if ( loudness_meter )
+		{
+			GME_STATS_STAGE( gme_stage_loudness );
+			loudness_meter->analyze( out, out_count );
+		}
 	}
 	out_time += out_count;
 	return 0;
@@ -416,6 +765,9 @@ blargg_err_t Gme_Info_::play_( long, sample_t* )            { return "Use full e
 
 unsigned char *MidiTrack::ensure(size_t n) {
 	size_t new_size = mtrk.size();
+	if (new_size == 0) {
+		new_size = 256;
+	}
 	while ((length + n) > new_size) {
 		new_size *= 2;
 	}
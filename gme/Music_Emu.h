@@ -5,7 +5,10 @@
 #define MUSIC_EMU_H
 
 #include "Gme_File.h"
+#include "Gme_Stats.h"
 class Multi_Buffer;
+class Blargg_State_Copier;
+class Loudness_Meter;
 
 typedef unsigned long long midi_tick_t;
 
@@ -14,6 +17,8 @@ struct MidiTrack {
 	int length;
 	midi_tick_t last_tick;
 
+	MidiTrack() : length(0), last_tick(0) { }
+
 	unsigned char *ensure(size_t n);
 	void write_varint(unsigned int value);
 	void write_meta(midi_tick_t abs_tick, int event, unsigned int len, const char *data);
@@ -82,6 +87,42 @@ public:
 	// Info for current track
 	blargg_err_t track_info( track_info_t* out ) const;
 	
+// Start states
+
+	// Record state just after start_track() for each track in the playlist, so that
+	// starting one of those tracks later restores it instead of running the track's
+	// init code and initial silence scan. States are recorded with the current tempo,
+	// muting, equalizer, stereo depth, and silence detection settings; starting a track
+	// after these are changed does a normal start. Stops current track. Returns error if this
+	// emulator type doesn't support saving state. Loading a file discards states.
+	blargg_err_t record_start_states();
+	
+	// Take start states recorded by another emulator of the same type and sample rate
+	// with the same file loaded, leaving it with none. Returns error if the type, rate,
+	// or file data differ. This allows recording them on a
+	// background thread with a second emulator while this one keeps playing.
+	blargg_err_t take_start_states( Music_Emu& );
+	
+// Extra sample rates
+
+	// Also generate output at up to max_extra_rates other sample rates from the same
+	// emulation, so that rendering a track at several rates emulates it only once.
+	// Only supported by classic emulators, and not for VGM files using FM sound chips.
+	// Output at all rates is plain stereo, replacing any custom buffer meanwhile.
+	// Must be called after loading a file; loading another file removes them. Stops
+	// current track. Passing count of 0 removes them.
+	enum { max_extra_rates = gme_max_extra_rates };
+	blargg_err_t set_extra_rates( long const* rates, int count );
+	
+	// Number of extra sample rates
+	int extra_rate_count() const;
+	
+	// Read at most 'count' samples at extra rate 'index', where 0 is the first rate
+	// passed to set_extra_rates(), covering the part of the track that play() has
+	// generated so far, faded the same way. Returns number of samples read. Samples not
+	// read before the next skip(), seek(), or start_track() are discarded.
+	long play_extra( int index, long count, sample_t* out );
+	
 // Sound customization
 	
 	// Adjust song tempo, where 1.0 = normal, 0.5 = half speed, 2.0 = double speed.
@@ -122,6 +163,23 @@ public:
 	// Equalizer settings for TV speaker
 	static equalizer_t const tv_eq;
 	
+// Loudness measurement
+
+	// Enable/disable measurement of loudness, peaks, and clipping of output from
+	// play(), restarted by start_track(). See gme_loudness_t in gme.h.
+	blargg_err_t enable_loudness( bool enable = true );
+	
+	// Measurements of current track's output so far. Returns error if not enabled.
+	blargg_err_t loudness( gme_loudness_t* out ) const;
+	
+#ifdef GME_STATS
+// Profiling (see gme_stats() in gme.h)
+
+	// Counters and timers collected since creation or last clear_stats()
+	gme_stats_t const& stats() const            { return stats_; }
+	void clear_stats();
+	
+#endif
 // MIDI conversion functionality:
 	virtual bool midi_supported() { return false; }
 	enum {
@@ -154,6 +212,18 @@ protected:
 	virtual blargg_err_t start_track_( int ) = 0; // tempo is set before this
 	virtual blargg_err_t play_( long count, sample_t* out ) = 0;
 	virtual blargg_err_t skip_( long count );
+	
+	// Copy emulator state just after start_track_(), for record_start_states().
+	// Default returns error that start states aren't supported.
+	virtual blargg_err_t copy_state_( Blargg_State_Copier& );
+	void clear_start_states(); // call when track numbers start meaning different tracks
+	
+	// Extra sample rates, for set_extra_rates(). Samples available at an extra rate
+	// exclude those corresponding to the 'pending' most recent samples generated by
+	// play_(). Default set_extra_rates_() returns error that they aren't supported.
+	virtual blargg_err_t set_extra_rates_( long const* rates, int count );
+	virtual long extra_avail_( int index, long pending ) const;
+	virtual long read_extra_( int index, long count, sample_t* out ); // NULL out discards
 protected:
 	virtual void unload();
 	virtual void pre_load();
@@ -179,11 +249,16 @@ private:
 	volatile bool track_ended_;
 	void clear_track_vars();
 	void end_track_if_error( blargg_err_t );
+	void cache_length( blargg_long end_time ); // add length of track that just ended
+	blargg_err_t start_remapped_track( int ); // start_track_() and initial silence scan
 	
 	// fading
 	blargg_long fade_start;
 	int fade_step;
-	void handle_fade( long count, sample_t* out );
+	// Fades out, and if silence isn't NULL, counts silence at end of out [begin, count)
+	// in the same pass. Returns true if fade has finished.
+	bool handle_fade( long count, sample_t* out, long begin = 0, long* silence = 0 );
+	void fade_extra( int index, long count, long after, sample_t* out );
 	
 	// silence detection
 	int silence_lookahead; // speed to run emulator when looking ahead for silence
@@ -196,7 +271,29 @@ private:
 	void fill_buf();
 	void emu_play( long count, sample_t* out );
 	
+	// start states
+	blargg_vector<byte> start_states;          // states of all recorded tracks
+	blargg_vector<blargg_long> start_offsets;  // [remapped track] offset in start_states, or -1
+	equalizer_t start_eq;                      // settings states were recorded with
+	double start_tempo;
+	double start_stereo_depth;
+	int start_mute_mask;
+	bool start_ignore_silence;
+	bool start_state_usable( int remapped ) const;
+	blargg_err_t copy_track_state( Blargg_State_Copier& );
+	
+	// extra sample rates
+	int extra_count_;
+	long extra_rates_ [max_extra_rates];
+	long extra_pending() const;
+	void drop_extras(); // discard samples for time before out_time
+	
 	Multi_Buffer* effects_buffer;
+	double stereo_depth_; // last given to gme_set_stereo_depth(), which configures effects_buffer
+	Loudness_Meter* loudness_meter; // NULL if not measuring
+#ifdef GME_STATS
+	gme_stats_t stats_;
+#endif
 	friend Music_Emu* gme_new_emu( gme_type_t, int );
 	friend void gme_set_stereo_depth( Music_Emu*, double );
 };
@@ -224,6 +321,7 @@ inline long Music_Emu::sample_rate() const          { return sample_rate_; }
 inline const char** Music_Emu::voice_names() const  { return voice_names_; }
 inline int Music_Emu::voice_count() const           { return voice_count_; }
 inline int Music_Emu::current_track() const         { return current_track_; }
+inline int Music_Emu::extra_rate_count() const      { return extra_count_; }
 inline bool Music_Emu::track_ended() const          { return track_ended_; }
 inline const Music_Emu::equalizer_t& Music_Emu::equalizer() const { return equalizer_; }
 
@@ -2,6 +2,8 @@
 
 #include "Nes_Apu.h"
 
+#include "blargg_state.h"
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -105,6 +107,7 @@ void Nes_Apu::reset( bool pal_mode, int initial_dmc_dac )
 	noise.reset();
 	dmc.reset();
 	
+	abs_time = 0;
 	last_time = 0;
 	last_dmc_time = 0;
 	osc_enables = 0;
@@ -150,6 +153,7 @@ Nes_Osc* Nes_Apu::get_osc(int index)
 
 void Nes_Apu::run_until( nes_time_t end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	require( end_time >= last_dmc_time );
 	if ( end_time > next_dmc_read_time() )
 	{
@@ -166,6 +170,8 @@ void Nes_Apu::run_until_( nes_time_t end_time )
 	if ( end_time == last_time )
 		return;
 	
+	GME_STATS_STAGE( gme_stage_apu );
+	
 	// printf("apu abs: %d run_until_ %d\n", abs_time + last_time, end_time);
 
 	if ( last_dmc_time < end_time )
@@ -307,6 +313,7 @@ static const unsigned char length_table [0x20] = {
 
 void Nes_Apu::write_register( nes_time_t time, nes_addr_t addr, int data )
 {
+	GME_STATS_WRITE( nes_apu );
 	require( addr > 0x20 ); // addr must be actual address (i.e. 0x40xx)
 	require( (unsigned) data <= 0xFF );
 	
@@ -415,3 +422,94 @@ int Nes_Apu::read_status( nes_time_t time )
 	
 	return result;
 }
+
+// Save/load
+
+static void copy_midi_track( MidiTrack& track, Blargg_State_Copier& copier )
+{
+	copier( track.last_tick );
+	int length = track.length;
+	copier( length );
+	unsigned char* p = track.mtrk.begin();
+	if ( copier.loading() )
+	{
+		track.length = 0;
+		p = track.ensure( length );
+		if ( track.mtrk.size() >= (size_t) length )
+			track.length = length;
+		else
+			p = NULL; // out of memory; lose MIDI events so far
+	}
+	copier.copy( p, length );
+}
+
+static void copy_osc_state( Nes_Osc& osc, Blargg_State_Copier& copier )
+{
+	copier( osc.regs );
+	copier( osc.reg_written );
+	copier( osc.length_counter );
+	copier( osc.delay );
+	copier( osc.last_amp );
+	
+	copier( osc.abs_time );
+	copier( osc.last_tick );
+	copier( osc.last_midi_note );
+	copier( osc.last_midi_channel );
+	copier( osc.last_midi_channel_volume );
+	copier( osc.note_on_period );
+	copier( osc.last_wheel );
+	copier( osc.last_wheel_emit );
+	copy_midi_track( osc.midi, copier );
+}
+
+static void copy_square_state( Nes_Square& osc, Blargg_State_Copier& copier )
+{
+	copy_osc_state( osc, copier );
+	copier( osc.envelope );
+	copier( osc.env_delay );
+	copier( osc.phase );
+	copier( osc.sweep_delay );
+}
+
+void Nes_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	copy_square_state( square1, copier );
+	copy_square_state( square2, copier );
+	
+	copy_osc_state( triangle, copier );
+	copier( triangle.phase );
+	copier( triangle.linear_counter );
+	
+	copy_osc_state( noise, copier );
+	copier( noise.envelope );
+	copier( noise.env_delay );
+	copier( noise.noise );
+	copier( noise.last_midi_note_volume );
+	
+	// channel_address_map persists across tracks, so it isn't part of track state
+	copy_osc_state( dmc, copier );
+	copier( dmc.address );
+	copier( dmc.period );
+	copier( dmc.buf );
+	copier( dmc.bits_remain );
+	copier( dmc.bits );
+	copier( dmc.buf_full );
+	copier( dmc.silence );
+	copier( dmc.dac );
+	copier( dmc.next_irq );
+	copier( dmc.irq_enabled );
+	copier( dmc.irq_flag );
+	copier( dmc.pal_mode );
+	
+	copier( abs_time );
+	copier( last_time );
+	copier( last_dmc_time );
+	copier( earliest_irq_ );
+	copier( next_irq );
+	copier( frame_period );
+	copier( frame_delay );
+	copier( frame );
+	copier( osc_enables );
+	copier( frame_mode );
+	copier( irq_flag );
+}
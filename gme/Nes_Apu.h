@@ -13,6 +13,7 @@ typedef unsigned nes_addr_t; // 16-bit memory address
 
 struct apu_state_t;
 class Nes_Buffer;
+class Blargg_State_Copier;
 
 class Nes_Apu {
 public:
@@ -58,6 +59,10 @@ public:
 	void save_state( apu_state_t* out ) const;
 	void load_state( apu_state_t const& );
 	
+	// Copy exact emulation state, including MIDI conversion state, to/from saved
+	// state (see blargg_state.h)
+	void copy_state( Blargg_State_Copier& );
+	
 	// Set overall volume (default is 1.0)
 	void volume( double );
 	
@@ -2,6 +2,7 @@
 
 #include "Nes_Fme7_Apu.h"
 
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
@@ -28,6 +29,15 @@ void Nes_Fme7_Apu::reset()
 	memset( state, 0, sizeof *state );
 }
 
+void Nes_Fme7_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	fme7_apu_state_t* state = this;
+	copier( *state );
+	for ( int i = 0; i < osc_count; i++ )
+		copier( oscs [i].last_amp );
+	copier( last_time );
+}
+
 unsigned char const Nes_Fme7_Apu::amp_table [16] =
 {
 	#define ENTRY( n ) (unsigned char) (n * amp_range + 0.5)
@@ -40,6 +50,7 @@ unsigned char const Nes_Fme7_Apu::amp_table [16] =
 
 void Nes_Fme7_Apu::run_until( blip_time_t end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	require( end_time >= last_time );
 	
 	for ( int index = 0; index < osc_count; index++ )
@@ -50,7 +61,10 @@ void Nes_Fme7_Apu::run_until( blip_time_t end_time )
 		
 		Blip_Buffer* const osc_output = oscs [index].output;
 		if ( !osc_output )
+		{
+			GME_STATS_IDLE( fme7, end_time - last_time );
 			continue;
+		}
 		osc_output->set_modified();
 		
 		// check for unsupported mode
@@ -107,6 +121,7 @@ void Nes_Fme7_Apu::run_until( blip_time_t end_time )
 			else
 			{
 				// maintain phase when silent
+				GME_STATS_IDLE( fme7, end_time - time );
 				int count = (end_time - time + period - 1) / period;
 				phases [index] ^= count & 1;
 				time += (blargg_long) count * period;
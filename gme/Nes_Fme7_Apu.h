@@ -6,6 +6,7 @@
 
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
+class Blargg_State_Copier;
 
 struct fme7_apu_state_t
 {
@@ -28,6 +29,7 @@ public:
 	void end_frame( blip_time_t );
 	void save_state( fme7_apu_state_t* ) const;
 	void load_state( fme7_apu_state_t const& );
+	void copy_state( Blargg_State_Copier& );
 	
 	// Mask and addresses of registers
 	enum { addr_mask = 0xE000 };
@@ -95,6 +97,7 @@ inline void Nes_Fme7_Apu::write_latch( int data ) { latch = data; }
 
 inline void Nes_Fme7_Apu::write_data( blip_time_t time, int data )
 {
+	GME_STATS_WRITE( fme7 );
 	if ( (unsigned) latch >= reg_count )
 	{
 		#ifdef debug_printf
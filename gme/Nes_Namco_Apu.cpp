@@ -2,6 +2,8 @@
 
 #include "Nes_Namco_Apu.h"
 
+#include "blargg_state.h"
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -75,13 +77,17 @@ void Nes_Namco_Apu::end_frame( blip_time_t time )
 
 void Nes_Namco_Apu::run_until( blip_time_t nes_end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	int active_oscs = (reg [0x7F] >> 4 & 7) + 1;
 	for ( int i = osc_count - active_oscs; i < osc_count; i++ )
 	{
 		Namco_Osc& osc = oscs [i];
 		Blip_Buffer* output = osc.output;
 		if ( !output )
+		{
+			GME_STATS_IDLE( namco, nes_end_time - last_time );
 			continue;
+		}
 		output->set_modified();
 		
 		blip_resampled_time_t time =
@@ -96,7 +102,10 @@ void Nes_Namco_Apu::run_until( blip_time_t nes_end_time )
 			
 			int volume = osc_reg [7] & 15;
 			if ( !volume )
+			{
+				GME_STATS_IDLE( namco, nes_end_time - last_time );
 				continue;
+			}
 			
 			blargg_long freq = (osc_reg [4] & 3) * 0x10000 + osc_reg [2] * 0x100L + osc_reg [0];
 			if ( freq < 64 * active_oscs )
@@ -143,3 +152,16 @@ void Nes_Namco_Apu::run_until( blip_time_t nes_end_time )
 	last_time = nes_end_time;
 }
 
+void Nes_Namco_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Namco_Osc& osc = oscs [i];
+		copier( osc.delay );
+		copier( osc.last_amp );
+		copier( osc.wave_pos );
+	}
+	copier( last_time );
+	copier( addr_reg );
+	copier( reg );
+}
@@ -8,6 +8,7 @@
 #include "Blip_Buffer.h"
 
 struct namco_state_t;
+class Blargg_State_Copier;
 
 class Nes_Namco_Apu {
 public:
@@ -32,6 +33,7 @@ public:
 	// to do: implement save/restore
 	void save_state( namco_state_t* out ) const;
 	void load_state( namco_state_t const& );
+	void copy_state( Blargg_State_Copier& );
 	
 public:
 	Nes_Namco_Apu();
@@ -95,6 +97,7 @@ inline void Nes_Namco_Apu::osc_output( int i, Blip_Buffer* buf )
 
 inline void Nes_Namco_Apu::write_data( blip_time_t time, int data )
 {
+	GME_STATS_WRITE( namco );
 	run_until( time );
 	access() = data;
 }
@@ -2,6 +2,8 @@
 
 #include "Nes_Apu.h"
 
+#include "blargg_lfsr.h"
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -85,6 +87,7 @@ inline nes_time_t Nes_Square::maintain_phase( nes_time_t time, nes_time_t end_ti
 	nes_time_t remain = end_time - time;
 	if ( remain > 0 )
 	{
+		GME_STATS_IDLE( nes_apu, remain );
 		int count = (remain + timer_period - 1) / timer_period;
 		phase = (phase + count) & (phase_range - 1);
 		time += (blargg_long) count * timer_period;
@@ -199,6 +202,7 @@ inline nes_time_t Nes_Triangle::maintain_phase( nes_time_t time, nes_time_t end_
 	nes_time_t remain = end_time - time;
 	if ( remain > 0 )
 	{
+		GME_STATS_IDLE( nes_apu, remain );
 		int count = (remain + timer_period - 1) / timer_period;
 		phase = ((unsigned) phase + 1 - count) & (phase_range * 2 - 1);
 		phase++;
@@ -233,6 +237,8 @@ void Nes_Triangle::run( nes_time_t time, nes_time_t end_time )
 	{
 		note_off(time);
 
+		if ( time < end_time )
+			GME_STATS_IDLE( nes_apu, end_time - time );
 		time = end_time;
 	}
 	else if ( time < end_time )
@@ -431,6 +437,7 @@ void Nes_Dmc::run( nes_time_t time, nes_time_t end_time )
 		int bits_remain = this->bits_remain;
 		if ( silence && !buf_full )
 		{
+			GME_STATS_IDLE( nes_apu, end_time - time );
 			int count = (end_time - time + period - 1) / period;
 			bits_remain = (bits_remain - 1 + 8 - (count % 8)) % 8 + 1;
 			time += count * period;
@@ -491,15 +498,44 @@ static short const noise_period_table [16] = {
 	0x0CA, 0x0FE, 0x17C, 0x1FC, 0x2FA, 0x3F8, 0x7F2, 0xFE4
 };
 
+struct nes_noise_step_t
+{
+	int tap;
+	blargg_ulong operator () ( blargg_ulong n ) const
+	{
+		return (((n << tap) ^ (n << 14)) & 0x4000) | (n >> 1);
+	}
+};
+
+static nes_noise_step_t const normal_noise_step = { 13 };
+static nes_noise_step_t const short_noise_step  = {  8 };
+
+// Noise register after count steps, without running them one at a time
+static int jump_noise( int noise, int short_mode, blargg_long count )
+{
+	// normal and short mode, built on first use
+	static Blargg_Lfsr_Jump const normal_jump( normal_noise_step, 15 );
+	static Blargg_Lfsr_Jump const short_jump ( short_noise_step,  15 );
+	Blargg_Lfsr_Jump const& jump = (short_mode ? short_jump : normal_jump);
+	return (int) jump.run( noise, count );
+}
+
 void Nes_Noise::run( nes_time_t time, nes_time_t end_time )
 {
 	int period = noise_period_table [regs [2] & 15];
+	const int mode_flag = 0x80;
 	
 	if ( !output )
 	{
-		// TODO: clean up
 		time += delay;
-		delay = time + (end_time - time + period - 1) / period * period - end_time;
+		if ( time < end_time )
+		{
+			GME_STATS_IDLE( nes_apu, end_time - time );
+			blargg_long count = (end_time - time + period - 1) / period;
+			noise = jump_noise( noise, regs [2] & mode_flag, count );
+			time += count * period;
+		}
+		delay = time - end_time;
 		return;
 	}
 	
@@ -516,21 +552,15 @@ void Nes_Noise::run( nes_time_t time, nes_time_t end_time )
 	time += delay;
 	if ( time < end_time )
 	{
-		const int mode_flag = 0x80;
-		
 		if ( !volume )
 		{
 			note_off(time);
+			GME_STATS_IDLE( nes_apu, end_time - time );
 
-			// round to next multiple of period
-			time += (end_time - time + period - 1) / period * period;
-			
-			// approximate noise cycling while muted, by shuffling up noise register
-			// to do: precise muted noise cycling?
-			if ( !(regs [2] & mode_flag) ) {
-				int feedback = (noise << 13) ^ (noise << 14);
-				noise = (feedback & 0x4000) | (noise >> 1);
-			}
+			// keep noise cycling while muted
+			blargg_long count = (end_time - time + period - 1) / period;
+			noise = jump_noise( noise, regs [2] & mode_flag, count );
+			time += count * period;
 		}
 		else
 		{
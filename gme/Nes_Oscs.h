@@ -186,6 +186,7 @@ struct Nes_Osc
 
 		midi.mtrk.resize(30000);
 		midi.length = 0;
+		midi.last_tick = 0;
 	}
 	int update_amp( int amp ) {
 		int delta = amp - last_amp;
@@ -2,6 +2,8 @@
 
 #include "Nes_Vrc6_Apu.h"
 
+#include "blargg_state.h"
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -45,6 +47,7 @@ void Nes_Vrc6_Apu::output( Blip_Buffer* buf )
 
 void Nes_Vrc6_Apu::run_until( blip_time_t time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	require( time >= last_time );
 	run_square( oscs [0], time );
 	run_square( oscs [1], time );
@@ -54,6 +57,7 @@ void Nes_Vrc6_Apu::run_until( blip_time_t time )
 
 void Nes_Vrc6_Apu::write_osc( blip_time_t time, int osc_index, int reg, int data )
 {
+	GME_STATS_WRITE( vrc6 );
 	require( (unsigned) osc_index < osc_count );
 	require( (unsigned) reg < reg_count );
 	
@@ -102,11 +106,28 @@ void Nes_Vrc6_Apu::load_state( vrc6_apu_state_t const& in )
 		oscs [2].phase = 1;
 }
 
+void Nes_Vrc6_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Vrc6_Osc& osc = oscs [i];
+		copier( osc.regs );
+		copier( osc.delay );
+		copier( osc.last_amp );
+		copier( osc.phase );
+		copier( osc.amp );
+	}
+	copier( last_time );
+}
+
 void Nes_Vrc6_Apu::run_square( Vrc6_Osc& osc, blip_time_t end_time )
 {
 	Blip_Buffer* output = osc.output;
 	if ( !output )
+	{
+		GME_STATS_IDLE( vrc6, end_time - last_time );
 		return;
+	}
 	output->set_modified();
 	
 	int volume = osc.regs [0] & 15;
@@ -154,6 +175,10 @@ void Nes_Vrc6_Apu::run_square( Vrc6_Osc& osc, blip_time_t end_time )
 		}
 		osc.delay = time - end_time;
 	}
+	else if ( !volume && time < end_time )
+	{
+		GME_STATS_IDLE( vrc6, end_time - time );
+	}
 }
 
 void Nes_Vrc6_Apu::run_saw( blip_time_t end_time )
@@ -161,7 +186,10 @@ void Nes_Vrc6_Apu::run_saw( blip_time_t end_time )
 	Vrc6_Osc& osc = oscs [2];
 	Blip_Buffer* output = osc.output;
 	if ( !output )
+	{
+		GME_STATS_IDLE( vrc6, end_time - last_time );
 		return;
+	}
 	output->set_modified();
 	
 	int amp = osc.amp;
@@ -170,6 +198,7 @@ void Nes_Vrc6_Apu::run_saw( blip_time_t end_time )
 	int last_amp = osc.last_amp;
 	if ( !(osc.regs [2] & 0x80) || !(amp_step | amp) )
 	{
+		GME_STATS_IDLE( vrc6, end_time - time );
 		osc.delay = 0;
 		int delta = (amp >> 3) - last_amp;
 		last_amp = amp >> 3;
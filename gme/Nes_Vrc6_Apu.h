@@ -8,6 +8,7 @@
 #include "Blip_Buffer.h"
 
 struct vrc6_apu_state_t;
+class Blargg_State_Copier;
 
 class Nes_Vrc6_Apu {
 public:
@@ -21,6 +22,7 @@ public:
 	void end_frame( blip_time_t );
 	void save_state( vrc6_apu_state_t* ) const;
 	void load_state( vrc6_apu_state_t const& );
+	void copy_state( Blargg_State_Copier& );
 	
 	// Oscillator 0 write-only registers are at $9000-$9002
 	// Oscillator 1 write-only registers are at $A000-$A002
@@ -3,6 +3,7 @@
 #include "Nsf_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -71,7 +72,7 @@ void Nsf_Emu::unload()
 	#endif
 	
 	rom.clear();
-	Music_Emu::unload();
+	Classic_Emu::unload();
 }
 
 // Track info
@@ -270,7 +271,7 @@ blargg_err_t Nsf_Emu::init_sound()
 blargg_err_t Nsf_Emu::load_( Data_Reader& in )
 {
 	assert( offsetof (header_t,unused [4]) == header_size );
-	RETURN_ERR( rom.load( in, header_size, &header_, 0 ) );
+	RETURN_ERR( rom.load( in, header_size, &header_, 0, shared_rom() ) );
 	
 	set_track_count( header_.track_count );
 	RETURN_ERR( check_nsf_header( &header_ ) );
@@ -486,6 +487,39 @@ blargg_err_t Nsf_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Nsf_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	RETURN_ERR( copy_buffer_state( copier ) );
+	
+	copier( banks );
+	if ( copier.loading() )
+	{
+		cpu::reset( unmapped_code );
+		cpu::map_code( sram_addr, sizeof sram, sram );
+		for ( int i = 0; i < bank_count; ++i )
+			cpu_write( bank_select_addr + i, banks [i] );
+	}
+	copier( cpu::r );
+	copier( low_mem );
+	copier( sram );
+	
+	copier( saved_state );
+	copier( next_play );
+	copier( play_extra );
+	copier( play_ready );
+	
+	apu.copy_state( copier );
+	#if !NSF_EMU_APU_ONLY
+	{
+		if ( namco ) namco->copy_state( copier );
+		if ( vrc6  ) vrc6 ->copy_state( copier );
+		if ( fme7  ) fme7 ->copy_state( copier );
+	}
+	#endif
+	
+	return 0;
+}
+
 blargg_err_t Nsf_Emu::run_clocks( blip_time_t& duration, int )
 {
 	set_time( 0 );
@@ -67,9 +67,11 @@ protected:
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
 	void unload();
+	blargg_err_t copy_state_( Blargg_State_Copier& );
 protected:
 	enum { bank_count = 8 };
 	byte initial_banks [bank_count];
+	byte banks [bank_count]; // currently mapped
 	nes_addr_t init_addr;
 	nes_addr_t play_addr;
 	double clock_rate_;
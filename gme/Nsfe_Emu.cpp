@@ -319,6 +319,7 @@ void Nsfe_Emu::disable_playlist( bool b )
 {
 	info.disable_playlist( b );
 	set_track_count( info.info.track_count );
+	clear_start_states(); // track numbers now refer to different tracks
 }
 
 void Nsfe_Emu::clear_playlist_()
@@ -3,6 +3,7 @@
 #include "Sap_Apu.h"
 
 #include <string.h>
+#include "blargg_state.h"
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -90,6 +91,17 @@ void Sap_Apu::reset( Sap_Apu_Impl* new_impl )
 		memset( &oscs [i], 0, offsetof (osc_t,output) );
 }
 
+void Sap_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+		copier.copy( &oscs [i], offsetof (osc_t,output) );
+	copier( last_time );
+	copier( poly5_pos );
+	copier( poly4_pos );
+	copier( polym_pos );
+	copier( control );
+}
+
 inline void Sap_Apu::calc_periods()
 {
 	 // 15/64 kHz clock
@@ -123,6 +135,7 @@ inline void Sap_Apu::calc_periods()
 
 void Sap_Apu::run_until( blip_time_t end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	calc_periods();
 	Sap_Apu_Impl* const impl = this->impl; // cache
 	
@@ -164,6 +177,9 @@ void Sap_Apu::run_until( blip_time_t end_time )
 				}
 				
 				// TODO: doesn't maintain high pass flip-flop (very minor issue)
+				
+				if ( time < end_time )
+					GME_STATS_IDLE( sap_apu, end_time - time );
 			}
 			else
 			{
@@ -298,6 +314,7 @@ void Sap_Apu::run_until( blip_time_t end_time )
 
 void Sap_Apu::write_data( blip_time_t time, unsigned addr, int data )
 {
+	GME_STATS_WRITE( sap_apu );
 	run_until( time );
 	int i = (addr ^ 0xD200) >> 1;
 	if ( i < osc_count )
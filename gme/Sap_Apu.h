@@ -8,6 +8,7 @@
 #include "Blip_Buffer.h"
 
 class Sap_Apu_Impl;
+class Blargg_State_Copier;
 
 class Sap_Apu {
 public:
@@ -22,6 +23,8 @@ public:
 	
 	void end_frame( blip_time_t );
 	
+	void copy_state( Blargg_State_Copier& );
+	
 public:
 	Sap_Apu();
 private:
@@ -3,6 +3,7 @@
 #include "Sap_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2006 Shay Green. This module is free software; you
@@ -368,6 +369,28 @@ blargg_err_t Sap_Emu::start_track_( int track )
 	return 0;
 }
 
+blargg_err_t Sap_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	RETURN_ERR( copy_buffer_state( copier ) );
+	
+	if ( copier.loading() )
+	{
+		apu.reset( &apu_impl );
+		apu2.reset( &apu_impl );
+		cpu::reset( mem.ram );
+		time_mask = -1;
+	}
+	copier( r );
+	copier( mem );
+	copier( next_play );
+	
+	apu.copy_state( copier );
+	if ( info.stereo )
+		apu2.copy_state( copier );
+	
+	return 0;
+}
+
 // Emulation
 
 // see sap_cpu_io.h for read/write functions
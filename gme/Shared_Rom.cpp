@@ -0,0 +1,187 @@
+// Game_Music_Emu 0.5.5. http://www.slack.net/~ant/
+
+#include "Shared_Rom.h"
+
+#include <string.h>
+
+/* Copyright (C) 2006 Shay Green. This module is free software; you
+can redistribute it and/or modify it under the terms of the GNU Lesser
+General Public License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version. This
+module is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+details. You should have received a copy of the GNU Lesser General Public
+License along with this module; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
+
+#include "blargg_source.h"
+
+// Atomic operations, so that emulators on different threads can share data
+#if defined (_MSC_VER)
+	#include <intrin.h>
+	#define ATOMIC_INC( p )     _InterlockedIncrement( p )
+	#define ATOMIC_DEC( p )     _InterlockedDecrement( p )
+	#define ATOMIC_LOAD_PTR( p ) _InterlockedCompareExchangePointer( (void* volatile*) (p), 0, 0 )
+	#define ATOMIC_SET_PTR( p, old, n ) \
+		(_InterlockedCompareExchangePointer( (void* volatile*) (p), n, old ) == (old))
+#elif __GNUC__ >= 5 || defined (__clang__)
+	#define ATOMIC_INC( p )     __atomic_add_fetch( p, 1, __ATOMIC_RELAXED )
+	#define ATOMIC_DEC( p )     __atomic_sub_fetch( p, 1, __ATOMIC_ACQ_REL )
+	#define ATOMIC_LOAD_PTR( p ) __atomic_load_n( p, __ATOMIC_ACQUIRE )
+	#define ATOMIC_SET_PTR( p, old, n ) __extension__ ({ \
+		Shared_Rom* expected_ = (old);\
+		__atomic_compare_exchange_n( p, &expected_, n, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );\
+	})
+#elif GME_DISABLE_THREADS
+	// only one thread, so plain operations will do
+	#define ATOMIC_INC( p )     (++*(p))
+	#define ATOMIC_DEC( p )     (--*(p))
+	#define ATOMIC_LOAD_PTR( p ) (*(p))
+	#define ATOMIC_SET_PTR( p, old, n ) (*(p) == (old) ? (*(p) = (n), true) : false)
+#elif defined (_WIN32)
+	#include <windows.h>
+	#define ATOMIC_INC( p )     InterlockedIncrement( p )
+	#define ATOMIC_DEC( p )     InterlockedDecrement( p )
+	#define ATOMIC_LOAD_PTR( p ) InterlockedCompareExchangePointer( (void* volatile*) (p), 0, 0 )
+	#define ATOMIC_SET_PTR( p, old, n ) \
+		(InterlockedCompareExchangePointer( (void* volatile*) (p), n, old ) == (old))
+#else
+	// Without compiler support, each operation holds one lock shared by all data
+	#include <pthread.h>
+	
+	static pthread_mutex_t atomic_mutex = PTHREAD_MUTEX_INITIALIZER;
+	
+	static long atomic_add( long volatile* p, int delta )
+	{
+		pthread_mutex_lock( &atomic_mutex );
+		long n = (*p += delta);
+		pthread_mutex_unlock( &atomic_mutex );
+		return n;
+	}
+	
+	static Shared_Rom* atomic_load_ptr( Shared_Rom* volatile* p )
+	{
+		pthread_mutex_lock( &atomic_mutex );
+		Shared_Rom* r = *p;
+		pthread_mutex_unlock( &atomic_mutex );
+		return r;
+	}
+	
+	static bool atomic_set_ptr( Shared_Rom* volatile* p, Shared_Rom* old, Shared_Rom* n )
+	{
+		pthread_mutex_lock( &atomic_mutex );
+		bool set = (*p == old);
+		if ( set )
+			*p = n;
+		pthread_mutex_unlock( &atomic_mutex );
+		return set;
+	}
+	
+	#define ATOMIC_INC( p )     atomic_add( p, 1 )
+	#define ATOMIC_DEC( p )     atomic_add( p, -1 )
+	#define ATOMIC_LOAD_PTR( p ) atomic_load_ptr( p )
+	#define ATOMIC_SET_PTR( p, old, n ) atomic_set_ptr( p, old, n )
+#endif
+
+Shared_Rom::Shared_Rom()
+{
+	ref_count    = 1;
+	image        = 0;
+	image_header = 0;
+	image_fill   = 0;
+	image_pad    = 0;
+}
+
+Shared_Rom::~Shared_Rom()
+{
+	if ( image )
+		image->release();
+}
+
+blargg_err_t Shared_Rom::load( Data_Reader& in, Shared_Rom** out )
+{
+	*out = 0;
+	
+	Shared_Rom* rom = BLARGG_NEW Shared_Rom;
+	CHECK_ALLOC( rom );
+	
+	blargg_err_t err = rom->data_.resize( in.remain() );
+	if ( !err )
+		err = in.read( rom->data_.begin(), rom->data_.size() );
+	if ( err )
+	{
+		delete rom;
+		return err;
+	}
+	
+	*out = rom;
+	return 0;
+}
+
+void Shared_Rom::add_ref()
+{
+	ATOMIC_INC( &ref_count );
+}
+
+void Shared_Rom::release()
+{
+	if ( !ATOMIC_DEC( &ref_count ) )
+		delete this;
+}
+
+inline bool Shared_Rom::image_matches( int header_size, int fill, long pad_size ) const
+{
+	return image_header == header_size && image_fill == fill && image_pad == pad_size;
+}
+
+blargg_err_t Shared_Rom::padded_image( int header_size, int fill, long pad_size, Shared_Rom** out )
+{
+	require( header_size <= size() );
+	*out = 0;
+	
+	Shared_Rom* existing = (Shared_Rom*) ATOMIC_LOAD_PTR( &image );
+	if ( existing && existing->image_matches( header_size, fill, pad_size ) )
+	{
+		existing->add_ref();
+		*out = existing;
+		return 0;
+	}
+	
+	Shared_Rom* img = BLARGG_NEW Shared_Rom;
+	CHECK_ALLOC( img );
+	
+	long data_size = size() - header_size;
+	if ( img->data_.resize( pad_size + data_size + pad_size ) )
+	{
+		delete img;
+		return "Out of memory";
+	}
+	memset( img->data_.begin(), fill, pad_size );
+	memcpy( img->data_.begin() + pad_size, data() + header_size, data_size );
+	memset( img->data_.end() - pad_size, fill, pad_size );
+	img->image_header = header_size;
+	img->image_fill   = fill;
+	img->image_pad    = pad_size;
+	
+	if ( !existing )
+	{
+		// publish for later emulators, unless another thread just did
+		img->add_ref();
+		if ( !ATOMIC_SET_PTR( &image, (Shared_Rom*) 0, img ) )
+		{
+			img->release();
+			existing = (Shared_Rom*) ATOMIC_LOAD_PTR( &image );
+			if ( existing->image_matches( header_size, fill, pad_size ) )
+			{
+				img->release();
+				existing->add_ref();
+				img = existing;
+			}
+		}
+	}
+	
+	// if an image with different parameters was already made, this one is private
+	*out = img;
+	return 0;
+}
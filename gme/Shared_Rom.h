@@ -0,0 +1,59 @@
+// Reference-counted read-only file data that any number of emulators can load
+
+// Game_Music_Emu 0.5.5
+#ifndef SHARED_ROM_H
+#define SHARED_ROM_H
+
+#include "blargg_common.h"
+#include "Data_Reader.h"
+
+// Emulators loaded from a Shared_Rom keep a reference to it and use its data
+// directly rather than making their own copy, so memory use grows with the number
+// of distinct files rather than the number of emulators. Only data that emulators
+// never modify is shared; RAM and other mutable state are still per-emulator.
+// References may be added and removed from any thread.
+struct Shared_Rom {
+public:
+	typedef BOOST::uint8_t byte;
+	
+	// Read remaining data from 'in' into new shared data with one reference
+	static blargg_err_t load( Data_Reader& in, Shared_Rom** out );
+	
+	// Data
+	byte const* data() const    { return data_.begin(); }
+	long size() const           { return (long) data_.size(); }
+	
+	// Add reference
+	void add_ref();
+	
+	// Remove reference, deleting data once none remain
+	void release();
+	
+	// Set *out to new reference to data with first header_size bytes removed and
+	// pad_size bytes of 'fill' added before and after, as used by Rom_Data. Made by
+	// the first emulator that needs it, then shared by later ones.
+	blargg_err_t padded_image( int header_size, int fill, long pad_size, Shared_Rom** out );
+	
+public:
+	BLARGG_DISABLE_NOTHROW
+private:
+	Shared_Rom();
+	~Shared_Rom();
+	
+	// noncopyable
+	Shared_Rom( const Shared_Rom& );
+	Shared_Rom& operator = ( const Shared_Rom& );
+	
+	blargg_vector<byte> data_;
+	long volatile ref_count;
+	Shared_Rom* volatile image; // padded image, or NULL if not made yet
+	
+	// parameters image was made with
+	int image_header;
+	int image_fill;
+	long image_pad;
+	
+	bool image_matches( int header_size, int fill, long pad_size ) const;
+};
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "Sms_Apu.h"
 
+#include "blargg_state.h"
+
 /* Copyright (C) 2003-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -55,6 +57,8 @@ void Sms_Square::run( blip_time_t time, blip_time_t end_time )
 			last_amp = 0;
 		}
 		time += delay;
+		if ( time < end_time )
+			GME_STATS_IDLE( sms_psg, end_time - time );
 		if ( !period )
 		{
 			time = end_time;
@@ -107,9 +111,19 @@ inline void Sms_Noise::reset()
 	period = &noise_periods [0];
 	shifter = 0x8000;
 	feedback = 0x9000;
+	jump_feedback = 0;
 	Sms_Osc::reset();
 }
 
+struct sms_noise_step_t
+{
+	unsigned feedback;
+	blargg_ulong operator () ( blargg_ulong n ) const
+	{
+		return (feedback & (0 - (n & 1))) ^ (n >> 1);
+	}
+};
+
 void Sms_Noise::run( blip_time_t time, blip_time_t end_time )
 {
 	int amp = volume;
@@ -125,18 +139,33 @@ void Sms_Noise::run( blip_time_t time, blip_time_t end_time )
 		}
 	}
 	
+	int period = *this->period * 2;
+	if ( !period )
+		period = 16;
+	
 	time += delay;
 	if ( !volume )
-		time = end_time;
-	
-	if ( time < end_time )
+	{
+		// keep shifter running while silent
+		if ( time < end_time )
+		{
+			GME_STATS_IDLE( sms_psg, end_time - time );
+			if ( jump_feedback != feedback )
+			{
+				jump_feedback = feedback;
+				sms_noise_step_t step = { feedback };
+				jump.init( step, 16 );
+			}
+			blargg_long count = (end_time - time + period - 1) / period;
+			shifter = (unsigned) jump.run( shifter, count );
+			time += count * period;
+		}
+	}
+	else if ( time < end_time )
 	{
 		Blip_Buffer* const output = this->output;
 		unsigned shifter = this->shifter;
 		int delta = amp * 2;
-		int period = *this->period * 2;
-		if ( !period )
-			period = 16;
 		
 		do
 		{
@@ -233,6 +262,7 @@ void Sms_Apu::reset( unsigned feedback, int noise_width )
 
 void Sms_Apu::run_until( blip_time_t end_time )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	require( end_time >= last_time ); // end_time must not be before previous time
 	
 	if ( end_time > last_time )
@@ -266,6 +296,7 @@ void Sms_Apu::end_frame( blip_time_t end_time )
 
 void Sms_Apu::write_ggstereo( blip_time_t time, int data )
 {
+	GME_STATS_WRITE( sms_psg );
 	require( (unsigned) data <= 0xFF );
 	
 	run_until( time );
@@ -289,6 +320,84 @@ void Sms_Apu::write_ggstereo( blip_time_t time, int data )
 	}
 }
 
+void Sms_Apu::save_state( sms_apu_state_t* out ) const
+{
+	assert( last_time == 0 ); // must be at beginning of frame
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		out->delay [i]         = oscs [i]->delay;
+		out->volume [i]        = oscs [i]->volume;
+		out->output_select [i] = oscs [i]->output_select;
+	}
+	for ( int i = 0; i < 3; i++ )
+	{
+		out->period [i] = squares [i].period;
+		out->phase [i]  = squares [i].phase;
+	}
+	out->noise_period = 3;
+	if ( noise.period != &squares [2].period )
+		out->noise_period = noise.period - noise_periods;
+	out->noise_shifter  = noise.shifter;
+	out->noise_feedback = noise.feedback;
+	out->latch = latch;
+}
+
+void Sms_Apu::load_state( sms_apu_state_t const& in )
+{
+	last_time = 0;
+	latch = in.latch;
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Sms_Osc& osc = *oscs [i];
+		osc.delay         = in.delay [i];
+		osc.volume        = in.volume [i];
+		osc.output_select = in.output_select [i] & 3;
+		osc.output        = osc.outputs [osc.output_select];
+		osc.last_amp      = 0; // buffers were cleared
+	}
+	for ( int i = 0; i < 3; i++ )
+	{
+		squares [i].period = in.period [i];
+		squares [i].phase  = in.phase [i];
+	}
+	noise.period = &squares [2].period;
+	if ( (unsigned) in.noise_period < 3 )
+		noise.period = &noise_periods [in.noise_period];
+	noise.shifter  = in.noise_shifter;
+	noise.feedback = in.noise_feedback;
+}
+
+void Sms_Apu::copy_state( Blargg_State_Copier& copier )
+{
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Sms_Osc& osc = *oscs [i];
+		copier( osc.output_select );
+		osc.output = osc.outputs [osc.output_select];
+		copier( osc.delay );
+		copier( osc.last_amp );
+		copier( osc.volume );
+	}
+	for ( int i = 0; i < 3; i++ )
+	{
+		copier( squares [i].period );
+		copier( squares [i].phase );
+	}
+	
+	int noise_period = 3;
+	if ( noise.period != &squares [2].period )
+		noise_period = noise.period - noise_periods;
+	copier( noise_period );
+	noise.period = &squares [2].period;
+	if ( (unsigned) noise_period < 3 )
+		noise.period = &noise_periods [noise_period];
+	copier( noise.shifter );
+	copier( noise.feedback );
+	
+	copier( latch );
+	copier( last_time );
+}
+
 // volumes [i] = 64 * pow( 1.26, 15 - i ) / pow( 1.26, 15 )
 static unsigned char const volumes [16] = {
 	64, 50, 39, 31, 24, 19, 15, 12, 9, 7, 5, 4, 3, 2, 1, 0
@@ -296,6 +405,7 @@ static unsigned char const volumes [16] = {
 
 void Sms_Apu::write_data( blip_time_t time, int data )
 {
+	GME_STATS_WRITE( sms_psg );
 	require( (unsigned) data <= 0xFF );
 	
 	run_until( time );
@@ -6,6 +6,9 @@
 
 #include "Sms_Oscs.h"
 
+struct sms_apu_state_t;
+class Blargg_State_Copier;
+
 class Sms_Apu {
 public:
 	// Set overall volume of all oscillators, where 1.0 is full volume
@@ -41,6 +44,15 @@ public:
 	// Run all oscillators up to specified time, end current frame, then
 	// start a new frame at time 0.
 	void end_frame( blip_time_t );
+	
+	// Save/load complete state. Load should be done at the beginning of a frame
+	// with output buffers cleared.
+	void save_state( sms_apu_state_t* ) const;
+	void load_state( sms_apu_state_t const& );
+	
+	// Copy exact emulation state to/from saved state (see blargg_state.h). Unlike
+	// save_state(), includes output amplitudes, so buffers don't need clearing.
+	void copy_state( Blargg_State_Copier& );
 
 public:
 	Sms_Apu();
@@ -64,8 +76,15 @@ private:
 
 struct sms_apu_state_t
 {
-	unsigned char regs [8] [2];
-	unsigned char latch;
+	int delay [4];
+	int volume [4];
+	int output_select [4];
+	int period [3];
+	int phase [3];
+	int noise_period; // 0-2 = fixed periods, 3 = square 3 period
+	unsigned noise_shifter;
+	unsigned noise_feedback;
+	int latch;
 };
 
 inline void Sms_Apu::output( Blip_Buffer* b ) { output( b, b, b ); }
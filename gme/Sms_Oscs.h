@@ -6,6 +6,7 @@
 
 #include "blargg_common.h"
 #include "Blip_Buffer.h"
+#include "blargg_lfsr.h"
 
 struct Sms_Osc
 {
@@ -39,6 +40,10 @@ struct Sms_Noise : Sms_Osc
 	unsigned shifter;
 	unsigned feedback;
 	
+	// for running shifter while silent, built for jump_feedback when needed
+	Blargg_Lfsr_Jump jump;
+	unsigned jump_feedback;
+	
 	typedef Blip_Synth<blip_med_quality,1> Synth;
 	Synth synth;
 	
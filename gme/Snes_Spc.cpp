@@ -255,10 +255,140 @@ void Snes_Spc::clear_echo()
 		if ( end > 0x10000 )
 			end = 0x10000;
 		memset( &RAM [addr], 0xFF, end - addr );
+		dsp.ram_loaded();
 	}
 }
 
 
+//// State save/load
+
+#if !SPC_NO_COPY_STATE_FUNCS
+
+void Snes_Spc::save_regs( uint8_t out [reg_count] )
+{
+	// Use current timer counter values
+	for ( int i = 0; i < timer_count; i++ )
+		out [r_t0out + i] = m.timers [i].counter;
+	
+	// Last written values
+	memcpy( out, REGS, r_t0out );
+}
+
+void Snes_Spc::init_header( void* spc_out )
+{
+	spc_file_t* const spc = (spc_file_t*) spc_out;
+	
+	spc->has_id666 = 26; // has none
+	spc->version   = 30;
+	memcpy( spc, signature, sizeof spc->signature );
+	memset( spc->text, 0, sizeof spc->text );
+}
+
+void Snes_Spc::save_spc( void* spc_out )
+{
+	spc_file_t* const spc = (spc_file_t*) spc_out;
+	
+	// CPU
+	spc->pcl = (uint8_t) (m.cpu_regs.pc >> 0);
+	spc->pch = (uint8_t) (m.cpu_regs.pc >> 8);
+	spc->a   = m.cpu_regs.a;
+	spc->x   = m.cpu_regs.x;
+	spc->y   = m.cpu_regs.y;
+	spc->psw = m.cpu_regs.psw;
+	spc->sp  = m.cpu_regs.sp;
+	
+	// RAM, ROM
+	memcpy( spc->ram, RAM, sizeof spc->ram );
+	if ( m.rom_enabled )
+		memcpy( spc->ram + rom_addr, m.hi_ram, sizeof m.hi_ram );
+	memset( spc->unused, 0, sizeof spc->unused );
+	memcpy( spc->ipl_rom, m.rom, sizeof spc->ipl_rom );
+	
+	// SMP registers
+	save_regs( &spc->ram [0xF0] );
+	int i;
+	for ( i = 0; i < port_count; i++ )
+		spc->ram [0xF0 + r_cpuio0 + i] = REGS_IN [r_cpuio0 + i];
+	
+	// DSP registers
+	for ( i = 0; i < Spc_Dsp::register_count; i++ )
+		spc->dsp [i] = dsp.read( i );
+}
+
+void Snes_Spc::copy_state( unsigned char** io, copy_func_t copy )
+{
+	SPC_State_Copier copier( io, copy );
+	
+	// Make state data more readable by putting 64K RAM, 16 SMP registers,
+	// then DSP (with its 128 registers) first
+	
+	// RAM
+	enable_rom( 0 ); // will get re-enabled if necessary in regs_loaded() below
+	copier.copy( RAM, 0x10000 );
+	
+	{
+		// SMP registers
+		uint8_t out_ports [port_count];
+		uint8_t regs [reg_count];
+		memcpy( out_ports, &REGS [r_cpuio0], sizeof out_ports );
+		save_regs( regs );
+		copier.copy( regs, sizeof regs );
+		copier.copy( out_ports, sizeof out_ports );
+		load_regs( regs );
+		regs_loaded();
+		memcpy( &REGS [r_cpuio0], out_ports, sizeof out_ports );
+	}
+	
+	// CPU registers
+	SPC_COPY( uint16_t, m.cpu_regs.pc );
+	SPC_COPY(  uint8_t, m.cpu_regs.a );
+	SPC_COPY(  uint8_t, m.cpu_regs.x );
+	SPC_COPY(  uint8_t, m.cpu_regs.y );
+	SPC_COPY(  uint8_t, m.cpu_regs.psw );
+	SPC_COPY(  uint8_t, m.cpu_regs.sp );
+	copier.extra();
+	
+	SPC_COPY( int16_t, m.spc_time );
+	SPC_COPY( int16_t, m.dsp_time );
+	
+	// DSP
+	dsp.copy_state( io, copy );
+	
+	// Timers
+	for ( int i = 0; i < timer_count; i++ )
+	{
+		Timer* t = &m.timers [i];
+		SPC_COPY( int16_t, t->next_time );
+		SPC_COPY( uint8_t, t->divider );
+		copier.extra();
+	}
+	
+	// Samples generated beyond end of last play() and fraction of sample
+	{
+		int extra_clocks = m.extra_clocks & (clocks_per_sample - 1);
+		SPC_COPY( uint8_t, extra_clocks );
+		m.extra_clocks = extra_clocks;
+		
+		int count = m.extra_pos - m.extra_buf;
+		SPC_COPY( uint8_t, count );
+		if ( (unsigned) count > extra_size )
+			count = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			int s = m.extra_buf [i];
+			SPC_COPY( int16_t, s );
+			m.extra_buf [i] = s;
+		}
+		m.extra_pos = &m.extra_buf [count];
+		m.buf_begin = 0;
+		dsp.set_output( 0, 0 );
+	}
+	copier.extra();
+}
+
+#endif
+
+
 //// Sample output
 
 void Snes_Spc::reset_buf()
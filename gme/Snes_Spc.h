@@ -84,10 +84,12 @@ public:
 	// Skips count samples. Several times faster than play() when using fast DSP.
 	blargg_err_t skip( int count );
 	
-// State save/load (only available with accurate DSP)
+// State save/load (unless SPC_NO_COPY_STATE_FUNCS is defined)
 
 #if !SPC_NO_COPY_STATE_FUNCS
-	// Saves/loads state
+	// Saves/loads exact state, including samples buffered since last play().
+	// Must only be called between calls to play()/skip(). Cheap enough to use
+	// every few seconds of playback; state is around 66K, mostly RAM.
 	enum { state_size = 67 * 1024L }; // maximum space needed when saving
 	typedef Spc_Dsp::copy_func_t copy_func_t;
 	void copy_state( unsigned char** io, copy_func_t );
@@ -117,7 +119,9 @@ public:
 	};
 	regs_t& smp_regs() { return m.cpu_regs; }
 	
+	// Call dsp_ram_loaded() after changing RAM through this
 	uint8_t* smp_ram() { return m.ram.ram; }
+	void dsp_ram_loaded() { dsp.ram_loaded(); }
 	
 	void run_until( time_t t ) { run_until_( t ); }
 public:
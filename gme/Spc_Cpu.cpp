@@ -190,6 +190,16 @@ inline void Snes_Spc::dsp_write( int data, rel_time_t time )
 			RUN_DSP( time, max_reg_time );\
 		}\
 	}
+	
+	// DSP only writes to echo buffer, so it can stay behind while CPU reads
+	// elsewhere. Letting it fall behind lets it run many samples at once.
+	#define MEM_READ_ACCESS( time, addr ) \
+	{\
+		if ( time >= m.dsp_time && dsp.may_write_ram( addr ) )\
+		{\
+			RUN_DSP( time, max_reg_time );\
+		}\
+	}
 #elif !defined (NDEBUG)
 	// Debug-only check for read/write within echo buffer, since this might result in
 	// inaccurate emulation due to the DSP not being caught up to the present.
@@ -214,8 +224,10 @@ inline void Snes_Spc::dsp_write( int data, rel_time_t time )
 	}
 	
 	#define MEM_ACCESS( time, addr ) check( !check_echo_access( (uint16_t) addr ) );
+	#define MEM_READ_ACCESS( time, addr ) MEM_ACCESS( time, addr )
 #else
 	#define MEM_ACCESS( time, addr )
+	#define MEM_READ_ACCESS( time, addr )
 #endif
 
 
@@ -417,6 +429,7 @@ void Snes_Spc::cpu_write( int data, int addr, rel_time_t time )
 	
 	// RAM
 	RAM [addr] = (uint8_t) data;
+	dsp.ram_written( addr );
 	int reg = addr - 0xF0;
 	if ( reg >= 0 ) // 64%
 	{
@@ -467,7 +480,7 @@ inline int Snes_Spc::cpu_read_smp_reg( int reg, rel_time_t time )
 
 int Snes_Spc::cpu_read( int addr, rel_time_t time )
 {
-	MEM_ACCESS( time, addr )
+	MEM_READ_ACCESS( time, addr )
 	
 	// RAM
 	int result = RAM [addr];
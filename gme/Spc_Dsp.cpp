@@ -3,8 +3,13 @@
 #include "Spc_Dsp.h"
 
 #include "blargg_endian.h"
+#include "blargg_cpu.h"
 #include <string.h>
 
+#if BLARGG_X86_SIMD
+	#include <immintrin.h>
+#endif
+
 /* Copyright (C) 2007 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -183,38 +188,251 @@ inline void Spc_Dsp::run_counter( int i )
 
 //// Emulation
 
+// Gaussian interpolation inputs of one voice over a block, recorded so that
+// filter and volume can then be applied to all samples at once
+struct spc_gauss_t
+{
+	short in    [Spc_Dsp::block_max] [4]; // samples under filter
+	short gauss [Spc_Dsp::block_max] [4]; // matching filter coefficients
+	int   env   [Spc_Dsp::block_max];
+};
+
+// Voice outputs summed for each sample of a block
+struct spc_mix_t
+{
+	int main [2] [Spc_Dsp::block_max];
+	int echo [2] [Spc_Dsp::block_max];
+};
+
+// Finishes fast Gaussian interpolation of samples begin to end-1 and adds them
+// to mix. Voice output goes to out, for pitch modulation of next voice.
+static void mix_voice( spc_gauss_t const& g, int begin, int end, int const vol [2],
+		bool echo, int* out, spc_mix_t& mix )
+{
+	for ( int t = begin; t < end; t++ )
+	{
+		short const* in  = g.in    [t];
+		short const* fir = g.gauss [t];
+		int output = (fir [0] * in [0] +
+		              fir [1] * in [1] +
+		              fir [2] * in [2] +
+		              fir [3] * in [3]) >> 11;
+		output = (output * g.env [t]) >> 11;
+		out [t] = output;
+		
+		int l = output * vol [0];
+		int r = output * vol [1];
+		mix.main [0] [t] += l;
+		mix.main [1] [t] += r;
+		if ( echo )
+		{
+			mix.echo [0] [t] += l;
+			mix.echo [1] [t] += r;
+		}
+	}
+}
+
+// Runs 8-tap echo FIR for samples begin to end-1. Input for sample t is
+// window [channel] [t + 7], after the seven inputs before it.
+static void echo_fir( short const (*window) [Spc_Dsp::block_max + 8],
+		short const fir [8], int begin, int end, int (*out) [2] )
+{
+	for ( int t = begin; t < end; t++ )
+	{
+		for ( int ch = 0; ch < 2; ch++ )
+		{
+			short const* in = &window [ch] [t];
+			out [t] [ch] = in [0] * fir [0] + in [1] * fir [1] +
+			               in [2] * fir [2] + in [3] * fir [3] +
+			               in [4] * fir [4] + in [5] * fir [5] +
+			               in [6] * fir [6] + in [7] * fir [7];
+		}
+	}
+}
+
+#if BLARGG_X86_SIMD
+
+#define LOAD( p )       _mm_loadu_si128( (__m128i const*) (p) )
+#define STORE( p, v )   _mm_storeu_si128( (__m128i*) (p), v )
+#define ADD_TO( p, v )  STORE( p, _mm_add_epi32( LOAD( p ), v ) )
+
+// Same as mix_voice(), four samples at a time
+BLARGG_TARGET( "sse4.1" )
+static void mix_voice_sse41( spc_gauss_t const& g, int begin, int end, int const vol [2],
+		bool echo, int* out, spc_mix_t& mix )
+{
+	__m128i const vol_l = _mm_set1_epi32( vol [0] );
+	__m128i const vol_r = _mm_set1_epi32( vol [1] );
+	int t = begin;
+	for ( ; t + 4 <= end; t += 4 )
+	{
+		// each madd sums two pairs of taps for two samples
+		__m128i a = _mm_madd_epi16( LOAD( g.in [t    ] ), LOAD( g.gauss [t    ] ) );
+		__m128i b = _mm_madd_epi16( LOAD( g.in [t + 2] ), LOAD( g.gauss [t + 2] ) );
+		__m128i output = _mm_srai_epi32( _mm_hadd_epi32( a, b ), 11 );
+		output = _mm_srai_epi32( _mm_mullo_epi32( output, LOAD( &g.env [t] ) ), 11 );
+		STORE( &out [t], output );
+		
+		__m128i l = _mm_mullo_epi32( output, vol_l );
+		__m128i r = _mm_mullo_epi32( output, vol_r );
+		ADD_TO( &mix.main [0] [t], l );
+		ADD_TO( &mix.main [1] [t], r );
+		if ( echo )
+		{
+			ADD_TO( &mix.echo [0] [t], l );
+			ADD_TO( &mix.echo [1] [t], r );
+		}
+	}
+	mix_voice( g, t, end, vol, echo, out, mix );
+}
+
+// Same as echo_fir(), two samples at a time
+BLARGG_TARGET( "sse4.1" )
+static void echo_fir_sse41( short const (*window) [Spc_Dsp::block_max + 8],
+		short const fir [8], int begin, int end, int (*out) [2] )
+{
+	__m128i const taps = LOAD( fir );
+	int t = begin;
+	for ( ; t + 2 <= end; t += 2 )
+	{
+		// each madd leaves four partial sums of a channel, and hadds finish them
+		__m128i l0 = _mm_madd_epi16( LOAD( &window [0] [t    ] ), taps );
+		__m128i r0 = _mm_madd_epi16( LOAD( &window [1] [t    ] ), taps );
+		__m128i l1 = _mm_madd_epi16( LOAD( &window [0] [t + 1] ), taps );
+		__m128i r1 = _mm_madd_epi16( LOAD( &window [1] [t + 1] ), taps );
+		STORE( out [t], _mm_hadd_epi32( _mm_hadd_epi32( l0, r0 ), _mm_hadd_epi32( l1, r1 ) ) );
+	}
+	echo_fir( window, fir, t, end, out );
+}
+
+#undef LOAD
+#undef STORE
+#undef ADD_TO
+
+#endif
+
+// True if byte ranges overlap, with addresses wrapping around at 64K
+static inline bool ram_ranges_overlap( int a, int a_size, int b, int b_size )
+{
+	return ((b - a) & 0xFFFF) < a_size || ((a - b) & 0xFFFF) < b_size;
+}
+
+inline bool Spc_Dsp::voice_idle( voice_t const& v ) const
+{
+	// a released voice at zero stays silent and runs no BRR decoding
+	return v.env_mode == env_release && !v.env && !v.kon_delay;
+}
+
+// Number of samples, up to count, that can be run as one block, one voice at a
+// time, and still give exactly the same result as running them in order
+int Spc_Dsp::block_size( int count ) const
+{
+	// KON takes effect on next even sample. Running it alone keeps note_on()
+	// seeing RAM as it was on that sample.
+	if ( count <= 1 || (m.new_kon & ~m.kon) )
+		return 1;
+	
+	if ( count > block_max )
+		count = block_max;
+	
+	if ( REG(flg) & 0x20 )
+		return count;
+	
+	// Echo writes must not reach any RAM that voices will read during block.
+	// At most one BRR group (four samples) is decoded per sample.
+	int const echo_addr = REG(esa) * 0x100;
+	int echo_size = (REG(edl) & 0x0F) * 0x800;
+	if ( echo_size < m.echo_length )
+		echo_size = m.echo_length;
+	if ( echo_size < 4 )
+		echo_size = 4;
+	
+	int const brr_size = (count / 4 + 2) * 9;
+	uint8_t const* const dir = &m.ram [REG(dir) * 0x100];
+	for ( int i = 0; i < voice_count; i++ )
+	{
+		voice_t const& v = m.voices [i];
+		if ( voice_idle( v ) )
+			continue;
+		
+		int const srcn = m.regs [i * 0x10 + v_srcn] * 4;
+		if ( ram_ranges_overlap( echo_addr, echo_size, REG(dir) * 0x100 + srcn, 4 ) ||
+				ram_ranges_overlap( echo_addr, echo_size, v.brr_addr, brr_size ) ||
+				ram_ranges_overlap( echo_addr, echo_size, GET_LE16A( &dir [srcn + 2] ), brr_size ) ||
+				(v.kon_delay && ram_ranges_overlap( echo_addr, echo_size,
+						GET_LE16A( &dir [srcn] ), brr_size )) )
+			return 1;
+	}
+	
+	return count;
+}
+
 void Spc_Dsp::run( int clock_count )
 {
+	GME_STATS_STAGE( gme_stage_apu );
 	int new_phase = m.phase + clock_count;
 	int count = new_phase >> 5;
 	m.phase = new_phase & 31;
-	if ( !count )
-		return;
+	
+	while ( count > 0 )
+	{
+		int n = block_size( count );
+		run_block( n );
+		count -= n;
+	}
+}
+
+// Runs count samples as a block. Global state that voices depend on is run for
+// all samples first, then each voice is run over the whole block, then echo and
+// output. Registers can't change within a block.
+void Spc_Dsp::run_block( int const count )
+{
+	assert( 0 < count && count <= block_max );
 	
 	uint8_t* const ram = m.ram;
 	uint8_t const* const dir = &ram [REG(dir) * 0x100];
 	int const slow_gaussian = (REG(pmon) >> 1) | REG(non);
 	int const noise_rate = REG(flg) & 0x1F;
+	int const base_sample = abs_sample;
 	
-	// Global volume
-	int mvoll = (int8_t) REG(mvoll);
-	int mvolr = (int8_t) REG(mvolr);
-	if ( mvoll * mvolr < m.surround_threshold )
-		mvoll = -mvoll; // eliminate surround
+	// MIDI hooks made by each voice, replayed in sample order once all voices
+	// have run. They only affect MIDI state.
+	enum { note_off_hook = -1, note_on_hook = -2 };
+	struct hook_t { int t; int pitch; }; // pitch for note_pitch(), else *_hook
+	hook_t hooks [voice_count] [block_max * 2 + 1];
+	int hook_count [voice_count] = { 0 };
+	int any_hooks = 0;
+	#define ADD_HOOK( pitch_ )\
+	{\
+		hook_t& h = hooks [i] [hook_count [i]++];\
+		h.t     = t;\
+		h.pitch = pitch_;\
+		any_hooks = 1;\
+		last_pitch = (pitch_ == note_off_hook ? 0 : pitch_ == note_on_hook ? voice_pitch : pitch_);\
+	}
 	
-	do
+	// Global state for each sample
+	char     every_other_sample [block_max];
+	unsigned counters [block_max] [4];
+	int      noise [block_max];
+	int      kon = 0; // only a block of one sample can have KON
+	for ( int t = 0; t < count; t++ )
 	{
 		// KON/KOFF reading
 		if ( (m.every_other_sample ^= 1) != 0 )
 		{
 			m.new_kon &= ~m.kon;
 			m.kon    = m.new_kon;
+			m.kon_check |= m.kon;
 			m.t_koff = REG(koff); 
+			kon |= m.kon;
 		}
+		every_other_sample [t] = (char) m.every_other_sample;
 		
 		run_counter( 1 );
 		run_counter( 2 );
 		run_counter( 3 );
+		memcpy( counters [t], m.counters, sizeof m.counters );
 		
 		// Noise
 		if ( !READ_COUNTER( noise_rate ) )
@@ -222,27 +440,57 @@ void Spc_Dsp::run( int clock_count )
 			int feedback = (m.noise << 13) ^ (m.noise << 14);
 			m.noise = (feedback & 0x4000) ^ (m.noise >> 1);
 		}
+		noise [t] = m.noise;
+	}
+	assert( count == 1 || !kon );
+	
+	#undef READ_COUNTER
+	#define READ_COUNTER( rate )\
+		(counters [t] [m.counter_select [rate] - m.counters] & counter_mask [rate])
+	
+	// Voices
+	spc_mix_t mix;
+	memset( &mix, 0, sizeof mix );
+	int voice_out [block_max]; // output of previous voice, for pitch modulation
+	int const pmon = REG(pmon) & 0xFE; // voice 0 doesn't support PMON
+	for ( int i = 0; i < voice_count; i++ )
+	{
+		uint8_t* const v_regs = &m.regs [i * 0x10];
+		int const vbit = 1 << i;
+		
+		#define SAMPLE_PTR(i) GET_LE16A( &dir [VREG(v_regs,srcn) * 4 + i * 2] )
+		
+		if ( voice_idle( m.voices [i] ) && !(kon & vbit) )
+		{
+			VREG(v_regs,envx) = 0;
+			VREG(v_regs,outx) = 0;
+			if ( pmon & vbit << 1 )
+				memset( voice_out, 0, count * sizeof voice_out [0] );
+			continue;
+		}
 		
-		// Voices
-		int pmon_input = 0;
-		int main_out_l = 0;
-		int main_out_r = 0;
-		int echo_out_l = 0;
-		int echo_out_r = 0;
-		voice_t* v = m.voices;
-		uint8_t* v_regs = m.regs;
-		int vbit = 1;
-		do
+		// Run copy of voice so that its state can stay in registers
+		voice_t voice = m.voices [i];
+		voice.buf_pos = voice.buf + (m.voices [i].buf_pos - m.voices [i].buf);
+		voice_t* const v = &voice;
+		
+		spc_gauss_t gauss;
+		bool const slow = (slow_gaussian & vbit) != 0;
+		int const voice_pitch = GET_LE16A( &VREG(v_regs,pitchl) ) & 0x3FFF;
+		
+		// Pitch MIDI state will have, since note_pitch() does nothing when it's unchanged.
+		// Calls that don't set it return early for the rest of block too.
+		int last_pitch = voice_midi [i].pitch;
+		int envx = 0; // written to register after block
+		for ( int t = 0; t < count; t++ )
 		{
-			#define SAMPLE_PTR(i) GET_LE16A( &dir [VREG(v_regs,srcn) * 4 + i * 2] )
-			
 			int brr_header = ram [v->brr_addr];
 			int kon_delay = v->kon_delay;
 			
 			// Pitch
-			int pitch = GET_LE16A( &VREG(v_regs,pitchl) ) & 0x3FFF;
-			if ( REG(pmon) & vbit )
-				pitch += ((pmon_input >> 5) * pitch) >> 10;
+			int pitch = voice_pitch;
+			if ( pmon & vbit )
+				pitch += ((voice_out [t] >> 5) * pitch) >> 10;
 			
 			// KON phases
 			if ( --kon_delay >= 0 )
@@ -273,30 +521,45 @@ void Spc_Dsp::run( int clock_count )
 			
 			// Gaussian interpolation
 			{
-				int output = 0;
-				VREG(v_regs,envx) = (uint8_t) (env >> 4);
-				if ( env )
+				envx = env >> 4;
+				
+				// Make pointers into gaussian based on fractional position between samples
+				int offset = (unsigned) v->interp_pos >> 3 & 0x1FE;
+				short const* fwd = interleved_gauss       + offset;
+				short const* rev = interleved_gauss + 510 - offset; // mirror left half of gaussian
+				
+				int const* in = &v->buf_pos [(unsigned) v->interp_pos >> 12];
+				
+				if ( !slow ) // 99%
 				{
-					int apenv = env;
-					// Make pointers into gaussian based on fractional position between samples
-					int offset = (unsigned) v->interp_pos >> 3 & 0x1FE;
-					short const* fwd = interleved_gauss       + offset;
-					short const* rev = interleved_gauss + 510 - offset; // mirror left half of gaussian
-					
-					int const* in = &v->buf_pos [(unsigned) v->interp_pos >> 12];
-					
-					if ( !(slow_gaussian & vbit) ) // 99%
+					// Faster approximation when exact sample value isn't necessary for pitch
+					// mod. Finished for whole block by mix_voice().
+					short* rec = gauss.in [t];
+					if ( env )
 					{
-						// Faster approximation when exact sample value isn't necessary for pitch mod
-						output = (fwd [0] * in [0] +
-						          fwd [1] * in [1] +
-						          rev [1] * in [2] +
-						          rev [0] * in [3]) >> 11;
-						output = (output * apenv) >> 11;
+						rec [0] = (short) in [0];
+						rec [1] = (short) in [1];
+						rec [2] = (short) in [2];
+						rec [3] = (short) in [3];
 					}
 					else
 					{
-						output = (int16_t) (m.noise * 2);
+						rec [0] = rec [1] = rec [2] = rec [3] = 0;
+					}
+					
+					rec = gauss.gauss [t];
+					rec [0] = fwd [0];
+					rec [1] = fwd [1];
+					rec [2] = rev [1];
+					rec [3] = rev [0];
+					gauss.env [t] = env;
+				}
+				else
+				{
+					int output = 0;
+					if ( env )
+					{
+						output = (int16_t) (noise [t] * 2);
 						if ( !(REG(non) & vbit) )
 						{
 							output  = (fwd [0] * in [0]) >> 11;
@@ -308,26 +571,23 @@ void Spc_Dsp::run( int clock_count )
 							CLAMP16( output );
 							output &= ~1;
 						}
-						output = (output * apenv) >> 11 & ~1;
-					}
-					
-					// Output
-					int l = output * v->volume [0];
-					int r = output * v->volume [1];
-					
-					main_out_l += l;
-					main_out_r += r;
-					
-					if ( REG(eon) & vbit )
-					{
-						echo_out_l += l;
-						echo_out_r += r;
+						output = (output * env) >> 11 & ~1;
+						
+						// Output
+						int l = output * v->volume [0];
+						int r = output * v->volume [1];
+						
+						mix.main [0] [t] += l;
+						mix.main [1] [t] += r;
+						
+						if ( REG(eon) & vbit )
+						{
+							mix.echo [0] [t] += l;
+							mix.echo [1] [t] += r;
+						}
 					}
-
+					voice_out [t] = output;
 				}
-
-				pmon_input = output;
-				VREG(v_regs,outx) = (uint8_t) (output >> 8);
 			}
 			
 			// Soft reset or end of sample
@@ -335,30 +595,30 @@ void Spc_Dsp::run( int clock_count )
 			{
 				if ( v->env_mode != env_release )
 				{
-					note_off(v);
+					ADD_HOOK( note_off_hook );
 				}
 				v->env_mode = env_release;
 				env         = 0;
 			}
 			
-			if ( m.every_other_sample )
+			if ( every_other_sample [t] )
 			{
 				// KOFF
 				if ( m.t_koff & vbit )
 				{
 					if ( v->env_mode != env_release )
 					{
-						note_off(v);
+						ADD_HOOK( note_off_hook );
 					}
 					v->env_mode = env_release;
 				}
 
 				// KON
-				if ( m.kon & vbit )
+				if ( kon & vbit )
 				{
 					v->kon_delay = 5;
 					v->env_mode  = env_attack;
-					note_on(v);
+					ADD_HOOK( note_on_hook );
 					REG(endx) &= ~vbit;
 				}
 			}
@@ -469,18 +729,34 @@ void Spc_Dsp::run( int clock_count )
 					interp_pos = 0x7FFF;
 				v->interp_pos = interp_pos;
 
-				note_pitch(v, pitch);
+				if ( pitch != last_pitch )
+					ADD_HOOK( pitch );
 
 				// BRR decode if necessary
 				if ( old_pos >= 0x4000 )
 				{
-					// Arrange the four input nybbles in 0xABCD order for easy decoding
-					int nybbles = ram [(v->brr_addr + v->brr_offset) & 0xFFFF] * 0x100 +
-							ram [(v->brr_addr + v->brr_offset + 1) & 0xFFFF];
+					int* pos = v->buf_pos;
+					int brr_offset = v->brr_offset;
+					int const data_addr = v->brr_addr + brr_offset;
+					int const first = (brr_offset - 1) * 2; // index in block of next sample
+					
+					// Use cached decoding of block if RAM hasn't changed since
+					brr_cache_t const* cached = v->brr_cache;
+					if ( brr_offset == 1 )
+					{
+						cached = cached_brr( v->brr_addr, pos [brr_buf_size - 1], pos [brr_buf_size - 2] );
+						v->brr_cache = cached;
+						if ( cached )
+							v->brr_fill = cached->fill;
+					}
+					else if ( cached && (cached->fill != v->brr_fill || !brr_valid( *cached )) )
+					{
+						cached = NULL;
+						v->brr_cache = NULL;
+					}
 					
 					// Advance read position
 					int const brr_block_size = 9;
-					int brr_offset = v->brr_offset;
 					if ( (brr_offset += 2) >= brr_block_size )
 					{
 						// Next BRR block
@@ -497,56 +773,63 @@ void Spc_Dsp::run( int clock_count )
 					}
 					v->brr_offset = brr_offset;
 					
-					// Decode
-					
-					// 0: >>1  1: <<0  2: <<1 ... 12: <<11  13-15: >>4 <<11
-					static unsigned char const shifts [16 * 2] = {
-						13,12,12,12,12,12,12,12,12,12,12, 12, 12, 16, 16, 16,
-						 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 11, 11, 11
-					};
-					int const scale = brr_header >> 4;
-					int const right_shift = shifts [scale];
-					int const left_shift  = shifts [scale + 16];
-					
-					// Write to next four samples in circular buffer
-					int* pos = v->buf_pos;
-					int* end;
-					
-					// Decode four samples
-					for ( end = pos + 4; pos < end; pos++, nybbles <<= 4 )
+					if ( cached )
 					{
-						// Extract upper nybble and scale appropriately
-						int s = ((int16_t) nybbles >> right_shift) << left_shift;
+						short const* in = &cached->out [first];
+						for ( int i = 0; i < 4; i++ )
+							pos [brr_buf_size + i] = pos [i] = in [i];
+						pos += 4;
+					}
+					else
+					{
+						// Arrange the four input nybbles in 0xABCD order for easy decoding
+						int nybbles = ram [data_addr & 0xFFFF] * 0x100 + ram [(data_addr + 1) & 0xFFFF];
+						
+						// 0: >>1  1: <<0  2: <<1 ... 12: <<11  13-15: >>4 <<11
+						static unsigned char const shifts [16 * 2] = {
+							13,12,12,12,12,12,12,12,12,12,12, 12, 12, 16, 16, 16,
+							 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 11, 11, 11
+						};
+						int const scale = brr_header >> 4;
+						int const right_shift = shifts [scale];
+						int const left_shift  = shifts [scale + 16];
 						
-						// Apply IIR filter (8 is the most commonly used)
-						int const filter = brr_header & 0x0C;
-						int const p1 = pos [brr_buf_size - 1];
-						int const p2 = pos [brr_buf_size - 2] >> 1;
-						if ( filter >= 8 )
+						// Decode four samples into next four of circular buffer
+						for ( int* end = pos + 4; pos < end; pos++, nybbles <<= 4 )
 						{
-							s += p1;
-							s -= p2;
-							if ( filter == 8 ) // s += p1 * 0.953125 - p2 * 0.46875
+							// Extract upper nybble and scale appropriately
+							int s = ((int16_t) nybbles >> right_shift) << left_shift;
+							
+							// Apply IIR filter (8 is the most commonly used)
+							int const filter = brr_header & 0x0C;
+							int const p1 = pos [brr_buf_size - 1];
+							int const p2 = pos [brr_buf_size - 2] >> 1;
+							if ( filter >= 8 )
 							{
-								s += p2 >> 4;
-								s += (p1 * -3) >> 6;
+								s += p1;
+								s -= p2;
+								if ( filter == 8 ) // s += p1 * 0.953125 - p2 * 0.46875
+								{
+									s += p2 >> 4;
+									s += (p1 * -3) >> 6;
+								}
+								else // s += p1 * 0.8984375 - p2 * 0.40625
+								{
+									s += (p1 * -13) >> 7;
+									s += (p2 * 3) >> 4;
+								}
 							}
-							else // s += p1 * 0.8984375 - p2 * 0.40625
+							else if ( filter ) // s += p1 * 0.46875
 							{
-								s += (p1 * -13) >> 7;
-								s += (p2 * 3) >> 4;
+								s += p1 >> 1;
+								s += (-p1) >> 5;
 							}
+							
+							// Adjust and write sample
+							CLAMP16( s );
+							s = (int16_t) (s * 2);
+							pos [brr_buf_size] = pos [0] = s; // second copy simplifies wrap-around
 						}
-						else if ( filter ) // s += p1 * 0.46875
-						{
-							s += p1 >> 1;
-							s += (-p1) >> 5;
-						}
-						
-						// Adjust and write sample
-						CLAMP16( s );
-						s = (int16_t) (s * 2);
-						pos [brr_buf_size] = pos [0] = s; // second copy simplifies wrap-around
 					}
 					
 					if ( pos >= &v->buf [brr_buf_size] )
@@ -555,76 +838,152 @@ void Spc_Dsp::run( int clock_count )
 				}
 			}
 skip_brr:
-			// Next voice
-			vbit <<= 1;
-			v_regs += 0x10;
-			v++;
+			;
 		}
-		while ( vbit < 0x100 );
 		
-		// Echo position
+		if ( !slow )
+		{
+			bool const echo = (REG(eon) & vbit) != 0;
+		#if BLARGG_X86_SIMD
+			if ( m.sse41 )
+				mix_voice_sse41( gauss, 0, count, v->volume, echo, voice_out, mix );
+			else
+		#endif
+				mix_voice( gauss, 0, count, v->volume, echo, voice_out, mix );
+		}
+		m.voices [i] = voice;
+		m.voices [i].buf_pos = m.voices [i].buf + (voice.buf_pos - voice.buf);
+		VREG(v_regs,envx) = (uint8_t) envx;
+		VREG(v_regs,outx) = (uint8_t) (voice_out [count - 1] >> 8);
+	}
+	
+	// MIDI hooks
+	int hook_pos [voice_count] = { 0 };
+	for ( int t = 0; any_hooks && t < count; t++ )
+	{
+		abs_sample = base_sample + t;
+		for ( int i = 0; i < voice_count; i++ )
+		{
+			voice_t* const v = &m.voices [i];
+			for ( ; hook_pos [i] < hook_count [i] && hooks [i] [hook_pos [i]].t == t; hook_pos [i]++ )
+			{
+				int const pitch = hooks [i] [hook_pos [i]].pitch;
+				if ( pitch == note_off_hook )
+					note_off( v );
+				else if ( pitch == note_on_hook )
+					note_on( v );
+				else
+					note_pitch( v, pitch );
+			}
+		}
+	}
+	abs_sample = base_sample;
+	
+	// Global volume
+	int mvoll = (int8_t) REG(mvoll);
+	int mvolr = (int8_t) REG(mvolr);
+	if ( mvoll * mvolr < m.surround_threshold )
+		mvoll = -mvoll; // eliminate surround
+	
+	// Echo position
+	int echo_offsets [block_max];
+	for ( int t = 0; t < count; t++ )
+	{
 		int echo_offset = m.echo_offset;
-		uint8_t* const echo_ptr = &ram [(REG(esa) * 0x100 + echo_offset) & 0xFFFF];
+		echo_offsets [t] = echo_offset;
 		if ( !echo_offset )
 			m.echo_length = (REG(edl) & 0x0F) * 0x800;
 		echo_offset += 4;
 		if ( echo_offset >= m.echo_length )
 			echo_offset = 0;
 		m.echo_offset = echo_offset;
+	}
+	
+	// FIR input window: seven samples before block, then sample t at t + 7
+	short echo_window [2] [block_max + 8];
+	for ( int i = 0; i < echo_hist_size - 1; i++ )
+	{
+		echo_window [0] [i] = (short) m.echo_hist_pos [i + 2] [0];
+		echo_window [1] [i] = (short) m.echo_hist_pos [i + 2] [1];
+	}
+	
+	short fir [echo_hist_size];
+	for ( int i = 0; i < echo_hist_size; i++ )
+		fir [i] = (int8_t) REG(fir + i * 0x10);
+	
+	// Echo is run in spans that each touch a part of the echo buffer only once,
+	// so a span's input can all be read before its output is written. A span
+	// ends where the buffer would wrap back to it, which can be every sample.
+	int echo_in [block_max] [2];
+	for ( int begin = 0, end; begin < count; begin = end )
+	{
+		bool wrapped = false;
+		for ( end = begin + 1; end < count; end++ )
+		{
+			int offset = echo_offsets [end];
+			if ( offset == echo_offsets [begin] || (!offset && wrapped) )
+				break;
+			if ( !offset )
+				wrapped = true;
+		}
 		
 		// FIR
-		int echo_in_l = GET_LE16SA( echo_ptr + 0 );
-		int echo_in_r = GET_LE16SA( echo_ptr + 2 );
-		
-		int (*echo_hist_pos) [2] = m.echo_hist_pos;
-		if ( ++echo_hist_pos >= &m.echo_hist [echo_hist_size] )
-			echo_hist_pos = m.echo_hist;
-		m.echo_hist_pos = echo_hist_pos;
-		
-		echo_hist_pos [0] [0] = echo_hist_pos [8] [0] = echo_in_l;
-		echo_hist_pos [0] [1] = echo_hist_pos [8] [1] = echo_in_r;
-		
-		#define CALC_FIR_( i, in )  ((in) * (int8_t) REG(fir + i * 0x10))
-		echo_in_l = CALC_FIR_( 7, echo_in_l );
-		echo_in_r = CALC_FIR_( 7, echo_in_r );
+		for ( int t = begin; t < end; t++ )
+		{
+			uint8_t const* echo_ptr = &ram [(REG(esa) * 0x100 + echo_offsets [t]) & 0xFFFF];
+			echo_window [0] [t + 7] = (short) GET_LE16SA( echo_ptr + 0 );
+			echo_window [1] [t + 7] = (short) GET_LE16SA( echo_ptr + 2 );
+		}
 		
-		#define CALC_FIR( i, ch )   CALC_FIR_( i, echo_hist_pos [i + 1] [ch] )
-		#define DO_FIR( i )\
-			echo_in_l += CALC_FIR( i, 0 );\
-			echo_in_r += CALC_FIR( i, 1 );
-		DO_FIR( 0 );
-		DO_FIR( 1 );
-		DO_FIR( 2 );
-		#if defined (__MWERKS__) && __MWERKS__ < 0x3200
-			__eieio(); // keeps compiler from stupidly "caching" things in memory
-		#endif
-		DO_FIR( 3 );
-		DO_FIR( 4 );
-		DO_FIR( 5 );
-		DO_FIR( 6 );
+	#if BLARGG_X86_SIMD
+		if ( m.sse41 )
+			echo_fir_sse41( echo_window, fir, begin, end, echo_in );
+		else
+	#endif
+			echo_fir( echo_window, fir, begin, end, echo_in );
 		
 		// Echo out
 		if ( !(REG(flg) & 0x20) )
 		{
-			int l = (echo_out_l >> 7) + ((echo_in_l * (int8_t) REG(efb)) >> 14);
-			int r = (echo_out_r >> 7) + ((echo_in_r * (int8_t) REG(efb)) >> 14);
-			
-			// just to help pass more validation tests
-			#if SPC_MORE_ACCURACY
-				l &= ~1;
-				r &= ~1;
-			#endif
-			
-			CLAMP16( l );
-			CLAMP16( r );
-			
-			SET_LE16A( echo_ptr + 0, l );
-			SET_LE16A( echo_ptr + 2, r );
+			for ( int t = begin; t < end; t++ )
+			{
+				int l = (mix.echo [0] [t] >> 7) + ((echo_in [t] [0] * (int8_t) REG(efb)) >> 14);
+				int r = (mix.echo [1] [t] >> 7) + ((echo_in [t] [1] * (int8_t) REG(efb)) >> 14);
+				
+				// just to help pass more validation tests
+				#if SPC_MORE_ACCURACY
+					l &= ~1;
+					r &= ~1;
+				#endif
+				
+				CLAMP16( l );
+				CLAMP16( r );
+				
+				int const echo_addr = (REG(esa) * 0x100 + echo_offsets [t]) & 0xFFFF;
+				SET_LE16A( &ram [echo_addr + 0], l );
+				SET_LE16A( &ram [echo_addr + 2], r );
+				ram_written( echo_addr ); // all four bytes are in same page
+			}
 		}
+	}
+	
+	// Keep last eight inputs in history
+	for ( int t = count < echo_hist_size ? 0 : count - echo_hist_size; t < count; t++ )
+	{
+		int (*echo_hist_pos) [2] = m.echo_hist_pos;
+		if ( ++echo_hist_pos >= &m.echo_hist [echo_hist_size] )
+			echo_hist_pos = m.echo_hist;
+		m.echo_hist_pos = echo_hist_pos;
 		
+		echo_hist_pos [0] [0] = echo_hist_pos [8] [0] = echo_window [0] [t + 7];
+		echo_hist_pos [0] [1] = echo_hist_pos [8] [1] = echo_window [1] [t + 7];
+	}
+	
+	for ( int t = 0; t < count; t++ )
+	{
 		// Sound out
-		int l = (main_out_l * mvoll + echo_in_l * (int8_t) REG(evoll)) >> 14;
-		int r = (main_out_r * mvolr + echo_in_r * (int8_t) REG(evolr)) >> 14;
+		int l = (mix.main [0] [t] * mvoll + echo_in [t] [0] * (int8_t) REG(evoll)) >> 14;
+		int r = (mix.main [1] [t] * mvolr + echo_in [t] [1] * (int8_t) REG(evolr)) >> 14;
 		
 		CLAMP16( l );
 		CLAMP16( r );
@@ -641,7 +1000,103 @@ skip_brr:
 
 		abs_sample++;
 	}
-	while ( --count );
+}
+
+// Decodes 16 samples of BRR block at addr that follows samples prev2 and prev1
+static void decode_brr( BOOST::uint8_t const* ram, int addr, int prev1, int prev2, short out [16] )
+{
+	int const brr_header = ram [addr];
+	
+	// 0: >>1  1: <<0  2: <<1 ... 12: <<11  13-15: >>4 <<11
+	static unsigned char const shifts [16 * 2] = {
+		13,12,12,12,12,12,12,12,12,12,12, 12, 12, 16, 16, 16,
+		 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 11, 11, 11
+	};
+	int const scale = brr_header >> 4;
+	int const right_shift = shifts [scale];
+	int const left_shift  = shifts [scale + 16];
+	int const filter = brr_header & 0x0C;
+	
+	int buf [2 + 16];
+	buf [0] = prev2;
+	buf [1] = prev1;
+	int* pos = &buf [2];
+	for ( int i = 0; i < 16; i++, pos++ )
+	{
+		// Extract nybble, high one first, and scale appropriately
+		int nybbles = ram [(addr + 1 + i / 2) & 0xFFFF] << (i & 1 ? 12 : 8);
+		int s = ((int16_t) nybbles >> right_shift) << left_shift;
+		
+		// Apply IIR filter (8 is the most commonly used)
+		int const p1 = pos [-1];
+		int const p2 = pos [-2] >> 1;
+		if ( filter >= 8 )
+		{
+			s += p1;
+			s -= p2;
+			if ( filter == 8 ) // s += p1 * 0.953125 - p2 * 0.46875
+			{
+				s += p2 >> 4;
+				s += (p1 * -3) >> 6;
+			}
+			else // s += p1 * 0.8984375 - p2 * 0.40625
+			{
+				s += (p1 * -13) >> 7;
+				s += (p2 * 3) >> 4;
+			}
+		}
+		else if ( filter ) // s += p1 * 0.46875
+		{
+			s += p1 >> 1;
+			s += (-p1) >> 5;
+		}
+		
+		CLAMP16( s );
+		pos [0] = (int16_t) (s * 2);
+		out [i] = (short) pos [0];
+	}
+}
+
+Spc_Dsp::brr_cache_t const* Spc_Dsp::cached_brr( int addr, int p1, int p2 )
+{
+	if ( addr < brr_cache_begin || addr + 9 > brr_cache_end )
+		return NULL;
+	
+	// Filter 0 ignores previous samples and filter 1 only uses the last
+	int const filter = m.ram [addr] & 0x0C;
+	if ( filter < 8 )
+	{
+		p2 = 0;
+		if ( !filter )
+			p1 = 0;
+	}
+	
+	unsigned hash = (unsigned) addr * 31 + (unsigned) p1 * 7 + (unsigned) p2;
+	brr_cache_t& e = brr_cache [(hash ^ hash >> 8) & (brr_cache_size - 1)];
+	if ( e.addr == addr && e.p1 == p1 && e.p2 == p2 && brr_valid( e ) )
+	{
+		GME_STATS_ADD( brr_cache_hits, 1 );
+		return &e;
+	}
+	
+	GME_STATS_ADD( brr_cache_misses, 1 );
+	e.addr     = addr;
+	e.p1       = p1;
+	e.p2       = p2;
+	e.gens [0] = brr_gens [addr >> brr_page_shift];
+	e.gens [1] = brr_gens [(addr + 8) >> brr_page_shift];
+	e.fill     = ++brr_fills;
+	decode_brr( m.ram, addr, p1, p2, e.out );
+	return &e;
+}
+
+void Spc_Dsp::ram_loaded()
+{
+	for ( int i = 0; i < brr_cache_size; i++ )
+		brr_cache [i].addr = -1;
+	
+	for ( int i = 0; i < voice_count; i++ )
+		m.voices [i].brr_cache = NULL;
 }
 
 void Spc_Dsp::decode_sample(int dir, int sample, short *buf, size_t buf_size, size_t *loop_pos)
@@ -650,7 +1105,6 @@ void Spc_Dsp::decode_sample(int dir, int sample, short *buf, size_t buf_size, si
 	uint8_t const* const dir_ram = &ram[dir * 0x100];
 
 	int brr_addr = GET_LE16A( &dir_ram[sample * 4 + 0 * 2] );
-	int brr_offset = 1;
 
 	short* buf_pos = buf;       // place in buffer where next samples will be decoded
 	short* buf_end = buf + buf_size;
@@ -665,84 +1119,37 @@ void Spc_Dsp::decode_sample(int dir, int sample, short *buf, size_t buf_size, si
 			break;
 		}
 
-		// Arrange the four input nybbles in 0xABCD order for easy decoding
-		int nybbles = ram [(brr_addr + brr_offset) & 0xFFFF] * 0x100 +
-				ram [(brr_addr + brr_offset + 1) & 0xFFFF];
-
-		// Decode
-		
-		// 0: >>1  1: <<0  2: <<1 ... 12: <<11  13-15: >>4 <<11
-		static unsigned char const shifts [16 * 2] = {
-			13,12,12,12,12,12,12,12,12,12,12, 12, 12, 16, 16, 16,
-			 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 11, 11, 11
-		};
-		int const scale = brr_header >> 4;
-		int const right_shift = shifts [scale];
-		int const left_shift  = shifts [scale + 16];
-		
-		// Write to next four samples in circular buffer
-		short* pos = buf_pos;
-		short* end;
-		
-		// Decode four samples
-		for ( end = pos + 4; pos < end; pos++, nybbles <<= 4 )
-		{
-			// Extract upper nybble and scale appropriately
-			int s = ((int16_t) nybbles >> right_shift) << left_shift;
-			
-			// Apply IIR filter (8 is the most commonly used)
-			int const filter = brr_header & 0x0C;
-			int const p1 = pos [brr_buf_size - 1];
-			int const p2 = pos [brr_buf_size - 2] >> 1;
-			if ( filter >= 8 )
-			{
-				s += p1;
-				s -= p2;
-				if ( filter == 8 ) // s += p1 * 0.953125 - p2 * 0.46875
-				{
-					s += p2 >> 4;
-					s += (p1 * -3) >> 6;
-				}
-				else // s += p1 * 0.8984375 - p2 * 0.40625
-				{
-					s += (p1 * -13) >> 7;
-					s += (p2 * 3) >> 4;
-				}
-			}
-			else if ( filter ) // s += p1 * 0.46875
-			{
-				s += p1 >> 1;
-				s += (-p1) >> 5;
-			}
-			
-			// Adjust and write sample
-			CLAMP16( s );
-			s = (int16_t) (s * 2);
+		// Decode whole block, or get it from cache
+		short decoded [16];
+		short const* in = decoded;
+		brr_cache_t const* cached = cached_brr( brr_addr,
+				buf_pos [brr_buf_size - 1], buf_pos [brr_buf_size - 2] );
+		if ( cached )
+			in = cached->out;
+		else
+			decode_brr( ram, brr_addr, buf_pos [brr_buf_size - 1], buf_pos [brr_buf_size - 2], decoded );
 
-			// Avoid writing past end of buffer:
-			if (pos < buf_end) {
-				pos [brr_buf_size] = pos [0] = s; // second copy simplifies wrap-around
-			}
+		// Avoid writing past end of buffer:
+		int count = 16;
+		if (count > buf_end - buf_pos) {
+			count = buf_end - buf_pos;
+		}
+		for (int i = 0; i < count; i++) {
+			buf_pos [brr_buf_size + i] = buf_pos [i] = in [i]; // second copy simplifies wrap-around
 		}
+		buf_pos += 16;
 
+		// Next BRR block, only reached if its last four samples were decoded
 		int const brr_block_size = 9;
-		if ( (brr_offset += 2) >= brr_block_size )
+		brr_addr = (brr_addr + brr_block_size) & 0xFFFF;
+		if ( count > 12 && (brr_header & 1) )
 		{
-			// Next BRR block
-			brr_addr = (brr_addr + brr_block_size) & 0xFFFF;
-			assert( brr_offset == brr_block_size );
-			if ( brr_header & 1 )
-			{
-				// Start looping:
-				if (*loop_pos == buf_size) {
-					*loop_pos = (pos + 4) - buf;
-				}
-				brr_addr = GET_LE16A( &dir_ram[sample * 4 + 1 * 2] );
+			// Start looping:
+			if (*loop_pos == buf_size) {
+				*loop_pos = (buf_pos + 4) - buf;
 			}
-			brr_offset  = 1;
+			brr_addr = GET_LE16A( &dir_ram[sample * 4 + 1 * 2] );
 		}
-
-		buf_pos = pos;
 	} while (buf_pos < buf_end);
 }
 
@@ -762,6 +1169,18 @@ void Spc_Dsp::mute_voices( int mask )
 void Spc_Dsp::init( void* ram_64k )
 {
 	m.ram = (uint8_t*) ram_64k;
+	
+	m.sse41 = false;
+	#if BLARGG_X86_SIMD
+		m.sse41 = blargg_cpu_has( blargg_cpu_sse41 );
+	#endif
+	
+	memset( brr_gens, 0, sizeof brr_gens );
+	brr_fills = 0;
+	
+	// mute_voices() updates MIDI volume, which indexes midi_channel by voice's channel
+	memset( voice_midi, 0, sizeof voice_midi );
+	memset( midi_channel, 0, sizeof midi_channel );
 	mute_voices( 0 );
 	disable_surround( false );
 	set_output( 0, 0 );
@@ -834,6 +1253,7 @@ void Spc_Dsp::load( uint8_t const regs [register_count] )
 		v.brr_offset = 1;
 		v.buf_pos    = v.buf;
 	}
+	ram_loaded();
 
 	m.new_kon = REG(kon);
 	
@@ -842,3 +1262,136 @@ void Spc_Dsp::load( uint8_t const regs [register_count] )
 }
 
 void Spc_Dsp::reset() { load( initial_regs ); }
+
+
+//// State save/load
+
+#if !SPC_NO_COPY_STATE_FUNCS
+
+void SPC_State_Copier::copy( void* state, size_t size )
+{
+	func( buf, state, size );
+}
+
+int SPC_State_Copier::copy_int( int state, int size )
+{
+	BOOST::uint8_t s [2];
+	SET_LE16( s, state );
+	func( buf, &s, size );
+	return GET_LE16( s );
+}
+
+void SPC_State_Copier::skip( int count )
+{
+	if ( count > 0 )
+	{
+		char temp [64];
+		memset( temp, 0, sizeof temp );
+		do
+		{
+			int n = sizeof temp;
+			if ( n > count )
+				n = count;
+			count -= n;
+			func( buf, temp, n );
+		}
+		while ( count );
+	}
+}
+
+void SPC_State_Copier::extra()
+{
+	int n = 0;
+	SPC_State_Copier& copier = *this;
+	SPC_COPY( uint8_t, n );
+	skip( n );
+}
+
+void Spc_Dsp::copy_state( unsigned char** io, copy_func_t copy )
+{
+	SPC_State_Copier copier( io, copy );
+	
+	// DSP registers
+	copier.copy( m.regs, register_count );
+	
+	// Internal state
+	
+	// Voices
+	int i;
+	for ( i = 0; i < voice_count; i++ )
+	{
+		voice_t* v = &m.voices [i];
+		
+		// BRR buffer
+		int j;
+		for ( j = 0; j < brr_buf_size; j++ )
+		{
+			int s = v->buf [j];
+			SPC_COPY(  int16_t, s );
+			v->buf [j] = v->buf [j + brr_buf_size] = s;
+		}
+		
+		int buf_pos = v->buf_pos - v->buf;
+		SPC_COPY(  uint8_t, buf_pos );
+		v->buf_pos = &v->buf [buf_pos < brr_buf_size ? buf_pos : 0];
+		
+		SPC_COPY( uint16_t, v->interp_pos );
+		SPC_COPY( uint16_t, v->brr_addr );
+		SPC_COPY( uint16_t, v->env );
+		SPC_COPY(  int16_t, v->hidden_env );
+		SPC_COPY(  uint8_t, v->brr_offset );
+		SPC_COPY(  uint8_t, v->kon_delay );
+		{
+			int m = v->env_mode;
+			SPC_COPY(  uint8_t, m );
+			v->env_mode = (enum env_mode_t) m;
+		}
+		
+		copier.extra();
+	}
+	
+	// Echo history
+	for ( i = 0; i < echo_hist_size; i++ )
+	{
+		int j;
+		for ( j = 0; j < 2; j++ )
+		{
+			int s = m.echo_hist_pos [i] [j];
+			SPC_COPY( int16_t, s );
+			m.echo_hist [i] [j] = s; // write back at offset 0
+		}
+	}
+	m.echo_hist_pos = m.echo_hist;
+	memcpy( &m.echo_hist [echo_hist_size], m.echo_hist, echo_hist_size * sizeof m.echo_hist [0] );
+	
+	// Misc
+	SPC_COPY(  uint8_t, m.every_other_sample );
+	SPC_COPY(  uint8_t, m.kon );
+	SPC_COPY(  uint8_t, m.new_kon );
+	SPC_COPY(  uint8_t, m.t_koff );
+	
+	SPC_COPY( uint16_t, m.noise );
+	SPC_COPY( uint16_t, m.echo_offset );
+	SPC_COPY( uint16_t, m.echo_length );
+	SPC_COPY(  uint8_t, m.phase );
+	
+	// Counters use all 32 bits
+	for ( i = 0; i < 4; i++ )
+	{
+		int lo = m.counters [i] & 0xFFFF;
+		int hi = m.counters [i] >> 16;
+		SPC_COPY( uint16_t, lo );
+		SPC_COPY( uint16_t, hi );
+		m.counters [i] = (unsigned) hi << 16 | lo;
+	}
+	
+	copier.extra();
+	
+	// Volumes are cached with mute and surround applied
+	mute_voices( m.mute_mask );
+	
+	// RAM is usually restored along with DSP
+	ram_loaded();
+}
+
+#endif
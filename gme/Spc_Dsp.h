@@ -11,6 +11,8 @@
 #include <math.h>
 #include <string.h>
 
+extern "C" { typedef void (*dsp_copy_func_t)( unsigned char** io, void* state, size_t ); }
+
 struct Spc_Dsp {
 public:
 	typedef BOOST::uint8_t uint8_t;
@@ -46,6 +48,18 @@ public:
 	// Runs DSP for specified number of clocks (~1024000 per second). Every 32 clocks
 	// a pair of samples is be generated.
 	void run( int clock_count );
+	
+	// True if running DSP might write to RAM at addr. It only writes to the echo
+	// buffer, and only while echo writes are enabled.
+	bool may_write_ram( int addr ) const;
+	
+	// Must be called after RAM at addr is written to by anything but DSP, so that
+	// decoded samples from there aren't reused. Writes below $200 and at $FFC0 and
+	// above don't need this, since samples there are never cached.
+	void ram_written( int addr );
+	
+	// Must be called after other changes to RAM, such as loading it all at once
+	void ram_loaded();
 
 // Sound control
 
@@ -63,6 +77,14 @@ public:
 	enum { register_count = 128 };
 	void load( uint8_t const regs [register_count] );
 
+	// Saves/loads exact emulator state
+	enum { state_size = 640 }; // maximum space needed when saving
+	typedef dsp_copy_func_t copy_func_t;
+	void copy_state( unsigned char** io, copy_func_t );
+
+	// Returns non-zero if new key-on events occurred since last call
+	bool check_kon();
+
 // DSP register addresses
 
 	// Global registers
@@ -98,8 +120,24 @@ public:
 	typedef BOOST::int16_t int16_t;
 	
 	enum { echo_hist_size = 8 };
+	enum { block_max = 64 }; // most samples run() runs one voice at a time
 	
 	enum env_mode_t { env_release, env_attack, env_decay, env_sustain };
+	
+	// Decoded BRR blocks, for looping samples that play same blocks over and over.
+	// Entries are validated against write counts of the 64-byte pages they span.
+	enum { brr_page_shift = 6 };
+	enum { brr_cache_size = 256 };
+	enum { brr_cache_begin = 0x200, brr_cache_end = 0xFFC0 }; // cacheable addresses
+	struct brr_cache_t
+	{
+		int addr;               // address of BRR block, or -1 if unused
+		int p1, p2;             // two samples before block, or 0 where filter ignores them
+		unsigned gens [2];      // brr_gens [] of first and last page when decoded
+		unsigned fill;          // changes each time entry is decoded into
+		short out [16];
+	};
+	
 	enum { brr_buf_size = 12 };
 	struct voice_t
 	{
@@ -114,6 +152,8 @@ public:
 		int hidden_env;         // used by GAIN mode 7, very obscure quirk
 		int volume [2];         // copy of volume from DSP registers, with surround disabled
 		int enabled;            // -1 if enabled, 0 if muted
+		brr_cache_t const* brr_cache; // decoded current BRR block, or NULL
+		unsigned brr_fill;      // brr_cache->fill when it was looked up
 	};
 private:
 	struct state_t
@@ -134,6 +174,7 @@ private:
 		
 		int new_kon;
 		int t_koff;
+		int kon_check;          // set when a new KON occurs
 		
 		voice_t voices [voice_count];
 		
@@ -147,14 +188,24 @@ private:
 		sample_t* out_end;
 		sample_t* out_begin;
 		sample_t extra [extra_size];
+		bool sse41; // mix voices with SSE4.1
 	};
 	state_t m;
 	
+	brr_cache_t brr_cache [brr_cache_size];
+	unsigned brr_gens [0x10000 >> brr_page_shift]; // writes to each page of RAM
+	unsigned brr_fills;
+	
 	void init_counter();
 	void run_counter( int );
 	void soft_reset_common();
 	void write_outline( int addr, int data );
 	void update_voice_vol( int addr );
+	bool voice_idle( voice_t const& ) const;
+	int  block_size( int count ) const;
+	void run_block( int count );
+	bool brr_valid( brr_cache_t const& ) const;
+	brr_cache_t const* cached_brr( int addr, int p1, int p2 );
 
 public:
 // MIDI conversion support:
@@ -256,7 +307,9 @@ public:
 			double real[n];
 			double imag[n];
 
+		#if SPC_DEBUG_SAMPLES
 			printf("%02X:%02X sample:\n", directory, sample);
+		#endif
 
 			for (int i = 0; i < buf_size + brr_buf_size; i++) {
 				buf[i] = 0;
@@ -275,9 +328,11 @@ public:
 
 			spl.gain = (double)max / 32768.0;
 
+		#if SPC_DEBUG_SAMPLES
 			char fname[14];
 			sprintf(fname, "sample%02X.wav", sample);
 			write_wave_file(fname, buf, buf_size, 32000);
+		#endif
 
 			// Determine base frequency of sample using FFT over buf:
 			if (loop_pos+n < buf_size) {
@@ -315,6 +370,7 @@ public:
 
 			int k = fft_min_peak(peaks, peak_count, 4);
 
+		#if SPC_DEBUG_SAMPLES
 			printf(
 				"  min peak is FFT bin #%4d of possible peaks [%4d, %4d, %4d, %4d, %4d, %4d, %4d, %4d]\n",
 				k,
@@ -327,6 +383,7 @@ public:
 				peaks[6],
 				peaks[7]
 			);
+		#endif
 
 			// Interpolate FFT bins to find more exact frequency:
 			double y1 = real[k-1];
@@ -352,10 +409,13 @@ public:
 			}
 
 			double approx_fundamental_pitch = kp * 32000.0 / (double)n;
+			spl.base_pitch = approx_fundamental_pitch;
+			spl.used = true;
+
+		#if SPC_DEBUG_SAMPLES
 			// Round to nearest tone in A=440Hz scale:
 			double nearest_note = round(log2(approx_fundamental_pitch / 55.0) * 12.0);
 			double nearest_pitch = pow(2, nearest_note / 12.0) * 55.0;
-			spl.base_pitch = approx_fundamental_pitch;
 
 			const char note_names[12][3] = {
 				"A ", "A#", "B ", "C ", "C#", "D ", "D#", "E ", "F ", "F#", "G ", "G#"
@@ -365,7 +425,6 @@ public:
 			const char *note_name = note_names[x % 12];
 			int note_oct = (x / 12) + 1;
 
-			spl.used = true;
 			char loopmsg[15 + 5 + 1];
 			if (loop_pos < 16384)
 			{
@@ -376,6 +435,7 @@ public:
 				sprintf(loopmsg, "no looping");
 			}
 			printf("  f = %9.3f ~ %9.3f (%s%1d), gain = %7.6f, %s\n", spl.base_pitch, nearest_pitch, note_name, note_oct, spl.gain, loopmsg);
+		#endif
 
 			free(buf);
 		}
@@ -575,12 +635,44 @@ public:
 
 inline int Spc_Dsp::sample_count() const { return m.out - m.out_begin; }
 
+inline bool Spc_Dsp::check_kon()
+{
+	bool old = m.kon_check != 0;
+	m.kon_check = 0;
+	return old;
+}
+
 inline int Spc_Dsp::read( int addr ) const
 {
 	assert( (unsigned) addr < register_count );
 	return m.regs [addr];
 }
 
+inline bool Spc_Dsp::may_write_ram( int addr ) const
+{
+	if ( m.regs [r_flg] & 0x20 )
+		return false;
+	
+	// echo offset stays below current echo length and the one EDL will set next
+	int size = (m.regs [r_edl] & 0x0F) * 0x800;
+	if ( size < m.echo_length )
+		size = m.echo_length;
+	if ( size < 4 )
+		size = 4;
+	return ((addr - m.regs [r_esa] * 0x100) & 0xFFFF) < size;
+}
+
+inline void Spc_Dsp::ram_written( int addr )
+{
+	brr_gens [(addr & 0xFFFF) >> brr_page_shift]++;
+}
+
+inline bool Spc_Dsp::brr_valid( brr_cache_t const& e ) const
+{
+	return brr_gens [e.addr >> brr_page_shift] == e.gens [0] &&
+			brr_gens [(e.addr + 8) >> brr_page_shift] == e.gens [1];
+}
+
 inline void Spc_Dsp::update_voice_vol( int addr )
 {
 	int l = (int8_t) m.regs [addr + v_voll];
@@ -604,6 +696,7 @@ inline void Spc_Dsp::update_voice_vol( int addr )
 inline void Spc_Dsp::write( int addr, int data )
 {
 	assert( (unsigned) addr < register_count );
+	GME_STATS_WRITE( spc_dsp );
 	
 	m.regs [addr] = (uint8_t) data;
 	int low = addr & 0x0F;
@@ -626,7 +719,26 @@ inline void Spc_Dsp::disable_surround( bool disable )
 	m.surround_threshold = disable ? 0 : -0x4000;
 }
 
-#define SPC_NO_COPY_STATE_FUNCS 1
+#if !SPC_NO_COPY_STATE_FUNCS
+
+class SPC_State_Copier {
+	Spc_Dsp::copy_func_t func;
+	unsigned char** buf;
+public:
+	SPC_State_Copier( unsigned char** p, Spc_Dsp::copy_func_t f ) { func = f; buf = p; }
+	void copy( void* state, size_t size );
+	int copy_int( int state, int size );
+	void skip( int count );
+	void extra();
+};
+
+#define SPC_COPY( type, state )\
+{\
+	state = (BOOST::type) copier.copy_int( state, sizeof (BOOST::type) );\
+	assert( (BOOST::type) state == state );\
+}
+
+#endif
 
 #define SPC_LESS_ACCURATE 0
 
@@ -3,6 +3,7 @@
 #include "Spc_Emu.h"
 
 #include "blargg_endian.h"
+#include "blargg_state.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -254,6 +255,7 @@ blargg_err_t Spc_Emu::set_sample_rate_( long sample_rate )
 {
 	RETURN_ERR( apu.init() );
 	enable_accuracy( false );
+	filter.set_gain( (int) (gain() * SPC_Filter::gain_unit) );
 	if ( sample_rate != native_sample_rate )
 	{
 		RETURN_ERR( resampler.buffer_size( native_sample_rate / 20 * 2 ) );
@@ -266,6 +268,7 @@ void Spc_Emu::enable_accuracy_( bool b )
 {
 	Music_Emu::enable_accuracy_( b );
 	filter.enable( b );
+	clear_start_states(); // recorded with filter set differently
 }
 
 void Spc_Emu::mute_voices_( int m )
@@ -298,14 +301,41 @@ blargg_err_t Spc_Emu::start_track_( int track )
 	resampler.clear();
 	filter.clear();
 	RETURN_ERR( apu.load_spc( file_data, file_size ) );
-	filter.set_gain( (int) (gain() * SPC_Filter::gain_unit) );
 	apu.clear_echo();
 	return 0;
 }
 
+#if !SPC_NO_COPY_STATE_FUNCS
+
+// Snes_Spc copies its state through a C callback, whose io is passed a pointer to
+// the Blargg_State_Copier
+extern "C" {
+	static void copy_spc_state( unsigned char** io, void* state, size_t size )
+	{
+		(*(Blargg_State_Copier**) io)->copy( state, (long) size );
+	}
+}
+
+blargg_err_t Spc_Emu::copy_state_( Blargg_State_Copier& copier )
+{
+	Blargg_State_Copier* io = &copier;
+	apu.copy_state( (unsigned char**) &io, copy_spc_state );
+	filter.copy_state( copier );
+	if ( sample_rate() != native_sample_rate )
+		resampler.copy_state( copier );
+	return 0;
+}
+
+#endif
+
 blargg_err_t Spc_Emu::play_and_filter( long count, sample_t out [] )
 {
-	RETURN_ERR( apu.play( count, out ) );
+	{
+		GME_STATS_STAGE( gme_stage_cpu );
+		RETURN_ERR( apu.play( count, out ) );
+	}
+	GME_STATS_ADD( clocks, count * 16 ); // 1.024 MHz clock, 32 clocks per stereo pair
+	GME_STATS_STAGE( gme_stage_filter );
 	filter.run( out, count );
 	return 0;
 }
@@ -340,11 +370,20 @@ blargg_err_t Spc_Emu::play_( long count, sample_t* out )
 	long remain = count;
 	while ( remain > 0 )
 	{
-		remain -= resampler.read( &out [count - remain], remain );
+		{
+			GME_STATS_STAGE( gme_stage_resample );
+			remain -= resampler.read( &out [count - remain], remain );
+		}
 		if ( remain > 0 )
 		{
 			long n = resampler.max_write();
-			RETURN_ERR( play_and_filter( n, resampler.buffer() ) );
+			blargg_err_t err = play_and_filter( n, resampler.buffer() );
+			if ( err )
+			{
+				// don't leave rest of output unwritten
+				memset( &out [count - remain], 0, remain * sizeof *out );
+				return err;
+			}
 			resampler.write( n );
 		}
 	}
@@ -73,6 +73,9 @@ protected:
 	void mute_voices_( int );
 	void set_tempo_( double );
 	void enable_accuracy_( bool );
+#if !SPC_NO_COPY_STATE_FUNCS
+	blargg_err_t copy_state_( Blargg_State_Copier& );
+#endif
 private:
 	byte const* file_data;
 	long        file_size;
@@ -2,6 +2,7 @@
 
 #include "Spc_Filter.h"
 
+#include "blargg_state.h"
 #include <string.h>
 
 /* Copyright (C) 2007 Shay Green. This module is free software; you
@@ -19,6 +20,8 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 
 void SPC_Filter::clear() { memset( ch, 0, sizeof ch ); }
 
+void SPC_Filter::copy_state( Blargg_State_Copier& copier ) { copier( ch ); }
+
 SPC_Filter::SPC_Filter()
 {
 	enabled = true;
@@ -6,6 +6,8 @@
 
 #include "blargg_common.h"
 
+class Blargg_State_Copier;
+
 struct SPC_Filter {
 public:
 	
@@ -18,6 +20,10 @@ public:
 	// Clears filter to silence
 	void clear();
 	
+	// Copies filter history to/from saved state (see blargg_state.h). Gain, bass,
+	// and enable aren't included.
+	void copy_state( Blargg_State_Copier& );
+	
 	// Sets gain (volume), where gain_unit is normal. Gains greater than gain_unit
 	// are fine, since output is clamped to 16-bit sample range.
 	enum { gain_unit = 0x100 };
@@ -0,0 +1,414 @@
+// Game_Music_Emu 0.5.5. http://www.slack.net/~ant/
+
+#include "Track_Cache.h"
+
+#include "Data_Reader.h"
+#include "blargg_endian.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined (_WIN32)
+	#include <windows.h>
+	#include <process.h>
+	#define getpid _getpid
+#else
+	#include <unistd.h>
+	#if !GME_DISABLE_THREADS
+		#include <pthread.h>
+	#endif
+#endif
+
+/* Copyright (C) 2006 Shay Green. This module is free software; you
+can redistribute it and/or modify it under the terms of the GNU Lesser
+General Public License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version. This
+module is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+details. You should have received a copy of the GNU Lesser General Public
+License along with this module; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
+
+#include "blargg_source.h"
+
+// File_Hash
+
+typedef File_Hash::hash_t hash_t;
+
+static inline hash_t get_le64( void const* p )
+{
+	return get_le32( p ) | (hash_t) get_le32( (byte const*) p + 4 ) << 32;
+}
+
+// one multiply per word, with rotate so high bits affect low bits of later words
+static inline hash_t mix( hash_t h, hash_t word )
+{
+	h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+	return h << 31 | h >> 33;
+}
+
+void File_Hash::clear()
+{
+	for ( int i = 0; i < lanes; i++ )
+		hash_ [i] = 0xCBF29CE484222325ull + i;
+	size_ = 0;
+}
+
+// count is a multiple of block_size
+void File_Hash::add_blocks( byte const* in, long count )
+{
+	// lanes don't depend on each other, so their multiplies overlap
+	hash_t h0 = hash_ [0];
+	hash_t h1 = hash_ [1];
+	hash_t h2 = hash_ [2];
+	hash_t h3 = hash_ [3];
+	for ( ; count; count -= block_size, in += block_size )
+	{
+		h0 = mix( h0, get_le64( in      ) );
+		h1 = mix( h1, get_le64( in +  8 ) );
+		h2 = mix( h2, get_le64( in + 16 ) );
+		h3 = mix( h3, get_le64( in + 24 ) );
+	}
+	hash_ [0] = h0;
+	hash_ [1] = h1;
+	hash_ [2] = h2;
+	hash_ [3] = h3;
+}
+
+void File_Hash::add( void const* in_, long count )
+{
+	byte const* in = (byte const*) in_;
+	int partial_size = size_ % block_size;
+	size_ += count;
+	
+	// complete block left by previous add()
+	if ( partial_size )
+	{
+		int n = block_size - partial_size;
+		if ( n > count )
+			n = (int) count;
+		memcpy( partial + partial_size, in, n );
+		in += n;
+		count -= n;
+		if ( partial_size + n < block_size )
+			return;
+		add_blocks( partial, block_size );
+	}
+	
+	long whole = count - count % block_size;
+	add_blocks( in, whole );
+	memcpy( partial, in + whole, count - whole );
+}
+
+File_Hash::hash_t File_Hash::hash() const
+{
+	// last partial block is padded with zeros
+	hash_t lane [lanes];
+	int partial_size = size_ % block_size;
+	for ( int i = 0; i < lanes; i++ )
+	{
+		lane [i] = hash_ [i];
+		if ( partial_size > i * 8 )
+		{
+			byte word [8] = { 0 };
+			memcpy( word, partial + i * 8, min( partial_size - i * 8, 8 ) );
+			lane [i] = mix( lane [i], get_le64( word ) );
+		}
+	}
+	
+	hash_t h = lane [0];
+	for ( int i = 1; i < lanes; i++ )
+		h = mix( h, lane [i] );
+	
+	// include size, then spread every bit over the whole result
+	h ^= size_;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Minimal mutex, so that emulators on different threads can share a cache
+#if GME_DISABLE_THREADS
+	typedef int cache_mutex_t;
+	inline void mutex_init( cache_mutex_t* ) { }
+	inline void mutex_destroy( cache_mutex_t* ) { }
+	inline void mutex_lock( cache_mutex_t* ) { }
+	inline void mutex_unlock( cache_mutex_t* ) { }
+#elif defined (_WIN32)
+	typedef CRITICAL_SECTION cache_mutex_t;
+	inline void mutex_init( cache_mutex_t* m ) { InitializeCriticalSection( m ); }
+	inline void mutex_destroy( cache_mutex_t* m ) { DeleteCriticalSection( m ); }
+	inline void mutex_lock( cache_mutex_t* m ) { EnterCriticalSection( m ); }
+	inline void mutex_unlock( cache_mutex_t* m ) { LeaveCriticalSection( m ); }
+#else
+	typedef pthread_mutex_t cache_mutex_t;
+	inline void mutex_init( cache_mutex_t* m ) { pthread_mutex_init( m, 0 ); }
+	inline void mutex_destroy( cache_mutex_t* m ) { pthread_mutex_destroy( m ); }
+	inline void mutex_lock( cache_mutex_t* m ) { pthread_mutex_lock( m ); }
+	inline void mutex_unlock( cache_mutex_t* m ) { pthread_mutex_unlock( m ); }
+#endif
+
+// Track_Cache
+
+Track_Cache::Track_Cache()
+{
+	count_ = 0;
+	mutex  = 0;
+}
+
+Track_Cache::~Track_Cache()
+{
+	if ( mutex )
+	{
+		mutex_destroy( (cache_mutex_t*) mutex );
+		free( mutex );
+	}
+}
+
+blargg_err_t Track_Cache::create( Track_Cache** out )
+{
+	*out = 0;
+	
+	void* mutex = malloc( sizeof (cache_mutex_t) );
+	CHECK_ALLOC( mutex );
+	
+	Track_Cache* cache = BLARGG_NEW Track_Cache;
+	if ( !cache )
+	{
+		free( mutex );
+		CHECK_ALLOC( cache );
+	}
+	mutex_init( (cache_mutex_t*) mutex );
+	cache->mutex = mutex;
+	
+	*out = cache;
+	return 0;
+}
+
+inline void Track_Cache::lock() const   { mutex_lock( (cache_mutex_t*) mutex ); }
+inline void Track_Cache::unlock() const { mutex_unlock( (cache_mutex_t*) mutex ); }
+
+int Track_Cache::compare( entry_t const& x, entry_t const& y )
+{
+	if ( x.hash      != y.hash      ) return (x.hash      < y.hash      ? -1 : 1);
+	if ( x.file_size != y.file_size ) return (x.file_size < y.file_size ? -1 : 1);
+	if ( x.track     != y.track     ) return (x.track     < y.track     ? -1 : 1);
+	return 0;
+}
+
+// index of first entry not less than e. Cache must be locked.
+long Track_Cache::lower_bound( entry_t const& e ) const
+{
+	long begin = 0;
+	long end = count_;
+	while ( begin < end )
+	{
+		long mid = (begin + end) >> 1;
+		if ( compare( entries [mid], e ) < 0 )
+			begin = mid + 1;
+		else
+			end = mid;
+	}
+	return begin;
+}
+
+// Merges sorted entries, keeping existing ones for tracks in both. Cache must be locked.
+blargg_err_t Track_Cache::merge( entry_t const* in, long count )
+{
+	long old_count = count_;
+	if ( entries.size() < (size_t) (old_count + count) )
+	{
+		size_t size = entries.size() * 2;
+		if ( size < (size_t) (old_count + count) )
+			size = old_count + count;
+		RETURN_ERR( entries.resize( size ) );
+	}
+	
+	// merge from end, so that entries only move once
+	entry_t* const merged_end = &entries [old_count + count];
+	entry_t* out = merged_end;
+	long i = old_count;
+	while ( count )
+	{
+		if ( i )
+		{
+			int diff = compare( entries [i - 1], in [count - 1] );
+			if ( diff >= 0 )
+			{
+				*--out = entries [--i];
+				if ( !diff )
+					count--;
+				continue;
+			}
+		}
+		*--out = in [--count];
+	}
+	
+	// entries before i didn't move; close gap left by tracks that were already in cache
+	long merged = merged_end - out;
+	if ( out != &entries [i] )
+		memmove( &entries [i], out, merged * sizeof *out );
+	count_ = i + merged;
+	return 0;
+}
+
+blargg_err_t Track_Cache::add( hash_t hash, blargg_ulong file_size, int track, length_t const& length )
+{
+	entry_t e;
+	e.hash      = hash;
+	e.file_size = file_size;
+	e.track     = track;
+	e.length    = length;
+	
+	lock();
+	blargg_err_t err = 0;
+	long i = lower_bound( e );
+	if ( i < count_ && !compare( entries [i], e ) )
+		entries [i].length = length;
+	else
+		err = merge( &e, 1 );
+	unlock();
+	return err;
+}
+
+bool Track_Cache::find( hash_t hash, blargg_ulong file_size, int track, length_t* out ) const
+{
+	entry_t e;
+	e.hash      = hash;
+	e.file_size = file_size;
+	e.track     = track;
+	
+	lock();
+	long i = lower_bound( e );
+	bool found = (i < count_ && !compare( entries [i], e ));
+	if ( found )
+		*out = entries [i].length;
+	unlock();
+	return found;
+}
+
+long Track_Cache::count() const
+{
+	lock();
+	long n = count_;
+	unlock();
+	return n;
+}
+
+// Binary form
+
+// "GMTC" and track count, then tracks in the order they're kept in memory. Each has
+// file hash (low then high 32 bits), file size, track, length, intro length, loop
+// length, and silence start. All are 32-bit little-endian.
+int const data_header_size = 8;
+int const data_entry_size  = 4 * 8;
+
+blargg_err_t Track_Cache::load_data( void const* in_, long size )
+{
+	byte const* in = (byte const*) in_;
+	if ( size < data_header_size || memcmp( in, "GMTC", 4 ) )
+		return "Not a track length cache";
+	
+	blargg_ulong count = get_le32( in + 4 );
+	if ( count != (blargg_ulong) (size - data_header_size) / data_entry_size ||
+			(size - data_header_size) % data_entry_size )
+		return "Corrupt track length cache";
+	
+	blargg_vector<entry_t> loaded;
+	RETURN_ERR( loaded.resize( count ) );
+	in += data_header_size;
+	for ( blargg_ulong i = 0; i < count; i++, in += data_entry_size )
+	{
+		entry_t& e = loaded [i];
+		e.hash      = get_le64( in );
+		e.file_size = get_le32( in + 8 );
+		e.track     = (BOOST::int32_t) get_le32( in + 12 );
+		e.length.length        = (BOOST::int32_t) get_le32( in + 16 );
+		e.length.intro_length  = (BOOST::int32_t) get_le32( in + 20 );
+		e.length.loop_length   = (BOOST::int32_t) get_le32( in + 24 );
+		e.length.silence_start = (BOOST::int32_t) get_le32( in + 28 );
+		
+		// merge() relies on order
+		if ( i && compare( loaded [i - 1], e ) >= 0 )
+			return "Corrupt track length cache";
+	}
+	
+	lock();
+	blargg_err_t err = merge( loaded.begin(), count );
+	unlock();
+	return err;
+}
+
+blargg_err_t Track_Cache::save_data( blargg_vector<byte>* out ) const
+{
+	lock();
+	blargg_err_t err = out->resize( data_header_size + count_ * data_entry_size );
+	if ( !err )
+	{
+		byte* p = out->begin();
+		memcpy( p, "GMTC", 4 );
+		set_le32( p + 4, count_ );
+		p += data_header_size;
+		for ( long i = 0; i < count_; i++, p += data_entry_size )
+		{
+			entry_t const& e = entries [i];
+			set_le32( p +  0, (blargg_ulong) e.hash );
+			set_le32( p +  4, (blargg_ulong) (e.hash >> 32) );
+			set_le32( p +  8, e.file_size );
+			set_le32( p + 12, e.track );
+			set_le32( p + 16, e.length.length );
+			set_le32( p + 20, e.length.intro_length );
+			set_le32( p + 24, e.length.loop_length );
+			set_le32( p + 28, e.length.silence_start );
+		}
+	}
+	unlock();
+	return err;
+}
+
+blargg_err_t Track_Cache::load_file( const char* path )
+{
+	Std_File_Reader in;
+	RETURN_ERR( in.open( path ) );
+	blargg_vector<byte> data;
+	RETURN_ERR( data.resize( in.size() ) );
+	RETURN_ERR( in.read( data.begin(), data.size() ) );
+	return load_data( data.begin(), data.size() );
+}
+
+blargg_err_t Track_Cache::save_file( const char* path )
+{
+	// pick up what other processes have saved; fine if file doesn't exist yet, and a
+	// corrupt one is just replaced
+	load_file( path );
+	
+	blargg_vector<byte> data;
+	RETURN_ERR( save_data( &data ) );
+	
+	// write to file unique to this process, then rename it over old one
+	blargg_vector<char> temp;
+	RETURN_ERR( temp.resize( strlen( path ) + 32 ) );
+	sprintf( temp.begin(), "%s.%lu.tmp", path, (unsigned long) getpid() );
+	
+	FILE* file = fopen( temp.begin(), "wb" );
+	if ( !file )
+		return "Couldn't create file";
+	bool written = (fwrite( data.begin(), data.size(), 1, file ) == 1);
+	if ( fclose( file ) )
+		written = false;
+	
+	#if defined (_WIN32)
+		bool renamed = written && MoveFileExA( temp.begin(), path, MOVEFILE_REPLACE_EXISTING );
+	#else
+		bool renamed = written && !rename( temp.begin(), path );
+	#endif
+	if ( !renamed )
+	{
+		remove( temp.begin() );
+		return (written ? "Couldn't replace file" : "Couldn't write to file");
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+// Track lengths measured during playback, keyed by file content and track
+
+// Game_Music_Emu 0.5.5
+#ifndef TRACK_CACHE_H
+#define TRACK_CACHE_H
+
+#include "blargg_common.h"
+#include "gme.h"
+
+// Hash of file contents, computed as data is loaded. Mixes four independent 64-bit
+// words at a time, so it runs about as fast as copying the data.
+struct File_Hash {
+public:
+	typedef unsigned long long hash_t;
+	
+	// Add count bytes to hash
+	void add( void const*, long count );
+	
+	// Hash of data added so far
+	hash_t hash() const;
+	
+	// Number of bytes added so far
+	blargg_ulong size() const   { return size_; }
+	
+	// Start over
+	void clear();
+	
+	File_Hash()                 { clear(); }
+private:
+	enum { lanes = 4 };
+	enum { block_size = lanes * 8 };
+	hash_t hash_ [lanes];
+	blargg_ulong size_;
+	BOOST::uint8_t partial [block_size]; // bytes of incomplete block
+	void add_blocks( BOOST::uint8_t const*, long count );
+};
+
+// Maps file hash, file size, and track to the track's measured length. Can be used by
+// emulators on different threads at once, and saved to a file that several processes
+// update.
+struct Track_Cache {
+public:
+	typedef File_Hash::hash_t hash_t;
+	typedef gme_track_length_t length_t;
+	typedef BOOST::uint8_t byte;
+	
+	// Create empty cache
+	static blargg_err_t create( Track_Cache** out );
+	
+	// Add or replace length of track of file
+	blargg_err_t add( hash_t, blargg_ulong file_size, int track, length_t const& );
+	
+	// Find length of track of file and return true, or return false if not in cache
+	bool find( hash_t, blargg_ulong file_size, int track, length_t* out ) const;
+	
+	// Number of tracks in cache
+	long count() const;
+	
+// Saving
+	
+	// Merge tracks from binary form written by save_data(). Tracks already in cache
+	// are kept rather than replaced.
+	blargg_err_t load_data( void const*, long size );
+	
+	// Write binary form to out, resizing it to fit
+	blargg_err_t save_data( blargg_vector<byte>* out ) const;
+	
+	// Merge tracks from file
+	blargg_err_t load_file( const char* path );
+	
+	// Merge tracks from file, if it exists, then replace it with tracks in cache. File
+	// is replaced by renaming a new file over it, so other processes loading it never
+	// see a partly written file. Tracks another process saves between the two steps
+	// are lost, which only means they'll be measured again.
+	blargg_err_t save_file( const char* path );
+	
+public:
+	~Track_Cache();
+	BLARGG_DISABLE_NOTHROW
+private:
+	Track_Cache();
+	
+	// noncopyable
+	Track_Cache( const Track_Cache& );
+	Track_Cache& operator = ( const Track_Cache& );
+	
+	struct entry_t {
+		hash_t hash;
+		blargg_ulong file_size;
+		int track;
+		length_t length;
+	};
+	blargg_vector<entry_t> entries; // sorted by hash, file size, then track
+	long count_;
+	void* mutex;
+	
+	void lock() const;
+	void unlock() const;
+	static int compare( entry_t const&, entry_t const& );
+	long lower_bound( entry_t const& ) const;
+	blargg_err_t merge( entry_t const* in, long count );
+};
+
+#endif
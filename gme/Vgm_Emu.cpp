@@ -22,11 +22,14 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA */
 double const fm_gain = 3.0; // FM emulators are internally quieter to avoid 16-bit overflow
 double const rolloff = 0.990;
 double const oversample_factor = 1.5;
+int const register_skip_sec = 6; // more than checkpoint interval; shorter skips run emulator
 
 Vgm_Emu::Vgm_Emu()
 {
 	disable_oversampling_ = false;
 	psg_rate   = 0;
+	checkpoint_count = 0;
+	voices_muted = 0;
 	set_type( gme_vgm_type );
 	
 	static int const types [8] = {
@@ -225,6 +228,7 @@ void Vgm_Emu::set_tempo_( double t )
 		//vgm_rate = (long) floor( double (1L << blip_time_bits) * psg_rate / blip_time_factor + 0.5 );
 		
 		fm_time_factor = 2 + (long) floor( fm_rate * (1L << fm_time_bits) / vgm_rate + 0.5 );
+		checkpoint_count = 0; // output positions no longer match
 	}
 }
 
@@ -246,9 +250,18 @@ void Vgm_Emu::set_voice( int i, Blip_Buffer* c, Blip_Buffer* l, Blip_Buffer* r )
 		psg.osc_output( i, c, l, r );
 }
 
+blargg_err_t Vgm_Emu::set_extra_rates_( long const* rates, int count )
+{
+	// FM chips are resampled by Dual_Resampler, which only makes one rate
+	if ( uses_fm && count )
+		return "FM sound chips don't support extra sample rates";
+	return Classic_Emu::set_extra_rates_( rates, count );
+}
+
 void Vgm_Emu::mute_voices_( int mask )
 {
 	Classic_Emu::mute_voices_( mask );
+	voices_muted = mask & ((1 << voice_count()) - 1);
 	dac_synth.output( &blip_buf );
 	if ( uses_fm )
 	{
@@ -298,6 +311,17 @@ blargg_err_t Vgm_Emu::load_mem_( byte const* new_data, long new_size )
 	if ( get_le32( h.loop_offset ) )
 		loop_begin = &data [get_le32( h.loop_offset ) + offsetof (header_t,loop_offset)];
 	
+	// beginning of command stream
+	byte const* begin = data + header_size;
+	if ( get_le32( h.version ) >= 0x150 )
+	{
+		long data_offset = get_le32( h.data_offset );
+		check( data_offset );
+		if ( data_offset )
+			begin += data_offset + offsetof (header_t,data_offset) - 0x40;
+	}
+	RETURN_ERR( parse_commands( begin ) );
+	
 	set_voice_count( psg.osc_count );
 	
 	RETURN_ERR( setup_fm() );
@@ -320,6 +344,8 @@ blargg_err_t Vgm_Emu::setup_fm()
 		update_fm_rates( &ym2413_rate, &ym2612_rate );
 	
 	uses_fm = false;
+	ym2612.enable( false );
+	ym2413.enable( false );
 	
 	fm_rate = blip_buf.sample_rate() * oversample_factor;
 	
@@ -355,8 +381,6 @@ blargg_err_t Vgm_Emu::setup_fm()
 	}
 	else
 	{
-		ym2612.enable( false );
-		ym2413.enable( false );
 		psg.volume( gain() );
 	}
 	
@@ -371,18 +395,9 @@ blargg_err_t Vgm_Emu::start_track_( int track )
 	psg.reset( get_le16( header().noise_feedback ), header().noise_width );
 	
 	dac_disabled = -1;
-	pos          = data + header_size;
-	pcm_data     = pos;
-	pcm_pos      = pos;
 	dac_amp      = -1;
-	vgm_time     = 0;
-	if ( get_le32( header().version ) >= 0x150 )
-	{
-		long data_offset = get_le32( header().data_offset );
-		check( data_offset );
-		if ( data_offset )
-			pos += data_offset + offsetof (header_t,data_offset) - 0x40;
-	}
+	play_time    = 0;
+	start_events();
 	
 	if ( uses_fm )
 	{
@@ -403,11 +418,73 @@ blargg_err_t Vgm_Emu::run_clocks( blip_time_t& time_io, int msec )
 {
 	time_io = run_commands( msec * vgm_rate / 1000 );
 	psg.end_frame( time_io );
+	
+	// track output position the same way Classic_Emu's buffer will
+	Blip_Buffer::blip_resampled_time_t t = out_frac + blip_buf.resampled_duration( time_io );
+	out_time += t >> BLIP_BUFFER_ACCURACY;
+	out_frac  = t & ((1L << BLIP_BUFFER_ACCURACY) - 1);
 	return 0;
 }
 
+blargg_err_t Vgm_Emu::skip_( long count )
+{
+	// jump to latest checkpoint before destination if it's ahead of current position
+	blargg_long end = play_time + count / stereo;
+	blargg_long const register_skip = register_skip_sec * sample_rate();
+	checkpoint_t const* cp = find_checkpoint( end );
+	if ( cp && cp->out_time >= play_time && end - cp->out_time <= register_skip )
+	{
+		load_checkpoint( *cp );
+		play_time = cp->out_time;
+		if ( uses_fm )
+		{
+			blip_buf.clear();
+			Dual_Resampler::clear();
+			if ( dac_amp >= 0 )
+				dac_synth.offset( 0, dac_amp, &blip_buf );
+		}
+		else
+		{
+			clear_buffer();
+		}
+		count = (end - cp->out_time) * stereo;
+		
+		// remainder is less than checkpoint interval, so run it unmuted to keep
+		// chip state identical to normal playback
+		sample_t scratch [1024];
+		while ( count > 0 )
+		{
+			long n = sizeof scratch / sizeof *scratch;
+			if ( n > count )
+				n = count;
+			count -= n;
+			RETURN_ERR( play_( n, scratch ) );
+		}
+		return 0;
+	}
+	
+	// Otherwise, if destination is far, restart and write registers up to it instead
+	// of running there. Like a muted skip, this leaves envelopes where they were when
+	// keyed, but only has to scan events.
+	if ( end - play_time > register_skip )
+	{
+		// FM timing runs stream slightly slower than vgm_rate
+		double stream_rate = vgm_rate;
+		if ( uses_fm )
+			stream_rate = fm_rate * (1L << fm_time_bits) / fm_time_factor;
+		vgm_time_t time = (vgm_time_t) (end * stream_rate / sample_rate());
+		RETURN_ERR( start_track_( 0 ) ); // VGM has only one track
+		replay_registers( time );
+		play_time = (blargg_long) (time * sample_rate() / stream_rate);
+		out_time  = play_time;
+		count = (end - play_time) * stereo;
+	}
+	return Classic_Emu::skip_( count );
+}
+
 blargg_err_t Vgm_Emu::play_( long count, sample_t* out )
 {
+	play_time += count / stereo;
 	if ( !uses_fm )
 		return Classic_Emu::play_( count, out );
 		
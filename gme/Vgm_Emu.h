@@ -9,8 +9,7 @@
 // Emulates VGM music using SN76489/SN76496 PSG, YM2612, and YM2413 FM sound chips.
 // Supports custom sound buffer and frequency equalization when VGM uses just the PSG.
 // FM sound chips can be run at their proper rates, or slightly higher to reduce
-// aliasing on high notes. Currently YM2413 support requires that you supply a
-// YM2413 sound chip emulator. I can provide one I've modified to work with the library.
+// aliasing on high notes.
 class Vgm_Emu : public Vgm_Emu_Impl {
 public:
 	// True if custom buffer and custom equalization are supported
@@ -65,10 +64,12 @@ protected:
 	blargg_err_t start_track_( int );
 	blargg_err_t play_( long count, sample_t* );
 	blargg_err_t run_clocks( blip_time_t&, int );
+	blargg_err_t skip_( long count );
 	void set_tempo_( double );
 	void mute_voices_( int mask );
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
+	blargg_err_t set_extra_rates_( long const*, int );
 private:
 	// removed; use disable_oversampling() and set_tempo() instead
 	Vgm_Emu( bool oversample, double tempo = 1.0 );
@@ -77,6 +78,7 @@ private:
 	long vgm_rate;
 	bool disable_oversampling_;
 	bool uses_fm;
+	blargg_long play_time; // sample pairs played since start of track
 	blargg_err_t setup_fm();
 };
 
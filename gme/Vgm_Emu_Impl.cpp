@@ -95,6 +95,11 @@ inline Vgm_Emu_Impl::fm_time_t Vgm_Emu_Impl::to_fm_time( vgm_time_t t ) const
 	return (t * fm_time_factor + fm_time_offset) >> fm_time_bits;
 }
 
+inline long Vgm_Emu_Impl::to_fm_pairs( vgm_time_t t ) const
+{
+	return (long) (t * (double) fm_time_factor / (1L << fm_time_bits));
+}
+
 inline blip_time_t Vgm_Emu_Impl::to_blip_time( vgm_time_t t ) const
 {
 	return (t * blip_time_factor) >> blip_time_bits;
@@ -112,79 +117,76 @@ void Vgm_Emu_Impl::write_pcm( vgm_time_t vgm_time, int amp )
 		dac_amp |= dac_disabled;
 }
 
-blip_time_t Vgm_Emu_Impl::run_commands( vgm_time_t end_time )
+// Command parsing
+
+blargg_err_t Vgm_Emu_Impl::parse_commands( byte const* begin )
 {
-	vgm_time_t vgm_time = this->vgm_time; 
-	byte const* pos = this->pos;
-	if ( pos >= data_end )
-	{
-		set_track_ended();
-		if ( pos > data_end )
-			set_warning( "Stream lacked end event" );
-	}
+	long count = 0;
+	long pcm_count = 0;
+	RETURN_ERR( events.resize( max( data_end - begin, 0L ) / 4 + 64 ) );
+	RETURN_ERR( pcm_offsets.resize( 16 ) );
+	pcm_offsets [pcm_count++] = begin - data; // PCM data defaults to beginning of stream
 	
-	while ( vgm_time < end_time && pos < data_end )
+	loop_event = -1;
+	loop_time  = 0;
+	vgm_time_t time = 0;
+	byte const* pcm_data = begin;
+	byte const* pos = begin;
+	event_t* e;
+	
+	while ( pos < data_end )
 	{
-		// TODO: be sure there are enough bytes left in stream for particular command
-		// so we don't read past end
-		switch ( *pos++ )
+		if ( loop_event < 0 && pos >= loop_begin )
+		{
+			loop_event = count;
+			loop_time  = time;
+		}
+		
+		if ( (unsigned long) count >= events.size() )
+			RETURN_ERR( events.resize( events.size() * 2 ) );
+		e = &events [count];
+		e->time     = time;
+		e->cmd      = *pos++;
+		e->addr     = 0;
+		e->data     = 0;
+		e->index_hi = 0;
+		
+		switch ( e->cmd )
 		{
 		case cmd_end:
-			pos = loop_begin; // if not looped, loop_begin == data_end
-			break;
+			count++;
+			goto done;
 		
 		case cmd_delay_735:
-			vgm_time += 735;
+			time += 735;
 			break;
 		
 		case cmd_delay_882:
-			vgm_time += 882;
+			time += 882;
 			break;
 		
 		case cmd_gg_stereo:
-			psg.write_ggstereo( to_blip_time( vgm_time ), *pos++ );
-			break;
-		
 		case cmd_psg:
-			psg.write_data( to_blip_time( vgm_time ), *pos++ );
+			e->data = *pos++;
+			count++;
 			break;
 		
 		case cmd_delay:
-			vgm_time += pos [1] * 0x100L + pos [0];
+			time += pos [1] * 0x100L + pos [0];
 			pos += 2;
 			break;
 		
 		case cmd_byte_delay:
-			vgm_time += *pos++;
+			time += *pos++;
 			break;
 		
 		case cmd_ym2413:
-			if ( ym2413.run_until( to_fm_time( vgm_time ) ) )
-				ym2413.write( pos [0], pos [1] );
-			pos += 2;
-			break;
-		
 		case cmd_ym2612_port0:
-			if ( pos [0] == ym2612_dac_port )
-			{
-				write_pcm( vgm_time, pos [1] );
-			}
-			else if ( ym2612.run_until( to_fm_time( vgm_time ) ) )
-			{
-				if ( pos [0] == 0x2B )
-				{
-					dac_disabled = (pos [1] >> 7 & 1) - 1;
-					dac_amp |= dac_disabled;
-				}
-				ym2612.write0( pos [0], pos [1] );
-			}
-			pos += 2;
-			break;
-		
 		case cmd_ym2612_port1:
-			if ( ym2612.run_until( to_fm_time( vgm_time ) ) )
-				ym2612.write1( pos [0], pos [1] );
+			e->addr = pos [0];
+			e->data = pos [1];
 			pos += 2;
+			count++;
 			break;
 			
 		case cmd_data_block: {
@@ -199,22 +201,32 @@ blip_time_t Vgm_Emu_Impl::run_commands( vgm_time_t end_time )
 		}
 		
 		case cmd_pcm_seek:
-			pcm_pos = pcm_data + pos [3] * 0x1000000L + pos [2] * 0x10000L +
-					pos [1] * 0x100L + pos [0];
+			if ( (unsigned long) pcm_count >= pcm_offsets.size() )
+				RETURN_ERR( pcm_offsets.resize( pcm_offsets.size() * 2 ) );
+			if ( pcm_count >= 0x1000000 )
+				return "Too many PCM seeks in VGM stream";
+			pcm_offsets [pcm_count] = (pcm_data - data) + pos [3] * 0x1000000L +
+					pos [2] * 0x10000L + pos [1] * 0x100L + pos [0];
+			e->addr     = pcm_count;
+			e->data     = pcm_count >> 8;
+			e->index_hi = pcm_count >> 16;
+			pcm_count++;
+			count++;
 			pos += 4;
 			break;
 		
 		default:
-			int cmd = pos [-1];
+			int cmd = e->cmd;
 			switch ( cmd & 0xF0 )
 			{
 				case cmd_pcm_delay:
-					write_pcm( vgm_time, *pcm_pos++ );
-					vgm_time += cmd & 0x0F;
+					e->cmd = cmd_pcm_delay;
+					count++;
+					time += cmd & 0x0F;
 					break;
 				
 				case cmd_short_delay:
-					vgm_time += (cmd & 0x0F) + 1;
+					time += (cmd & 0x0F) + 1;
 					break;
 				
 				case 0x50:
@@ -227,13 +239,305 @@ blip_time_t Vgm_Emu_Impl::run_commands( vgm_time_t end_time )
 			}
 		}
 	}
-	vgm_time -= end_time;
-	this->pos = pos;
-	this->vgm_time = vgm_time;
+	
+	// stream lacked end event, so add one
+	if ( (unsigned long) count >= events.size() )
+		RETURN_ERR( events.resize( count + 1 ) );
+	e = &events [count++];
+	e->time     = time;
+	e->cmd      = cmd_end;
+	e->addr     = 0;
+	e->data     = (pos > data_end); // warn when reached
+	e->index_hi = 0;
+	
+done:
+	// a loop without any delay would never end
+	if ( loop_event >= 0 && events [count - 1].time == loop_time )
+		loop_event = -1;
+	
+	if ( events.resize( count ) ) { } // OK if shrink fails
+	if ( pcm_offsets.resize( pcm_count ) ) { }
+	
+	checkpoint_count = 0;
+	return 0;
+}
+
+// Playback
+
+void Vgm_Emu_Impl::start_events()
+{
+	event_pos    = events.begin();
+	event_offset = 0;
+	track_time   = 0;
+	out_time     = 0;
+	out_frac     = 0;
+	pcm_pos      = data + pcm_offsets [0];
+	state_matches = true;
+}
+
+blip_time_t Vgm_Emu_Impl::run_commands( vgm_time_t end_time )
+{
+	if ( voices_muted )
+		state_matches = false;
+	else if ( state_matches && track_time >= (vgm_time_t) checkpoint_count * checkpoint_interval )
+		save_checkpoint();
+	
+	event_t const* pos = event_pos;
+	event_t const* const end = events.end();
+	vgm_time_t const offset = event_offset;
+	vgm_time_t loop_offset = 0;
+	if ( pos >= end )
+	{
+		set_track_ended();
+		if ( end [-1].data )
+			set_warning( "Stream lacked end event" );
+	}
+	
+	while ( pos < end )
+	{
+		vgm_time_t vgm_time = pos->time - offset + loop_offset;
+		if ( vgm_time >= end_time )
+			break;
+		
+		switch ( pos->cmd )
+		{
+		case cmd_end:
+			if ( loop_event < 0 )
+			{
+				pos = end; // track ends on next call
+				continue;
+			}
+			loop_offset += pos->time - loop_time;
+			pos = &events [loop_event];
+			continue;
+		
+		case cmd_gg_stereo:
+			psg.write_ggstereo( to_blip_time( vgm_time ), pos->data );
+			break;
+		
+		case cmd_psg:
+			psg.write_data( to_blip_time( vgm_time ), pos->data );
+			break;
+		
+		case cmd_ym2413:
+			if ( ym2413.run_until( to_fm_time( vgm_time ) ) )
+				ym2413.write( pos->addr, pos->data );
+			break;
+		
+		case cmd_ym2612_port0:
+			if ( pos->addr == ym2612_dac_port )
+			{
+				write_pcm( vgm_time, pos->data );
+			}
+			else if ( ym2612.run_until( to_fm_time( vgm_time ) ) )
+			{
+				if ( pos->addr == 0x2B )
+				{
+					dac_disabled = (pos->data >> 7 & 1) - 1;
+					dac_amp |= dac_disabled;
+				}
+				ym2612.write0( pos->addr, pos->data );
+			}
+			break;
+		
+		case cmd_ym2612_port1:
+			if ( ym2612.run_until( to_fm_time( vgm_time ) ) )
+				ym2612.write1( pos->addr, pos->data );
+			break;
+		
+		case cmd_pcm_seek:
+			pcm_pos = data + pcm_offsets [pos->index_hi * 0x10000L + pos->data * 0x100L + pos->addr];
+			break;
+		
+		case cmd_pcm_delay:
+			if ( pcm_pos < data_end )
+				write_pcm( vgm_time, *pcm_pos );
+			pcm_pos++;
+			break;
+		}
+		pos++;
+	}
+	event_pos    = pos;
+	event_offset = offset - loop_offset + end_time;
+	track_time  += end_time;
 	
 	return to_blip_time( end_time );
 }
 
+// Checkpoints
+
+long Vgm_Emu_Impl::fm_state_size() const
+{
+	if ( ym2612.enabled() )
+		return Ym2612_Emu::state_size();
+	
+	if ( ym2413.enabled() )
+		return Ym2413_Emu::state_size();
+	
+	return 0;
+}
+
+void Vgm_Emu_Impl::save_checkpoint()
+{
+	long fm_size = fm_state_size();
+	if ( (unsigned long) checkpoint_count >= checkpoints.size() )
+	{
+		long n = checkpoints.size() * 2 + 16;
+		if ( fm_size && checkpoint_fm.resize( n * fm_size ) )
+			return;
+		if ( checkpoints.resize( n ) )
+			return;
+	}
+	
+	checkpoint_t& cp = checkpoints [checkpoint_count];
+	cp.track_time     = track_time;
+	cp.out_time       = out_time;
+	cp.event          = event_pos - events.begin();
+	cp.event_offset   = event_offset;
+	cp.fm_time_offset = fm_time_offset;
+	cp.pcm_pos        = pcm_pos - data;
+	cp.dac_amp        = dac_amp;
+	cp.dac_disabled   = dac_disabled;
+	psg.save_state( &cp.psg );
+	if ( ym2612.enabled() )
+		ym2612.save_state( &checkpoint_fm [checkpoint_count * fm_size] );
+	else if ( ym2413.enabled() )
+		ym2413.save_state( &checkpoint_fm [checkpoint_count * fm_size] );
+	checkpoint_count++;
+}
+
+Vgm_Emu_Impl::checkpoint_t const* Vgm_Emu_Impl::find_checkpoint( blargg_long time ) const
+{
+	// latest checkpoint at or before time
+	int lo = 0;
+	int hi = checkpoint_count;
+	while ( lo < hi )
+	{
+		int mid = (lo + hi) >> 1;
+		if ( checkpoints [mid].out_time <= time )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo ? &checkpoints [lo - 1] : 0;
+}
+
+void Vgm_Emu_Impl::load_checkpoint( checkpoint_t const& cp )
+{
+	event_pos      = &events [cp.event];
+	event_offset   = cp.event_offset;
+	track_time     = cp.track_time;
+	out_time       = cp.out_time;
+	out_frac       = 0; // output buffers are cleared
+	fm_time_offset = cp.fm_time_offset;
+	pcm_pos        = data + cp.pcm_pos;
+	dac_amp        = cp.dac_amp;
+	dac_disabled   = cp.dac_disabled;
+	state_matches  = true;
+	psg.load_state( cp.psg );
+	long fm_size = fm_state_size();
+	if ( ym2612.enabled() )
+		ym2612.load_state( &checkpoint_fm [(&cp - checkpoints.begin()) * fm_size] );
+	else if ( ym2413.enabled() )
+		ym2413.load_state( &checkpoint_fm [(&cp - checkpoints.begin()) * fm_size] );
+}
+
+void Vgm_Emu_Impl::replay_registers( vgm_time_t time )
+{
+	// same as run_commands(), except that writes all happen at time 0 and
+	// sound chips don't run. LFOs do, as they keep running in a muted skip.
+	event_t const* pos = events.begin();
+	event_t const* const end = events.end();
+	vgm_time_t loop_offset = 0;
+	vgm_time_t lfo_time = 0;
+	while ( pos < end && pos->time + loop_offset < time )
+	{
+		switch ( pos->cmd )
+		{
+		case cmd_end:
+			if ( loop_event < 0 )
+			{
+				pos = end;
+				continue;
+			}
+			loop_offset += pos->time - loop_time;
+			pos = &events [loop_event];
+			continue;
+		
+		case cmd_gg_stereo:
+			psg.write_ggstereo( 0, pos->data );
+			break;
+		
+		case cmd_psg:
+			psg.write_data( 0, pos->data );
+			break;
+		
+		case cmd_ym2413:
+			if ( ym2413.enabled() )
+				ym2413.write( pos->addr, pos->data );
+			break;
+		
+		case cmd_ym2612_port0:
+			if ( pos->addr == ym2612_dac_port )
+			{
+				int old = dac_amp;
+				dac_amp = pos->data;
+				if ( old < 0 )
+					dac_amp |= dac_disabled;
+			}
+			else if ( ym2612.enabled() )
+			{
+				if ( pos->addr == 0x2B )
+				{
+					dac_disabled = (pos->data >> 7 & 1) - 1;
+					dac_amp |= dac_disabled;
+				}
+				else if ( pos->addr == 0x22 ) // LFO rate
+				{
+					ym2612.run_lfo( to_fm_pairs( pos->time + loop_offset - lfo_time ) );
+					lfo_time = pos->time + loop_offset;
+				}
+				ym2612.write0( pos->addr, pos->data );
+			}
+			break;
+		
+		case cmd_ym2612_port1:
+			if ( ym2612.enabled() )
+				ym2612.write1( pos->addr, pos->data );
+			break;
+		
+		case cmd_pcm_seek:
+			pcm_pos = data + pcm_offsets [pos->index_hi * 0x10000L + pos->data * 0x100L + pos->addr];
+			break;
+		
+		case cmd_pcm_delay:
+			if ( pcm_pos < data_end )
+			{
+				int old = dac_amp;
+				dac_amp = *pcm_pos;
+				if ( old < 0 )
+					dac_amp |= dac_disabled;
+			}
+			pcm_pos++;
+			break;
+		}
+		pos++;
+	}
+	if ( dac_amp >= 0 )
+		dac_synth.offset( 0, dac_amp, &blip_buf );
+	
+	if ( ym2612.enabled() )
+		ym2612.run_lfo( to_fm_pairs( time - lfo_time ) );
+	
+	if ( ym2413.enabled() )
+		ym2413.run_lfo( to_fm_pairs( time ) );
+	
+	event_pos     = pos;
+	event_offset  = time - loop_offset;
+	track_time    = time;
+	state_matches = false; // envelopes and phases weren't run
+}
+
 int Vgm_Emu_Impl::play_frame( blip_time_t blip_time, int sample_count, sample_t* buf )
 {
 	// to do: timing is working mostly by luck
@@ -257,6 +561,7 @@ int Vgm_Emu_Impl::play_frame( blip_time_t blip_time, int sample_count, sample_t*
 	}
 	
 	run_commands( vgm_time );
+	out_time += blip_buf.count_samples( blip_time );
 	ym2612.run_until( pairs );
 	ym2413.run_until( pairs );
 	
@@ -37,6 +37,7 @@ protected:
 	long fm_time_offset;
 	int fm_time_factor;
 	fm_time_t to_fm_time( vgm_time_t ) const;
+	long to_fm_pairs( vgm_time_t ) const; // for times too long for to_fm_time()
 	
 	enum { blip_time_bits = 12 };
 	int blip_time_factor;
@@ -47,17 +48,66 @@ protected:
 	byte const* data_end;
 	void update_fm_rates( long* ym2413_rate, long* ym2612_rate ) const;
 	
-	vgm_time_t vgm_time;
-	byte const* pos;
+	// Command stream is decoded once when loading into events with absolute
+	// times, so playback doesn't have to parse bytes
+	struct event_t
+	{
+		vgm_time_t time; // time since beginning of stream, not counting loops
+		byte cmd;        // cmd_* value, or cmd_pcm_delay for PCM write
+		byte addr;
+		byte data;
+		byte index_hi;   // for cmd_pcm_seek: pcm_offsets index is index_hi:data:addr
+	};
+	blargg_vector<event_t> events;
+	blargg_vector<blargg_long> pcm_offsets; // PCM seek offsets from beginning of data
+	int loop_event;       // index of first event of loop, or -1 if not looped
+	vgm_time_t loop_time; // stream time at loop point
+	blargg_err_t parse_commands( byte const* begin );
+	
+	event_t const* event_pos;
+	vgm_time_t event_offset; // subtracted from event time to get time within frame
+	vgm_time_t track_time;   // time at beginning of current frame, including loops
+	blargg_long out_time;    // sample pairs generated before current frame
+	Blip_Buffer::blip_resampled_time_t out_frac; // PSG-only: fraction of pair left over
+	void start_events();
 	blip_time_t run_commands( vgm_time_t );
 	int play_frame( blip_time_t blip_time, int sample_count, sample_t* buf );
 	
-	byte const* pcm_data;
 	byte const* pcm_pos;
 	int dac_amp;
 	int dac_disabled; // -1 if disabled
 	void write_pcm( vgm_time_t, int amp );
 	
+	// Chip state is saved every five seconds during unmuted playback, so that seeking
+	// to an earlier time or one already played only needs to replay a few seconds.
+	// YM2413 state is saved too.
+	struct checkpoint_t
+	{
+		vgm_time_t track_time;
+		blargg_long out_time;
+		int event;
+		vgm_time_t event_offset;
+		long fm_time_offset;
+		blargg_long pcm_pos; // offset from data
+		int dac_amp;
+		int dac_disabled;
+		sms_apu_state_t psg;
+	};
+	enum { checkpoint_interval = 5 * 44100 };
+	blargg_vector<checkpoint_t> checkpoints;
+	blargg_vector<byte> checkpoint_fm; // fm_state_size() bytes per checkpoint
+	int checkpoint_count;
+	int voices_muted;   // muted voices don't run, so their state doesn't match playback
+	bool state_matches; // false once state differs from normal playback from start
+	long fm_state_size() const;
+	void save_checkpoint();
+	checkpoint_t const* find_checkpoint( blargg_long out_time ) const;
+	void load_checkpoint( checkpoint_t const& );
+	
+	// Seeking past checkpoints writes registers up to the destination straight to
+	// the just-reset chips, without running them there
+	void replay_registers( vgm_time_t );
+	
 	Ym_Emu<Ym2612_Emu> ym2612;
 	Ym_Emu<Ym2413_Emu> ym2413;
 	
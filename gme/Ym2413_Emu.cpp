@@ -1,21 +1,749 @@
-
-// Use in place of Ym2413_Emu.cpp and ym2413.c to disable support for this chip
-
 // Game_Music_Emu 0.5.5. http://www.slack.net/~ant/
 
 #include "Ym2413_Emu.h"
 
-Ym2413_Emu::Ym2413_Emu() { }
+#include "blargg_common.h"
+#include "Gme_Stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. This module is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General
+Public License for more details. You should have received a copy of the GNU
+Lesser General Public License along with this module; if not, write to the Free
+Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301 USA */
+
+#include "blargg_source.h"
+
+// Operators work in the log domain: sine and envelope give attenuations, which
+// are added and converted to amplitude with one table lookup. Everything that
+// changes only on register writes (phase steps, key scaling, envelope rates) is
+// recalculated on the write, so running is just table lookups and adds.
+
+int const sin_bits     = 10;
+int const sin_size     = 1 << sin_bits;
+int const phase_shift  = 32 - sin_bits;         // phase is 32-bit fraction of cycle
+
+double const atten_db  = 3.0 / 64;              // attenuation unit, in dB
+int const atten_max    = 2047;                  // about 96 dB, where output is silent
+int const exp_size     = 2 * (atten_max + 1);   // sine + envelope attenuation
+int const out_max      = 4095;                  // operator output range
+
+int const eg_bits      = 7;                     // 0.375 dB steps
+int const eg_frac_bits = 15;
+int const eg_end       = (1 << eg_bits) << eg_frac_bits;
+int const eg_off_phase = 255 << eg_frac_bits;   // past atten_max once scaled
+int const eg_shift     = 3;                     // envelope step to attenuation
+int const tl_shift     = 4;                     // 0.75 dB total level step
+int const vol_shift    = 6;                     // 3 dB volume and sustain level step
+
+int const lfo_bits     = 8;
+int const lfo_size     = 1 << lfo_bits;
+int const am_depth     = 104;                   // 4.875 dB
+double const am_rate   = 3.6413;
+double const pm_cents  = 13.75;
+double const pm_rate   = 6.4;
+
+int const rhythm_flag  = 0x20;
+int const block_size   = 64;                    // samples run together
+
+// Instrument ROM: 15 melodic instruments, then bass drum, hi-hat/snare drum
+// and tom-tom/top cymbal. Instrument 0 is the user instrument in registers 0-7.
+static unsigned char const inst_rom [19] [8] = {
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},
+	{0x71,0x61,0x1E,0x17,0xD0,0x78,0x00,0x17}, // violin
+	{0x13,0x41,0x1A,0x0D,0xD8,0xF7,0x23,0x13}, // guitar
+	{0x13,0x01,0x99,0x00,0xF2,0xC4,0x21,0x23}, // piano
+	{0x11,0x61,0x0E,0x07,0x8D,0x64,0x70,0x27}, // flute
+	{0x32,0x21,0x1E,0x06,0xE1,0x76,0x01,0x28}, // clarinet
+	{0x31,0x22,0x16,0x05,0xE0,0x71,0x00,0x18}, // oboe
+	{0x21,0x61,0x1D,0x07,0x82,0x81,0x11,0x07}, // trumpet
+	{0x33,0x21,0x2D,0x13,0xB0,0x70,0x00,0x07}, // organ
+	{0x61,0x61,0x1B,0x06,0x64,0x65,0x10,0x17}, // horn
+	{0x41,0x61,0x0B,0x18,0x85,0xF0,0x81,0x07}, // synthesizer
+	{0x33,0x01,0x83,0x11,0xEA,0xEF,0x10,0x04}, // harpsichord
+	{0x17,0xC1,0x24,0x07,0xF8,0xF8,0x22,0x12}, // vibraphone
+	{0x61,0x50,0x0C,0x05,0xD2,0xF5,0x40,0x42}, // synthesizer bass
+	{0x01,0x01,0x55,0x03,0xE9,0x90,0x03,0x02}, // acoustic bass
+	{0x41,0x41,0x89,0x03,0xF1,0xE4,0xC0,0x13}, // electric guitar
+	{0x01,0x01,0x18,0x0F,0xDF,0xF8,0x6A,0x6D}, // bass drum
+	{0x01,0x01,0x00,0x00,0xC8,0xD8,0xA7,0x68}, // hi-hat, snare drum
+	{0x05,0x01,0x00,0x00,0xF8,0xAA,0x59,0x55}  // tom-tom, top cymbal
+};
+
+// Frequency multiplier, times 2
+static unsigned char const mul_tab [16] = {
+	1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 20, 24, 24, 30, 30
+};
+
+// Tables that don't depend on clock or sample rate, shared by all instances
+
+struct ym2413_tables_t
+{
+	short exp_tab [exp_size * 2];           // attenuation to amplitude, negated after exp_size
+	unsigned short sin_tab [2] [sin_size];  // full and half sine, as attenuation
+	unsigned char ar_adjust [1 << eg_bits]; // attack curve
+	unsigned short ksl_tab [4] [8 * 16];    // key scaling by KSL, block and high fnum bits
+	unsigned char am_tab [lfo_size];
+	short pm_tab [lfo_size];                // vibrato, as fraction of phase step * 0x10000
+};
+
+static ym2413_tables_t tables;
+
+static bool build_tables()
+{
+	ym2413_tables_t& t = tables;
+	double const pi = 3.14159265358979323846;
+	
+	for ( int i = 0; i < exp_size; i++ )
+	{
+		int x = (int) floor( out_max * pow( 10.0, -i * atten_db / 20 ) + 0.5 );
+		t.exp_tab [i] = x;
+		t.exp_tab [exp_size + i] = -x;
+	}
+	
+	for ( int i = 0; i < sin_size; i++ )
+	{
+		double x = sin( (i + 0.5) * 2 * pi / sin_size );
+		int atten = (int) floor( -20 * log10( fabs( x ) ) / atten_db + 0.5 );
+		if ( atten > atten_max )
+			atten = atten_max;
+		t.sin_tab [0] [i] = atten + (x < 0 ? exp_size : 0);
+		t.sin_tab [1] [i] = (x < 0 ? atten_max : atten);
+	}
+	
+	t.ar_adjust [0] = (1 << eg_bits) - 1;
+	for ( int i = 1; i < (1 << eg_bits); i++ )
+	{
+		double x = (1 << eg_bits) - 1 - (1 << eg_bits) * log( (double) i ) / log( 128.0 );
+		t.ar_adjust [i] = (x > 0 ? (int) x : 0);
+	}
+	
+	// level at 6 dB/octave for highest four fnum bits, in dB
+	static double const ksl_db [16] = {
+		 0.00, 18.00, 24.00, 27.75, 30.00, 32.25, 33.75, 35.25,
+		36.00, 37.50, 38.25, 39.00, 39.75, 40.50, 41.25, 42.00
+	};
+	for ( int block = 0; block < 8; block++ )
+	{
+		for ( int f = 0; f < 16; f++ )
+		{
+			double db = ksl_db [f] - 6.0 * (7 - block);
+			if ( db < 0 )
+				db = 0;
+			t.ksl_tab [0] [block << 4 | f] = 0;
+			for ( int ksl = 1; ksl < 4; ksl++ )
+				t.ksl_tab [ksl] [block << 4 | f] =
+						(int) floor( db / (1 << (3 - ksl)) / atten_db + 0.5 );
+		}
+	}
+	
+	for ( int i = 0; i < lfo_size; i++ )
+	{
+		double angle = 2 * pi * i / lfo_size;
+		t.am_tab [i] = (int) floor( am_depth * (1 - cos( angle )) / 2 + 0.5 );
+		t.pm_tab [i] = (int) floor( (pow( 2.0, pm_cents / 1200 * sin( angle ) ) - 1) *
+				0x10000 + 0.5 );
+	}
+	
+	return true;
+}
+
+static void init_tables()
+{
+	// Function-local static is built only once, even if several threads get here
+	// at the same time, and they all see the finished tables
+	static bool const built = build_tables();
+	(void) built;
+}
+
+// Chip state
+
+enum { eg_attack, eg_decay, eg_sustain, eg_sustain_release, eg_release, eg_off };
+
+struct slot_t
+{
+	blargg_ulong phase;
+	blargg_ulong phase_inc;     // without vibrato
+	int eg_phase;               // envelope level << eg_frac_bits, or attack curve index
+	int eg_inc;
+	int eg_limit;               // eg_phase where current stage ends
+	int eg_stage;
+	int tll;                    // total level and key scaling, in attenuation units
+	int out [2];                // last two outputs, for feedback
+	
+	// from instrument and channel registers
+	int am_mask;
+	int vib_mask;
+	int wave;
+	int eg_type;                // 1 if tone sustains while key is on
+	int sustain;                // channel's sustain bit
+	int ar, dr, sl, rr, rks;
+};
+
+enum { slot_count = 18 };
+enum { bd1 = 12, bd2 = 13, hh = 14, sd = 15, tom = 16, cym = 17 };
+
+struct ym2413_state_t
+{
+	slot_t slots [slot_count];  // modulator then carrier for each channel
+	int fb_shift [9];
+	int fb_mask [9];
+	unsigned char regs [0x40];
+	blargg_ulong am_phase;
+	blargg_ulong pm_phase;
+	blargg_ulong noise_phase;   // fraction of noise step, 16 bits
+	blargg_ulong noise;         // 23-bit shift register
+};
+
+struct Ym2413_Impl
+{
+	ym2413_state_t s;
+	int mute_mask;
+	
+	// depend on clock and sample rate
+	double phase_factor;
+	int ar_inc [16] [16];
+	int dr_inc [16] [16];
+	blargg_ulong am_inc;
+	blargg_ulong pm_inc;
+	blargg_ulong noise_inc;
+	
+	void set_rate( double sample_rate, double clock_rate );
+	void reset();
+	void write( int addr, int data );
+	void run( int pair_count, Ym2413_Emu::sample_t* );
+	
+	bool rhythm() const { return (s.regs [0x0E] & rhythm_flag) != 0; }
+	unsigned char const* patch( int chan ) const;
+	void update_channel( int chan );
+	void update_eg( slot_t& );
+	void next_stage( slot_t& );
+	void key_on( slot_t& );
+	void key_off( slot_t& );
+	void write_rhythm( int old, int data );
+	void run_channel( int chan, int const* am, int const* pm, int* mix, int count );
+	void run_rhythm( int const* am, int const* pm, int* mix, int count );
+};
+
+void Ym2413_Impl::set_rate( double sample_rate, double clock_rate )
+{
+	init_tables();
+	
+	double const ratio = clock_rate / 72 / sample_rate; // chip samples per output sample
+	phase_factor = 4096.0 * ratio;
+	
+	for ( int rate = 0; rate < 16; rate++ )
+	{
+		for ( int rks = 0; rks < 16; rks++ )
+		{
+			int rm = rate + (rks >> 2);
+			if ( rm > 15 )
+				rm = 15;
+			int rl = rks & 3;
+			
+			// in 1/0x8000 envelope steps per chip sample
+			double dr = (rate ? (rl + 4) << (rm - 1) : 0);
+			double ar = (rate && rate < 15 ? 3 * (rl + 4) << (rm + 1) : 0);
+			dr_inc [rate] [rks] = (int) (dr * ratio + 0.5);
+			ar_inc [rate] [rks] = (int) (ar * ratio + 0.5);
+		}
+	}
+	
+	am_inc    = (blargg_ulong) (am_rate / sample_rate * 4294967296.0);
+	pm_inc    = (blargg_ulong) (pm_rate / sample_rate * 4294967296.0);
+	noise_inc = (blargg_ulong) (ratio * 0x10000 + 0.5);
+}
+
+int Ym2413_Emu::set_rate( double sample_rate, double clock_rate )
+{
+	if ( !impl )
+	{
+		impl = (Ym2413_Impl*) malloc( sizeof *impl );
+		if ( !impl )
+			return 1;
+		impl->mute_mask = 0;
+	}
+	
+	impl->set_rate( sample_rate, clock_rate );
+	impl->reset();
+	
+	return 0;
+}
+
+Ym2413_Emu::~Ym2413_Emu()
+{
+	free( impl );
+}
+
+// Registers
+
+unsigned char const* Ym2413_Impl::patch( int chan ) const
+{
+	if ( chan >= 6 && rhythm() )
+		return inst_rom [16 + chan - 6];
+	
+	int inst = s.regs [0x30 + chan] >> 4;
+	return inst ? inst_rom [inst] : s.regs;
+}
+
+void Ym2413_Impl::update_eg( slot_t& sl )
+{
+	int inc = 0;
+	int limit = INT_MAX;
+	switch ( sl.eg_stage )
+	{
+	case eg_attack:
+		inc = ar_inc [sl.ar] [sl.rks];
+		limit = eg_end;
+		break;
+		
+	case eg_decay:
+		inc = dr_inc [sl.dr] [sl.rks];
+		limit = (sl.sl << 3) << eg_frac_bits;
+		break;
+		
+	case eg_sustain_release:
+		inc = dr_inc [sl.rr] [sl.rks];
+		limit = eg_end;
+		break;
+		
+	case eg_release:
+		inc = dr_inc [sl.sustain ? 5 : sl.eg_type ? sl.rr : 7] [sl.rks];
+		limit = eg_end;
+		break;
+	}
+	sl.eg_inc = inc;
+	sl.eg_limit = limit;
+}
+
+void Ym2413_Impl::next_stage( slot_t& sl )
+{
+	do
+	{
+		switch ( sl.eg_stage )
+		{
+		case eg_attack:
+			sl.eg_stage = eg_decay;
+			sl.eg_phase = 0;
+			break;
+			
+		case eg_decay:
+			sl.eg_stage = (sl.eg_type ? eg_sustain : eg_sustain_release);
+			sl.eg_phase = sl.eg_limit;
+			break;
+			
+		default:
+			sl.eg_stage = eg_off;
+			sl.eg_phase = eg_off_phase;
+			break;
+		}
+		update_eg( sl );
+	}
+	while ( sl.eg_phase >= sl.eg_limit );
+}
+
+void Ym2413_Impl::key_on( slot_t& sl )
+{
+	sl.phase = 0;
+	sl.eg_stage = eg_attack;
+	sl.eg_phase = (sl.ar == 15 ? eg_end : 0);
+	update_eg( sl );
+	if ( sl.eg_phase >= sl.eg_limit )
+		next_stage( sl );
+}
+
+void Ym2413_Impl::key_off( slot_t& sl )
+{
+	if ( sl.eg_stage == eg_off )
+		return;
+	
+	if ( sl.eg_stage == eg_attack )
+		sl.eg_phase = tables.ar_adjust [sl.eg_phase >> eg_frac_bits] << eg_frac_bits;
+	sl.eg_stage = eg_release;
+	update_eg( sl );
+	if ( sl.eg_phase >= sl.eg_limit )
+		next_stage( sl );
+}
+
+void Ym2413_Impl::update_channel( int chan )
+{
+	unsigned char const* p = patch( chan );
+	int const fnum  = (s.regs [0x20 + chan] & 1) << 8 | s.regs [0x10 + chan];
+	int const block = s.regs [0x20 + chan] >> 1 & 7;
+	int const vol   = s.regs [0x30 + chan];
+	
+	s.fb_shift [chan] = 9 - (p [3] & 7);
+	s.fb_mask  [chan] = ((p [3] & 7) ? -1 : 0);
+	
+	for ( int i = 0; i < 2; i++ )
+	{
+		slot_t& sl = s.slots [chan * 2 + i];
+		int const flags = p [i];
+		
+		sl.am_mask  = (flags & 0x80 ? -1 : 0);
+		sl.vib_mask = (flags & 0x40 ? -1 : 0);
+		sl.eg_type  = flags >> 5 & 1;
+		sl.rks      = (block << 1 | fnum >> 8) >> (flags & 0x10 ? 0 : 2);
+		sl.wave     = p [3] >> (3 + i) & 1;
+		sl.sustain  = s.regs [0x20 + chan] >> 5 & 1;
+		sl.ar       = p [4 + i] >> 4;
+		sl.dr       = p [4 + i] & 15;
+		sl.sl       = p [6 + i] >> 4;
+		sl.rr       = p [6 + i] & 15;
+		
+		double inc = (double) (fnum << block) * mul_tab [flags & 15] * phase_factor;
+		sl.phase_inc = (blargg_ulong) fmod( inc, 4294967296.0 );
+		
+		// carriers use volume; in rhythm mode, so do hi-hat and tom-tom
+		int level;
+		if ( i )
+			level = (vol & 15) << vol_shift;
+		else if ( chan >= 7 && rhythm() )
+			level = (vol >> 4) << vol_shift;
+		else
+			level = (p [2] & 0x3F) << tl_shift;
+		sl.tll = level + tables.ksl_tab [p [2 + i] >> 6] [block << 4 | fnum >> 5];
+		
+		update_eg( sl );
+	}
+}
+
+void Ym2413_Impl::write_rhythm( int old, int data )
+{
+	if ( (old ^ data) & rhythm_flag )
+	{
+		for ( int i = bd1; i < slot_count; i++ )
+			key_off( s.slots [i] );
+		for ( int chan = 6; chan < 9; chan++ )
+			update_channel( chan );
+	}
+	
+	if ( !(data & rhythm_flag) )
+		return;
+	
+	if ( !(old & rhythm_flag) )
+		old = 0;
+	
+	// bass drum, snare drum, tom-tom, top cymbal, hi-hat
+	static unsigned char const key_slots [5] = { bd2, sd, tom, cym, hh };
+	for ( int i = 0; i < 5; i++ )
+	{
+		int const mask = 0x10 >> i;
+		if ( !((old ^ data) & mask) )
+			continue;
+		
+		slot_t& sl = s.slots [key_slots [i]];
+		if ( data & mask )
+		{
+			if ( i == 0 )
+			{
+				key_on( s.slots [bd1] );
+				s.slots [bd1].out [0] = 0;
+				s.slots [bd1].out [1] = 0;
+			}
+			key_on( sl );
+		}
+		else
+		{
+			key_off( sl );
+		}
+	}
+}
+
+void Ym2413_Impl::write( int addr, int data )
+{
+	if ( (unsigned) addr >= sizeof s.regs )
+		return;
+	
+	int const old = s.regs [addr];
+	s.regs [addr] = data;
+	
+	int const chan = addr & 15;
+	switch ( addr >> 4 )
+	{
+	case 0:
+		if ( addr < 8 )
+		{
+			// user instrument
+			for ( int i = 0; i < 9; i++ )
+			{
+				if ( !(s.regs [0x30 + i] >> 4) && !(i >= 6 && rhythm()) )
+					update_channel( i );
+			}
+		}
+		else if ( addr == 0x0E )
+		{
+			write_rhythm( old, data );
+		}
+		break;
+		
+	case 1:
+	case 3:
+		if ( chan < 9 )
+			update_channel( chan );
+		break;
+		
+	case 2:
+		if ( chan < 9 )
+		{
+			update_channel( chan );
+			if ( ((old ^ data) & 0x10) && !(chan >= 6 && rhythm()) )
+			{
+				slot_t& mod = s.slots [chan * 2];
+				if ( data & 0x10 )
+				{
+					key_on( mod );
+					mod.out [0] = 0;
+					mod.out [1] = 0;
+					key_on( s.slots [chan * 2 + 1] );
+				}
+				else
+				{
+					key_off( s.slots [chan * 2 + 1] );
+				}
+			}
+		}
+		break;
+	}
+}
+
+void Ym2413_Emu::write( int addr, int data )
+{
+	GME_STATS_WRITE( ym2413 );
+	impl->write( addr, data );
+}
+
+void Ym2413_Impl::reset()
+{
+	memset( &s, 0, sizeof s );
+	s.noise = 1;
+	for ( int i = 0; i < slot_count; i++ )
+	{
+		s.slots [i].eg_stage = eg_off;
+		s.slots [i].eg_phase = eg_off_phase;
+	}
+	for ( int chan = 0; chan < 9; chan++ )
+		update_channel( chan );
+}
+
+void Ym2413_Emu::reset()
+{
+	impl->reset();
+}
+
+void Ym2413_Emu::mute_voices( int mask )
+{
+	impl->mute_mask = mask;
+}
+
+void Ym2413_Emu::run_lfo( long pair_count )
+{
+	impl->s.am_phase += impl->am_inc * (blargg_ulong) pair_count;
+	impl->s.pm_phase += impl->pm_inc * (blargg_ulong) pair_count;
+}
+
+long Ym2413_Emu::state_size() { return sizeof (ym2413_state_t); }
+
+void Ym2413_Emu::save_state( void* out ) const
+{
+	*(ym2413_state_t*) out = impl->s;
+}
+
+void Ym2413_Emu::load_state( void const* in )
+{
+	impl->s = *(ym2413_state_t const*) in;
+}
+
+// Emulation
+
+// Attenuation of slot for current sample
+static inline int slot_env( slot_t const& sl, int am )
+{
+	int level = sl.eg_phase >> eg_frac_bits;
+	if ( sl.eg_stage == eg_attack )
+		level = tables.ar_adjust [level];
+	int env = (level << eg_shift) + sl.tll + (am & sl.am_mask);
+	return (env < atten_max ? env : atten_max);
+}
 
-Ym2413_Emu::~Ym2413_Emu() { }
+// Advances phase of slot by one sample
+static inline void slot_phase( slot_t& sl, int pm )
+{
+	blargg_ulong inc = sl.phase_inc;
+	sl.phase += inc + (blargg_ulong) ((blargg_long) (inc >> 11) * (pm & sl.vib_mask) >> 5);
+}
 
-int Ym2413_Emu::set_rate( double, double ) { return 2; }
+// Advances envelope and phase of slot by one sample
+static inline void slot_step( Ym2413_Impl& impl, slot_t& sl, int pm )
+{
+	slot_phase( sl, pm );
+	sl.eg_phase += sl.eg_inc;
+	if ( sl.eg_phase >= sl.eg_limit )
+		impl.next_stage( sl );
+}
 
-void Ym2413_Emu::reset() { }
+// Output of slot at sine index, which is offset by modulation
+static inline int slot_out( slot_t const& sl, int index, int env )
+{
+	return tables.exp_tab [tables.sin_tab [sl.wave] [index & (sin_size - 1)] + env];
+}
 
-void Ym2413_Emu::write( int, int ) { }
+void Ym2413_Impl::run_channel( int chan, int const* am, int const* pm, int* mix, int count )
+{
+	slot_t& mod = s.slots [chan * 2];
+	slot_t& car = s.slots [chan * 2 + 1];
+	int const fb_shift = s.fb_shift [chan];
+	int const fb_mask  = s.fb_mask  [chan];
+	int out0 = mod.out [0];
+	int out1 = mod.out [1];
+	
+	for ( int i = 0; i < count; i++ )
+	{
+		int fb = (out0 + out1) >> fb_shift & fb_mask;
+		out1 = out0;
+		out0 = slot_out( mod, (int) (mod.phase >> phase_shift) + fb, slot_env( mod, am [i] ) );
+		
+		mix [i] += slot_out( car, (int) (car.phase >> phase_shift) + out0,
+				slot_env( car, am [i] ) );
+		
+		slot_step( *this, mod, pm [i] );
+		slot_step( *this, car, pm [i] );
+	}
+	
+	mod.out [0] = out0;
+	mod.out [1] = out1;
+}
 
-void Ym2413_Emu::mute_voices( int ) { }
+void Ym2413_Impl::run_rhythm( int const* am, int const* pm, int* mix, int count )
+{
+	// bass drum is an ordinary two-operator channel
+	if ( !(mute_mask & 0x2000) && s.slots [bd2].eg_stage != eg_off )
+	{
+		int bd [block_size] = { 0 };
+		run_channel( 6, am, pm, bd, count );
+		for ( int i = 0; i < count; i++ )
+			mix [i] += bd [i] * 2;
+	}
+	
+	// others each use one operator. Hi-hat, snare drum and top cymbal get their
+	// phase from bits of the hi-hat and top cymbal phases, and noise.
+	int const active = ~mute_mask >> 9 & (
+			(s.slots [hh ].eg_stage != eg_off ? 0x01 : 0) |
+			(s.slots [cym].eg_stage != eg_off ? 0x02 : 0) |
+			(s.slots [tom].eg_stage != eg_off ? 0x04 : 0) |
+			(s.slots [sd ].eg_stage != eg_off ? 0x08 : 0));
+	
+	slot_t& hh_sl  = s.slots [hh];
+	slot_t& sd_sl  = s.slots [sd];
+	slot_t& tom_sl = s.slots [tom];
+	slot_t& cym_sl = s.slots [cym];
+	for ( int i = 0; i < count; i++ )
+	{
+		s.noise_phase += noise_inc;
+		while ( s.noise_phase >= 0x10000 )
+		{
+			s.noise_phase -= 0x10000;
+			s.noise = s.noise >> 1 | ((s.noise ^ s.noise >> 14) & 1) << 22;
+		}
+		int const noise = s.noise & 1;
+		
+		int const hh_index  = (int) (hh_sl.phase  >> phase_shift);
+		int const cym_index = (int) (cym_sl.phase >> phase_shift);
+		int const ring = ((hh_index >> 2 ^ hh_index >> 7) | hh_index >> 3 |
+				(cym_index >> 3 ^ cym_index >> 5)) & 1;
+		
+		int sum = 0;
+		if ( active & 0x01 )
+		{
+			int index = (ring ? (noise ? 0x2D0 : 0x234) : (noise ? 0x34 : 0xD0));
+			sum += slot_out( hh_sl, index, slot_env( hh_sl, am [i] ) );
+			slot_step( *this, hh_sl, pm [i] );
+		}
+		else
+		{
+			slot_phase( hh_sl, pm [i] ); // snare drum and top cymbal still use it
+		}
+		
+		if ( active & 0x02 )
+		{
+			sum += slot_out( cym_sl, ring ? 0x300 : 0x100, slot_env( cym_sl, am [i] ) );
+			slot_step( *this, cym_sl, pm [i] );
+		}
+		else
+		{
+			slot_phase( cym_sl, pm [i] );
+		}
+		
+		if ( active & 0x04 )
+		{
+			sum += slot_out( tom_sl, (int) (tom_sl.phase >> phase_shift),
+					slot_env( tom_sl, am [i] ) );
+			slot_step( *this, tom_sl, pm [i] );
+		}
+		
+		if ( active & 0x08 )
+		{
+			int index = (hh_index & 0x100 ? 0x200 : 0x100) ^ noise << 8;
+			sum += slot_out( sd_sl, index, slot_env( sd_sl, am [i] ) );
+			slot_step( *this, sd_sl, pm [i] );
+		}
+		
+		mix [i] += sum * 2;
+	}
+}
 
-void Ym2413_Emu::run( int, sample_t* ) { }
+void Ym2413_Impl::run( int pair_count, Ym2413_Emu::sample_t* out )
+{
+	int const melodic = (rhythm() ? 6 : 9);
+	while ( pair_count > 0 )
+	{
+		int const count = (pair_count < block_size ? pair_count : block_size);
+		pair_count -= count;
+		
+		int am  [block_size];
+		int pm  [block_size];
+		int mix [block_size];
+		for ( int i = 0; i < count; i++ )
+		{
+			am [i] = tables.am_tab [s.am_phase >> (32 - lfo_bits) & (lfo_size - 1)];
+			pm [i] = tables.pm_tab [s.pm_phase >> (32 - lfo_bits) & (lfo_size - 1)];
+			s.am_phase += am_inc;
+			s.pm_phase += pm_inc;
+			mix [i] = 0;
+		}
+		
+		// silent channels are skipped; key on resets everything they'd update
+		for ( int chan = 0; chan < melodic; chan++ )
+		{
+			if ( !(mute_mask >> chan & 1) && s.slots [chan * 2 + 1].eg_stage != eg_off )
+				run_channel( chan, am, pm, mix, count );
+		}
+		
+		if ( melodic < 9 )
+			run_rhythm( am, pm, mix, count );
+		
+		for ( int i = 0; i < count; i++ )
+		{
+			int x = mix [i] >> 2;
+			if ( (short) x != x )
+				x = 0x7FFF - (x >> 24);
+			out [0] = x;
+			out [1] = x;
+			out += 2;
+		}
+	}
+}
 
+void Ym2413_Emu::run( int pair_count, sample_t* out )
+{
+	GME_STATS_STAGE( gme_stage_apu );
+	impl->run( pair_count, out );
+}
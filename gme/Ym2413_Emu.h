@@ -4,10 +4,12 @@
 #ifndef YM2413_EMU_H
 #define YM2413_EMU_H
 
+struct Ym2413_Impl;
+
 class Ym2413_Emu  {
-	struct OPLL* opll;
+	Ym2413_Impl* impl;
 public:
-	Ym2413_Emu();
+	Ym2413_Emu() { impl = 0; }
 	~Ym2413_Emu();
 	
 	// Set output sample rate and chip clock rates, in Hz. Returns non-zero
@@ -17,7 +19,9 @@ public:
 	// Reset to power-up state
 	void reset();
 	
-	// Mute voice n if bit n (1 << n) of mask is set
+	// Mute voice n if bit n (1 << n) of mask is set. Voices 0-8 are the melodic
+	// channels and 9-13 are the rhythm sounds (hi-hat, top cymbal, tom-tom,
+	// snare drum, bass drum).
 	enum { channel_count = 14 };
 	void mute_voices( int mask );
 	
@@ -28,6 +32,15 @@ public:
 	typedef short sample_t;
 	enum { out_chan_count = 2 }; // stereo
 	void run( int pair_count, sample_t* out );
+	
+	// Run LFOs as if pair_count samples were run with all channels muted
+	void run_lfo( long pair_count );
+	
+	// Save/restore complete chip state (excluding rates and mute mask) to/from
+	// state_size() bytes of memory. Only valid with the same set_rate() setup.
+	static long state_size();
+	void save_state( void* out ) const;
+	void load_state( void const* in );
 };
 
 #endif
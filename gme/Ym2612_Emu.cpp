@@ -4,6 +4,8 @@
 
 #include "Ym2612_Emu.h"
 
+#include "blargg_cpu.h"
+#include "Gme_Stats.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +13,10 @@
 #include <stdio.h>
 #include <math.h>
 
+#if BLARGG_X86_SIMD
+	#include <immintrin.h>
+#endif
+
 /* Copyright (C) 2002 Stphane Dallongeville (gens AT consolemul.com) */
 /* Copyright (C) 2004-2006 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -261,6 +267,7 @@ struct Ym2612_Impl
 	
 	state_t YM2612;
 	int mute_mask;
+	bool avx2; // run_avx2() can be used
 	tables_t g;
 	
 	void KEY_ON( channel_t&, int );
@@ -275,6 +282,7 @@ struct Ym2612_Impl
 	void write1( int addr, int data );
 	void run_timer( int );
 	void run( int pair_count, Ym2612_Emu::sample_t* );
+	void run_avx2( int pair_count, Ym2612_Emu::sample_t*, int channel_mask );
 };
 
 void Ym2612_Impl::KEY_ON( channel_t& ch, int nsl)
@@ -832,6 +840,10 @@ const char* Ym2612_Emu::set_rate( double sample_rate, double clock_rate )
 		if ( !impl )
 			return "Out of memory";
 		impl->mute_mask = 0;
+		impl->avx2 = false;
+		#if BLARGG_X86_SIMD
+			impl->avx2 = blargg_cpu_has( blargg_cpu_avx2 );
+		#endif
 	}
 	memset( &impl->YM2612, 0, sizeof impl->YM2612 );
 	
@@ -951,16 +963,53 @@ void Ym2612_Impl::reset()
 
 void Ym2612_Emu::write0( int addr, int data )
 {
+	GME_STATS_WRITE( ym2612 );
 	impl->write0( addr, data );
 }
 
 void Ym2612_Emu::write1( int addr, int data )
 {
+	GME_STATS_WRITE( ym2612 );
 	impl->write1( addr, data );
 }
 
 void Ym2612_Emu::mute_voices( int mask ) { impl->mute_mask = mask; }
 
+void Ym2612_Emu::run_lfo( long pair_count )
+{
+	// only low bits of counter are used, so keep it from overflowing
+	unsigned long const mask = (1L << (LFO_HBITS + LFO_LBITS)) - 1;
+	impl->g.LFOcnt = (int) ((impl->g.LFOcnt + (unsigned long) impl->g.LFOinc * (pair_count & mask)) & mask);
+}
+
+// State
+
+struct ym2612_saved_state_t
+{
+	state_t YM2612;
+	int LFOcnt;
+	int LFOinc;
+};
+
+long Ym2612_Emu::state_size() { return sizeof (ym2612_saved_state_t); }
+
+void Ym2612_Emu::save_state( void* out ) const
+{
+	// slot pointers refer to impl's own tables, so state is only valid for this object
+	ym2612_saved_state_t* s = (ym2612_saved_state_t*) out;
+	s->YM2612 = impl->YM2612;
+	s->LFOcnt = impl->g.LFOcnt;
+	s->LFOinc = impl->g.LFOinc;
+}
+
+void Ym2612_Emu::load_state( void const* in )
+{
+	ym2612_saved_state_t const* s = (ym2612_saved_state_t const*) in;
+	impl->YM2612 = s->YM2612;
+	impl->g.LFOcnt = s->LFOcnt;
+	impl->g.LFOinc = s->LFOinc;
+}
+
 static void update_envelope_( slot_t* sl )
 {
 	switch ( sl->Ecurp )
@@ -1031,6 +1080,24 @@ inline void update_envelope( slot_t& sl )
 		update_envelope_( &sl );
 }
 
+// True if an operator that is heard for channel's algorithm hasn't reached the
+// end of its envelope
+inline bool channel_audible( channel_t const& ch, int algo )
+{
+	int not_end = ch.SLOT [S3].Ecnt - ENV_END;
+	
+	if ( algo == 7 )
+		not_end |= ch.SLOT [S0].Ecnt - ENV_END;
+	
+	if ( algo >= 5 )
+		not_end |= ch.SLOT [S2].Ecnt - ENV_END;
+	
+	if ( algo >= 4 )
+		not_end |= ch.SLOT [S1].Ecnt - ENV_END;
+	
+	return not_end != 0;
+}
+
 template<int algo>
 struct ym2612_update_chan {
 	static void func( tables_t&, channel_t&, Ym2612_Emu::sample_t*, int );
@@ -1042,21 +1109,9 @@ template<int algo>
 void ym2612_update_chan<algo>::func( tables_t& g, channel_t& ch,
 		Ym2612_Emu::sample_t* buf, int length )
 {
-	int not_end = ch.SLOT [S3].Ecnt - ENV_END;
-	
 	// algo is a compile-time constant, so all conditions based on it are resolved
 	// during compilation
 	
-	// special cases
-	if ( algo == 7 )
-		not_end |= ch.SLOT [S0].Ecnt - ENV_END;
-	
-	if ( algo >= 5 )
-		not_end |= ch.SLOT [S2].Ecnt - ENV_END;
-	
-	if ( algo >= 4 )
-		not_end |= ch.SLOT [S1].Ecnt - ENV_END;
-	
 	int CH_S0_OUT_1 = ch.S0_OUT [1];
 	
 	int in0 = ch.SLOT [S0].Fcnt;
@@ -1067,7 +1122,7 @@ void ym2612_update_chan<algo>::func( tables_t& g, channel_t& ch,
 	int YM2612_LFOinc = g.LFOinc;
 	int YM2612_LFOcnt = g.LFOcnt + YM2612_LFOinc;
 	
-	if ( !not_end )
+	if ( !channel_audible( ch, algo ) )
 		return;
 	
 	do
@@ -1201,6 +1256,255 @@ static const ym2612_update_chan_t UPDATE_CHAN [8] = {
 	&ym2612_update_chan<7>::func
 };
 
+#if BLARGG_X86_SIMD
+
+// AVX2 version of all the ym2612_update_chan<algo>::func, running channels in
+// parallel with one channel in each lane. Differences between algorithms are
+// reduced to masks that select which operator outputs feed each operator and
+// the channel output. Output is identical to running channels one at a time.
+
+// Operators in order of evaluation, as indices into channel_t::SLOT
+static int const op_slots [4] = { S0, S1, S2, S3 };
+
+// Connections between operators, for each algorithm
+enum {
+	fb_to_1  = 0x001, // op 0 (feedback) modulates op 1
+	fb_to_2  = 0x002,
+	op1_to_2 = 0x004,
+	fb_to_3  = 0x008,
+	op1_to_3 = 0x010,
+	op2_to_3 = 0x020,
+	fb_out   = 0x040, // op 0 is added to output
+	op1_out  = 0x080,
+	op2_out  = 0x100
+};
+
+static int const algo_connections [8] = {
+	fb_to_1 | op1_to_2 | op2_to_3,
+	fb_to_2 | op1_to_2 | op2_to_3,
+	op1_to_2 | fb_to_3 | op2_to_3,
+	fb_to_1 | op1_to_3 | op2_to_3,
+	fb_to_1 | op2_to_3 | op1_out,
+	fb_to_1 | fb_to_2 | fb_to_3 | op1_out | op2_out,
+	fb_to_1 | op1_out | op2_out,
+	fb_out | op1_out | op2_out
+};
+
+enum { lane_count = 8, min_avx2_channels = 3 };
+
+// Loads field from each active channel into lanes. Other lanes are zero, which
+// keeps their table indices in range and their output silent.
+#define YM_LOAD_LANES( out, expr ) \
+	{\
+		int lanes_ [lane_count] = { 0 };\
+		for ( int c = 0; c < Ym2612_Emu::channel_count; c++ )\
+		{\
+			channel_t& ch = chans [c];\
+			if ( channel_mask >> c & 1 )\
+				lanes_ [c] = (expr);\
+		}\
+		out = _mm256_loadu_si256( (__m256i const*) lanes_ );\
+	}
+
+// Sign-extended shorts from table at indices
+BLARGG_TARGET( "avx2" )
+static inline __m256i gather_shorts( short const* table, __m256i indices )
+{
+	// reads two bytes past last entry, which are still inside tables_t
+	__m256i n = _mm256_i32gather_epi32( (int const*) table, indices, 2 );
+	return _mm256_srai_epi32( _mm256_slli_epi32( n, 16 ), 16 );
+}
+
+// SINT() for each lane
+BLARGG_TARGET( "avx2" )
+static inline __m256i sin_lanes( tables_t const& g, __m256i phase, __m256i en )
+{
+	__m256i i = _mm256_and_si256( _mm256_srai_epi32( phase, SIN_LBITS ),
+			_mm256_set1_epi32( SIN_MASK ) );
+	__m256i s = gather_shorts( g.SIN_TAB, i );
+	return _mm256_i32gather_epi32( g.TL_TAB, _mm256_add_epi32( s, en ), 4 );
+}
+
+BLARGG_TARGET( "avx2" )
+void Ym2612_Impl::run_avx2( int pair_count, Ym2612_Emu::sample_t* buf, int channel_mask )
+{
+	channel_t* const chans = YM2612.CHANNEL;
+	
+	// operator state
+	__m256i Ecnt [4], Einc [4], Ecmp [4], env_xor [4], env_max [4];
+	__m256i TLL [4], AMS [4], Fcnt [4], Finc [4];
+	for ( int op = 0; op < 4; op++ )
+	{
+		int const s = op_slots [op];
+		YM_LOAD_LANES( Ecnt    [op], ch.SLOT [s].Ecnt );
+		YM_LOAD_LANES( Einc    [op], ch.SLOT [s].Einc );
+		YM_LOAD_LANES( Ecmp    [op], ch.SLOT [s].Ecmp );
+		YM_LOAD_LANES( env_xor [op], ch.SLOT [s].env_xor );
+		YM_LOAD_LANES( env_max [op], ch.SLOT [s].env_max );
+		YM_LOAD_LANES( TLL     [op], ch.SLOT [s].TLL );
+		YM_LOAD_LANES( AMS     [op], ch.SLOT [s].AMS );
+		YM_LOAD_LANES( Fcnt    [op], ch.SLOT [s].Fcnt );
+		YM_LOAD_LANES( Finc    [op], ch.SLOT [s].Finc );
+	}
+	
+	// channel state
+	__m256i out_0, out_1, FB, FMS, LEFT, RIGHT, conn;
+	YM_LOAD_LANES( out_0, ch.S0_OUT [0] );
+	YM_LOAD_LANES( out_1, ch.S0_OUT [1] );
+	YM_LOAD_LANES( FB,    ch.FB );
+	YM_LOAD_LANES( FMS,   ch.FMS );
+	YM_LOAD_LANES( LEFT,  ch.LEFT );
+	YM_LOAD_LANES( RIGHT, ch.RIGHT );
+	YM_LOAD_LANES( conn,  algo_connections [ch.ALGO] );
+	
+	#define YM_CONN( bit ) \
+		_mm256_cmpeq_epi32( _mm256_and_si256( conn, _mm256_set1_epi32( bit ) ),\
+				_mm256_set1_epi32( bit ) )
+	__m256i const fb_to_1_  = YM_CONN( fb_to_1 );
+	__m256i const fb_to_2_  = YM_CONN( fb_to_2 );
+	__m256i const op1_to_2_ = YM_CONN( op1_to_2 );
+	__m256i const fb_to_3_  = YM_CONN( fb_to_3 );
+	__m256i const op1_to_3_ = YM_CONN( op1_to_3 );
+	__m256i const op2_to_3_ = YM_CONN( op2_to_3 );
+	__m256i const fb_out_   = YM_CONN( fb_out );
+	__m256i const op1_out_  = YM_CONN( op1_out );
+	__m256i const op2_out_  = YM_CONN( op2_out );
+	#undef YM_CONN
+	
+	int const LFOinc = g.LFOinc;
+	int LFOcnt = g.LFOcnt + LFOinc;
+	
+	do
+	{
+		// envelope
+		__m256i const env_LFO = _mm256_set1_epi32(
+				g.LFO_ENV_TAB [LFOcnt >> LFO_LBITS & LFO_MASK] );
+		__m256i en [4];
+		for ( int op = 0; op < 4; op++ )
+		{
+			__m256i temp = _mm256_add_epi32( TLL [op], gather_shorts( g.ENV_TAB,
+					_mm256_srai_epi32( Ecnt [op], ENV_LBITS ) ) );
+			__m256i e = _mm256_add_epi32( _mm256_xor_si256( temp, env_xor [op] ),
+					_mm256_srav_epi32( env_LFO, AMS [op] ) );
+			en [op] = _mm256_and_si256( e, _mm256_srai_epi32(
+					_mm256_sub_epi32( temp, env_max [op] ), 31 ) );
+		}
+		
+		// feedback
+		__m256i const fb = out_0;
+		{
+			__m256i temp = _mm256_add_epi32( Fcnt [0],
+					_mm256_srav_epi32( _mm256_add_epi32( out_0, out_1 ), FB ) );
+			out_1 = out_0;
+			out_0 = sin_lanes( g, temp, en [0] );
+		}
+		
+		// operators
+		__m256i temp = _mm256_add_epi32( Fcnt [1], _mm256_and_si256( fb, fb_to_1_ ) );
+		__m256i const op1 = sin_lanes( g, temp, en [1] );
+		
+		temp = _mm256_add_epi32( Fcnt [2], _mm256_add_epi32(
+				_mm256_and_si256( fb, fb_to_2_ ), _mm256_and_si256( op1, op1_to_2_ ) ) );
+		__m256i const op2 = sin_lanes( g, temp, en [2] );
+		
+		temp = _mm256_add_epi32( _mm256_add_epi32( Fcnt [3], _mm256_and_si256( fb, fb_to_3_ ) ),
+				_mm256_add_epi32( _mm256_and_si256( op1, op1_to_3_ ),
+				_mm256_and_si256( op2, op2_to_3_ ) ) );
+		__m256i out = sin_lanes( g, temp, en [3] );
+		
+		out = _mm256_add_epi32( _mm256_add_epi32( out, _mm256_and_si256( fb, fb_out_ ) ),
+				_mm256_add_epi32( _mm256_and_si256( op1, op1_out_ ),
+				_mm256_and_si256( op2, op2_out_ ) ) );
+		out = _mm256_srai_epi32( out, MAX_OUT_BITS - output_bits + 2 );
+		
+		// update phase
+		__m256i const freq_LFO = _mm256_add_epi32( _mm256_srai_epi32( _mm256_mullo_epi32(
+				_mm256_set1_epi32( g.LFO_FREQ_TAB [LFOcnt >> LFO_LBITS & LFO_MASK] ), FMS ),
+				LFO_HBITS - 1 + 1 ), _mm256_set1_epi32( 1L << (LFO_FMS_LBITS - 1) ) );
+		LFOcnt += LFOinc;
+		for ( int op = 0; op < 4; op++ )
+			Fcnt [op] = _mm256_add_epi32( Fcnt [op], _mm256_srli_epi32(
+					_mm256_mullo_epi32( Finc [op], freq_LFO ), LFO_FMS_LBITS - 1 ) );
+		
+		// sum lanes, left and right
+		__m256i sum = _mm256_hadd_epi32( _mm256_and_si256( out, LEFT ),
+				_mm256_and_si256( out, RIGHT ) );
+		sum = _mm256_hadd_epi32( sum, sum );
+		__m128i pair = _mm_add_epi32( _mm256_castsi256_si128( sum ),
+				_mm256_extracti128_si256( sum, 1 ) );
+		buf [0] += _mm_cvtsi128_si32( pair );
+		buf [1] += _mm_cvtsi128_si32( _mm_srli_si128( pair, 4 ) );
+		buf += 2;
+		
+		// envelope
+		for ( int op = 0; op < 4; op++ )
+		{
+			Ecnt [op] = _mm256_add_epi32( Ecnt [op], Einc [op] );
+			int next = ~_mm256_movemask_ps( _mm256_castsi256_ps(
+					_mm256_cmpgt_epi32( Ecmp [op], Ecnt [op] ) ) ) & channel_mask;
+			if ( next )
+			{
+				// rare, so do it one lane at a time in original code
+				int ecnt [lane_count], einc [lane_count], ecmp [lane_count];
+				int exor [lane_count], emax [lane_count];
+				_mm256_storeu_si256( (__m256i*) ecnt, Ecnt    [op] );
+				_mm256_storeu_si256( (__m256i*) einc, Einc    [op] );
+				_mm256_storeu_si256( (__m256i*) ecmp, Ecmp    [op] );
+				_mm256_storeu_si256( (__m256i*) exor, env_xor [op] );
+				_mm256_storeu_si256( (__m256i*) emax, env_max [op] );
+				for ( int c = 0; c < Ym2612_Emu::channel_count; c++ )
+				{
+					if ( next >> c & 1 )
+					{
+						slot_t& sl = chans [c].SLOT [op_slots [op]];
+						sl.Ecnt = ecnt [c];
+						update_envelope_( &sl );
+						ecnt [c] = sl.Ecnt;
+						einc [c] = sl.Einc;
+						ecmp [c] = sl.Ecmp;
+						exor [c] = sl.env_xor;
+						emax [c] = sl.env_max;
+					}
+				}
+				Ecnt    [op] = _mm256_loadu_si256( (__m256i const*) ecnt );
+				Einc    [op] = _mm256_loadu_si256( (__m256i const*) einc );
+				Ecmp    [op] = _mm256_loadu_si256( (__m256i const*) ecmp );
+				env_xor [op] = _mm256_loadu_si256( (__m256i const*) exor );
+				env_max [op] = _mm256_loadu_si256( (__m256i const*) emax );
+			}
+		}
+	}
+	while ( --pair_count );
+	
+	// store state of active channels
+	int ecnt [4] [lane_count], fcnt [4] [lane_count];
+	int s0_out [2] [lane_count];
+	for ( int op = 0; op < 4; op++ )
+	{
+		_mm256_storeu_si256( (__m256i*) ecnt [op], Ecnt [op] );
+		_mm256_storeu_si256( (__m256i*) fcnt [op], Fcnt [op] );
+	}
+	_mm256_storeu_si256( (__m256i*) s0_out [0], out_0 );
+	_mm256_storeu_si256( (__m256i*) s0_out [1], out_1 );
+	for ( int c = 0; c < Ym2612_Emu::channel_count; c++ )
+	{
+		if ( !(channel_mask >> c & 1) )
+			continue;
+		channel_t& ch = chans [c];
+		for ( int op = 0; op < 4; op++ )
+		{
+			ch.SLOT [op_slots [op]].Ecnt = ecnt [op] [c];
+			ch.SLOT [op_slots [op]].Fcnt = fcnt [op] [c];
+		}
+		ch.S0_OUT [0] = s0_out [0] [c];
+		ch.S0_OUT [1] = s0_out [1] [c];
+	}
+}
+
+#undef YM_LOAD_LANES
+
+#endif
+
 void Ym2612_Impl::run_timer( int length )
 {
 	int const step = 6;
@@ -1307,6 +1611,32 @@ void Ym2612_Impl::run( int pair_count, Ym2612_Emu::sample_t* out )
 		}
 	}
 	
+	#if BLARGG_X86_SIMD
+		if ( avx2 )
+		{
+			int channel_mask = 0;
+			int active = 0;
+			for ( int i = 0; i < channel_count; i++ )
+			{
+				channel_t const& ch = YM2612.CHANNEL [i];
+				if ( !(mute_mask & (1 << i)) && (i != 5 || !YM2612.DAC) &&
+						channel_audible( ch, ch.ALGO ) )
+				{
+					channel_mask |= 1 << i;
+					active++;
+				}
+			}
+			
+			// with few channels, lanes are mostly idle and one at a time is faster
+			if ( active >= min_avx2_channels )
+			{
+				run_avx2( pair_count, out, channel_mask );
+				g.LFOcnt += g.LFOinc * pair_count;
+				return;
+			}
+		}
+	#endif
+	
 	for ( int i = 0; i < channel_count; i++ )
 	{
 		if ( !(mute_mask & (1 << i)) && (i != 5 || !YM2612.DAC) )
@@ -1316,4 +1646,8 @@ void Ym2612_Impl::run( int pair_count, Ym2612_Emu::sample_t* out )
 	g.LFOcnt += g.LFOinc * pair_count;
 }
 
-void Ym2612_Emu::run( int pair_count, sample_t* out ) { impl->run( pair_count, out ); }
+void Ym2612_Emu::run( int pair_count, sample_t* out )
+{
+	GME_STATS_STAGE( gme_stage_apu );
+	impl->run( pair_count, out );
+}
@@ -33,6 +33,15 @@ public:
 	typedef short sample_t;
 	enum { out_chan_count = 2 }; // stereo
 	void run( int pair_count, sample_t* out );
+	
+	// Run LFO as if pair_count samples were run with all channels muted
+	void run_lfo( long pair_count );
+	
+	// Save/restore complete chip state (excluding rates and mute mask) to/from
+	// state_size() bytes of memory. Only valid with the same set_rate() setup.
+	static long state_size();
+	void save_state( void* out ) const;
+	void load_state( void const* in );
 };
 
 #endif
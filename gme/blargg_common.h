@@ -22,6 +22,18 @@
 	#define BLARGG_RESTRICT
 #endif
 
+// BLARGG_VECTORIZE: Put before a function with loops the compiler can vectorize
+// to also compile it for AVX2 and choose which to use at run time, where
+// supported. Define as nothing in blargg_config.h to disable.
+#ifndef BLARGG_VECTORIZE
+	#if __GNUC__ >= 6 && !defined (__clang__) && defined (__GLIBC__) && \
+			(defined (__x86_64__) || defined (__i386__))
+		#define BLARGG_VECTORIZE __attribute__ ((target_clones ("avx2", "default")))
+	#else
+		#define BLARGG_VECTORIZE
+	#endif
+#endif
+
 // STATIC_CAST(T,expr): Used in place of static_cast<T> (expr)
 #ifndef STATIC_CAST
 	#define STATIC_CAST(T,expr) ((T) (expr))
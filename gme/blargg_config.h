@@ -29,6 +29,24 @@
 // Uncomment to use faster, lower quality sound synthesis
 //#define BLIP_BUFFER_FAST 1
 
+// Uncomment to only use code for the base instruction set, even where
+// AVX2 versions could be chosen at run time
+//#define BLARGG_VECTORIZE
+
+// Uncomment to disable SIMD code that is chosen at run time based on CPU
+//#define BLARGG_NO_SIMD 1
+
+// Uncomment to collect emulation counters and timers for gme_stats()
+//#define GME_STATS 1
+
+// Uncomment if threads aren't available; gme_loader_t then loads files as soon as
+// they're queued
+//#define GME_DISABLE_THREADS 1
+
+// Uncomment to have SPC MIDI conversion print the pitch found for each new sample
+// and write the sample to sampleNN.wav in the current directory
+//#define SPC_DEBUG_SAMPLES 1
+
 // Uncomment if automatic byte-order determination doesn't work
 //#define BLARGG_BIG_ENDIAN 1
 
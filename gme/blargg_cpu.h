@@ -0,0 +1,79 @@
+// CPU feature detection, for choosing SIMD code at run time
+
+// Game_Music_Emu 0.5.5
+#ifndef BLARGG_CPU_H
+#define BLARGG_CPU_H
+
+#include "blargg_common.h"
+
+// BLARGG_X86_SIMD: 1 if x86 SIMD intrinsics can be used in functions marked with
+// BLARGG_TARGET( "feature" ). Such functions must only be called if
+// blargg_cpu_has() reports that the CPU supports the feature. Define
+// BLARGG_NO_SIMD in blargg_config.h to disable.
+#if !defined (BLARGG_NO_SIMD) && (defined (__i386__) || defined (__x86_64__) || \
+		defined (_M_IX86) || defined (_M_X64))
+	#if defined (_MSC_VER) && !defined (__clang__)
+		#include <intrin.h>
+		#define BLARGG_X86_SIMD 1
+		#define BLARGG_TARGET( feature )
+	#elif __GNUC__ >= 5 || defined (__clang__)
+		#define BLARGG_X86_SIMD 1
+		#define BLARGG_TARGET( feature ) __attribute__ ((target (feature)))
+	#endif
+#endif
+
+enum {
+	blargg_cpu_sse2  = 0x01,
+	blargg_cpu_sse41 = 0x02,
+	blargg_cpu_avx2  = 0x04
+};
+
+// Set of blargg_cpu_* features supported by CPU, detected on first call
+inline int blargg_cpu_features();
+
+// True if CPU supports all features in mask
+inline bool blargg_cpu_has( int mask );
+
+// End of public interface
+
+inline int blargg_cpu_detect_()
+{
+	int features = 0;
+	#if BLARGG_X86_SIMD && defined (_MSC_VER) && !defined (__clang__)
+		int info [4];
+		__cpuid( info, 0 );
+		int max_leaf = info [0];
+		__cpuid( info, 1 );
+		if ( info [3] & (1 << 26) )
+			features |= blargg_cpu_sse2;
+		if ( info [2] & (1 << 19) )
+			features |= blargg_cpu_sse41;
+		
+		// AVX2 also needs OS to save YMM registers
+		if ( max_leaf >= 7 && (info [2] & (1 << 27)) && (_xgetbv( 0 ) & 6) == 6 )
+		{
+			__cpuidex( info, 7, 0 );
+			if ( info [1] & (1 << 5) )
+				features |= blargg_cpu_avx2;
+		}
+	#elif BLARGG_X86_SIMD
+		__builtin_cpu_init();
+		if ( __builtin_cpu_supports( "sse2" ) )
+			features |= blargg_cpu_sse2;
+		if ( __builtin_cpu_supports( "sse4.1" ) )
+			features |= blargg_cpu_sse41;
+		if ( __builtin_cpu_supports( "avx2" ) )
+			features |= blargg_cpu_avx2;
+	#endif
+	return features;
+}
+
+inline int blargg_cpu_features()
+{
+	static int const features = blargg_cpu_detect_();
+	return features;
+}
+
+inline bool blargg_cpu_has( int mask ) { return (blargg_cpu_features() & mask) == mask; }
+
+#endif
@@ -0,0 +1,76 @@
+// Jump-ahead for linear feedback shift registers, for advancing noise generators
+// over long silent spans without running them step by step
+
+// Game_Music_Emu 0.5.5
+#ifndef BLARGG_LFSR_H
+#define BLARGG_LFSR_H
+
+#include "blargg_common.h"
+
+// Powers of two of an LFSR's transition matrix over GF(2). Running n steps takes
+// one matrix-vector product per set bit of n.
+class Blargg_Lfsr_Jump {
+public:
+	Blargg_Lfsr_Jump() { width = 0; }
+	
+	// Build for LFSR whose states fit in low 'width' bits and whose single step
+	// is step( state ). Step must be linear: step( a ^ b ) == step( a ) ^ step( b ).
+	template<class Step>
+	void init( Step step, int width );
+	
+	// Same as init(), so a table shared by all instances can be a function-local
+	// static, which is built only once even with several threads
+	template<class Step>
+	Blargg_Lfsr_Jump( Step step, int width ) { init( step, width ); }
+	
+	// True if init() has been called
+	bool initialized() const { return width != 0; }
+	
+	// State after running n steps from state. Bits of state above width are ignored.
+	blargg_ulong run( blargg_ulong state, blargg_ulong n ) const;
+	
+private:
+	enum { max_width = 32 };
+	enum { max_powers = 32 };
+	int width;
+	blargg_ulong powers [max_powers] [max_width]; // [k] [i] = bit i after 2^k steps
+	
+	static blargg_ulong mul( blargg_ulong const* matrix, blargg_ulong state );
+};
+
+// End of public interface
+
+inline blargg_ulong Blargg_Lfsr_Jump::mul( blargg_ulong const* m, blargg_ulong s )
+{
+	blargg_ulong out = 0;
+	for ( ; s; s >>= 1, m++ )
+		out ^= *m & (0 - (s & 1));
+	return out;
+}
+
+template<class Step>
+void Blargg_Lfsr_Jump::init( Step step, int new_width )
+{
+	assert( 0 < new_width && new_width <= max_width );
+	blargg_ulong const mask = ((blargg_ulong) 2 << (new_width - 1)) - 1;
+	for ( int i = 0; i < new_width; i++ )
+		powers [0] [i] = step( (blargg_ulong) 1 << i ) & mask;
+	for ( int k = 1; k < max_powers; k++ )
+		for ( int i = 0; i < new_width; i++ )
+			powers [k] [i] = mul( powers [k - 1], powers [k - 1] [i] );
+	width = new_width;
+}
+
+inline blargg_ulong Blargg_Lfsr_Jump::run( blargg_ulong state, blargg_ulong n ) const
+{
+	assert( initialized() );
+	state &= ((blargg_ulong) 2 << (width - 1)) - 1;
+	for ( blargg_ulong const (*p) [max_width] = powers; n; n >>= 1, p++ )
+	{
+		if ( n & 1 )
+			state = mul( *p, state );
+	}
+	return state;
+}
+
+#endif
@@ -0,0 +1,57 @@
+// Field-by-field copying of emulation state to and from a flat block of memory
+
+// Game_Music_Emu 0.5.5
+#ifndef BLARGG_STATE_H
+#define BLARGG_STATE_H
+
+#include "blargg_common.h"
+#include <string.h>
+
+// Passed to copy_state( Blargg_State_Copier& ) functions, which pass each of their
+// fields to it in a fixed order. The same function measures, saves, and loads
+// state, so they can't get out of sync. Variable-sized data copies its size first,
+// so that a load can resize it before copying its contents.
+class Blargg_State_Copier {
+public:
+	enum mode_t { measure, save, load };
+	
+	// Measure size of state, save state to data, or load state from data
+	Blargg_State_Copier( mode_t, void* data = 0 );
+	
+	mode_t mode() const     { return mode_; }
+	bool loading() const    { return mode_ == load; }
+	
+	// Copy size bytes at p. When loading, a NULL p skips the bytes.
+	void copy( void* p, long size );
+	
+	// Copy object
+	template<class T>
+	void operator () ( T& t ) { copy( &t, sizeof t ); }
+	
+	// Number of bytes copied so far
+	long size() const       { return pos; }
+	
+private:
+	mode_t mode_;
+	BOOST::uint8_t* data;
+	long pos;
+};
+
+inline Blargg_State_Copier::Blargg_State_Copier( mode_t m, void* d ) :
+	mode_( m ),
+	data( (BOOST::uint8_t*) d ),
+	pos( 0 )
+{
+	assert( d || m == measure );
+}
+
+inline void Blargg_State_Copier::copy( void* p, long size )
+{
+	if ( mode_ == save )
+		memcpy( data + pos, p, size );
+	else if ( mode_ == load && p )
+		memcpy( p, data + pos, size );
+	pos += size;
+}
+
+#endif
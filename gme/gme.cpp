@@ -6,6 +6,7 @@
 #if !GME_DISABLE_STEREO_DEPTH
 #include "Effects_Buffer.h"
 #endif
+#include "Shared_Rom.h"
 #include "blargg_endian.h"
 #include <string.h>
 #include <ctype.h>
@@ -150,6 +151,30 @@ BLARGG_EXPORT gme_err_t gme_open_data( void const* data, long size, Music_Emu**
 	return err;
 }
 
+BLARGG_EXPORT gme_err_t gme_open_rom( gme_rom_t* rom, Music_Emu** out, int sample_rate )
+{
+	require( rom && out );
+	*out = 0;
+	
+	gme_type_t file_type = 0;
+	if ( rom->size() >= 4 )
+		file_type = gme_identify_extension( gme_identify_header( rom->data() ) );
+	if ( !file_type )
+		return gme_wrong_file_type;
+	
+	Music_Emu* emu = gme_new_emu( file_type, sample_rate );
+	CHECK_ALLOC( emu );
+	
+	gme_err_t err = emu->load_shared( rom );
+	
+	if ( err )
+		delete emu;
+	else
+		*out = emu;
+	
+	return err;
+}
+
 BLARGG_EXPORT gme_err_t gme_open_file( const char* path, Music_Emu** out, int sample_rate )
 {
 	require( path && out );
@@ -220,6 +245,141 @@ BLARGG_EXPORT Music_Emu* gme_new_emu( gme_type_t type, int rate )
 	return 0;
 }
 
+// Emulator pools
+
+struct gme_pool_t
+{
+	gme_type_t type;
+	int sample_rate;
+	int idle_count;
+	blargg_vector<Music_Emu*> idle;
+	Music_Emu::equalizer_t eq;
+	
+	BLARGG_DISABLE_NOTHROW
+};
+
+BLARGG_EXPORT gme_pool_t* gme_pool_create( gme_type_t type, int rate, int count )
+{
+	require( type && rate != gme_info_only && count >= 0 );
+	
+	gme_pool_t* pool = BLARGG_NEW gme_pool_t;
+	if ( !pool )
+		return 0;
+	
+	pool->type        = type;
+	pool->sample_rate = rate;
+	pool->idle_count  = 0;
+	if ( !pool->idle.resize( count ) )
+	{
+		// equalizer restored on release is the type's default, which differs
+		// between types, so it's taken from an emulator even if count is 0
+		Music_Emu* me = gme_new_emu( type, rate );
+		if ( me )
+		{
+			pool->eq = me->equalizer();
+			if ( count )
+				pool->idle [pool->idle_count++] = me;
+			else
+				delete me;
+			
+			while ( pool->idle_count < count )
+			{
+				me = gme_new_emu( type, rate );
+				if ( !me )
+					break;
+				pool->idle [pool->idle_count++] = me;
+			}
+			if ( pool->idle_count == count )
+				return pool;
+		}
+	}
+	
+	gme_pool_delete( pool );
+	return 0;
+}
+
+// Takes idle emulator from pool, or creates new one. Returns NULL if out of memory.
+static Music_Emu* pool_take( gme_pool_t* pool )
+{
+	if ( pool->idle_count )
+		return pool->idle [--pool->idle_count];
+	
+	return gme_new_emu( pool->type, pool->sample_rate );
+}
+
+// Returns emulator to pool if loading failed, otherwise sets *out to it
+static gme_err_t pool_loaded( gme_pool_t* pool, Music_Emu* me, gme_err_t err, Music_Emu** out )
+{
+	if ( err )
+	{
+		gme_pool_release( pool, me );
+		return err;
+	}
+	
+	*out = me;
+	return 0;
+}
+
+BLARGG_EXPORT gme_err_t gme_pool_acquire( gme_pool_t* pool, void const* data, long size, Music_Emu** out )
+{
+	require( pool && (data || !size) && out );
+	*out = 0;
+	
+	Music_Emu* me = pool_take( pool );
+	CHECK_ALLOC( me );
+	
+	return pool_loaded( pool, me, gme_load_data( me, data, size ), out );
+}
+
+BLARGG_EXPORT gme_err_t gme_pool_acquire_rom( gme_pool_t* pool, gme_rom_t* rom, Music_Emu** out )
+{
+	require( pool && rom && out );
+	*out = 0;
+	
+	Music_Emu* me = pool_take( pool );
+	CHECK_ALLOC( me );
+	
+	return pool_loaded( pool, me, me->load_shared( rom ), out );
+}
+
+BLARGG_EXPORT void gme_pool_release( gme_pool_t* pool, Music_Emu* me )
+{
+	require( pool );
+	if ( !me )
+		return;
+	
+	check( me->type() == pool->type );
+	if ( (size_t) pool->idle_count >= pool->idle.size() )
+	{
+		delete me;
+		return;
+	}
+	
+	// restore defaults, but leave loaded data and buffers allocated for reuse
+	me->set_user_cleanup( 0 );
+	me->set_user_data( 0 );
+	me->ignore_silence( false );
+	me->set_tempo( 1.0 );
+	me->mute_voices( 0 );
+	me->enable_accuracy( false );
+	me->set_equalizer( pool->eq );
+	gme_set_stereo_depth( me, 0.0 );
+	me->enable_loudness( false );
+	me->set_length_cache( 0 );
+	
+	pool->idle [pool->idle_count++] = me;
+}
+
+BLARGG_EXPORT void gme_pool_delete( gme_pool_t* pool )
+{
+	if ( pool )
+	{
+		while ( pool->idle_count )
+			delete pool->idle [--pool->idle_count];
+		delete pool;
+	}
+}
+
 BLARGG_EXPORT gme_err_t gme_load_file( Music_Emu* me, const char* path ) { return me->load_file( path ); }
 
 BLARGG_EXPORT gme_err_t gme_load_data( Music_Emu* me, void const* data, long size )
@@ -234,6 +394,31 @@ BLARGG_EXPORT gme_err_t gme_load_custom( Music_Emu* me, gme_reader_t func, long
 	return me->load( in );
 }
 
+BLARGG_EXPORT gme_err_t gme_rom_load_file( const char* path, gme_rom_t** out )
+{
+	require( path && out );
+	*out = 0;
+	
+	GME_FILE_READER in;
+	RETURN_ERR( in.open( path ) );
+	return Shared_Rom::load( in, out );
+}
+
+BLARGG_EXPORT gme_err_t gme_rom_load_data( void const* data, long size, gme_rom_t** out )
+{
+	require( (data || !size) && out );
+	Mem_File_Reader in( data, size );
+	return Shared_Rom::load( in, out );
+}
+
+BLARGG_EXPORT gme_err_t gme_load_rom( Music_Emu* me, gme_rom_t* rom ) { return me->load_shared( rom ); }
+
+BLARGG_EXPORT void gme_rom_release( gme_rom_t* rom )
+{
+	if ( rom )
+		rom->release();
+}
+
 BLARGG_EXPORT void gme_delete( Music_Emu* me ) { delete me; }
 
 BLARGG_EXPORT gme_type_t gme_type( Music_Emu const* me ) { return me->type(); }
@@ -315,6 +500,34 @@ BLARGG_EXPORT gme_err_t gme_track_info( Music_Emu const* me, gme_info_t** out, i
 	return 0;
 }
 
+BLARGG_EXPORT gme_err_t gme_length_cache_new( gme_length_cache_t** out )
+{
+	return Track_Cache::create( out );
+}
+
+BLARGG_EXPORT gme_err_t gme_length_cache_load( gme_length_cache_t* cache, const char* path )
+{
+	return cache->load_file( path );
+}
+
+BLARGG_EXPORT gme_err_t gme_length_cache_save( gme_length_cache_t* cache, const char* path )
+{
+	return cache->save_file( path );
+}
+
+BLARGG_EXPORT long gme_length_cache_count( gme_length_cache_t const* cache ) { return cache->count(); }
+
+BLARGG_EXPORT void gme_use_length_cache( Music_Emu* me, gme_length_cache_t* cache ) { me->set_length_cache( cache ); }
+
+BLARGG_EXPORT gme_err_t gme_cached_length( Music_Emu const* me, int track, gme_track_length_t* out )
+{
+	if ( !me->cached_length( track, out ) )
+		return "Track length not in cache";
+	return 0;
+}
+
+BLARGG_EXPORT void gme_length_cache_delete( gme_length_cache_t* cache ) { delete cache; }
+
 BLARGG_EXPORT void gme_free_info( gme_info_t* info )
 {
 	delete STATIC_CAST(gme_info_t_*,info);
@@ -324,7 +537,35 @@ BLARGG_EXPORT void gme_set_stereo_depth( Music_Emu* me, double depth )
 {
 #if !GME_DISABLE_STEREO_DEPTH
 	if ( me->effects_buffer )
+	{
 		STATIC_CAST(Effects_Buffer*,me->effects_buffer)->set_depth( depth );
+		me->stereo_depth_ = depth; // start states are only used at depth recorded with
+	}
+#endif
+}
+
+// gme_stats_t has fixed room for each stage and chip
+BOOST_STATIC_ASSERT( gme_stage_count <= 16 && gme_chip_count <= 16 );
+
+BLARGG_EXPORT gme_err_t gme_stats( Music_Emu const* me, gme_stats_t* out )
+{
+#ifdef GME_STATS
+	*out = me->stats();
+	out->ticks_per_sec = gme_stats_time_rate();
+	return 0;
+#else
+	(void) me;
+	memset( out, 0, sizeof *out );
+	return "Library was built without GME_STATS";
+#endif
+}
+
+BLARGG_EXPORT void gme_clear_stats( Music_Emu* me )
+{
+#ifdef GME_STATS
+	me->clear_stats();
+#else
+	(void) me;
 #endif
 }
 
@@ -345,6 +586,12 @@ BLARGG_EXPORT void      gme_mute_voice     ( Music_Emu* me, int index, int mute
 BLARGG_EXPORT void      gme_mute_voices    ( Music_Emu* me, int mask )            { me->mute_voices( mask ); }
 BLARGG_EXPORT void      gme_enable_accuracy( Music_Emu* me, int enabled )         { me->enable_accuracy( enabled ); }
 BLARGG_EXPORT void      gme_clear_playlist ( Music_Emu* me )                      { me->clear_playlist(); }
+BLARGG_EXPORT gme_err_t gme_record_start_states( Music_Emu* me )                  { return me->record_start_states(); }
+BLARGG_EXPORT gme_err_t gme_take_start_states( Music_Emu* me, Music_Emu* src )    { return me->take_start_states( *src ); }
+BLARGG_EXPORT gme_err_t gme_enable_loudness( Music_Emu* me, int enable )          { return me->enable_loudness( enable != 0 ); }
+BLARGG_EXPORT gme_err_t gme_track_loudness ( Music_Emu const* me, gme_loudness_t* out ) { return me->loudness( out ); }
+BLARGG_EXPORT gme_err_t gme_set_extra_rates( Music_Emu* me, long const* r, int n ) { return me->set_extra_rates( r, n ); }
+BLARGG_EXPORT int       gme_play_extra     ( Music_Emu* me, int i, int n, short* p ) { return me->play_extra( i, n, p ); }
 BLARGG_EXPORT int       gme_type_multitrack( gme_type_t t )                       { return t->track_count != 1; }
 
 BLARGG_EXPORT void      gme_set_equalizer  ( Music_Emu* me, gme_equalizer_t const* eq )
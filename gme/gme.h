@@ -77,7 +77,8 @@ void gme_free_info( gme_info_t* );
 struct gme_info_t
 {
 	/* times in milliseconds; -1 if unknown */
-	int length;			/* total length, if file specifies it */
+	int length;			/* total length, if file specifies it or it was measured (see
+	                       gme_use_length_cache()) */
 	int intro_length;	/* length of song up to looping section */
 	int loop_length;	/* length of looping section */
 	
@@ -145,6 +146,31 @@ void gme_set_equalizer( Music_Emu*, gme_equalizer_t const* eq );
 /* Enables/disables most accurate sound emulation options */
 void gme_enable_accuracy( Music_Emu*, int enabled );
 
+/* Record state just after starting each track in the playlist, so that starting
+one of those tracks later restores it instead of running the track's init code and
+initial silence scan. Changing tempo, muting, equalizer, stereo depth or silence
+detection makes later starts normal again. Stops current track. GYM and VGM don't support this, and
+changing accuracy of an SPC emulator discards its states. */
+gme_err_t gme_record_start_states( Music_Emu* );
+
+/* Move start states recorded by src into dest. Both must be the same type and
+sample rate and have the same file data loaded, otherwise an error is returned.
+Allows recording them on a background thread using a second emulator. */
+gme_err_t gme_take_start_states( Music_Emu* dest, Music_Emu* src );
+
+/* Also generate output at up to gme_max_extra_rates other sample rates from the same
+emulation, so that rendering a track at several rates emulates it only once. Must be
+called after loading a file; loading another file removes them. Stops current track.
+Output is plain stereo, without stereo depth. Not supported by GYM, SPC, or VGM using
+FM sound chips. A count of 0 removes them. */
+enum { gme_max_extra_rates = 4 };
+gme_err_t gme_set_extra_rates( Music_Emu*, long const rates [], int count );
+
+/* Read at most count samples at extra rate 'index' (0 is first), covering the part
+of the track gme_play() has generated so far, with the same fade. Returns number of
+samples read. Unread samples are discarded by seeking or starting a track. */
+int gme_play_extra( Music_Emu*, int index, int count, short out [] );
+
 
 /******** Game music types ********/
 
@@ -218,6 +244,286 @@ gme_err_t gme_load_custom( Music_Emu*, gme_reader_t, long file_size, void* your_
 gme_err_t gme_load_m3u_data( Music_Emu*, void const* data, long size );
 
 
+/******** Shared playlists ********/
+
+/* M3U playlist loaded once and used by any number of emulators, for playlists that
+cover many music files. Also has a compact binary form that loads without parsing. */
+typedef struct gme_playlist_t gme_playlist_t;
+
+/* Load m3u playlist from file or memory. Sets *out to NULL on error. */
+gme_err_t gme_playlist_load( const char path [], gme_playlist_t** out );
+gme_err_t gme_playlist_load_data( void const* data, long size, gme_playlist_t** out );
+
+/* Load binary form written by gme_playlist_save_index() */
+gme_err_t gme_playlist_load_index( void const* data, long size, gme_playlist_t** out );
+
+/* Size of binary form, and write it to out, which must hold that many bytes */
+long gme_playlist_index_size( gme_playlist_t const* );
+void gme_playlist_save_index( gme_playlist_t const*, void* out );
+
+/* Use entries of playlist for file, as named in the playlist, as if they were
+loaded with gme_load_m3u(). Must be done after loading music. Playlist must not be
+deleted until gme_clear_playlist() is called or another file is loaded. */
+gme_err_t gme_use_playlist( Music_Emu*, gme_playlist_t const*, const char file [] );
+
+/* Delete playlist */
+void gme_playlist_delete( gme_playlist_t* );
+
+
+/******** Shared file data ********/
+
+/* Music file data loaded once and used by any number of emulators without each
+making its own copy, for playing the same file many times at once. Emulators loaded
+from it keep a reference, so it can be released as soon as they are loaded; it is
+deleted once it's released and no emulator uses it. Emulators using it can be on
+different threads, except when the library was built with GME_DISABLE_THREADS by a
+compiler that lacks atomic operations. */
+typedef struct Shared_Rom gme_rom_t;
+
+/* Load music file data from file or memory, with one reference. Sets *out to NULL
+on error. */
+gme_err_t gme_rom_load_file( const char path [], gme_rom_t** out );
+gme_err_t gme_rom_load_data( void const* data, long size, gme_rom_t** out );
+
+/* Load shared data into emulator */
+gme_err_t gme_load_rom( Music_Emu*, gme_rom_t* );
+
+/* Create new emulator of type determined by header of shared data, set its sample
+rate and load data into it. Sets *out to NULL on error. */
+gme_err_t gme_open_rom( gme_rom_t*, Music_Emu** out, int sample_rate );
+
+/* Release reference to shared data. Does nothing if NULL. */
+void gme_rom_release( gme_rom_t* );
+
+
+/******** Emulator pools ********/
+
+/* Pool of preallocated emulators of one type and sample rate. Acquiring an emulator
+loads new file data into an idle one, reusing its sound buffers and file data
+allocation, so that once every emulator in the pool has been used, opening a file of
+similar size doesn't allocate memory. A pool is not thread-safe; serialize calls
+to it if it's shared between threads. */
+typedef struct gme_pool_t gme_pool_t;
+
+/* Create pool of 'count' emulators of given type at given sample rate. Returns NULL
+if out of memory. */
+gme_pool_t* gme_pool_create( gme_type_t, int sample_rate, int count );
+
+/* Take idle emulator from pool (or create a new one if none are idle) and load file
+data into it. Makes a copy of data. Sets *out to the emulator. */
+gme_err_t gme_pool_acquire( gme_pool_t*, void const* data, long size, Music_Emu** out );
+
+/* Same as gme_pool_acquire(), but loads shared data without copying it. Released
+emulators keep their reference until acquired again or deleted. */
+gme_err_t gme_pool_acquire_rom( gme_pool_t*, gme_rom_t*, Music_Emu** out );
+
+/* Return emulator to pool. Restores tempo, muting, accuracy, silence detection,
+equalizer and stereo depth to their defaults, stops loudness measurement and use of
+any length cache, and clears user data without calling the cleanup function. Deletes
+emulator if pool is already full. */
+void gme_pool_release( gme_pool_t*, Music_Emu* );
+
+/* Delete pool and all idle emulators in it. Emulators still acquired must be
+deleted with gme_delete() instead of being released. */
+void gme_pool_delete( gme_pool_t* );
+
+
+/******** Background loading ********/
+
+/* Opens music files on a pool of threads, so that reading and parsing them doesn't
+block the caller. Each finished request waits in a queue until the caller collects
+it with gme_loader_poll() or gme_loader_wait(), which call the request's callback
+on the calling thread. If the library was built with GME_DISABLE_THREADS, files are
+instead loaded as soon as they're queued. */
+typedef struct gme_loader_t gme_loader_t;
+
+/* Called for each finished request. Takes ownership of emu, which is NULL if error
+isn't. Index is the path's position in gme_open_batch(), or 0 for gme_open_async(). */
+typedef void (*gme_loaded_t)( void* user_data, int index, Music_Emu* emu, gme_err_t error );
+
+/* Create loader that uses thread_count threads. Returns NULL if out of memory or no
+threads could be started. */
+gme_loader_t* gme_loader_create( int thread_count );
+
+/* If enabled, each emulator loaded from requests queued after this also records
+its start states as by gme_record_start_states(), so that the first start of each
+track is fast too. Recording takes as long as starting every track, and counts
+as parsing in gme_loader_stats(). Types without start states load normally.
+Disabled by default. */
+void gme_loader_record_start_states( gme_loader_t*, int enabled );
+
+/* Queue music file to be opened as by gme_open_file(), except that the type is
+determined from the file's header first, then from its extension. */
+gme_err_t gme_open_async( gme_loader_t*, const char path [], int sample_rate,
+		gme_loaded_t, void* user_data );
+
+/* Queue count files at once. Either all are queued or, on error, none are. */
+gme_err_t gme_open_batch( gme_loader_t*, const char* const paths [], int count,
+		int sample_rate, gme_loaded_t, void* user_data );
+
+/* Call callbacks of finished requests. Returns number of callbacks made. */
+int gme_loader_poll( gme_loader_t* );
+
+/* Same as gme_loader_poll(), but first waits for a request to finish if none have
+and any are still queued or loading */
+int gme_loader_wait( gme_loader_t* );
+
+/* Number of requests whose callbacks haven't been called yet */
+int gme_loader_pending( gme_loader_t* );
+
+/* Histograms of load times. Bucket i counts loads whose time in microseconds was
+from 2^i to 2^(i+1) - 1; bucket 0 also counts 0 and 1, and the last bucket counts
+all longer times. */
+enum { gme_latency_buckets = 24 };
+typedef struct gme_loader_stats_t
+{
+	long loaded;                        /* requests that succeeded */
+	long failed;                        /* requests that failed */
+	long queued [gme_latency_buckets];  /* time waiting for a thread */
+	long read   [gme_latency_buckets];  /* time reading file */
+	long parse  [gme_latency_buckets];  /* time creating emulator and loading file */
+	long total  [gme_latency_buckets];  /* time from queueing to finishing */
+} gme_loader_stats_t;
+
+/* Get statistics for all requests finished so far */
+void gme_loader_stats( gme_loader_t*, gme_loader_stats_t* out );
+
+/* Wait for requests being loaded to finish, then delete loader. Callbacks aren't
+called; emulators not yet collected are deleted, and requests not yet started are
+dropped. */
+void gme_loader_delete( gme_loader_t* );
+
+
+/******** Track length cache ********/
+
+/* Lengths of tracks measured during playback, keyed by a hash of the music file's
+contents and the track number. When an emulator using a cache plays a track until it
+ends by itself rather than by fading out, the track's length is added to the cache.
+From then on, gme_track_info() gives that length for the track when the file and its
+playlist don't specify one, in any emulator using the cache with the same file loaded.
+Can be used by emulators on different threads at once, and saved to a file that
+several processes share. */
+typedef struct Track_Cache gme_length_cache_t;
+
+typedef struct gme_track_length_t
+{
+	/* times in milliseconds, at a tempo of 1.0 */
+	int length;         /* time track ended, including any silence before end was detected */
+	int intro_length;   /* as given by file when track was played; -1 if unknown */
+	int loop_length;
+	int silence_start;  /* time silence at end began; -1 if silence detection was off */
+} gme_track_length_t;
+
+/* Create empty cache. Sets *out to NULL on error. */
+gme_err_t gme_length_cache_new( gme_length_cache_t** out );
+
+/* Add tracks from file written by gme_length_cache_save(), keeping ones already in
+cache */
+gme_err_t gme_length_cache_load( gme_length_cache_t*, const char path [] );
+
+/* Add tracks from file if it exists, then replace file with all tracks in cache.
+Other processes loading the file never see it partly written. */
+gme_err_t gme_length_cache_save( gme_length_cache_t*, const char path [] );
+
+/* Number of tracks in cache */
+long gme_length_cache_count( gme_length_cache_t const* );
+
+/* Use cache for emulator, or stop using one if NULL. Can be set before or after
+loading a file. Cache must not be deleted while any emulator uses it. */
+void gme_use_length_cache( Music_Emu*, gme_length_cache_t* );
+
+/* Get length of track in emulator's cache. Returns error if it isn't there. */
+gme_err_t gme_cached_length( Music_Emu const*, int track, gme_track_length_t* out );
+
+/* Delete cache. Does nothing if NULL. */
+void gme_length_cache_delete( gme_length_cache_t* );
+
+
+/******** Loudness ********/
+
+/* Loudness and peak levels of output played since track was started */
+typedef struct gme_loudness_t
+{
+	double integrated;      /* EBU R128 gated loudness, in LUFS; -HUGE_VAL if silent */
+	double range;           /* loudness range (LRA), in LU */
+	double momentary_max;   /* loudest 400 ms, in LUFS */
+	double short_term_max;  /* loudest 3 seconds, in LUFS */
+	double replay_gain;     /* gain in dB to make integrated loudness -18 LUFS */
+	double sample_peak;     /* highest absolute sample, where 1.0 is full scale */
+	double true_peak;       /* highest absolute level between samples, 4x oversampled */
+	long clipped;           /* samples at full scale, which were most likely clipped */
+	long samples;           /* sample pairs measured */
+} gme_loudness_t;
+
+/* Enable/disable measuring loudness of output from gme_play(). Measurement restarts
+with each track. Skipped and seeked-over output isn't measured. */
+gme_err_t gme_enable_loudness( Music_Emu*, int enable );
+
+/* Get loudness of current track's output so far. Returns error if not enabled. */
+gme_err_t gme_track_loudness( Music_Emu const*, gme_loudness_t* out );
+
+
+/******** Statistics ********/
+
+/* Stages that emulation time is divided into. Time in a stage excludes time in
+any stage called from it (CPU emulation excludes the sound chips it writes to).
+New stages and chips are only added at the end, just before the count. */
+enum {
+	gme_stage_cpu,      /* CPU or command stream interpretation */
+	gme_stage_apu,      /* sound chip emulation, including Blip_Synth additions */
+	gme_stage_mix,      /* Blip_Buffer and Multi_Buffer mixing */
+	gme_stage_resample, /* Fir_Resampler */
+	gme_stage_filter,   /* SPC output filter */
+	gme_stage_silence,  /* scanning output for silence */
+	gme_stage_fade,     /* fading out */
+	gme_stage_other,    /* everything else done while playing/seeking */
+	gme_stage_loudness, /* loudness and peak measurement */
+	gme_stage_count
+};
+
+/* Sound chips that register writes are counted for */
+enum {
+	gme_chip_nes_apu, gme_chip_vrc6, gme_chip_fme7, gme_chip_namco,
+	gme_chip_ay, gme_chip_scc, gme_chip_sms_psg, gme_chip_ym2612, gme_chip_ym2413,
+	gme_chip_gb_apu, gme_chip_hes_apu, gme_chip_sap_apu, gme_chip_spc_dsp,
+	gme_chip_count
+};
+
+typedef unsigned long long gme_counter_t;
+
+/* Arrays have room for stages and chips added later, and new counters are taken from
+the reserved ones, so the structure's size and layout never change */
+typedef struct gme_stats_t
+{
+	gme_counter_t ticks [16];       /* timer ticks spent in each gme_stage_* */
+	double ticks_per_sec;           /* approximate rate of timer ticks */
+	
+	gme_counter_t clocks;           /* clocks emulated (CPU clock, or Blip_Buffer clock) */
+	gme_counter_t writes [16];      /* register writes to each gme_chip_* */
+	gme_counter_t impulses;         /* amplitude changes added to Blip_Buffers */
+	gme_counter_t resampler_in;     /* samples read by resampler */
+	gme_counter_t resampler_out;    /* samples written by resampler */
+	gme_counter_t samples;          /* samples played */
+	gme_counter_t lookahead;        /* samples generated ahead for silence detection */
+	gme_counter_t lookahead_silent; /* ...that were silent, so replaced with zeroes */
+	gme_counter_t brr_cache_hits;   /* SPC sample blocks reused already decoded */
+	gme_counter_t brr_cache_misses; /* ...and decoded */
+	gme_counter_t idle_clocks [16]; /* oscillator clocks each gme_chip_* skipped while
+	                                   silent or muted */
+	
+	gme_counter_t reserved [16];
+} gme_stats_t;
+
+/* Get counters and timers collected since emulator was created or they were cleared.
+Only available if library was built with GME_STATS defined, otherwise returns error and
+sets all to zero. Collection has a small cost, so only enable it when profiling. Don't
+call while another thread is playing the emulator. */
+gme_err_t gme_stats( Music_Emu const*, gme_stats_t* out );
+
+/* Clear counters and timers */
+void gme_clear_stats( Music_Emu* );
+
+
 /******** User data ********/
 
 /* Set/get pointer to data you want to associate with this emulator.
@@ -2,6 +2,7 @@
 
 #include "Music_Player.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -37,15 +38,59 @@ static void sound_start();
 static void sound_stop();
 static void sound_cleanup();
 
+// Threads, mutexes and atomic access using SDL
+typedef int (*thread_func_t)( void* data );
+static void* thread_start( thread_func_t, const char* name, void* data );
+static void thread_wait( void* thread );
+static void thread_sleep( int msec );
+static void* mutex_new();
+static void mutex_delete( void* );
+static void mutex_lock( void* );
+static void mutex_unlock( void* );
+static void* atomic_get( void* volatile* p );
+static void atomic_set( void* volatile* p, void* value );
+static int atomic_get_int( int const volatile* p );
+static void atomic_set_int( int volatile* p, int value );
+
 Music_Player::Music_Player()
 {
-	emu_        = 0;
-	scope_buf   = 0;
-	paused      = false;
-	track_info_ = NULL;
+	emu_          = 0;
+	scope_buf     = 0;
+	paused        = false;
+	track_info_   = NULL;
+	path_         = NULL;
+	tempo_        = 1.0;
+	stereo_depth_ = 0.0;
+	accuracy_     = false;
+	mute_mask_    = 0;
+	track_        = -1;
+	track_pos     = 0;
+	track_end     = 0;
+	buf           = NULL;
+	buf_pos       = 0;
+	buf_count     = 0;
+	next.emu      = NULL;
+	next.info     = NULL;
+	next.buf      = NULL;
+	next.track    = -1;
+	next_thread   = NULL;
+	next_ready    = NULL;
+	pre_size      = 0;
+	old_emu       = NULL;
+	old_info      = NULL;
+	ring          = NULL;
+	ring_size_    = 0;
+	render_size   = 0;
+	write_pos     = 0;
+	read_pos      = 0;
+	underruns     = 0;
+	underrun_samples_ = 0;
+	render_thread = NULL;
+	render_mutex  = NULL;
+	render_quit   = 0;
 }
 
-gme_err_t Music_Player::init( long rate )
+gme_err_t Music_Player::init( long rate, int lookahead_msec )
 {
 	sample_rate = rate;
 	
@@ -54,29 +99,71 @@ gme_err_t Music_Player::init( long rate )
 	while ( buf_size < min_size )
 		buf_size *= 2;
 	
-	return sound_init( sample_rate, buf_size, fill_buffer, this );
+	// next track gets two callbacks worth of samples rendered in advance
+	pre_size = buf_size * 2 * 2;
+	buf      = (sample_t*) malloc( pre_size * sizeof *buf );
+	next.buf = (sample_t*) malloc( pre_size * sizeof *buf );
+	if ( !buf || !next.buf )
+		return "Out of memory";
+	
+	// Ring holds lookahead rounded up to a power of 2, and at least two callbacks
+	// worth. It's filled a quarter at a time.
+	long lookahead = sample_rate * 2 * lookahead_msec / 1000;
+	if ( lookahead < buf_size * 2 * 2 )
+		lookahead = buf_size * 2 * 2;
+	ring_size_ = 512;
+	while ( ring_size_ < lookahead )
+		ring_size_ *= 2;
+	render_size = ring_size_ / 4;
+	ring = (sample_t*) malloc( ring_size_ * sizeof *ring );
+	if ( !ring )
+		return "Out of memory";
+	
+	render_mutex = mutex_new();
+	if ( !render_mutex )
+		return "Couldn't create mutex";
+	
+	RETURN_ERR( sound_init( sample_rate, buf_size, fill_buffer, this ) );
+	
+	render_thread = thread_start( render_thread_func, "gme render", this );
+	if ( !render_thread )
+		return "Couldn't start thread";
+	
+	return 0;
 }
 
 void Music_Player::stop()
 {
 	sound_stop();
+	cancel_next();
+	free_old();
+	lock();
 	gme_delete( emu_ );
-	emu_ = NULL;
+	emu_   = NULL;
+	atomic_set_int( &track_, -1 );
+	flush_ring();
+	unlock();
 }
 
 Music_Player::~Music_Player()
 {
 	stop();
+	if ( render_thread )
+	{
+		atomic_set_int( &render_quit, 1 );
+		thread_wait( render_thread );
+	}
 	sound_cleanup();
+	mutex_delete( render_mutex );
 	gme_free_info( track_info_ );
+	free( path_ );
+	free( buf );
+	free( next.buf );
+	free( ring );
 }
 
-gme_err_t Music_Player::load_file( const char* path )
+static void load_m3u( Music_Emu* emu, const char* path )
 {
-	stop();
-	
-	RETURN_ERR( gme_open_file( path, &emu_, sample_rate ) );
-	
 	char m3u_path [256 + 5];
 	strncpy( m3u_path, path, 256 );
 	m3u_path [256] = 0;
@@ -84,36 +171,118 @@ gme_err_t Music_Player::load_file( const char* path )
 	if ( !p )
 		p = m3u_path + strlen( m3u_path );
 	strcpy( p, ".m3u" );
-	if ( gme_load_m3u( emu_, m3u_path ) ) { } // ignore error
+	if ( gme_load_m3u( emu, m3u_path ) ) { } // ignore error
+}
+
+gme_err_t Music_Player::load_file( const char* path )
+{
+	stop();
 	
-	return 0;
+	free( path_ );
+	path_ = strdup( path );
+	if ( !path_ )
+		return "Out of memory";
+	
+	lock();
+	gme_err_t err = gme_open_file( path, &emu_, sample_rate );
+	if ( !err )
+	{
+		load_m3u( emu_, path );
+		apply_settings( emu_ );
+	}
+	unlock();
+	
+	return err;
+}
+
+void Music_Player::apply_settings( Music_Emu* emu )
+{
+	gme_set_tempo( emu, tempo_ );
+	gme_set_stereo_depth( emu, stereo_depth_ );
+	gme_enable_accuracy( emu, accuracy_ );
+	gme_mute_voices( emu, mute_mask_ );
+	gme_ignore_silence( emu, mute_mask_ != 0 );
+}
+
+// Sets fade from track length and returns number of samples until fade ends
+static long set_fade( Music_Emu* emu, gme_info_t* info, long sample_rate )
+{
+	// Calculate track length
+	if ( info->length <= 0 )
+		info->length = info->intro_length +
+					info->loop_length * 2;
+	
+	if ( info->length <= 0 )
+		info->length = (long) (2.5 * 60 * 1000);
+	gme_set_fade( emu, info->length );
+	
+	long const fade_length = 8000; // gme_set_fade() default
+	long msec = info->length + fade_length;
+	return (msec / 1000 * sample_rate + msec % 1000 * sample_rate / 1000) * 2;
 }
 
 int Music_Player::track_count() const
 {
-	return emu_ ? gme_track_count( emu_ ) : false;
+	lock();
+	int count = emu_ ? gme_track_count( emu_ ) : 0;
+	unlock();
+	return count;
+}
+
+int Music_Player::current_track() const
+{
+	return atomic_get_int( &track_ );
+}
+
+// Render thread changes emu_ and track_info_ when it switches to next track, so
+// they're only read with lock held
+
+gme_info_t const& Music_Player::track_info() const
+{
+	lock();
+	gme_info_t const* info = track_info_;
+	unlock();
+	return *info;
+}
+
+Music_Emu* Music_Player::emu() const
+{
+	lock();
+	Music_Emu* emu = emu_;
+	unlock();
+	return emu;
 }
 
 gme_err_t Music_Player::start_track( int track )
 {
 	if ( emu_ )
 	{
-		gme_free_info( track_info_ );
-		track_info_ = NULL;
-		RETURN_ERR( gme_track_info( emu_, &track_info_, track ) );
-	
-		// Sound must not be running when operating on emulator
+		// Sound must not be running when ring is flushed
 		sound_stop();
-		RETURN_ERR( gme_start_track( emu_, track ) );
-		
-		// Calculate track length
-		if ( track_info_->length <= 0 )
-			track_info_->length = track_info_->intro_length +
-						track_info_->loop_length * 2;
+		cancel_next();
+		free_old();
 		
-		if ( track_info_->length <= 0 )
-			track_info_->length = (long) (2.5 * 60 * 1000);
-		gme_set_fade( emu_, track_info_->length );
+		lock();
+		atomic_set_int( &track_, -1 );
+		flush_ring();
+		gme_free_info( track_info_ );
+		track_info_ = NULL;
+		gme_err_t err = gme_track_info( emu_, &track_info_, track );
+		if ( !err )
+			err = gme_start_track( emu_, track );
+		if ( !err )
+		{
+			track_end = set_fade( emu_, track_info_, sample_rate );
+			atomic_set_int( &track_, track );
+			track_pos = 0;
+			buf_pos   = 0;
+			buf_count = 0;
+			
+			// fill ring so sound doesn't start with an underrun
+			while ( render() ) { }
+		}
+		unlock();
+		RETURN_ERR( err );
 		
 		paused = false;
 		sound_start();
@@ -130,62 +299,335 @@ void Music_Player::pause( int b )
 		sound_start();
 }
 
+// Keeps render thread from using emulator. Samples already in ring still play,
+// so changes are heard after the lookahead.
 void Music_Player::suspend()
 {
-	if ( !paused )
-		sound_stop();
+	lock();
 }
 
 void Music_Player::resume()
 {
-	if ( !paused )
-		sound_start();
+	unlock();
+}
+
+void Music_Player::lock() const
+{
+	if ( render_mutex )
+		mutex_lock( render_mutex );
+}
+
+void Music_Player::unlock() const
+{
+	if ( render_mutex )
+		mutex_unlock( render_mutex );
 }
 
 bool Music_Player::track_ended() const
 {
-	return emu_ ? gme_track_ended( emu_ ) : false;
+	lock();
+	bool ended = false;
+	
+	// render thread will switch to next track instead
+	if ( emu_ && !atomic_get( (void* volatile*) &next_ready ) )
+		ended = gme_track_ended( emu_ ) != 0;
+	
+	unlock();
+	return ended;
+}
+
+// Gapless playback
+
+gme_err_t Music_Player::prepare_next( int track )
+{
+	cancel_next();
+	free_old();
+	
+	// nothing to continue from if no track has been started
+	if ( !emu_ || !path_ || track < 0 || atomic_get_int( &track_ ) < 0 )
+		return 0;
+	
+	next.track  = track;
+	next.err    = 0;
+	next_thread = thread_start( next_thread_func, "gme next track", this );
+	if ( !next_thread )
+	{
+		next.track = -1;
+		return "Couldn't start thread";
+	}
+	return 0;
+}
+
+int Music_Player::next_thread_func( void* data )
+{
+	Music_Player* self = (Music_Player*) data;
+	self->next.err = self->load_next();
+	return 0;
+}
+
+gme_err_t Music_Player::load_next()
+{
+	// Runs in background thread. Nothing else touches next until it's published
+	// through next_ready, or this thread is waited on.
+	RETURN_ERR( gme_open_file( path_, &next.emu, sample_rate ) );
+	load_m3u( next.emu, path_ );
+	RETURN_ERR( gme_track_info( next.emu, &next.info, next.track ) );
+	apply_settings( next.emu );
+	
+	// start_track() can emulate several seconds when skipping initial silence,
+	// which is why this is done here rather than when switching
+	RETURN_ERR( gme_start_track( next.emu, next.track ) );
+	next.end = set_fade( next.emu, next.info, sample_rate );
+	
+	next.buf_count = pre_size;
+	RETURN_ERR( gme_play( next.emu, pre_size, next.buf ) );
+	
+	atomic_set( (void* volatile*) &next_ready, &next );
+	return 0;
+}
+
+void Music_Player::cancel_next()
+{
+	if ( next_thread )
+	{
+		thread_wait( next_thread );
+		next_thread = NULL;
+	}
+	
+	// keep render thread from switching to it meanwhile
+	lock();
+	atomic_set( (void* volatile*) &next_ready, NULL );
+	Music_Emu* emu  = next.emu;
+	gme_info_t* info = next.info;
+	next.emu   = NULL;
+	next.info  = NULL;
+	next.track = -1;
+	unlock();
+	
+	gme_delete( emu );
+	gme_free_info( info );
 }
 
-void Music_Player::set_stereo_depth( double tempo )
+void Music_Player::switch_to_next()
+{
+	// Called from render thread, so previous track is left for free_old()
+	old_emu  = emu_;
+	old_info = track_info_;
+	
+	emu_        = next.emu;
+	track_info_ = next.info;
+	track_end   = next.end;
+	track_pos   = 0;
+	
+	sample_t* b = buf;
+	buf       = next.buf;
+	next.buf  = b;
+	buf_pos   = 0;
+	buf_count = next.buf_count;
+	
+	next.emu   = NULL;
+	next.info  = NULL;
+	atomic_set_int( &track_, next.track );
+	next.track = -1; // so settings changes don't prepare this track again
+	atomic_set( (void* volatile*) &next_ready, NULL );
+}
+
+void Music_Player::free_old()
+{
+	lock();
+	Music_Emu* emu   = old_emu;
+	gme_info_t* info = old_info;
+	old_emu  = NULL;
+	old_info = NULL;
+	unlock();
+	
+	gme_delete( emu );
+	gme_free_info( info );
+}
+
+// Settings changes restart preparation of next track so it uses them too
+
+void Music_Player::settings_changed()
+{
+	// render thread clears next.track when it switches to next track
+	lock();
+	int track = next.track;
+	unlock();
+	
+	if ( track >= 0 )
+		prepare_next( track );
+}
+
+void Music_Player::set_stereo_depth( double depth )
 {
 	suspend();
-	gme_set_stereo_depth( emu_, tempo );
+	stereo_depth_ = depth;
+	if ( emu_ )
+		gme_set_stereo_depth( emu_, depth );
 	resume();
+	settings_changed();
 }
 
 void Music_Player::enable_accuracy( bool b )
 {
 	suspend();
-	gme_enable_accuracy( emu_, b );
+	accuracy_ = b;
+	if ( emu_ )
+		gme_enable_accuracy( emu_, b );
 	resume();
+	settings_changed();
 }
 
 void Music_Player::set_tempo( double tempo )
 {
 	suspend();
-	gme_set_tempo( emu_, tempo );
+	tempo_ = tempo;
+	if ( emu_ )
+		gme_set_tempo( emu_, tempo );
 	resume();
+	settings_changed();
 }
 
 void Music_Player::mute_voices( int mask )
 {
 	suspend();
-	gme_mute_voices( emu_, mask );
-	gme_ignore_silence( emu_, mask != 0 );
+	mute_mask_ = mask;
+	if ( emu_ )
+	{
+		gme_mute_voices( emu_, mask );
+		gme_ignore_silence( emu_, mask != 0 );
+	}
 	resume();
+	settings_changed();
 }
 
-void Music_Player::fill_buffer( void* data, sample_t* out, int count )
+void Music_Player::play( sample_t* out, int count )
+{
+	while ( count > 0 )
+	{
+		int n = count;
+		if ( atomic_get( (void* volatile*) &next_ready ) )
+		{
+			// Switch exactly at end of fade, or as soon as track ends by itself
+			long remain = track_end - track_pos;
+			if ( gme_track_ended( emu_ ) && buf_pos >= buf_count )
+				remain = 0;
+			
+			if ( remain <= 0 && !old_emu )
+			{
+				switch_to_next();
+				continue;
+			}
+			
+			if ( remain > 0 && n > remain )
+				n = remain;
+		}
+		
+		if ( buf_pos < buf_count )
+		{
+			// use samples rendered in background first
+			if ( n > buf_count - buf_pos )
+				n = buf_count - buf_pos;
+			memcpy( out, &buf [buf_pos], n * sizeof *out );
+			buf_pos += n;
+		}
+		else
+		{
+			if ( gme_play( emu_, n, out ) ) { } // ignore error
+		}
+		
+		track_pos += n;
+		out       += n;
+		count     -= n;
+	}
+}
+
+// Render-ahead ring
+
+int Music_Player::underrun_count() const
+{
+	return atomic_get_int( &underruns );
+}
+
+int Music_Player::underrun_samples() const
+{
+	return atomic_get_int( &underrun_samples_ );
+}
+
+// Positions are kept modulo twice the ring size, so a full ring can be told
+// from an empty one
+int Music_Player::ring_fill() const
+{
+	return (atomic_get_int( &write_pos ) - atomic_get_int( &read_pos )) & (ring_size_ * 2 - 1);
+}
+
+void Music_Player::flush_ring()
+{
+	// only valid while sound is stopped and render thread is locked out
+	atomic_set_int( &read_pos, atomic_get_int( &write_pos ) );
+}
+
+// Renders into ring if there's room and a track is playing. Lock must be held.
+bool Music_Player::render()
+{
+	if ( !emu_ || track_ < 0 || ring_size_ - ring_fill() < render_size )
+		return false;
+	
+	int pos = write_pos;
+	play( &ring [pos & (ring_size_ - 1)], render_size );
+	atomic_set_int( &write_pos, (pos + render_size) & (ring_size_ * 2 - 1) );
+	return true;
+}
+
+int Music_Player::render_thread_func( void* data )
 {
 	Music_Player* self = (Music_Player*) data;
-	if ( self->emu_ )
+	while ( !atomic_get_int( &self->render_quit ) )
 	{
-		if ( gme_play( self->emu_, count, out ) ) { } // ignore error
+		self->lock();
+		bool rendered = self->render();
+		self->unlock();
 		
-		if ( self->scope_buf )
-			memcpy( self->scope_buf, out, self->scope_buf_size * sizeof *self->scope_buf );
+		// ring is full or nothing is playing
+		if ( !rendered )
+			thread_sleep( 1 );
 	}
+	return 0;
+}
+
+void Music_Player::fill_buffer( void* data, sample_t* out, int count )
+{
+	// Only copies from ring, so a slow emulator can't hold up sound device
+	Music_Player* self = (Music_Player*) data;
+	int const mask = self->ring_size_ - 1;
+	int pos = atomic_get_int( &self->read_pos );
+	int n = self->ring_fill();
+	if ( n > count )
+		n = count;
+	
+	int first = self->ring_size_ - (pos & mask);
+	if ( first > n )
+		first = n;
+	memcpy( out, &self->ring [pos & mask], first * sizeof *out );
+	memcpy( out + first, self->ring, (n - first) * sizeof *out );
+	atomic_set_int( &self->read_pos, (pos + n) & (self->ring_size_ * 2 - 1) );
+	
+	if ( n < count )
+	{
+		memset( out + n, 0, (count - n) * sizeof *out );
+		if ( atomic_get_int( &self->track_ ) >= 0 )
+		{
+			// only this thread changes them
+			atomic_set_int( &self->underruns, atomic_get_int( &self->underruns ) + 1 );
+			atomic_set_int( &self->underrun_samples_,
+					atomic_get_int( &self->underrun_samples_ ) + count - n );
+		}
+	}
+	
+	// emu_ isn't checked since render thread can change it; out is silent anyway
+	// when nothing is playing
+	if ( self->scope_buf )
+		memcpy( self->scope_buf, out, self->scope_buf_size * sizeof *self->scope_buf );
 }
 
 // Sound output driver using SDL
@@ -243,3 +685,59 @@ static void sound_cleanup()
 	sound_stop();
 	SDL_CloseAudio();
 }
+
+static void* thread_start( thread_func_t func, const char* name, void* data )
+{
+	return SDL_CreateThread( func, name, data );
+}
+
+static void thread_wait( void* thread )
+{
+	SDL_WaitThread( (SDL_Thread*) thread, NULL );
+}
+
+static void thread_sleep( int msec )
+{
+	SDL_Delay( msec );
+}
+
+static void* mutex_new()
+{
+	return SDL_CreateMutex();
+}
+
+static void mutex_delete( void* mutex )
+{
+	if ( mutex )
+		SDL_DestroyMutex( (SDL_mutex*) mutex );
+}
+
+static void mutex_lock( void* mutex )
+{
+	SDL_LockMutex( (SDL_mutex*) mutex );
+}
+
+static void mutex_unlock( void* mutex )
+{
+	SDL_UnlockMutex( (SDL_mutex*) mutex );
+}
+
+static void* atomic_get( void* volatile* p )
+{
+	return SDL_AtomicGetPtr( (void**) p );
+}
+
+static void atomic_set( void* volatile* p, void* value )
+{
+	SDL_AtomicSetPtr( (void**) p, value );
+}
+
+static int atomic_get_int( int const volatile* p )
+{
+	return SDL_AtomicGet( (SDL_atomic_t*) p );
+}
+
+static void atomic_set_int( int volatile* p, int value )
+{
+	SDL_AtomicSet( (SDL_atomic_t*) p, value );
+}
@@ -8,8 +8,9 @@
 
 class Music_Player {
 public:
-	// Initialize player and set sample rate
-	gme_err_t init( long sample_rate = 44100 );
+	// Initialize player and set sample rate. Samples are rendered by a separate
+	// thread up to lookahead_msec ahead of what the sound device is playing.
+	gme_err_t init( long sample_rate = 44100, int lookahead_msec = 100 );
 	
 	// Load game music file. NULL on success, otherwise error string.
 	gme_err_t load_file( const char* path );
@@ -25,8 +26,9 @@ public:
 	// Number of tracks in current file, or 0 if no file loaded.
 	int track_count() const;
 	
-	// Info for current track
-	gme_info_t const& track_info() const { return *track_info_; }
+	// Info for current track. Stays valid until track is started, next track is
+	// prepared, or file is loaded or stopped.
+	gme_info_t const& track_info() const;
 	
 	// Pause/resume playing current track.
 	void pause( int );
@@ -34,8 +36,18 @@ public:
 	// True if track ended
 	bool track_ended() const;
 	
-	// Pointer to emulator
-	Music_Emu* emu() const { return emu_; }
+	// Load and start track of current file in the background, so that playback
+	// continues into it without a gap once current track ends. Passing -1 cancels.
+	// Does nothing if no track is playing.
+	gme_err_t prepare_next( int track );
+	
+	// Track currently playing. Changes on its own when playback moves into the
+	// track given to prepare_next().
+	int current_track() const;
+	
+	// Pointer to emulator. Changes when playback moves into next track, and render
+	// thread plays it meanwhile.
+	Music_Emu* emu() const;
 	
 	// Set stereo depth, where 0.0 = none and 1.0 = maximum
 	void set_stereo_depth( double );
@@ -53,6 +65,15 @@ public:
 	typedef short sample_t;
 	void set_scope_buffer( sample_t* buf, int size ) { scope_buf = buf; scope_buf_size = size; }
 	
+	// Number of times sound device needed samples before they were rendered,
+	// and total number of silent samples it played as a result
+	int underrun_count() const;
+	int underrun_samples() const;
+	
+	// Number of samples currently rendered ahead, out of ring_size()
+	int ring_fill() const;
+	int ring_size() const { return ring_size_; }
+	
 public:
 	Music_Player();
 	~Music_Player();
@@ -63,9 +84,68 @@ private:
 	int scope_buf_size;
 	bool paused;
 	gme_info_t* track_info_;
+	char* path_;
+	
+	// settings, also applied to next track
+	double tempo_;
+	double stereo_depth_;
+	bool accuracy_;
+	int mute_mask_;
+	
+	// current track
+	int volatile track_;
+	long track_pos;         // samples played
+	long track_end;         // samples until end of fade
+	sample_t* buf;          // samples rendered before track started playing
+	int buf_pos;
+	int buf_count;
+	
+	// next track, prepared by background thread
+	struct next_t {
+		Music_Emu* emu;
+		gme_info_t* info;
+		sample_t* buf;
+		int buf_count;
+		long end;
+		int track;
+		gme_err_t err;
+	};
+	next_t next;
+	void* next_thread;
+	next_t* volatile next_ready; // set by background thread once next is complete
+	int pre_size;
+	Music_Emu* old_emu;         // left by render thread after switching to next
+	gme_info_t* old_info;
+	
+	// render-ahead ring, written only by render thread and read only by
+	// audio callback
+	sample_t* ring;
+	int ring_size_;             // power of 2
+	int render_size;            // samples rendered at once
+	int volatile write_pos;     // positions wrap; only low bits index ring
+	int volatile read_pos;
+	int volatile underruns;
+	int volatile underrun_samples_;
+	void* render_thread;
+	void* render_mutex;         // held while render thread uses emulator
+	int volatile render_quit;
+	static int render_thread_func( void* );
+	bool render();
+	void flush_ring();
+	
+	gme_err_t load_next();
+	void cancel_next();
+	void switch_to_next();
+	void free_old();
+	void settings_changed();
+	void apply_settings( Music_Emu* );
+	void play( sample_t* out, int count );
+	static int next_thread_func( void* );
 	
 	void suspend();
 	void resume();
+	void lock() const;
+	void unlock() const;
 	static void fill_buffer( void*, sample_t*, int );
 };
 
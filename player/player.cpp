@@ -75,10 +75,11 @@ static void init()
 	player->set_scope_buffer( scope_buf, scopeWidth * 2 );
 }
 
-static void start_track( int track, const char* path )
+static void show_track( int track, const char* path )
 {
-	paused = false;
-	handle_error( player->start_track( track - 1 ) );
+	// have following track ready so playback continues into it without a gap
+	if ( track < player->track_count() )
+		handle_error( player->prepare_next( track ) );
 	
 	// update window title with track info
 	
@@ -104,6 +105,13 @@ static void start_track( int track, const char* path )
 	SDL_FillRect(gScreenSurface, NULL, 0x000000);
 }
 
+static void start_track( int track, const char* path )
+{
+	paused = false;
+	handle_error( player->start_track( track - 1 ) );
+	show_track( track, path );
+}
+
 int main( int argc, char** argv )
 {
 	init();
@@ -131,6 +139,11 @@ int main( int argc, char** argv )
 		//Update the surface
 		SDL_UpdateWindowSurface( gWindow );
 		
+		// Player moved into prepared track on its own
+		int current = player->current_track();
+		if ( current >= 0 && current + 1 != track )
+			show_track( track = current + 1, path );
+		
 		// Automatically go to next track when current one ends
 		if ( player->track_ended() )
 		{
@@ -233,6 +246,9 @@ int main( int argc, char** argv )
 	}
 	
 	// Cleanup
+	if ( player->underrun_count() )
+		fprintf( stderr, "%d sound underruns (%d samples)\n",
+				player->underrun_count(), player->underrun_samples() );
 	delete player;
 	delete scope;
 	free(path);